@@ -20,6 +20,7 @@
 #include "FIFO.h"
 
 #include <string.h>
+#include <algorithm>
 
 #include "armcpu.h"
 #include "debug.h"
@@ -227,24 +228,8 @@ static bool IsMatrixStackCommand(u8 cmd)
 	return cmd == 0x11 || cmd == 0x12;
 }
 
-void GFX_FIFOsend(u8 cmd, u32 param)
+static FORCEINLINE void GFX_FIFOpush(u8 cmd, u32 param)
 {
-	//INFO("gxFIFO: send 0x%02X = 0x%08X (size %03i/0x%02X) gxstat 0x%08X\n", cmd, param, gxFIFO.size, gxFIFO.size, gxstat);
-	//printf("fifo recv: %02X: %08X upto:%d\n",cmd,param,gxFIFO.size+1);
-
-	//TODO - WOAH ! NOT HANDLING A TOO-BIG FIFO RIGHT NOW!
-	//if (gxFIFO.size > 255)
-	//{
-	//	GXF_FIFO_handleEvents();
-	//	//NEED TO HANDLE THIS!!!!!!!!!!!!!!!!!!!!!!!!!!
-
-	//	//gxstat |= 0x08000000;			// busy
-	//	NDS_RescheduleGXFIFO(1);
-	//	//INFO("ERROR: gxFIFO is full (cmd 0x%02X = 0x%08X) (prev cmd 0x%02X = 0x%08X)\n", cmd, param, gxFIFO.cmd[255], gxFIFO.param[255]);
-	//	return;		
-	//}
-
-
 	gxFIFO.cmd[gxFIFO.tail] = cmd;
 	gxFIFO.param[gxFIFO.tail] = param;
 	gxFIFO.tail++;
@@ -271,6 +256,44 @@ void GFX_FIFOsend(u8 cmd, u32 param)
 	if(gxFIFO.size>=HACK_GXIFO_SIZE) {
 		printf("--FIFO FULL-- : %d\n",gxFIFO.size);
 	}
+}
+
+static FORCEINLINE void GFX_FIFOpop(u8 *cmd, u32 *param)
+{
+	*cmd = gxFIFO.cmd[gxFIFO.head];
+	*param = gxFIFO.param[gxFIFO.head];
+
+	//see the associated increment in another function
+	if(IsMatrixStackCommand(*cmd))
+	{
+		gxFIFO.matrix_stack_op_size--;
+		if(gxFIFO.matrix_stack_op_size>0x10000000)
+			printf("bad news disaster in matrix_stack_op_size\n");
+	}
+
+	gxFIFO.head++;
+	gxFIFO.size--;
+	if (gxFIFO.head > HACK_GXIFO_SIZE-1) gxFIFO.head = 0;
+}
+
+void GFX_FIFOsend(u8 cmd, u32 param)
+{
+	//INFO("gxFIFO: send 0x%02X = 0x%08X (size %03i/0x%02X) gxstat 0x%08X\n", cmd, param, gxFIFO.size, gxFIFO.size, gxstat);
+	//printf("fifo recv: %02X: %08X upto:%d\n",cmd,param,gxFIFO.size+1);
+
+	//TODO - WOAH ! NOT HANDLING A TOO-BIG FIFO RIGHT NOW!
+	//if (gxFIFO.size > 255)
+	//{
+	//	GXF_FIFO_handleEvents();
+	//	//NEED TO HANDLE THIS!!!!!!!!!!!!!!!!!!!!!!!!!!
+
+	//	//gxstat |= 0x08000000;			// busy
+	//	NDS_RescheduleGXFIFO(1);
+	//	//INFO("ERROR: gxFIFO is full (cmd 0x%02X = 0x%08X) (prev cmd 0x%02X = 0x%08X)\n", cmd, param, gxFIFO.cmd[255], gxFIFO.param[255]);
+	//	return;		
+	//}
+
+	GFX_FIFOpush(cmd, param);
 	
 	//gxstat |= 0x08000000;		// set busy flag
 
@@ -279,6 +302,25 @@ void GFX_FIFOsend(u8 cmd, u32 param)
 	NDS_RescheduleGXFIFO(1);
 }
 
+void GFX_FIFOsendBatch(const u8 *cmd, const u32 *param, const size_t count)
+{
+	if (count == 0) return;
+
+	//the fifo only grows while a batch is being sent, so the "less than half full" state can only
+	//have been passed through right after the first command went in. in that case, give the gxfifo dmas
+	//the same trigger they would have gotten if the commands were sent one at a time.
+	GFX_FIFOpush(cmd[0], param[0]);
+	if (gxFIFO.size <= 127)
+		GXF_FIFO_handleEvents();
+
+	for (size_t i = 1; i < count; i++)
+		GFX_FIFOpush(cmd[i], param[i]);
+
+	GXF_FIFO_handleEvents();
+
+	NDS_RescheduleGXFIFO(count);
+}
+
 // this function used ONLY in gxFIFO
 BOOL GFX_PIPErecv(u8 *cmd, u32 *param)
 {
@@ -290,24 +332,25 @@ BOOL GFX_PIPErecv(u8 *cmd, u32 *param)
 		return FALSE;
 	}
 
-	*cmd = gxFIFO.cmd[gxFIFO.head];
-	*param = gxFIFO.param[gxFIFO.head];
+	GFX_FIFOpop(cmd, param);
 
-	//see the associated increment in another function
-	if(IsMatrixStackCommand(*cmd))
-	{
-		gxFIFO.matrix_stack_op_size--;
-		if(gxFIFO.matrix_stack_op_size>0x10000000)
-			printf("bad news disaster in matrix_stack_op_size\n");
-	}
+	GXF_FIFO_handleEvents();
 
-	gxFIFO.head++;
-	gxFIFO.size--;
-	if (gxFIFO.head > HACK_GXIFO_SIZE-1) gxFIFO.head = 0;
+	return (TRUE);
+}
+
+size_t GFX_PIPErecvBatch(u8 *cmd, u32 *param, const size_t maxCount)
+{
+	//the fifo only shrinks while a batch is being received, and nothing can observe the
+	//intermediate states, so the fifo events only need to be handled for the final state.
+	const size_t count = std::min<size_t>(gxFIFO.size, maxCount);
+
+	for (size_t i = 0; i < count; i++)
+		GFX_FIFOpop(&cmd[i], &param[i]);
 
 	GXF_FIFO_handleEvents();
 
-	return (TRUE);
+	return count;
 }
 
 void GFX_FIFOcnt(u32 val)
@@ -73,7 +73,9 @@ extern GFX_FIFO gxFIFO;
 void GFX_PIPEclear();
 void GFX_FIFOclear();
 void GFX_FIFOsend(u8 cmd, u32 param);
+void GFX_FIFOsendBatch(const u8 *cmd, const u32 *param, const size_t count);
 BOOL GFX_PIPErecv(u8 *cmd, u32 *param);
+size_t GFX_PIPErecvBatch(u8 *cmd, u32 *param, const size_t maxCount);
 void GFX_FIFOcnt(u32 val);
 
 //=================================================== Display memory FIFO
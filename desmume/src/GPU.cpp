@@ -3525,6 +3525,7 @@ bool GPUEngineA::VerifyVRAMLineDidChange(const size_t blockID, const size_t l)
 template <NDSColorFormat OUTPUTFORMAT>
 void GPUEngineA::RenderLine(const size_t l)
 {
+	NDSPerfTimer perfTimer(NDS_PERF_GPU_MAIN_NS);
 	const IOREG_DISPCAPCNT &DISPCAPCNT = this->_IORegisterMap->DISPCAPCNT;
 	const bool isDisplayCaptureNeeded = this->WillDisplayCapture(l);
 	GPUEngineCompositorInfo &compInfo = this->_currentCompositorInfo[l];
@@ -4550,6 +4551,7 @@ void GPUEngineB::Reset()
 template <NDSColorFormat OUTPUTFORMAT>
 void GPUEngineB::RenderLine(const size_t l)
 {
+	NDSPerfTimer perfTimer(NDS_PERF_GPU_SUB_NS);
 	GPUEngineCompositorInfo &compInfo = this->_currentCompositorInfo[l];
 	
 	if ( this->IsForceBlankSet() )
@@ -947,6 +947,9 @@ void MMU_DeInit(void) {
 
 void MMU_Reset()
 {
+	//the threaded SPU may still be reading sample data from the memory that's about to be cleared
+	SPU_SyncCore();
+
 	memset(MMU.ARM9_DTCM, 0, sizeof(MMU.ARM9_DTCM));
 	memset(MMU.ARM9_ITCM, 0, sizeof(MMU.ARM9_ITCM));
 	memset(MMU.ARM9_LCD,  0, sizeof(MMU.ARM9_LCD));
@@ -1064,7 +1067,6 @@ static void execsqrt() {
 	MMU.sqrtCycles = nds_timer + 26;
 	MMU.sqrtResult = ret;
 	MMU.sqrtRunning = TRUE;
-	NDS_Reschedule();
 }
 
 static void execdiv() {
@@ -1136,7 +1138,33 @@ static void execdiv() {
 	MMU.divResult = res;
 	MMU.divMod = mod;
 	MMU.divRunning = TRUE;
-	NDS_Reschedule();
+}
+
+//the divider and sqrt unit aren't run by the sequencer. their results are computed when they start,
+//and they're made visible here once enough time has passed, whenever one of their registers is read
+static void update_math()
+{
+	if(MMU.divRunning && nds_timer >= MMU.divCycles)
+	{
+		MMU_new.div.busy = 0;
+#ifdef HOST_64 
+		T1WriteQuad(MMU.ARM9_REG, 0x2A0, MMU.divResult);
+		T1WriteQuad(MMU.ARM9_REG, 0x2A8, MMU.divMod);
+#else
+		T1WriteLong(MMU.ARM9_REG, 0x2A0, (u32)MMU.divResult);
+		T1WriteLong(MMU.ARM9_REG, 0x2A4, (u32)(MMU.divResult >> 32));
+		T1WriteLong(MMU.ARM9_REG, 0x2A8, (u32)MMU.divMod);
+		T1WriteLong(MMU.ARM9_REG, 0x2AC, (u32)(MMU.divMod >> 32));
+#endif
+		MMU.divRunning = FALSE;
+	}
+
+	if(MMU.sqrtRunning && nds_timer >= MMU.sqrtCycles)
+	{
+		MMU_new.sqrt.busy = 0;
+		T1WriteLong(MMU.ARM9_REG, 0x2B4, MMU.sqrtResult);
+		MMU.sqrtRunning = FALSE;
+	}
 }
 
 DSI_TSC::DSI_TSC()
@@ -1869,6 +1897,42 @@ static INLINE void MMU_IPCSync(u8 proc, u32 val)
 	NDS_Reschedule();
 }
 
+bool MMU_TimerNeedsEvent(int proc, int timerIndex)
+{
+	if(!MMU.timerON[proc][timerIndex] || MMU.timerMODE[proc][timerIndex] == 0xFFFF)
+		return false;
+
+	//the overflow irq
+	if(T1ReadWord(MMU.MMU_MEM[proc][0x40], 0x102+timerIndex*4) & 0x40)
+		return true;
+
+	//a count-up timer chained after this one
+	return timerIndex < 3 && MMU.timerON[proc][timerIndex+1] && MMU.timerMODE[proc][timerIndex+1] == 0xFFFF;
+}
+
+void MMU_SyncTimer(int proc, int timerIndex)
+{
+	if(!MMU.timerON[proc][timerIndex] || MMU.timerMODE[proc][timerIndex] == 0xFFFF)
+		return;
+
+	u64 &timerCycle = nds.timerCycle[proc][timerIndex];
+	if(timerCycle > nds_timer)
+		return;
+
+	//skip all the overflows that weren't run, keeping the timer in phase with them
+	const u64 period = (u64)(65536 - MMU.timerReload[proc][timerIndex]) << MMU.timerMODE[proc][timerIndex];
+	timerCycle += ((nds_timer - timerCycle) / period + 1) * period;
+}
+
+static INLINE void reload_timer(int proc, int timerIndex, u16 val)
+{
+	//the overflows that were skipped happened with the old reload value
+	if(!MMU_TimerNeedsEvent(proc,timerIndex))
+		MMU_SyncTimer(proc,timerIndex);
+
+	MMU.timerReload[proc][timerIndex] = val;
+}
+
 static INLINE u16 read_timer(int proc, int timerIndex)
 {
 	//chained timers are always up to date
@@ -1880,7 +1944,11 @@ static INLINE u16 read_timer(int proc, int timerIndex)
 	if(!MMU.timerON[proc][timerIndex])
 		return MMU.timer[proc][timerIndex];
 
-	//for unchained timers, we do not keep the timer up to date. its value will need to be calculated here
+	//for unchained timers, we do not keep the timer up to date. its value will need to be calculated here.
+	//when nothing happens at its overflows, it isn't even scheduled, so its next overflow time may need to catch up first
+	if(!MMU_TimerNeedsEvent(proc,timerIndex))
+		MMU_SyncTimer(proc,timerIndex);
+
 	s32 diff = (s32)(nds.timerCycle[proc][timerIndex] - nds_timer);
 	assert(diff>=0);
 	if(diff<0) 
@@ -1942,7 +2010,7 @@ static INLINE void write_timer(int proc, int timerIndex, u16 val)
 	nds.timerCycle[proc][timerIndex] = nds_timer + (remain<<MMU.timerMODE[proc][timerIndex]);
 
 	T1WriteWord(MMU.MMU_MEM[proc][0x40], 0x102+timerIndex*4, val);
-	NDS_RescheduleTimers();
+	NDS_RescheduleTimer(proc, timerIndex);
 }
 
 u32 TGXSTAT::read32()
@@ -2323,7 +2391,27 @@ void DmaController::doCopy()
 	//we might make another function to do just the raw copy op which can use them with checks
 	//outside the loop
 	int time_elapsed = 0;
-	if(sz==4) {
+	if(PROCNUM==ARMCPU_ARM9 && startmode==EDMAMode_GXFifo && sz==4 && dstinc==0 && dst>=0x04000400 && dst<0x04000440)
+	{
+		//gxfifo dmas are the main source of geometry commands, so rather than pushing them through the
+		//io port one word at a time, gather the whole block up and hand it to the geometry engine in one go.
+		u32 cmdBlock[112];
+		for(u32 i=0; i<todo; i++)
+		{
+			time_elapsed += _MMU_accesstime<PROCNUM,MMU_AT_DMA,32,MMU_AD_READ,TRUE>(src,true);
+			time_elapsed += _MMU_accesstime<PROCNUM,MMU_AT_DMA,32,MMU_AD_WRITE,TRUE>(dst,true);
+			cmdBlock[i] = _MMU_read32(procnum,MMU_AT_DMA,src);
+			src += srcinc;
+		}
+
+		//writes to the geometry engine are dropped while it's powered down
+		if(todo > 0 && nds.power1.gfx3d_geometry)
+		{
+			((u32 *)(MMU.ARM9_REG))[(dst & 0xFFF) >> 2] = cmdBlock[todo-1];
+			gfx3d_sendCommandToFIFOBatch(cmdBlock, todo);
+		}
+	}
+	else if(sz==4) {
 		for(s32 i=(s32)todo; i>0; i--)
 		{
 			time_elapsed += _MMU_accesstime<PROCNUM,MMU_AT_DMA,32,MMU_AD_READ,TRUE>(src,true);
@@ -2346,6 +2434,7 @@ void DmaController::doCopy()
 	}
 
 	//printf("ARM%c dma of size %d from 0x%08X to 0x%08X took %d cycles\n",PROCNUM==0?'9':'7',todo*sz,saddr,daddr,time_elapsed);
+	NDS_PERF_ADD(NDS_PERF_DMA_BYTES, todo*sz);
 
 	//reschedule an event for the end of this dma, and figure out how much it cost us
 	doSchedule();
@@ -2399,7 +2488,7 @@ void DmaController::doSchedule()
 {
 	dmaCheck = TRUE;
 	nextEvent = nds_timer;
-	NDS_RescheduleDMA();
+	NDS_RescheduleDMA(procnum, chan);
 }
 
 
@@ -3258,7 +3347,7 @@ bool MMU_WriteFromExternal(const int targetProc, const u32 targetAddress, T newV
 			break;
 	}
 	
-	bool needsJitReset = ( (targetAddress >= 0x02000000) && (targetAddress < 0x02400000) );
+	bool needsJitReset = ( (targetAddress >= 0x02000000) && (targetAddress < (0x02000000 + _MMU_MAIN_MEM_MASK + 1)) );
 	if (needsJitReset)
 	{
 		bool willValueChange = false;
@@ -3328,6 +3417,7 @@ void FASTCALL _MMU_ARM9_write08(u32 adr, u8 val)
 	const u32 adrBank = (adr >> 24);
 
 	mmu_log_debug_ARM9(adr, "(write08) 0x%02X", val);
+	MMU_GuardSPUCoreWrite(adr, 1);
 
 	if (adrBank < 0x02)
 	{
@@ -3865,6 +3955,7 @@ void FASTCALL _MMU_ARM9_write16(u32 adr, u16 val)
 	const u32 adrBank = (adr >> 24);
 
 	mmu_log_debug_ARM9(adr, "(write16) 0x%04X", val);
+	MMU_GuardSPUCoreWrite(adr, 2);
 	
 	if (adrBank < 0x02)
 	{
@@ -4532,7 +4623,7 @@ void FASTCALL _MMU_ARM9_write16(u32 adr, u16 val)
 				case REG_TM1CNTL :
 				case REG_TM2CNTL :
 				case REG_TM3CNTL :
-					MMU.timerReload[ARMCPU_ARM9][(adr>>2)&3] = val;
+					reload_timer(ARMCPU_ARM9, (adr>>2)&3, val);
 					return;
 				case REG_TM0CNTH :
 				case REG_TM1CNTH :
@@ -4581,6 +4672,7 @@ void FASTCALL _MMU_ARM9_write32(u32 adr, u32 val)
 	const u32 adrBank = (adr >> 24);
 	
 	mmu_log_debug_ARM9(adr, "(write32) 0x%08X", val);
+	MMU_GuardSPUCoreWrite(adr, 4);
 
 	if (adrBank < 0x02)
 	{
@@ -5034,7 +5126,7 @@ void FASTCALL _MMU_ARM9_write32(u32 adr, u32 val)
 				case REG_TM3CNTL:
 				{
 					int timerIndex = (adr>>2)&0x3;
-					MMU.timerReload[ARMCPU_ARM9][timerIndex] = (u16)val;
+					reload_timer(ARMCPU_ARM9, timerIndex, (u16)val);
 					T1WriteWord(MMU.ARM9_REG, adr & 0xFFF, val);
 					write_timer(ARMCPU_ARM9, timerIndex, val>>16);
 					return;
@@ -5135,6 +5227,9 @@ u8 FASTCALL _MMU_ARM9_read08(u32 adr)
 	if ((adr >> 24) == 4)
 	{
 		VALIDATE_IO_REGS_READ(ARMCPU_ARM9, 8);
+
+		//DIVCNT..SQRT_PARAM
+		if((adr & 0x0FFFFFC0) == REG_DIVCNT) update_math();
 		
 		if(MMU_new.is_dma(adr)) return MMU_new.read_dma(ARMCPU_ARM9,8,adr);
 
@@ -5259,6 +5354,9 @@ u16 FASTCALL _MMU_ARM9_read16(u32 adr)
 	{
 		VALIDATE_IO_REGS_READ(ARMCPU_ARM9, 16);
 
+		//DIVCNT..SQRT_PARAM
+		if((adr & 0x0FFFFFC0) == REG_DIVCNT) update_math();
+
 		if(MMU_new.is_dma(adr)) return MMU_new.read_dma(ARMCPU_ARM9,16,adr); 
 
 		switch(adr)
@@ -5368,6 +5466,9 @@ u32 FASTCALL _MMU_ARM9_read32(u32 adr)
 	if ((adr >> 24) == 4)
 	{
 		VALIDATE_IO_REGS_READ(ARMCPU_ARM9, 32);
+
+		//DIVCNT..SQRT_PARAM
+		if((adr & 0x0FFFFFC0) == REG_DIVCNT) update_math();
 		
 		if(MMU_new.is_dma(adr)) return MMU_new.read_dma(ARMCPU_ARM9,32,adr); 
 
@@ -5502,6 +5603,7 @@ void FASTCALL _MMU_ARM7_write08(u32 adr, u8 val)
 	adr &= 0x0FFFFFFF;
 
 	mmu_log_debug_ARM7(adr, "(write08) 0x%02X", val);
+	MMU_GuardSPUCoreWrite(adr, 1);
 
 	if (adr < 0x02000000) return; //can't write to bios or entire area below main memory
 
@@ -5615,6 +5717,7 @@ void FASTCALL _MMU_ARM7_write16(u32 adr, u16 val)
 	adr &= 0x0FFFFFFE;
 
 	mmu_log_debug_ARM7(adr, "(write16) 0x%04X", val);
+	MMU_GuardSPUCoreWrite(adr, 2);
 
 	if (adr < 0x02000000) return; //can't write to bios or entire area below main memory
 
@@ -5758,7 +5861,7 @@ void FASTCALL _MMU_ARM7_write16(u32 adr, u16 val)
 			case REG_TM1CNTL :
 			case REG_TM2CNTL :
 			case REG_TM3CNTL :
-				MMU.timerReload[ARMCPU_ARM7][(adr>>2)&3] = val;
+				reload_timer(ARMCPU_ARM7, (adr>>2)&3, val);
 				return;
 			case REG_TM0CNTH :
 			case REG_TM1CNTH :
@@ -5800,6 +5903,7 @@ void FASTCALL _MMU_ARM7_write32(u32 adr, u32 val)
 	adr &= 0x0FFFFFFC;
 
 	mmu_log_debug_ARM7(adr, "(write32) 0x%08X", val);
+	MMU_GuardSPUCoreWrite(adr, 4);
 
 	if (adr < 0x02000000) return; //can't write to bios or entire area below main memory
 
@@ -5852,7 +5956,7 @@ void FASTCALL _MMU_ARM7_write32(u32 adr, u32 val)
 			case REG_TM3CNTL:
 				{
 					int timerIndex = (adr>>2)&0x3;
-					MMU.timerReload[ARMCPU_ARM7][timerIndex] = (u16)val;
+					reload_timer(ARMCPU_ARM7, timerIndex, (u16)val);
 					T1WriteWord(MMU.MMU_MEM[ARMCPU_ARM7][0x40], adr & 0xFFF, val);
 					write_timer(ARMCPU_ARM7, timerIndex, val>>16);
 					return;
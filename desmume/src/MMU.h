@@ -25,6 +25,7 @@
 #include "mc.h"
 #include "mem.h"
 #include "NDSSystem.h"
+#include "SPU.h"
 
 #ifdef HAVE_LUA
 #include "lua-engine.h"
@@ -542,6 +543,11 @@ void MMU_DeInit(void);
 
 void MMU_Reset( void);
 
+//timers only get sequencer events when something happens at their overflows;
+//the others are brought up to date with MMU_SyncTimer() when they're needed
+bool MMU_TimerNeedsEvent(int proc, int timerIndex);
+void MMU_SyncTimer(int proc, int timerIndex);
+
 void print_memory_profiling( void);
 
 // Memory reading/writing (old)
@@ -666,6 +672,22 @@ extern u32 _MMU_MAIN_MEM_MASK16;
 extern u32 _MMU_MAIN_MEM_MASK32;
 void SetupMMU(bool debugConsole, bool dsi);
 
+//the threaded SPU may still have to read sample data from memory that's about to be written,
+//in which case it has to catch up first. see CommonSettings.spu_threaded.
+FORCEINLINE void MMU_GuardSPUCoreWrite(const u32 addr, const u32 size)
+{
+	if ((addr & 0x0F000000) == 0x02000000)
+	{
+		const u32 offset = addr & _MMU_MAIN_MEM_MASK;
+		if ((offset < SPU_coreGuardEnd) && ((offset + size) > SPU_coreGuardStart))
+			SPU_GuardCoreWrite(offset, size);
+	}
+	else if (SPU_coreGuardOther)
+	{
+		SPU_SyncCore();
+	}
+}
+
 FORCEINLINE void CheckMemoryDebugEvent(EDEBUG_EVENT event, const MMU_ACCESS_TYPE type, const u32 procnum, const u32 addr, const u32 size, const u32 val)
 {
 	//TODO - ugh work out a better prefetch event system
@@ -908,6 +930,7 @@ FORCEINLINE void _MMU_write08(const int PROCNUM, const MMU_ACCESS_TYPE AT, const
 		}
 
 	if ( (addr & 0x0F000000) == 0x02000000) {
+		MMU_GuardSPUCoreWrite(addr, 1);
 #ifdef HAVE_JIT
 		JIT_COMPILED_FUNC_KNOWNBANK(addr, MAIN_MEM, _MMU_MAIN_MEM_MASK, 0) = 0;
 #endif
@@ -966,6 +989,7 @@ FORCEINLINE void _MMU_write16(const int PROCNUM, const MMU_ACCESS_TYPE AT, const
 		}
 
 	if ( (addr & 0x0F000000) == 0x02000000) {
+		MMU_GuardSPUCoreWrite(addr, 2);
 #ifdef HAVE_JIT
 		JIT_COMPILED_FUNC_KNOWNBANK(addr, MAIN_MEM, _MMU_MAIN_MEM_MASK16, 0) = 0;
 #endif
@@ -1021,6 +1045,7 @@ FORCEINLINE void _MMU_write32(const int PROCNUM, const MMU_ACCESS_TYPE AT, const
 		}
 
 	if ( (addr & 0x0F000000) == 0x02000000) {
+		MMU_GuardSPUCoreWrite(addr, 4);
 #ifdef HAVE_JIT
 		JIT_COMPILED_FUNC_KNOWNBANK(addr, MAIN_MEM, _MMU_MAIN_MEM_MASK32, 0) = 0;
 		JIT_COMPILED_FUNC_KNOWNBANK(addr, MAIN_MEM, _MMU_MAIN_MEM_MASK32, 1) = 0;
@@ -20,10 +20,12 @@
 #include <string.h>
 #include <stdlib.h>
 #include <algorithm>
+#include <chrono>
 #include <math.h>
 #include <zlib.h>
 
 #include <features/features_cpu.h>
+#include <compat/intrinsics.h>
 
 #include "utils/decrypt/decrypt.h"
 #include "utils/decrypt/crc.h"
@@ -55,6 +57,7 @@
 #include "slot1.h"
 #include "slot2.h"
 #include "emufile.h"
+#include "saves.h"
 #include "SPU.h"
 #include "wifi.h"
 #include "Database.h"
@@ -207,6 +210,7 @@ int NDS_Init()
 
 void NDS_DeInit(void)
 {
+	savestate_flush();
 	gameInfo.closeROM();
 	SPU_DeInit();
 	
@@ -530,6 +534,17 @@ bool GameInfo::loadROM(std::string fname, u32 type)
 		if(isHomebrew())
 			loadToMemory = true;
 
+#ifdef HAVE_LIBZ
+		//compressed ROMs are always decompressed into memory, but on a background thread, so that
+		//emulation can start before all of it is ready. reads only wait for the part they need.
+		if ( !isHomebrew() && ((reader->id == ROMREADER_GZIP) || (reader->id == ROMREADER_ZIP)) )
+		{
+			reader = InflateROMReaderRead_TrueInit(reader, fROM);
+			fROM = reader->Init(NULL);
+			loadToMemory = false;
+		}
+#endif
+
 		//convert to an in-memory reader around a pre-read buffer if that's what's requested
 		if (loadToMemory)
 		{
@@ -550,6 +565,12 @@ bool GameInfo::loadROM(std::string fname, u32 type)
 			fROM = reader->Init(NULL);
 		}
 
+		if (reader->Data != NULL)
+		{
+			romdataView = reader->Data(fROM);
+			romdataViewSize = reader->Size(fROM);
+		}
+
 		if(hasRomBanner())
 		{
 			reader->Seek(fROM, header.IconOff, SEEK_SET);
@@ -604,7 +625,24 @@ void GameInfo::closeROM()
 	fROM = NULL;
 	reader = NULL;
 	romdataForReader = NULL;
+	romdataView = NULL;
+	romdataViewSize = 0;
 	romsize = 0;
+	crcPending = false;
+}
+
+u32 GameInfo::getCRC()
+{
+#ifdef HAVE_LIBZ
+	//the background decompression computes the CRC as it goes, so this waits for it to finish
+	if (crcPending)
+	{
+		crc = InflateROMReaderWaitForCRC();
+		crcPending = false;
+	}
+#endif
+
+	return crc;
 }
 
 u32 GameInfo::readROM(u32 pos)
@@ -612,6 +650,14 @@ u32 GameInfo::readROM(u32 pos)
 	u32 num;
 	u32 data;
 
+	//when the whole ROM is in memory, read it from there without going through the reader
+	if ( (romdataView != NULL) && (pos < romdataViewSize) && ((romdataViewSize - pos) >= 4) )
+	{
+		//pos needn't be aligned
+		memcpy(&data, romdataView + pos, sizeof(data));
+		return LE_TO_LOCAL_32(data);
+	}
+
 	//reader must try to be efficient and not do unneeded seeks
 	reader->Seek(fROM, pos, SEEK_SET);
 	num = reader->Read(fROM, &data, 4);
@@ -628,6 +674,30 @@ u32 GameInfo::readROM(u32 pos)
 	return (LE_TO_LOCAL_32(data) & ~pad) | pad;
 }
 
+//reads a run of ROM bytes at once, such as a whole card block, padding with 0xFF past the end like readROM()
+void GameInfo::readROMBlock(u32 pos, u8 *buffer, u32 size)
+{
+	u32 num = 0;
+
+	if (romdataView != NULL)
+	{
+		if (pos < romdataViewSize)
+		{
+			num = std::min<u32>(size, romdataViewSize - pos);
+			memcpy(buffer, romdataView + pos, num);
+		}
+	}
+	else
+	{
+		reader->Seek(fROM, pos, SEEK_SET);
+		const int read = reader->Read(fROM, buffer, size);
+		num = (read > 0) ? (u32)read : 0;
+	}
+
+	if (num < size)
+		memset(buffer + num, 0xFF, size - num);
+}
+
 bool GameInfo::isDSiEnhanced()
 {
 	return _isDSiEnhanced;
@@ -678,6 +748,10 @@ static int rom_init_path(const char *filename, const char *physicalName, const c
 	return 1;
 }
 
+//for reporting how long it takes from loading a ROM until its first frame has been emulated
+static std::chrono::steady_clock::time_point _romLoadStartTime;
+static bool _isFirstFramePending = false;
+
 struct LastRom {
 	std::string filename, physicalName, logicalFilename;
 } lastRom;
@@ -694,6 +768,9 @@ int NDS_LoadROM(const char *filename, const char *physicalName, const char *logi
 	if (filename == NULL)
 		return -1;
 
+	_romLoadStartTime = std::chrono::steady_clock::now();
+	_isFirstFramePending = false;
+
 	ret = rom_init_path(filename, physicalName, logicalFilename);
 	if (ret < 1)
 		return ret;
@@ -717,7 +794,14 @@ int NDS_LoadROM(const char *filename, const char *physicalName, const char *logi
 	u8 fROMBuffer[4096];
 	bool first = true;
 	
-	for(;;) {
+	if (gameInfo.reader->id == ROMREADER_INFLATE)
+	{
+		//the ROM is still being decompressed, which computes the crc along the way. see GameInfo::getCRC()
+		if (gameInfo.reader->Read(gameInfo.fROM, fROMBuffer, 512) == 512)
+			gameInfo.crcForCheatsDb = ~crc32(0, fROMBuffer, 512);
+		gameInfo.crcPending = true;
+	}
+	else for(;;) {
 		int read = gameInfo.reader->Read(gameInfo.fROM,fROMBuffer,4096);
 		if(read == 0) break;
 		if(first && read >= 512)
@@ -748,7 +832,10 @@ int NDS_LoadROM(const char *filename, const char *physicalName, const char *logi
 	}
 
 	INFO("\nROM game code: %c%c%c%c\n", gameInfo.header.gameCode[0], gameInfo.header.gameCode[1], gameInfo.header.gameCode[2], gameInfo.header.gameCode[3]);
-	INFO("ROM crc: %08X\n", gameInfo.crc);
+	if (gameInfo.crcPending)
+		INFO("ROM crc: (computed in the background)\n");
+	else
+		INFO("ROM crc: %08X\n", gameInfo.crc);
 	if (!gameInfo.isHomebrew())
 	{
 		INFO("ROM serial: %s\n", gameInfo.ROMserial);
@@ -765,7 +852,8 @@ int NDS_LoadROM(const char *filename, const char *physicalName, const char *logi
 	buf[2] = gameInfo.header.gameCode[2];
 	buf[3] = gameInfo.header.gameCode[3];
 	buf[4] = 0;
-	if (advsc.checkDB(buf, gameInfo.crc))
+	//the database matches on the crc as well as the serial, so this waits for a background decompression to finish
+	if (advsc.checkDB(buf, gameInfo.getCRC()))
 	{
 		u8 sv = advsc.getSaveType();
 		printf("Found in game database by %s:\n", advsc.getIdMethod());
@@ -806,6 +894,7 @@ int NDS_LoadROM(const char *filename, const char *physicalName, const char *logi
 
 	//UnloadMovieEmulationSettings(); called in NDS_Reset()
 	NDS_Reset();
+	_isFirstFramePending = true;
 
 	return ret;
 }
@@ -1002,7 +1091,11 @@ template<int procnum, int num> struct TSequenceItem_Timer : public TSequenceItem
 
 	FORCEINLINE void schedule()
 	{
-		enabled = MMU.timerON[procnum][num] && MMU.timerMODE[procnum][num] != 0xFFFF;
+		//timers whose overflows don't do anything are left to read_timer()
+		const bool wasEnabled = enabled;
+		enabled = MMU_TimerNeedsEvent(procnum, num);
+		if(enabled && !wasEnabled)
+			MMU_SyncTimer(procnum, num);
 	}
 
 	FORCEINLINE u64 next()
@@ -1146,70 +1239,33 @@ struct TSequenceItem_ReadSlot1 : public TSequenceItem
 
 };
 
-struct TSequenceItem_divider : public TSequenceItem
+enum ESequencerEvent
 {
-	FORCEINLINE bool isTriggered()
-	{
-		return MMU.divRunning && nds_timer >= MMU.divCycles;
-	}
-
-	bool isEnabled() { return MMU.divRunning!=0; }
-
-	FORCEINLINE u64 next()
-	{
-		return MMU.divCycles;
-	}
-
-	void exec()
-	{
-		IF_DEVELOPER(DEBUG_statistics.sequencerExecutionCounters[2]++);
-		MMU_new.div.busy = 0;
-#ifdef HOST_64 
-		T1WriteQuad(MMU.ARM9_REG, 0x2A0, MMU.divResult);
-		T1WriteQuad(MMU.ARM9_REG, 0x2A8, MMU.divMod);
-#else
-		T1WriteLong(MMU.ARM9_REG, 0x2A0, (u32)MMU.divResult);
-		T1WriteLong(MMU.ARM9_REG, 0x2A4, (u32)(MMU.divResult >> 32));
-		T1WriteLong(MMU.ARM9_REG, 0x2A8, (u32)MMU.divMod);
-		T1WriteLong(MMU.ARM9_REG, 0x2AC, (u32)(MMU.divMod >> 32));
-#endif
-		MMU.divRunning = FALSE;
-	}
-
-};
-
-struct TSequenceItem_sqrtunit : public TSequenceItem
-{
-	FORCEINLINE bool isTriggered()
-	{
-		return MMU.sqrtRunning && nds_timer >= MMU.sqrtCycles;
-	}
-
-	bool isEnabled() { return MMU.sqrtRunning!=0; }
-
-	FORCEINLINE u64 next()
-	{
-		return MMU.sqrtCycles;
-	}
-
-	FORCEINLINE void exec()
-	{
-		IF_DEVELOPER(DEBUG_statistics.sequencerExecutionCounters[3]++);
-		MMU_new.sqrt.busy = 0;
-		T1WriteLong(MMU.ARM9_REG, 0x2B4, MMU.sqrtResult);
-		MMU.sqrtRunning = FALSE;
-	}
-
+	//events that are due at the same time run in this order
+	ESE_DISPCNT, ESE_WIFI, ESE_GXFIFO, ESE_READSLOT1,
+	ESE_DMA_0_0, ESE_DMA_0_1, ESE_DMA_0_2, ESE_DMA_0_3,
+	ESE_DMA_1_0, ESE_DMA_1_1, ESE_DMA_1_2, ESE_DMA_1_3,
+	ESE_TIMER_0_0, ESE_TIMER_0_1, ESE_TIMER_0_2, ESE_TIMER_0_3,
+	ESE_TIMER_1_0, ESE_TIMER_1_1, ESE_TIMER_1_2, ESE_TIMER_1_3,
+	ESE_COUNT
 };
 
 struct Sequencer
 {
 	bool nds_vblankEnded;
 	bool reschedule;
+
+	//when each event happens next (kNever if it isn't scheduled), with the events kept in a binary min-heap
+	//ordered by that time, so that the next one is always queue[0].
+	//queuePos[] is where each event is in the heap, so that rescheduling an event moves only that event.
+	u64 queueTime[ESE_COUNT];
+	u8 queue[ESE_COUNT];
+	u8 queuePos[ESE_COUNT];
+	u32 dueEvents; //one bit per event, for execHardware()
+
 	TSequenceItem dispcnt;
 	TSequenceItem wifi;
-	TSequenceItem_divider divider;
-	TSequenceItem_sqrtunit sqrtunit;
+	TSequenceItem divider, sqrtunit; //no longer scheduled (see update_math() in MMU.cpp), but still in savestates
 	TSequenceItem_GXFIFO gxfifo;
 	TSequenceItem_ReadSlot1 readslot1;
 	TSequenceItem_DMA<0,0> dma_0_0; TSequenceItem_DMA<0,1> dma_0_1; 
@@ -1221,10 +1277,26 @@ struct Sequencer
 	TSequenceItem_Timer<1,0> timer_1_0; TSequenceItem_Timer<1,1> timer_1_1;
 	TSequenceItem_Timer<1,2> timer_1_2; TSequenceItem_Timer<1,3> timer_1_3;
 
+	Sequencer();
 	void init();
 
 	void execHardware();
-	u64 findNext();
+	u64 findNext() { return queueTime[queue[0]]; }
+
+	//call update() for an event whenever something changes when it happens, or rebuild() after changing everything.
+	//the events read their times from the emulated hardware, see eventTime().
+	void update(int id);
+	void rebuild();
+
+private:
+	u64 eventTime(int id);
+	bool execEvent(int id);
+	void queueSwap(int a, int b);
+	void siftUp(int pos);
+	void siftDown(int pos);
+	void findDue(int pos);
+
+public:
 
 	void save(EMUFILE &os)
 	{
@@ -1275,12 +1347,13 @@ void NDS_RescheduleGXFIFO(u32 cost)
 		sequencer.gxfifo.enabled = true;
 	}
 	MMU.gfx3dCycles += cost;
+	sequencer.update(ESE_GXFIFO);
 	NDS_Reschedule();
 }
 
 void NDS_RescheduleTimers()
 {
-#define check(X,Y) sequencer.timer_##X##_##Y .schedule();
+#define check(X,Y) sequencer.timer_##X##_##Y .schedule(); sequencer.update(ESE_TIMER_##X##_##Y);
 	check(0,0); check(0,1); check(0,2); check(0,3);
 	check(1,0); check(1,1); check(1,2); check(1,3);
 #undef check
@@ -1288,6 +1361,23 @@ void NDS_RescheduleTimers()
 	NDS_Reschedule();
 }
 
+void NDS_RescheduleTimer(int procnum, int num)
+{
+	//the timer before this one has to run its overflows when this one counts them up
+	for(int i = (num > 0) ? num-1 : num; i <= num; i++)
+	{
+		switch(procnum*4+i)
+		{
+#define check(X,Y) case X*4+Y: sequencer.timer_##X##_##Y .schedule(); sequencer.update(ESE_TIMER_##X##_##Y); break;
+		check(0,0); check(0,1); check(0,2); check(0,3);
+		check(1,0); check(1,1); check(1,2); check(1,3);
+#undef check
+		}
+	}
+
+	NDS_Reschedule();
+}
+
 void NDS_RescheduleReadSlot1(int procnum, int size)
 {
 	u32 gcromctrl = T1ReadLong(MMU.MMU_MEM[procnum][0x40], 0x1A4);
@@ -1307,15 +1397,15 @@ void NDS_RescheduleReadSlot1(int procnum, int size)
 	sequencer.readslot1.param = procnum;
 	sequencer.readslot1.timestamp = nds_timer + delay;
 	sequencer.readslot1.enabled = true;
+	sequencer.update(ESE_READSLOT1);
 
 	NDS_Reschedule();
 }
 
-void NDS_RescheduleDMA()
+void NDS_RescheduleDMA(int procnum, int chan)
 {
-	//TBD
+	sequencer.update(ESE_DMA_0_0 + procnum*4 + chan);
 	NDS_Reschedule();
-
 }
 
 static void initSchedule()
@@ -1338,10 +1428,21 @@ static void initSchedule()
 const u64 kWifiCycles = 67;//34*2;
 //(this isn't very precise. I don't think it needs to be)
 
+Sequencer::Sequencer()
+{
+	//nothing is scheduled until init()
+	for(int i=0;i<ESE_COUNT;i++)
+	{
+		queueTime[i] = kNever;
+		queue[i] = i;
+		queuePos[i] = i;
+	}
+	dueEvents = 0;
+}
+
 void Sequencer::init()
 {
 	NDS_RescheduleTimers();
-	NDS_RescheduleDMA();
 
 	reschedule = false;
 	nds_timer = 0;
@@ -1372,6 +1473,105 @@ void Sequencer::init()
 	{
 		wifi.enabled = false;
 	}
+
+	rebuild();
+}
+
+u64 Sequencer::eventTime(int id)
+{
+	switch(id)
+	{
+	//this one is always enabled so dont bother to check it
+	case ESE_DISPCNT: return dispcnt.next();
+	case ESE_WIFI: return wifi.enabled ? wifi.next() : kNever;
+	case ESE_GXFIFO: return gxfifo.next();
+	case ESE_READSLOT1: return readslot1.isEnabled() ? readslot1.next() : kNever;
+	//(read from MMU_new rather than through the dma items, whose controllers aren't set until init())
+#define test(X,Y) case ESE_DMA_##X##_##Y: return MMU_new.dma[X][Y].dmaCheck ? MMU_new.dma[X][Y].nextEvent : kNever;
+	test(0,0); test(0,1); test(0,2); test(0,3);
+	test(1,0); test(1,1); test(1,2); test(1,3);
+#undef test
+#define test(X,Y) case ESE_TIMER_##X##_##Y: return timer_##X##_##Y .enabled ? timer_##X##_##Y .next() : kNever;
+	test(0,0); test(0,1); test(0,2); test(0,3);
+	test(1,0); test(1,1); test(1,2); test(1,3);
+#undef test
+	}
+
+	return kNever;
+}
+
+void Sequencer::queueSwap(int a, int b)
+{
+	const u8 id = queue[a];
+	queue[a] = queue[b];
+	queue[b] = id;
+	queuePos[queue[a]] = a;
+	queuePos[queue[b]] = b;
+}
+
+void Sequencer::siftUp(int pos)
+{
+	while(pos > 0)
+	{
+		const int parent = (pos-1)/2;
+		if(queueTime[queue[pos]] >= queueTime[queue[parent]]) break;
+		queueSwap(pos,parent);
+		pos = parent;
+	}
+}
+
+void Sequencer::siftDown(int pos)
+{
+	for(;;)
+	{
+		int smallest = pos;
+		const int left = pos*2+1;
+		const int right = left+1;
+		if(left < ESE_COUNT && queueTime[queue[left]] < queueTime[queue[smallest]]) smallest = left;
+		if(right < ESE_COUNT && queueTime[queue[right]] < queueTime[queue[smallest]]) smallest = right;
+		if(smallest == pos) break;
+		queueSwap(pos,smallest);
+		pos = smallest;
+	}
+}
+
+void Sequencer::update(int id)
+{
+	const u64 time = eventTime(id);
+	const u64 oldTime = queueTime[id];
+	queueTime[id] = time;
+
+	if(time < oldTime) siftUp(queuePos[id]);
+	else if(time > oldTime) siftDown(queuePos[id]);
+
+	//an event can come due while execHardware() is running the others
+	if(time <= nds_timer) dueEvents |= (1<<id);
+}
+
+void Sequencer::rebuild()
+{
+	for(int i=0;i<ESE_COUNT;i++)
+	{
+		queueTime[i] = eventTime(i);
+		queue[i] = i;
+		queuePos[i] = i;
+	}
+
+	for(int i=ESE_COUNT/2-1;i>=0;i--)
+		siftDown(i);
+}
+
+//marks every event in the heap below pos that is due
+void Sequencer::findDue(int pos)
+{
+	if(pos >= ESE_COUNT) return;
+
+	const u8 id = queue[pos];
+	if(queueTime[id] > nds_timer) return;
+
+	dueEvents |= (1<<id);
+	findDue(pos*2+1);
+	findDue(pos*2+2);
 }
 
 static void execHardware_hblank()
@@ -1647,64 +1847,31 @@ void NDS_Reschedule()
 	sequencer.reschedule = true;
 }
 
-FORCEINLINE u32 _fast_min32(u32 a, u32 b, u32 c, u32 d)
-{
-	return ((( ((s32)(a-b)) >> (32-1)) & (c^d)) ^ d);
-}
-
-FORCEINLINE u64 _fast_min(u64 a, u64 b)
-{
-	//you might find that this is faster on a 64bit system; someone should try it
-	//http://aggregate.org/MAGIC/#Integer%20Selection
-	//u64 ret = (((((s64)(a-b)) >> (64-1)) & (a^b)) ^ b);
-	//assert(ret==min(a,b));
-	//return ret;	
-	
-	//but this ends up being the fastest on 32bits
-	return a<b?a:b;
-
-	//just for the record, I tried to do the 64bit math on a 32bit proc
-	//using sse2 and it was really slow
-	//__m128i __a; __a.m128i_u64[0] = a;
-	//__m128i __b; __b.m128i_u64[0] = b;
-	//__m128i xorval = _mm_xor_si128(__a,__b);
-	//__m128i temp = _mm_sub_epi64(__a,__b);
-	//temp.m128i_i64[0] >>= 63; //no 64bit shra in sse2, what a disappointment
-	//temp = _mm_and_si128(temp,xorval);
-	//temp = _mm_xor_si128(temp,__b);
-	//return temp.m128i_u64[0];
-}
-
-
-
-u64 Sequencer::findNext()
+void Sequencer::execHardware()
 {
-	//this one is always enabled so dont bother to check it
-	u64 next = dispcnt.next();
-
-	if(divider.isEnabled()) next = _fast_min(next,divider.next());
-	if(sqrtunit.isEnabled()) next = _fast_min(next,sqrtunit.next());
-	if(gxfifo.enabled) next = _fast_min(next,gxfifo.next());
-	if(readslot1.isEnabled()) next = _fast_min(next,readslot1.next());
-	if (wifi.enabled) next = _fast_min(next,wifi.next());
+	//run the events that are due, in the order of ESequencerEvent.
+	//if one of them makes a later one due, update() marks it and it runs too.
+	dueEvents = 0;
+	findDue(0);
 
-#define test(X,Y) if(dma_##X##_##Y .isEnabled()) next = _fast_min(next,dma_##X##_##Y .next());
-	test(0,0); test(0,1); test(0,2); test(0,3);
-	test(1,0); test(1,1); test(1,2); test(1,3);
-#undef test
-#define test(X,Y) if(timer_##X##_##Y .enabled) next = _fast_min(next,timer_##X##_##Y .next());
-	test(0,0); test(0,1); test(0,2); test(0,3);
-	test(1,0); test(1,1); test(1,2); test(1,3);
-#undef test
+	for(u32 first=0;;)
+	{
+		const u32 pending = dueEvents & ~((1u<<first)-1);
+		if(pending == 0) break;
 
-	return next;
+		const int id = compat_ctz(pending);
+		if(execEvent(id)) nds.sequencerEventCount++;
+		update(id);
+		first = id+1;
+	}
 }
 
-void Sequencer::execHardware()
+bool Sequencer::execEvent(int id)
 {
-	if(dispcnt.isTriggered())
+	switch(id)
 	{
-
+	case ESE_DISPCNT:
+		if(!dispcnt.isTriggered()) return false;
 		IF_DEVELOPER(DEBUG_statistics.sequencerExecutionCounters[1]++);
 
 		switch(dispcnt.param)
@@ -1722,7 +1889,7 @@ void Sequencer::execHardware()
 			dispcnt.timestamp += 7*6*2;
 			dispcnt.param = ESI_DISPCNT_HDraw;
 			break;
-			
+		
 		case ESI_DISPCNT_HDraw:
 			execHardware_hdraw();
 			//duration of non-blanking period is ~1606 clocks (gbatek agrees) [but says its different on arm7]
@@ -1740,31 +1907,29 @@ void Sequencer::execHardware()
 			dispcnt.param = ESI_DISPCNT_HStart;
 			break;
 		}
-	}
+		return true;
 
-	if (wifiHandler->GetCurrentEmulationLevel() != WifiEmulationLevel_Off)
-	{
-		if (wifi.isTriggered())
-		{
-			wifiHandler->CommTrigger();
-			wifi.timestamp += kWifiCycles;
-		}
-	}
-	
-	if(divider.isTriggered()) divider.exec();
-	if(sqrtunit.isTriggered()) sqrtunit.exec();
-	if(gxfifo.isTriggered()) gxfifo.exec();
-	if(readslot1.isTriggered()) readslot1.exec();
+	case ESE_WIFI:
+		if (wifiHandler->GetCurrentEmulationLevel() == WifiEmulationLevel_Off) return false;
+		if (!wifi.isTriggered()) return false;
+		wifiHandler->CommTrigger();
+		wifi.timestamp += kWifiCycles;
+		return true;
 
+	case ESE_GXFIFO: if(!gxfifo.isTriggered()) return false; gxfifo.exec(); return true;
+	case ESE_READSLOT1: if(!readslot1.isTriggered()) return false; readslot1.exec(); return true;
 
-#define test(X,Y) if(dma_##X##_##Y .isTriggered()) dma_##X##_##Y .exec();
+#define test(X,Y) case ESE_DMA_##X##_##Y: if(!dma_##X##_##Y .isTriggered()) return false; dma_##X##_##Y .exec(); return true;
 	test(0,0); test(0,1); test(0,2); test(0,3);
 	test(1,0); test(1,1); test(1,2); test(1,3);
 #undef test
-#define test(X,Y) if(timer_##X##_##Y .enabled) if(timer_##X##_##Y .isTriggered()) timer_##X##_##Y .exec();
+#define test(X,Y) case ESE_TIMER_##X##_##Y: if(!timer_##X##_##Y .isTriggered()) return false; timer_##X##_##Y .exec(); return true;
 	test(0,0); test(0,1); test(0,2); test(0,3);
 	test(1,0); test(1,1); test(1,2); test(1,3);
 #undef test
+	}
+
+	return false;
 }
 
 void execHardware_interrupts();
@@ -1953,8 +2118,10 @@ static /*donotinline*/ std::pair<s32,s32> armInnerLoop(
 				debug();
 #ifdef HAVE_JIT
 				arm9 += armcpu_exec<ARMCPU_ARM9,jit>();
+				NDS_PERF_ADD(jit ? NDS_PERF_ARM9_JIT_BLOCKS : NDS_PERF_ARM9_INTERPRETED, 1);
 #else
 				arm9 += armcpu_exec<ARMCPU_ARM9>();
+				NDS_PERF_ADD(NDS_PERF_ARM9_INTERPRETED, 1);
 #endif
 				#ifdef DEVELOPER
 					nds_debug_continuing[0] = false;
@@ -1994,8 +2161,10 @@ static /*donotinline*/ std::pair<s32,s32> armInnerLoop(
 				arm7log();
 #ifdef HAVE_JIT
 				arm7 += (armcpu_exec<ARMCPU_ARM7,jit>()<<1);
+				NDS_PERF_ADD(jit ? NDS_PERF_ARM7_JIT_BLOCKS : NDS_PERF_ARM7_INTERPRETED, 1);
 #else
 				arm7 += (armcpu_exec<ARMCPU_ARM7>()<<1);
+				NDS_PERF_ADD(NDS_PERF_ARM7_INTERPRETED, 1);
 #endif
 				#ifdef DEVELOPER
 					nds_debug_continuing[1] = false;
@@ -2062,6 +2231,70 @@ void NDS_debug_step()
 	singleStep = true;
 }
 
+bool nds_perfCountersEnabled = false;
+u64 nds_perfCounters[NDS_PERF_COUNTER_COUNT];
+
+static NDSPerfFrame perfHistory[NDS_PERF_HISTORY];
+static size_t perfHistoryNext = 0; //where the next frame goes
+static size_t perfHistoryCount = 0;
+
+static const char* const perfCounterNames[NDS_PERF_COUNTER_COUNT] = {
+	"arm9_cycles", "arm7_cycles",
+	"arm9_interpreted", "arm7_interpreted",
+	"arm9_jit_blocks", "arm7_jit_blocks",
+	"jit_compile_ns",
+	"gpu_main_ns", "gpu_sub_ns",
+	"3d_geometry_ns", "3d_clip_ns", "3d_render_ns",
+	"spu_mix_ns",
+	"cheats_ns",
+	"dma_bytes",
+	"sequencer_events",
+};
+
+void NDS_SetPerfCountersEnabled(bool enabled)
+{
+	if(enabled && !nds_perfCountersEnabled)
+	{
+		memset(nds_perfCounters, 0, sizeof(nds_perfCounters));
+		perfHistoryNext = 0;
+		perfHistoryCount = 0;
+	}
+
+	nds_perfCountersEnabled = enabled;
+}
+
+const char* NDS_GetPerfCounterName(int counter)
+{
+	if(counter < 0 || counter >= NDS_PERF_COUNTER_COUNT) return NULL;
+	return perfCounterNames[counter];
+}
+
+size_t NDS_GetPerfFrames(NDSPerfFrame *frames, size_t count)
+{
+	count = std::min(count, perfHistoryCount);
+	for(size_t i = 0; i < count; i++)
+		frames[i] = perfHistory[(perfHistoryNext + NDS_PERF_HISTORY - count + i) % NDS_PERF_HISTORY];
+	return count;
+}
+
+u64 NDS_GetPerfTime()
+{
+	return (u64)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static void NDS_FinishPerfFrame()
+{
+	nds_perfCounters[NDS_PERF_SEQUENCER_EVENTS] = nds.sequencerEventCount;
+
+	NDSPerfFrame &frame = perfHistory[perfHistoryNext];
+	frame.frame = currFrameCounter;
+	memcpy(frame.counters, nds_perfCounters, sizeof(nds_perfCounters));
+	memset(nds_perfCounters, 0, sizeof(nds_perfCounters));
+
+	perfHistoryNext = (perfHistoryNext + 1) % NDS_PERF_HISTORY;
+	if(perfHistoryCount < NDS_PERF_HISTORY) perfHistoryCount++;
+}
+
 template<bool FORCE>
 void NDS_exec(s32 nb)
 {
@@ -2072,6 +2305,11 @@ void NDS_exec(s32 nb)
 	sequencer.nds_vblankEnded = false;
 
 	nds.cpuloopIterationCount = 0;
+	nds.sequencerEventCount = 0;
+
+	//the hardware may have been changed from outside the emulation since the last frame (savestates, resets)
+	//without telling the sequencer, so put all of the events in order again
+	sequencer.rebuild();
 
 	IF_DEVELOPER(for(int i=0;i<32;i++) DEBUG_statistics.sequencerExecutionCounters[i] = 0);
 
@@ -2132,6 +2370,8 @@ void NDS_exec(s32 nb)
 
 			//cast these down to 32bits so that things run faster on 32bit procs
 			u64 nds_timer_base = nds_timer;
+			const u64 arm9start = nds_arm9_timer, arm7start = nds_arm7_timer;
+			const s32 arm9idle = nds.idleCycles[0], arm7idle = nds.idleCycles[1];
 			s32 arm9 = (s32)(nds_arm9_timer-nds_timer);
 			s32 arm7 = (s32)(nds_arm7_timer-nds_timer);
 			s32 s32next = (s32)(next-nds_timer);
@@ -2181,6 +2421,12 @@ void NDS_exec(s32 nb)
 				nds.idleCycles[1] -= (s32)(nds_arm7_timer-nds_timer);
 				nds_arm7_timer = nds_timer;
 			}
+
+			if(nds_perfCountersEnabled)
+			{
+				nds_perfCounters[NDS_PERF_ARM9_CYCLES] += (s64)(nds_arm9_timer-arm9start) - (nds.idleCycles[0]-arm9idle);
+				nds_perfCounters[NDS_PERF_ARM7_CYCLES] += (s64)(nds_arm7_timer-arm7start) - (nds.idleCycles[1]-arm7idle);
+			}
 		}
 	}
 
@@ -2198,8 +2444,16 @@ void NDS_exec(s32 nb)
 		lastLag = lagframecounter;
 		lagframecounter = 0;
 	}
+	if(nds_perfCountersEnabled) NDS_FinishPerfFrame();
 	currFrameCounter++;
 	DEBUG_Notify.NextFrame();
+	MMU_new.backupDevice.nextFrame();
+	if (_isFirstFramePending)
+	{
+		_isFirstFramePending = false;
+		const double elapsedMilliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - _romLoadStartTime).count();
+		INFO("Time to first frame: %.1f ms (%s)\n", elapsedMilliseconds, (gameInfo.reader->id == ROMREADER_INFLATE) ? "decompressing in the background" : "ROM fully loaded");
+	}
 	if (cheats != NULL)
 	{
 		cheats->process(CHEAT_TYPE_INTERNAL);
@@ -195,9 +195,10 @@ void emu_halt(EmuHaltReasonCode reasonCode, NDSErrorTag errorTag);
 extern u64 nds_timer;
 void NDS_Reschedule();
 void NDS_RescheduleGXFIFO(u32 cost);
-void NDS_RescheduleDMA();
+void NDS_RescheduleDMA(int procnum, int chan);
 void NDS_RescheduleReadSlot1(int procnum, int size);
 void NDS_RescheduleTimers();
+void NDS_RescheduleTimer(int procnum, int num);
 
 enum ENSATA_HANDSHAKE
 {
@@ -261,6 +262,7 @@ struct NDSSystem
 	s32 runCycleCollector[2][16];
 	s32 idleFrameCounter;
 	s32 cpuloopIterationCount; //counts the number of times during a frame that a reschedule happened
+	s32 sequencerEventCount; //counts the hardware events that the sequencer ran during a frame
 
 	//console type must be copied in when the system boots. it can't be changed on the fly.
 	int ConsoleType;
@@ -332,10 +334,13 @@ struct GameInfo
 	void *fROM;
 	ROMReader_struct *reader;
 	u8 *romdataForReader;
+	const u8 *romdataView; //the whole ROM file in memory when the reader has it (mapped or loaded), otherwise NULL
+	u32 romdataViewSize;
 	u32 romsize;
 	u32 cardSize;
 	u32 mask;
 	u32 crc;
+	bool crcPending; //crc isn't known until a background decompression finishes, use getCRC()
 	u32 crcForCheatsDb;
 	u32 chipID;
 	u32	romType;
@@ -351,7 +356,10 @@ struct GameInfo
 
 	GameInfo() :	fROM(NULL),
 					romdataForReader(NULL),
+					romdataView(NULL),
+					romdataViewSize(0),
 					crc(0),
+					crcPending(false),
 					chipID(0x00000FC2),
 					romsize(0),
 					cardSize(0),
@@ -372,6 +380,8 @@ struct GameInfo
 	bool loadROM(std::string fname, u32 type = ROM_NDS);
 	void closeROM();
 	u32 readROM(u32 pos);
+	u32 getCRC();
+	void readROMBlock(u32 pos, u8 *buffer, u32 size);
 	bool ValidateHeader();
 	void populate();
 	bool isDSiEnhanced();
@@ -487,6 +497,72 @@ void NDS_debug_step();
 
 int NDS_GetCPUCoreCount();
 void NDS_GetCPULoadAverage(u32 &outLoadAvgARM9, u32 &outLoadAvgARM7);
+
+//per-frame performance counters, for profiling the emulator rather than the game.
+//they're always compiled in, but cost only a test of nds_perfCountersEnabled while they're disabled.
+enum NDS_PERF_COUNTER
+{
+	NDS_PERF_ARM9_CYCLES, //cycles the cpu ran for (not counting halts and irq waits)
+	NDS_PERF_ARM7_CYCLES,
+	NDS_PERF_ARM9_INTERPRETED, //instructions run by the interpreter
+	NDS_PERF_ARM7_INTERPRETED,
+	NDS_PERF_ARM9_JIT_BLOCKS, //compiled blocks run by the jit
+	NDS_PERF_ARM7_JIT_BLOCKS,
+	NDS_PERF_JIT_COMPILE_NS,
+	NDS_PERF_GPU_MAIN_NS, //2D rendering, per engine
+	NDS_PERF_GPU_SUB_NS,
+	NDS_PERF_3D_GEOMETRY_NS, //running the geometry commands
+	NDS_PERF_3D_CLIP_NS, //clipping and sorting the polygon lists
+	NDS_PERF_3D_RENDER_NS, //time the emulation spends starting the 3D renderer and waiting for it
+	NDS_PERF_SPU_MIX_NS, //time the emulation spends in the core SPU (not its audio thread, if it has one)
+	NDS_PERF_CHEATS_NS, //running the enabled cheats
+	NDS_PERF_DMA_BYTES,
+	NDS_PERF_SEQUENCER_EVENTS,
+
+	NDS_PERF_COUNTER_COUNT
+};
+
+#define NDS_PERF_HISTORY 256
+
+struct NDSPerfFrame
+{
+	s32 frame; //currFrameCounter while the frame ran
+	u64 counters[NDS_PERF_COUNTER_COUNT];
+};
+
+extern bool nds_perfCountersEnabled;
+extern u64 nds_perfCounters[NDS_PERF_COUNTER_COUNT]; //the frame that's running
+
+#define NDS_PERF_ADD(counter, value) do { if(nds_perfCountersEnabled) nds_perfCounters[counter] += (value); } while(0)
+
+//enabling the counters clears the ones collected before
+void NDS_SetPerfCountersEnabled(bool enabled);
+const char* NDS_GetPerfCounterName(int counter);
+//copies the counters of the last frames (up to count of them, and NDS_PERF_HISTORY at most) to frames, oldest first.
+//returns how many it copied.
+size_t NDS_GetPerfFrames(NDSPerfFrame *frames, size_t count);
+u64 NDS_GetPerfTime(); //in nanoseconds
+
+//adds the time until the end of its scope to a counter
+class NDSPerfTimer
+{
+private:
+	const int _counter;
+	const u64 _start;
+
+public:
+	NDSPerfTimer(int counter)
+		: _counter(counter)
+		, _start(nds_perfCountersEnabled ? NDS_GetPerfTime() : 0)
+	{
+	}
+
+	~NDSPerfTimer()
+	{
+		if(_start != 0 && nds_perfCountersEnabled)
+			nds_perfCounters[_counter] += NDS_GetPerfTime() - _start;
+	}
+};
 void NDS_SetupDefaultFirmware();
 
 //void execHardware_doAllDma(EDMAMode modeNum);
@@ -514,6 +590,7 @@ extern struct TCommonSettings
 		, OpenGL_Emulation_DepthLEqualPolygonFacing(false)
 		, jit_max_block_size(12)
 		, loadToMemory(false)
+		, lazyFatImage(false)
 		, UseExtBIOS(false)
 		, SWIFromBIOS(false)
 		, PatchSWI3(false)
@@ -532,6 +609,8 @@ extern struct TCommonSettings
 		, autodetectBackupMethod(0)
 		, spu_captureMuted(false)
 		, spu_advanced(true)
+		, spu_threaded(false)
+		, spu_silent(false)
 		, StylusPressure(50)
 		, ConsoleType(NDS_CONSOLE_TYPE_FAT)
 		, backupSave(false)
@@ -577,6 +656,8 @@ extern struct TCommonSettings
 	bool OpenGL_Emulation_DepthLEqualPolygonFacing;
 
 	bool loadToMemory;
+	//builds the FAT images for slot-1 flash cards and the slot-2 cflash from a directory without copying the files into memory
+	bool lazyFatImage;
 
 	bool UseExtBIOS;
 	char ARM9BIOS[MAX_PATH];
@@ -655,6 +736,13 @@ extern struct TCommonSettings
 	bool spu_muteChannels[16];
 	bool spu_captureMuted;
 	bool spu_advanced;
+	//runs SPU_core on a dedicated audio thread, which may fall up to a frame behind. writes to sample data
+	//that it still has to read and reads of the channel busy bits wait for it to catch up, so the results
+	//are exactly the same as the inline SPU's.
+	bool spu_threaded;
+	//don't produce any audio, and only keep the SPU state that the emulated CPU can see.
+	//this is still deterministic, but the savestates won't have usable ADPCM/interpolation state.
+	bool spu_silent;
 
 	struct _ShowGpu {
 		_ShowGpu() : main(true), sub(true) {}
@@ -4989,9 +4989,6 @@ Render3DError OpenGLRenderer_1_2::SetupTexture(const POLY &thePoly, size_t polyR
 		glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAX_ANISOTROPY_EXT, 1.0f);
 	}
 	
-	theTexture->ResetCacheAge();
-	theTexture->IncreaseCacheUsageCount(1);
-	
 	return OGLERROR_NOERR;
 }
 
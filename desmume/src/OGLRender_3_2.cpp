@@ -3723,9 +3723,6 @@ Render3DError OpenGLRenderer_3_2::SetupTexture(const POLY &thePoly, size_t polyR
 		glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAX_ANISOTROPY_EXT, 1.0f);
 	}
 	
-	theTexture->ResetCacheAge();
-	theTexture->IncreaseCacheUsageCount(1);
-	
 	return OGLERROR_NOERR;
 }
 
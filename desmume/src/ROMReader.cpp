@@ -21,11 +21,21 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <stdio.h>
+#include <algorithm>
 #ifdef HAVE_LIBZZIP
 #include <zzip/zzip.h>
 #endif
 
 #include "utils/xstring.h"
+#include "utils/task.h"
+#include "emufile.h"
+#include "debug.h"
+
+#ifdef HAVE_LIBZ
+#include <atomic>
+#include <chrono>
+#include <rthreads/rthreads.h>
+#endif
 
 #ifdef WIN32
 #define stat(...) _stat(__VA_ARGS__)
@@ -49,7 +59,7 @@ ROMReader_struct * ROMReaderInit(char ** filename)
 		return &ZIPROMReader;
 	}
 #endif
-	return &STDROMReader;
+	return &MapROMReader;
 }
 
 void * STDROMReaderInit(const char * filename);
@@ -68,7 +78,8 @@ ROMReader_struct STDROMReader =
 	STDROMReaderSize,
 	STDROMReaderSeek,
 	STDROMReaderRead,
-	STDROMReaderWrite
+	STDROMReaderWrite,
+	NULL
 };
 
 struct STDROMReaderData
@@ -150,6 +161,119 @@ int STDROMReaderWrite(void *, void *, u32)
 	return 0;
 }
 
+// Reads uncompressed ROMs through a memory mapping of the file, so that streaming from the
+// cart doesn't need a seek and a read syscall for every word, and large ROMs don't need to
+// be copied into memory up front.
+void * MapROMReaderInit(const char * filename);
+void MapROMReaderDeInit(void *);
+u32 MapROMReaderSize(void *);
+int MapROMReaderSeek(void *, int, int);
+int MapROMReaderRead(void *, void *, u32);
+int MapROMReaderWrite(void *, void *, u32);
+const u8 * MapROMReaderGetData(void *);
+
+ROMReader_struct MapROMReader =
+{
+	ROMREADER_MAP,
+	"Mapped ROM Reader",
+	MapROMReaderInit,
+	MapROMReaderDeInit,
+	MapROMReaderSize,
+	MapROMReaderSeek,
+	MapROMReaderRead,
+	MapROMReaderWrite,
+	MapROMReaderGetData
+};
+
+struct MapROMReaderData
+{
+	EMUFILE_MAPPING *map;
+	u32 pos;
+};
+
+void* MapROMReaderInit(const char* filename)
+{
+#ifndef _MSC_VER
+	struct stat sb;
+	if (stat(filename, &sb) == -1)
+		return 0;
+
+ 	if ((sb.st_mode & S_IFMT) != S_IFREG)
+		return 0;
+#endif
+
+	EMUFILE_MAPPING *map = new EMUFILE_MAPPING(filename);
+	if (!map->is_open())
+	{
+		delete map;
+		return NULL;
+	}
+
+	MapROMReaderData* ret = new MapROMReaderData();
+	ret->map = map;
+	ret->pos = 0;
+	return (void*)ret;
+}
+
+void MapROMReaderDeInit(void * file)
+{
+	if (!file) return ;
+	delete ((MapROMReaderData*)file)->map;
+	delete ((MapROMReaderData*)file);
+}
+
+u32 MapROMReaderSize(void * file)
+{
+	if (!file) return 0;
+	return (u32)((MapROMReaderData*)file)->map->size();
+}
+
+int MapROMReaderSeek(void * file, int offset, int whence)
+{
+	if (!file) return 0;
+	MapROMReaderData *data = (MapROMReaderData*)file;
+	const s64 size = (s64)data->map->size();
+	s64 pos = 0;
+
+	switch(whence) {
+	case SEEK_SET: pos = offset; break;
+	case SEEK_CUR: pos = (s64)data->pos + offset; break;
+	case SEEK_END: pos = size + offset; break;
+	}
+
+	if (pos < 0) pos = 0;
+	data->pos = (u32)pos;
+	return 1;
+}
+
+int MapROMReaderRead(void * file, void * buffer, u32 size)
+{
+	if (!file) return 0;
+	MapROMReaderData *data = (MapROMReaderData*)file;
+	const u32 mapSize = (u32)data->map->size();
+	if (data->pos >= mapSize) return 0;
+
+	u32 todo = mapSize - data->pos;
+	if (size < todo)
+		todo = size;
+
+	memcpy(buffer, data->map->data() + data->pos, todo);
+	data->pos += todo;
+	return (int)todo;
+}
+
+int MapROMReaderWrite(void *, void *, u32)
+{
+	//the mapping is read-only
+	return 0;
+}
+
+const u8 * MapROMReaderGetData(void * file)
+{
+	if (!file) return NULL;
+	return ((MapROMReaderData*)file)->map->data();
+}
+
 #ifdef HAVE_LIBZ
 void * GZIPROMReaderInit(const char * filename);
 void GZIPROMReaderDeInit(void *);
@@ -167,42 +291,77 @@ ROMReader_struct GZIPROMReader =
 	GZIPROMReaderSize,
 	GZIPROMReaderSeek,
 	GZIPROMReaderRead,
-	GZIPROMReaderWrite
+	GZIPROMReaderWrite,
+	NULL
+};
+
+struct GZIPROMReaderData
+{
+	gzFile file;
+	u32 size;
 };
 
 void * GZIPROMReaderInit(const char * filename)
 {
-	return (void*)gzopen(filename, "rb");
+	gzFile inf = gzopen(filename, "rb");
+	if (!inf) return NULL;
+
+	GZIPROMReaderData* ret = new GZIPROMReaderData();
+	ret->file = inf;
+	ret->size = 0;
+
+	//a gzip file ends with the uncompressed size, so it doesn't need to be inflated just to find that out
+	bool hasSize = false;
+	FILE* raw = fopen(filename, "rb");
+	if (raw)
+	{
+		u8 magic[2];
+		u8 trailer[4];
+		if ( (fread(magic, 1, 2, raw) == 2) && (magic[0] == 0x1F) && (magic[1] == 0x8B) &&
+		     (fseek(raw, -4, SEEK_END) == 0) && (fread(trailer, 1, 4, raw) == 4) )
+		{
+			ret->size = (u32)trailer[0] | ((u32)trailer[1] << 8) | ((u32)trailer[2] << 16) | ((u32)trailer[3] << 24);
+			hasSize = true;
+		}
+		fclose(raw);
+	}
+
+	if (!hasSize)
+	{
+		char useless[1024];
+		while (gzeof(inf) == 0)
+		{
+			const int read = gzread(inf, useless, 1024);
+			if (read <= 0) break;
+			ret->size += read;
+		}
+		gzrewind(inf);
+	}
+
+	return (void*)ret;
 }
 
 void GZIPROMReaderDeInit(void * file)
 {
-	gzclose((gzFile)file);
+	if (!file) return ;
+	gzclose(((GZIPROMReaderData*)file)->file);
+	delete ((GZIPROMReaderData*)file);
 }
 
 u32 GZIPROMReaderSize(void * file)
 {
-	char useless[1024];
-	u32 size = 0;
-
-	/* FIXME this function should first save the current
-	 * position and restore it after size calculation */
-	gzrewind((gzFile)file);
-	while (gzeof ((gzFile)file) == 0)
-		size += gzread((gzFile)file, useless, 1024);
-	gzrewind((gzFile)file);
-
-	return size;
+	if (!file) return 0;
+	return ((GZIPROMReaderData*)file)->size;
 }
 
 int GZIPROMReaderSeek(void * file, int offset, int whence)
 {
-	return gzseek((gzFile)file, offset, whence);
+	return gzseek(((GZIPROMReaderData*)file)->file, offset, whence);
 }
 
 int GZIPROMReaderRead(void * file, void * buffer, u32 size)
 {
-	return gzread((gzFile)file, buffer, size);
+	return gzread(((GZIPROMReaderData*)file)->file, buffer, size);
 }
 
 int GZIPROMReaderWrite(void *, void *, u32)
@@ -229,7 +388,8 @@ ROMReader_struct ZIPROMReader =
 	ZIPROMReaderSize,
 	ZIPROMReaderSeek,
 	ZIPROMReaderRead,
-	ZIPROMReaderWrite
+	ZIPROMReaderWrite,
+	NULL
 };
 
 void * ZIPROMReaderInit(const char * filename)
@@ -287,6 +447,221 @@ int ZIPROMReaderWrite(void *, void *, u32)
 }
 #endif
 
+#ifdef HAVE_LIBZ
+// Decompresses a GZIP or ZIP ROM into memory on a background thread, so that emulation can start
+// right away. Reads only wait when they reach past what has been decompressed so far.
+void * InflateROMReaderInit(const char * filename);
+void InflateROMReaderDeInit(void *);
+u32 InflateROMReaderSize(void *);
+int InflateROMReaderSeek(void *, int, int);
+int InflateROMReaderRead(void *, void *, u32);
+int InflateROMReaderWrite(void *, void *, u32);
+
+static ROMReader_struct InflateROMReader =
+{
+	ROMREADER_INFLATE,
+	"Background Inflating ROM Reader",
+	InflateROMReaderInit,
+	InflateROMReaderDeInit,
+	InflateROMReaderSize,
+	InflateROMReaderSeek,
+	InflateROMReaderRead,
+	InflateROMReaderWrite,
+	NULL
+};
+
+#define INFLATEROMREADER_CHUNK_SIZE (1024 * 1024)
+
+static struct InflateROMReaderData
+{
+	ROMReader_struct *source;
+	void *sourceFile;
+	u8 *buf;
+	u32 len;
+	u32 pos;
+	u32 crc;
+
+	std::atomic<u32> available;
+	std::atomic<bool> finished;
+	std::atomic<bool> cancel;
+
+	slock_t *mutex;
+	scond_t *condAvailable;
+	Task *task;
+} inflateROM;
+
+static void* InflateROMReaderProc(void *)
+{
+	const std::chrono::steady_clock::time_point startTime = std::chrono::steady_clock::now();
+	u32 done = 0;
+	u32 crc = crc32(0, NULL, 0);
+
+	inflateROM.source->Seek(inflateROM.sourceFile, 0, SEEK_SET);
+
+	while ( (done < inflateROM.len) && !inflateROM.cancel.load() )
+	{
+		const u32 todo = std::min<u32>(INFLATEROMREADER_CHUNK_SIZE, inflateROM.len - done);
+		const int read = inflateROM.source->Read(inflateROM.sourceFile, inflateROM.buf + done, todo);
+		if (read <= 0)
+			break;
+
+		crc = crc32(crc, inflateROM.buf + done, read);
+		done += read;
+
+		slock_lock(inflateROM.mutex);
+		inflateROM.available.store(done);
+		scond_broadcast(inflateROM.condAvailable);
+		slock_unlock(inflateROM.mutex);
+	}
+
+	//a truncated archive reads as 0xFF past its end, the same as a trimmed ROM
+	if ( (done < inflateROM.len) && !inflateROM.cancel.load() )
+	{
+		INFO("ROM: the archive ended after %u of %u bytes, the rest reads as 0xFF\n", done, inflateROM.len);
+		memset(inflateROM.buf + done, 0xFF, inflateROM.len - done);
+	}
+
+	//the size of a gzip ROM comes from its trailer, which only covers the last member of a multi-member
+	//archive and wraps at 4GB. so make sure the inflated data really ends where the trailer said it would
+	u8 extra;
+	if ( (done == inflateROM.len) && !inflateROM.cancel.load() && (inflateROM.source->Read(inflateROM.sourceFile, &extra, 1) > 0) )
+		INFO("ROM: the archive holds more than the %u bytes it declares, only those were loaded. Decompress the ROM to load all of it.\n", inflateROM.len);
+
+	slock_lock(inflateROM.mutex);
+	inflateROM.crc = crc;
+	inflateROM.available.store(inflateROM.len);
+	inflateROM.finished.store(true);
+	scond_broadcast(inflateROM.condAvailable);
+	slock_unlock(inflateROM.mutex);
+
+	if (!inflateROM.cancel.load())
+	{
+		const double elapsedMilliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startTime).count();
+		INFO("ROM decompressed in the background in %.1f ms\n", elapsedMilliseconds);
+	}
+
+	return NULL;
+}
+
+static void InflateROMReaderWaitFor(u32 end)
+{
+	if (inflateROM.available.load() >= end)
+		return;
+
+	slock_lock(inflateROM.mutex);
+	while ( (inflateROM.available.load() < end) && !inflateROM.finished.load() )
+		scond_wait(inflateROM.condAvailable, inflateROM.mutex);
+	slock_unlock(inflateROM.mutex);
+}
+
+void * InflateROMReaderInit(const char * filename)
+{
+	return (void*)&inflateROM; //dummy
+}
+
+void InflateROMReaderDeInit(void *)
+{
+	if (inflateROM.task != NULL)
+	{
+		inflateROM.cancel.store(true);
+		inflateROM.task->finish();
+		inflateROM.task->shutdown();
+		delete inflateROM.task;
+		inflateROM.task = NULL;
+	}
+
+	if (inflateROM.source != NULL)
+		inflateROM.source->DeInit(inflateROM.sourceFile);
+
+	if (inflateROM.mutex != NULL)
+		slock_free(inflateROM.mutex);
+	if (inflateROM.condAvailable != NULL)
+		scond_free(inflateROM.condAvailable);
+
+	delete [] inflateROM.buf;
+
+	inflateROM.source = NULL;
+	inflateROM.sourceFile = NULL;
+	inflateROM.buf = NULL;
+	inflateROM.len = 0;
+	inflateROM.pos = 0;
+	inflateROM.mutex = NULL;
+	inflateROM.condAvailable = NULL;
+}
+
+u32 InflateROMReaderSize(void *)
+{
+	return inflateROM.len;
+}
+
+int InflateROMReaderSeek(void * file, int offset, int whence)
+{
+	switch(whence) {
+	case SEEK_SET:
+		inflateROM.pos = (u32)offset;
+		break;
+	case SEEK_CUR:
+		inflateROM.pos += offset;
+		break;
+	case SEEK_END:
+		inflateROM.pos = inflateROM.len + offset;
+		break;
+	}
+	return inflateROM.pos;
+}
+
+int InflateROMReaderRead(void * file, void * buffer, u32 size)
+{
+	if (inflateROM.pos >= inflateROM.len)
+		return 0;
+
+	const u32 todo = std::min<u32>(size, inflateROM.len - inflateROM.pos);
+	InflateROMReaderWaitFor(inflateROM.pos + todo);
+
+	memcpy(buffer, inflateROM.buf + inflateROM.pos, todo);
+	inflateROM.pos += todo;
+	return (int)todo;
+}
+
+int InflateROMReaderWrite(void *, void *, u32)
+{
+	//not supported
+	return 0;
+}
+
+ROMReader_struct * InflateROMReaderRead_TrueInit(ROMReader_struct *source, void *sourceFile)
+{
+	inflateROM.source = source;
+	inflateROM.sourceFile = sourceFile;
+	inflateROM.len = source->Size(sourceFile);
+	inflateROM.pos = 0;
+	inflateROM.crc = 0;
+	inflateROM.buf = new u8[inflateROM.len];
+	inflateROM.available.store(0);
+	inflateROM.finished.store(false);
+	inflateROM.cancel.store(false);
+	inflateROM.mutex = slock_new();
+	inflateROM.condAvailable = scond_new();
+
+	inflateROM.task = new Task;
+	inflateROM.task->start(false, 0, "ROM decompressor");
+	inflateROM.task->execute(&InflateROMReaderProc, NULL);
+
+	return &InflateROMReader;
+}
+
+bool InflateROMReaderIsFinished()
+{
+	return inflateROM.finished.load();
+}
+
+u32 InflateROMReaderWaitForCRC()
+{
+	InflateROMReaderWaitFor(inflateROM.len);
+	return inflateROM.crc;
+}
+#endif
+
 struct {
 	void* buf;
 	int len;
@@ -354,6 +729,11 @@ int MemROMReaderWrite(void * file, void * buffer, u32 size)
 	return todo;
 }
 
+const u8 * MemROMReaderGetData(void *)
+{
+	return (const u8 *)mem.buf;
+}
+
 static ROMReader_struct MemROMReader =
 {
 	ROMREADER_MEM,
@@ -364,6 +744,7 @@ static ROMReader_struct MemROMReader =
 	MemROMReaderSeek,
 	MemROMReaderRead,
 	MemROMReaderWrite,
+	MemROMReaderGetData
 };
 
 ROMReader_struct * MemROMReaderRead_TrueInit(void* buf, int length)
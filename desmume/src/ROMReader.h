@@ -31,6 +31,8 @@
 #define ROMREADER_GZIP	1
 #define ROMREADER_ZIP	2
 #define ROMREADER_MEM	3
+#define ROMREADER_MAP	4
+#define ROMREADER_INFLATE	5
 
 typedef struct
 {
@@ -42,9 +44,11 @@ typedef struct
 	int (*Seek)(void * file, int offset, int whence);
 	int (*Read)(void * file, void * buffer, u32 size);
 	int (*Write)(void * file, void * buffer, u32 size);
+	const u8 * (*Data)(void * file); //the whole ROM in memory, for readers that have it (NULL otherwise)
 } ROMReader_struct;
 
 extern ROMReader_struct STDROMReader;
+extern ROMReader_struct MapROMReader;
 #ifdef HAVE_LIBZ
 extern ROMReader_struct GZIPROMReader;
 #endif
@@ -54,5 +58,11 @@ extern ROMReader_struct ZIPROMReader;
 
 ROMReader_struct * ROMReaderInit(char ** filename);
 ROMReader_struct * MemROMReaderRead_TrueInit(void* buf, int length);
+#ifdef HAVE_LIBZ
+//takes over a compressed reader and decompresses its ROM on a background thread
+ROMReader_struct * InflateROMReaderRead_TrueInit(ROMReader_struct *source, void *sourceFile);
+bool InflateROMReaderIsFinished();
+u32 InflateROMReaderWaitForCRC();
+#endif
 
 #endif // _ROMREADER_H_
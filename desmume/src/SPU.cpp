@@ -30,6 +30,7 @@
 #include <string.h>
 #include <queue>
 #include <vector>
+#include <atomic>
 
 #include "debug.h"
 #include "driver.h"
@@ -43,6 +44,12 @@
 #include "matrix.h"
 #include "utils/bits.h"
 
+#ifdef ENABLE_SSE4_1
+#include <smmintrin.h>
+#endif
+
+#include <rthreads/rthreads.h>
+
 
 static inline s16 read16(u32 addr) { return (s16)_MMU_read16<ARMCPU_ARM7,MMU_AT_DEBUG>(addr); }
 static inline u8 read08(u32 addr) { return _MMU_read08<ARMCPU_ARM7,MMU_AT_DEBUG>(addr); }
@@ -115,6 +122,12 @@ static const double samples_per_hline = (DESMUME_SAMPLE_RATE / 59.8261f) / 263.0
 static double _samples = 0;
 int spu_core_samples = 0;
 
+//a copy of SPU_core's registers that's kept up to date from the register writes while the audio
+//thread is running, since SPU_core can't be looked at without draining the queue.
+static SPU_struct *_spuCoreShadow = NULL;
+static void SPU_StopCoreThread();
+static void SPU_CloneCoreShadow();
+
 template<typename T>
 static FORCEINLINE T MinMax(T val, T min, T max)
 {
@@ -223,6 +236,7 @@ int SPU_Init(int coreid, int newBufferSizeBytes)
 	for (size_t i = 0; i < COSINE_INTERPOLATION_RESOLUTION; i++)
 		cos_lut[i] = (u16)floor((1u<<16) * ((1.0 - cos(((double)i/(double)COSINE_INTERPOLATION_RESOLUTION) * M_PI)) * 0.5));
 
+	SPU_StopCoreThread();
 	SPU_core = new SPU_struct((int)ceil(samples_per_hline));
 	SPU_Reset();
 
@@ -262,6 +276,7 @@ void SPU_Pause(int pause)
 void SPU_CloneUser()
 {
 	if(SPU_user) {
+		SPU_SyncCore();
 		memcpy(SPU_user->channels,SPU_core->channels,sizeof(SPU_core->channels));
 		SPU_user->regs = SPU_core->regs;
 	}
@@ -308,6 +323,7 @@ void SPU_Reset(void)
 {
 	int i;
 
+	SPU_SyncCore();
 	SPU_core->reset();
 
 	if (SPU_user)
@@ -328,6 +344,7 @@ void SPU_Reset(void)
 		T1WriteByte(MMU.ARM7_REG, i, 0);
 
 	_samples = 0;
+	SPU_CloneCoreShadow();
 }
 
 //------------------------------------------
@@ -367,6 +384,8 @@ SPU_struct::~SPU_struct()
 
 void SPU_DeInit(void)
 {
+	SPU_StopCoreThread();
+
 	if (_currentSNDCore)
 		_currentSNDCore->DeInit();
 	_currentSNDCore = 0;
@@ -1221,42 +1240,300 @@ template<int CHANNELS> FORCEINLINE static void SPU_Mix(SPU_struct* SPU, channel_
 	SPU->lastdata = data;
 }
 
+//the channel update works in blocks: the samples are fetched and decoded one at a time, as before,
+//but the interpolation taps for each output sample are stashed away, so that the interpolation,
+//volume/pan scaling and accumulation into sndbuf can be done for the whole block at once.
+//everything here must stay bit-exact with Interpolate(), spumuldiv7() and SPU_Mix().
+#define SPU_MIX_BLOCK_SIZE 64
+
+//without a native 32-bit multiply, Catmull-Rom is cheaper to interpolate while the samples
+//are decoded, so only the mixing is done on the whole block.
+#if defined(ENABLE_AVX2) || defined(ENABLE_SSE4_1)
+	#define SPU_BLOCK_INTERPOLATE_CATMULLROM
+#endif
+
+struct SPUMixBlock
+{
+	s32 tap[4][SPU_MIX_BLOCK_SIZE]; //pcm16b at pcm16bOffs-3 ... pcm16bOffs-0
+	s32 weight[4][SPU_MIX_BLOCK_SIZE]; //the interpolation weights, already looked up from the LUTs
+	s32 data[SPU_MIX_BLOCK_SIZE]; //the interpolated samples
+};
+
+template<SPUInterpolationMode INTERPOLATE_MODE> static FORCEINLINE void SPU_StashInterpolationTaps(SPUMixBlock &block, const size_t i, const channel_struct *chan)
+{
+	const s16 *pcm16b = chan->pcm16b;
+	const u8 pcm16bOffs = chan->pcm16bOffs;
+	const u32 subPos = chan->sampcntFrac;
+
+	switch (INTERPOLATE_MODE)
+	{
+		case SPUInterpolation_CatmullRom:
+		{
+#ifndef SPU_BLOCK_INTERPOLATE_CATMULLROM
+			block.data[i] = Interpolate<SPUInterpolation_CatmullRom>(pcm16b, pcm16bOffs, subPos);
+#else
+			const u16 *w = catmullrom_lut[subPos >> (32 - CATMULLROM_INTERPOLATION_RESOLUTION_BITS)];
+			block.tap[0][i] = pcm16b[SPUCHAN_PCM16B_AT(pcm16bOffs - 3)];
+			block.tap[1][i] = pcm16b[SPUCHAN_PCM16B_AT(pcm16bOffs - 2)];
+			block.tap[2][i] = pcm16b[SPUCHAN_PCM16B_AT(pcm16bOffs - 1)];
+			block.tap[3][i] = pcm16b[SPUCHAN_PCM16B_AT(pcm16bOffs - 0)];
+			block.weight[0][i] = (s32)w[0];
+			block.weight[1][i] = (s32)w[1];
+			block.weight[2][i] = (s32)w[2];
+			block.weight[3][i] = (s32)w[3];
+#endif
+			break;
+		}
+
+		case SPUInterpolation_Cosine:
+			block.tap[2][i] = pcm16b[SPUCHAN_PCM16B_AT(pcm16bOffs - 1)];
+			block.tap[3][i] = pcm16b[SPUCHAN_PCM16B_AT(pcm16bOffs - 0)];
+			block.weight[0][i] = (s32)cos_lut[subPos >> (32 - COSINE_INTERPOLATION_RESOLUTION_BITS)];
+			break;
+
+		case SPUInterpolation_Linear:
+			block.tap[2][i] = pcm16b[SPUCHAN_PCM16B_AT(pcm16bOffs - 1)];
+			block.tap[3][i] = pcm16b[SPUCHAN_PCM16B_AT(pcm16bOffs - 0)];
+			block.weight[0][i] = (s32)(subPos >> (32 - 16));
+			break;
+
+		default:
+			block.data[i] = pcm16b[SPUCHAN_PCM16B_AT(pcm16bOffs)];
+			break;
+	}
+}
+
+#if defined(ENABLE_AVX2)
+
+static FORCEINLINE v256s32 SPU_MulDiv7_AVX2(const v256s32 &val, const u8 multiplier)
+{
+	return (multiplier == 127) ? val : _mm256_srai_epi32(_mm256_mullo_epi32(val, _mm256_set1_epi32(multiplier)), 7);
+}
+
+#elif defined(ENABLE_SSE2)
+
+static FORCEINLINE v128s32 SPU_MulLo32_SSE2(const v128s32 &a, const v128s32 &b)
+{
+#if defined(ENABLE_SSE4_1)
+	return _mm_mullo_epi32(a, b);
+#else
+	// The low 32 bits of the product are the same for signed and unsigned multiplies,
+	// so put it together from two _mm_mul_epu32() calls.
+	const v128u32 even = _mm_mul_epu32(a, b);
+	const v128u32 odd = _mm_mul_epu32(_mm_srli_epi64(a, 32), _mm_srli_epi64(b, 32));
+	return _mm_unpacklo_epi32(_mm_shuffle_epi32(even, 0x08), _mm_shuffle_epi32(odd, 0x08));
+#endif
+}
+
+static FORCEINLINE v128s32 SPU_MulDiv7_SSE2(const v128s32 &val, const u8 multiplier)
+{
+	return (multiplier == 127) ? val : _mm_srai_epi32(SPU_MulLo32_SSE2(val, _mm_set1_epi32(multiplier)), 7);
+}
+
+#endif
+
+template<SPUInterpolationMode INTERPOLATE_MODE> static FORCEINLINE void SPU_InterpolateBlock(SPUMixBlock &block, const size_t length)
+{
+	if (INTERPOLATE_MODE == SPUInterpolation_None)
+	{
+		//already stashed straight into block.data
+		return;
+	}
+
+#ifndef SPU_BLOCK_INTERPOLATE_CATMULLROM
+	if (INTERPOLATE_MODE == SPUInterpolation_CatmullRom)
+	{
+		return;
+	}
+#endif
+
+	size_t i = 0;
+
+#if defined(ENABLE_AVX2)
+	for (; i + 8 <= length; i += 8)
+	{
+		const v256s32 c = _mm256_loadu_si256((v256s32 *)(block.tap[2] + i));
+		const v256s32 d = _mm256_loadu_si256((v256s32 *)(block.tap[3] + i));
+		const v256s32 w0 = _mm256_loadu_si256((v256s32 *)(block.weight[0] + i));
+
+		if (INTERPOLATE_MODE == SPUInterpolation_CatmullRom)
+		{
+			const v256s32 a = _mm256_loadu_si256((v256s32 *)(block.tap[0] + i));
+			const v256s32 b = _mm256_loadu_si256((v256s32 *)(block.tap[1] + i));
+			const v256s32 w1 = _mm256_loadu_si256((v256s32 *)(block.weight[1] + i));
+			const v256s32 w2 = _mm256_loadu_si256((v256s32 *)(block.weight[2] + i));
+			const v256s32 w3 = _mm256_loadu_si256((v256s32 *)(block.weight[3] + i));
+
+			v256s32 sum = _mm256_sub_epi32(_mm256_setzero_si256(), _mm256_mullo_epi32(a, w0));
+			sum = _mm256_add_epi32(sum, _mm256_mullo_epi32(b, w1));
+			sum = _mm256_add_epi32(sum, _mm256_mullo_epi32(c, w2));
+			sum = _mm256_sub_epi32(sum, _mm256_mullo_epi32(d, w3));
+			_mm256_storeu_si256((v256s32 *)(block.data + i), _mm256_srai_epi32(sum, 15));
+		}
+		else
+		{
+			const v256s32 delta = _mm256_srai_epi32(_mm256_mullo_epi32(_mm256_sub_epi32(d, c), w0), 16);
+			_mm256_storeu_si256((v256s32 *)(block.data + i), _mm256_add_epi32(c, delta));
+		}
+	}
+#elif defined(ENABLE_SSE2)
+	for (; i + 4 <= length; i += 4)
+	{
+		const v128s32 c = _mm_loadu_si128((v128s32 *)(block.tap[2] + i));
+		const v128s32 d = _mm_loadu_si128((v128s32 *)(block.tap[3] + i));
+		const v128s32 w0 = _mm_loadu_si128((v128s32 *)(block.weight[0] + i));
+
+		if (INTERPOLATE_MODE == SPUInterpolation_CatmullRom)
+		{
+			const v128s32 a = _mm_loadu_si128((v128s32 *)(block.tap[0] + i));
+			const v128s32 b = _mm_loadu_si128((v128s32 *)(block.tap[1] + i));
+			const v128s32 w1 = _mm_loadu_si128((v128s32 *)(block.weight[1] + i));
+			const v128s32 w2 = _mm_loadu_si128((v128s32 *)(block.weight[2] + i));
+			const v128s32 w3 = _mm_loadu_si128((v128s32 *)(block.weight[3] + i));
+
+			v128s32 sum = _mm_sub_epi32(_mm_setzero_si128(), SPU_MulLo32_SSE2(a, w0));
+			sum = _mm_add_epi32(sum, SPU_MulLo32_SSE2(b, w1));
+			sum = _mm_add_epi32(sum, SPU_MulLo32_SSE2(c, w2));
+			sum = _mm_sub_epi32(sum, SPU_MulLo32_SSE2(d, w3));
+			_mm_storeu_si128((v128s32 *)(block.data + i), _mm_srai_epi32(sum, 15));
+		}
+		else
+		{
+			const v128s32 delta = _mm_srai_epi32(SPU_MulLo32_SSE2(_mm_sub_epi32(d, c), w0), 16);
+			_mm_storeu_si128((v128s32 *)(block.data + i), _mm_add_epi32(c, delta));
+		}
+	}
+#endif
+
+	for (; i < length; i++)
+	{
+		const s32 c = block.tap[2][i];
+		const s32 d = block.tap[3][i];
+
+		if (INTERPOLATE_MODE == SPUInterpolation_CatmullRom)
+		{
+			const s32 a = block.tap[0][i];
+			const s32 b = block.tap[1][i];
+			block.data[i] = (-a*block.weight[0][i] + b*block.weight[1][i] + c*block.weight[2][i] - d*block.weight[3][i]) >> 15;
+		}
+		else
+		{
+			block.data[i] = c + ((d - c)*block.weight[0][i] >> 16);
+		}
+	}
+}
+
+template<int CHANNELS> static FORCEINLINE void SPU_MixBlock(SPU_struct *SPU, channel_struct *chan, const SPUMixBlock &block, const size_t length)
+{
+	const u32 startPos = SPU->bufpos;
+	s32 *sndbuf = SPU->sndbuf + (startPos << 1);
+	size_t i = 0;
+
+#if defined(ENABLE_AVX2)
+	const v128s32 volShift = _mm_cvtsi32_si128(volume_shift[chan->volumeDiv]);
+
+	for (; i + 8 <= length; i += 8)
+	{
+		v256s32 data = _mm256_loadu_si256((v256s32 *)(block.data + i));
+		data = _mm256_sra_epi32(SPU_MulDiv7_AVX2(data, chan->vol), volShift);
+
+		// MixL() and MixR() are just MixLR() with a pan of 0 or 127.
+		const v256s32 left  = (CHANNELS == 2) ? _mm256_setzero_si256() : ((CHANNELS == 0) ? data : SPU_MulDiv7_AVX2(data, 127 - chan->pan));
+		const v256s32 right = (CHANNELS == 0) ? _mm256_setzero_si256() : ((CHANNELS == 2) ? data : SPU_MulDiv7_AVX2(data, chan->pan));
+
+		const v256s32 lo = _mm256_unpacklo_epi32(left, right);
+		const v256s32 hi = _mm256_unpackhi_epi32(left, right);
+		const v256s32 out0 = _mm256_permute2x128_si256(lo, hi, 0x20);
+		const v256s32 out1 = _mm256_permute2x128_si256(lo, hi, 0x31);
+
+		_mm256_storeu_si256((v256s32 *)(sndbuf + (i << 1) + 0), _mm256_add_epi32(_mm256_loadu_si256((v256s32 *)(sndbuf + (i << 1) + 0)), out0));
+		_mm256_storeu_si256((v256s32 *)(sndbuf + (i << 1) + 8), _mm256_add_epi32(_mm256_loadu_si256((v256s32 *)(sndbuf + (i << 1) + 8)), out1));
+	}
+#elif defined(ENABLE_SSE2)
+	const v128s32 volShift = _mm_cvtsi32_si128(volume_shift[chan->volumeDiv]);
+
+	for (; i + 4 <= length; i += 4)
+	{
+		v128s32 data = _mm_loadu_si128((v128s32 *)(block.data + i));
+		data = _mm_sra_epi32(SPU_MulDiv7_SSE2(data, chan->vol), volShift);
+
+		// MixL() and MixR() are just MixLR() with a pan of 0 or 127.
+		const v128s32 left  = (CHANNELS == 2) ? _mm_setzero_si128() : ((CHANNELS == 0) ? data : SPU_MulDiv7_SSE2(data, 127 - chan->pan));
+		const v128s32 right = (CHANNELS == 0) ? _mm_setzero_si128() : ((CHANNELS == 2) ? data : SPU_MulDiv7_SSE2(data, chan->pan));
+
+		_mm_storeu_si128((v128s32 *)(sndbuf + (i << 1) + 0), _mm_add_epi32(_mm_loadu_si128((v128s32 *)(sndbuf + (i << 1) + 0)), _mm_unpacklo_epi32(left, right)));
+		_mm_storeu_si128((v128s32 *)(sndbuf + (i << 1) + 4), _mm_add_epi32(_mm_loadu_si128((v128s32 *)(sndbuf + (i << 1) + 4)), _mm_unpackhi_epi32(left, right)));
+	}
+#endif
+
+	for (; i < length; i++)
+	{
+		SPU->bufpos = startPos + (u32)i;
+		SPU_Mix<CHANNELS>(SPU, chan, block.data[i]);
+	}
+
+	SPU->lastdata = block.data[length - 1];
+}
+
 //WORK
-template<int FORMAT, SPUInterpolationMode INTERPOLATE_MODE, int CHANNELS> 
-	FORCEINLINE static void ____SPU_ChanUpdate(SPU_struct* const SPU, channel_struct* const chan)
+template<int FORMAT> FORCEINLINE static void SPU_ChanAdvance(SPU_struct* const SPU, channel_struct* const chan)
 {
-	for (; SPU->bufpos < SPU->buflength; SPU->bufpos++)
+	// Advance sampcnt one sample at a time. This is
+	// needed to keep pcm16b[] filled for interpolation.
+	u32 nSamplesToSkip = chan->sampincInt + AddAndReturnCarry(&chan->sampcntFrac, chan->sampincFrac);
+	while(nSamplesToSkip--)
 	{
-		// Advance sampcnt one sample at a time. This is
-		// needed to keep pcm16b[] filled for interpolation.
-		u32 nSamplesToSkip = chan->sampincInt + AddAndReturnCarry(&chan->sampcntFrac, chan->sampincFrac);
-		while(nSamplesToSkip--)
+		s16 data = 0;
+		s32 pos = chan->sampcntInt;
+		if(chan->status != CHANSTAT_STOPPED)
 		{
-			s16 data = 0;
-			s32 pos = chan->sampcntInt;
-			if(chan->status != CHANSTAT_STOPPED)
+			switch(FORMAT)
 			{
-				switch(FORMAT)
-				{
-					case 0: data = Fetch8BitData (chan, pos); break;
-					case 1: data = Fetch16BitData(chan, pos); break;
-					case 2: data = FetchADPCMData(chan, pos); break;
-					case 3: data = FetchPSGData  (chan, pos); break;
-					default: break;
-				}
+				case 0: data = Fetch8BitData (chan, pos); break;
+				case 1: data = Fetch16BitData(chan, pos); break;
+				case 2: data = FetchADPCMData(chan, pos); break;
+				case 3: data = FetchPSGData  (chan, pos); break;
+				default: break;
 			}
-			chan->pcm16bOffs++;
-			chan->pcm16b[SPUCHAN_PCM16B_AT(chan->pcm16bOffs)] = data;
-
-			chan->sampcntInt++;
-			if (FORMAT != 3) TestForLoop<FORMAT>(SPU, chan);
 		}
+		chan->pcm16bOffs++;
+		chan->pcm16b[SPUCHAN_PCM16B_AT(chan->pcm16bOffs)] = data;
 
-		if(CHANNELS != -1)
+		chan->sampcntInt++;
+		if (FORMAT != 3) TestForLoop<FORMAT>(SPU, chan);
+	}
+}
+
+template<int FORMAT, SPUInterpolationMode INTERPOLATE_MODE, int CHANNELS> 
+	FORCEINLINE static void ____SPU_ChanUpdate(SPU_struct* const SPU, channel_struct* const chan)
+{
+	if(CHANNELS == -1)
+	{
+		for (; SPU->bufpos < SPU->buflength; SPU->bufpos++)
+			SPU_ChanAdvance<FORMAT>(SPU, chan);
+
+		return;
+	}
+
+	SPUMixBlock block;
+
+	while (SPU->bufpos < SPU->buflength)
+	{
+		const u32 startPos = SPU->bufpos;
+		size_t blockLength = SPU->buflength - startPos;
+		if (blockLength > SPU_MIX_BLOCK_SIZE)
+			blockLength = SPU_MIX_BLOCK_SIZE;
+
+		for (size_t i = 0; i < blockLength; i++)
 		{
-			s32 data = Interpolate<INTERPOLATE_MODE>(chan->pcm16b, chan->pcm16bOffs, chan->sampcntFrac);
-			SPU_Mix<CHANNELS>(SPU, chan, data);
+			SPU_ChanAdvance<FORMAT>(SPU, chan);
+			SPU_StashInterpolationTaps<INTERPOLATE_MODE>(block, i, chan);
 		}
+
+		SPU_InterpolateBlock<INTERPOLATE_MODE>(block, blockLength);
+		SPU_MixBlock<CHANNELS>(SPU, chan, block, blockLength);
+
+		SPU->bufpos = startPos + (u32)blockLength;
 	}
 }
 
@@ -1300,6 +1577,102 @@ FORCEINLINE static void _SPU_ChanUpdate(const bool actuallyMix, SPU_struct* cons
 	}
 }
 
+//silent mode (CommonSettings.spu_silent) doesn't decode any sample data at all. a channel is
+//advanced by a whole run of output samples at once, keeping only what the emulated CPU can
+//observe exact: the sample position, and when a one-shot channel stops. the interpolation
+//history and the ADPCM/PSG decoder state are left alone, since only the audio depends on them.
+static void SPU_ChanUpdateSilent(SPU_struct* const SPU, channel_struct* const chan, const u32 length)
+{
+	const s32 totlength = chan->totlength_shifted;
+	const bool isLooping = (chan->format != 3) && (chan->repeat == 1) && !(chan->format == 2 && chan->totlength < 4);
+	const s64 loopStep = (s64)totlength - ((s64)chan->loopstart << format_shift[chan->format]);
+
+	//TestForLoop() would never stop wrapping on these, so leave them to the sample-by-sample path
+	if (isLooping && loopStep <= 0)
+	{
+		SPU->bufpos = 0;
+		SPU->buflength = length;
+		_SPU_ChanUpdate(false, SPU, chan);
+		return;
+	}
+
+	const u64 fracSum = (u64)chan->sampcntFrac + ((u64)length * chan->sampincFrac);
+	s64 remaining = ((s64)length * chan->sampincInt) + (s64)(fracSum >> 32);
+	s64 sampcnt = chan->sampcntInt;
+
+	chan->sampcntFrac = (u32)fracSum;
+	chan->pcm16bOffs = (u8)(chan->pcm16bOffs + remaining);
+
+	//PSG never loops, and nothing happens until the end of the sample is reached
+	if ( (chan->format == 3) || (remaining == 0) || (sampcnt + remaining < totlength) )
+	{
+		chan->sampcntInt = (s32)(sampcnt + remaining);
+		return;
+	}
+
+	//step up to the first sample that makes TestForLoop() do something
+	const s64 toLoopPoint = (sampcnt < totlength) ? (totlength - sampcnt) : 1;
+	sampcnt += toLoopPoint;
+	remaining -= toLoopPoint;
+
+	if (!isLooping)
+	{
+		//one-shot channels get keyed off, but the position keeps on counting up until the end of the run.
+		//the same goes for short looping ADPCM, which never wraps.
+		if (chan->repeat != 1)
+			SPU->KeyOff(chan->num);
+
+		chan->sampcntInt = (s32)(sampcnt + remaining);
+		return;
+	}
+
+	//wrap like TestForLoop() does, and then the rest of the run just cycles through the loop
+	sampcnt -= loopStep * (((sampcnt - totlength) / loopStep) + 1);
+	sampcnt += remaining;
+	if (sampcnt >= totlength)
+		sampcnt = totlength - loopStep + ((sampcnt - totlength) % loopStep);
+
+	chan->sampcntInt = (s32)sampcnt;
+}
+
+//the non-advanced codepath doesn't emulate capturing, but it still writes zeroes to the capture buffers
+//so that the capture units behave when the option is changed (or a state with a different setting is loaded)
+static void SPU_CaptureZeroes(SPU_struct *SPU, int length)
+{
+	for (int capchan = 0; capchan < 2; capchan++)
+	{
+		SPU_struct::REGS::CAP& cap = SPU->regs.cap[capchan];
+		channel_struct& srcChan = SPU->channels[1 + 2 * capchan];
+		if (cap.runtime.running)
+		{
+			for (int samp = 0; samp < length; samp++)
+			{
+				u32 nSamplesToProcess = srcChan.sampincInt + AddAndReturnCarry(&cap.runtime.sampcntFrac, srcChan.sampincFrac);
+				cap.runtime.sampcntInt += nSamplesToProcess;
+				while (nSamplesToProcess--)
+				{
+					if (cap.bits8)
+					{
+						_MMU_write08<1,MMU_AT_DMA>(cap.runtime.curdad,0);
+						cap.runtime.curdad++;
+					}
+					else
+					{
+						_MMU_write16<1,MMU_AT_DMA>(cap.runtime.curdad,0);
+						cap.runtime.curdad+=2;
+					}
+
+					if (cap.runtime.curdad >= cap.runtime.maxdad)
+					{
+						cap.runtime.curdad = cap.dad;
+						cap.runtime.sampcntInt -= cap.len*(cap.bits8?4:2);
+					}
+				}
+			}
+		}
+	}
+}
+
 //ENTERNEW
 static void SPU_MixAudio_Advanced(bool actuallyMix, SPU_struct *SPU, int length)
 {
@@ -1531,10 +1904,29 @@ static void SPU_MixAudio(bool actuallyMix, SPU_struct *SPU, int length)
 
 	bool advanced = CommonSettings.spu_advanced;
 
+	//the advanced codepath captures the real mix, which can't be done without decoding the samples
+	const bool silent = !actuallyMix && CommonSettings.spu_silent && (SPU == SPU_core) &&
+	                    !(advanced && (SPU->regs.cap[0].runtime.running || SPU->regs.cap[1].runtime.running));
+
+	if (silent)
+	{
+		for (int i = 0; i < 16; i++)
+		{
+			channel_struct *chan = &SPU->channels[i];
+
+			if (chan->status != CHANSTAT_PLAY)
+				continue;
+
+			SPU_ChanUpdateSilent(SPU, chan, length);
+		}
+
+		if (!advanced)
+			SPU_CaptureZeroes(SPU, length);
+	}
 	//branch here so that slow computers don't have to take the advanced (slower) codepath.
 	//it remainds to be seen exactly how much slower it is
 	//if it isnt much slower then we should refactor everything to be simpler, once it is working
-	if (advanced && SPU == SPU_core)
+	else if (advanced && SPU == SPU_core)
 	{
 		SPU_MixAudio_Advanced(actuallyMix, SPU, length);
 	}
@@ -1560,38 +1952,7 @@ static void SPU_MixAudio(bool actuallyMix, SPU_struct *SPU, int length)
 		//this code is bulkier and slower than it might otherwise be to reduce the chance of bugs 
 		//IDEALLY the non-advanced codepath would be removed (while the advanced codepath was optimized and improved)
 		//and this code would disappear, to be replaced with code more capable of emitting zeroes at the opportune time.
-		for (int capchan = 0; capchan < 2; capchan++)
-		{
-			SPU_struct::REGS::CAP& cap = SPU->regs.cap[capchan];
-			channel_struct& srcChan = SPU->channels[1 + 2 * capchan];
-			if (cap.runtime.running)
-			{
-				for (int samp = 0; samp < length; samp++)
-				{
-					u32 nSamplesToProcess = srcChan.sampincInt + AddAndReturnCarry(&cap.runtime.sampcntFrac, srcChan.sampincFrac);
-					cap.runtime.sampcntInt += nSamplesToProcess;
-					while (nSamplesToProcess--)
-					{
-						if (cap.bits8)
-						{
-							_MMU_write08<1,MMU_AT_DMA>(cap.runtime.curdad,0);
-							cap.runtime.curdad++;
-						}
-						else
-						{
-							_MMU_write16<1,MMU_AT_DMA>(cap.runtime.curdad,0);
-							cap.runtime.curdad+=2;
-						}
-
-						if (cap.runtime.curdad >= cap.runtime.maxdad)
-						{
-							cap.runtime.curdad = cap.dad;
-							cap.runtime.sampcntInt -= cap.len*(cap.bits8?4:2);
-						}
-					}
-				}
-			}
-		}
+		SPU_CaptureZeroes(SPU, length);
 	} //non-advanced branch
 
 	//we used to bail out if speakers were disabled.
@@ -1616,6 +1977,550 @@ static void SPU_MixAudio(bool actuallyMix, SPU_struct *SPU, int length)
 
 }
 
+//---------------threaded core spu---------------
+
+//When CommonSettings.spu_threaded is set, SPU_core is run on a dedicated audio thread instead of
+//the emulation thread. Register writes and the per-hline updates are pushed, in the order that
+//they happen, to a single producer/single consumer queue. The audio thread then replays them
+//against SPU_core, so it goes through the same sequence of register states as the inline path.
+//Savestates and resets wait for the audio thread to catch up first.
+//
+//The writes are also applied to _spuCoreShadow right away. The only register state that the audio
+//thread changes by itself is whether a channel is still playing, so register reads are answered
+//from the shadow, and only wait for the audio thread when they return the status of a channel that
+//may still be playing.
+//
+//The audio thread reads the sample data from emulated memory when it gets to an hline, which can
+//be up to a frame after the hline happened. So that it reads the same data as the inline path,
+//the memory that the queued work may read from is guarded (see SPU_ExtendCoreGuard()), and the
+//memory writes wait for the audio thread to catch up before they change any of it (see
+//MMU_GuardSPUCoreWrite()). The output is therefore exactly the same as the inline path's.
+//
+//Sound capture writes into emulated memory, so while a capture unit may be running, the queue
+//is drained and the hline is emulated inline instead. The same goes for AVI/WAV recording,
+//since the recorders want SPU_core->outbuf right after every hline.
+
+enum SPUCoreEventType
+{
+	SPUCoreEventType_Write8 = 0,
+	SPUCoreEventType_Write16,
+	SPUCoreEventType_Write32,
+	SPUCoreEventType_Emulate
+};
+
+struct SPUCoreEvent
+{
+	u8 type;
+	u8 actuallyMix;
+	u16 addr;
+	u32 val; //the sample count, for SPUCoreEventType_Emulate
+};
+
+#define SPU_CORE_EVENT_QUEUE_SIZE	8192 //must be a power of 2
+#define SPU_CORE_OUTPUT_QUEUE_SIZE	4096 //in stereo samples, must be a power of 2
+#define SPU_CORE_MAX_PENDING_LINES	263 //don't let the audio thread fall more than a frame behind
+#define SPU_CORE_WAKE_LINES			16 //wake the audio thread up after this many hlines
+
+static void SPU_RunCoreThread(void *arg);
+static void SPU_OnCoreThreadDrained();
+
+class SPUCoreThread
+{
+private:
+	SPUCoreEvent _event[SPU_CORE_EVENT_QUEUE_SIZE];
+	std::atomic<u32> _eventReadIndex;
+	std::atomic<u32> _eventWriteIndex;
+
+	s16 _output[SPU_CORE_OUTPUT_QUEUE_SIZE * 2];
+	std::atomic<u32> _outputReadIndex;
+	std::atomic<u32> _outputWriteIndex;
+
+	std::atomic<u32> _linesDone;
+	u32 _linesPushed;
+	u32 _linesSinceWake;
+
+	sthread_t *_thread;
+	slock_t *_mutex;
+	scond_t *_condWake;
+	scond_t *_condDrained;
+	bool _exitRequested;
+
+	void _PushEvent(const SPUCoreEvent &theEvent)
+	{
+		const u32 writeIndex = this->_eventWriteIndex.load(std::memory_order_relaxed);
+
+		if ((writeIndex - this->_eventReadIndex.load(std::memory_order_acquire)) >= SPU_CORE_EVENT_QUEUE_SIZE)
+		{
+			this->Drain();
+		}
+
+		this->_event[writeIndex & (SPU_CORE_EVENT_QUEUE_SIZE - 1)] = theEvent;
+		this->_eventWriteIndex.store(writeIndex + 1, std::memory_order_release);
+	}
+
+	void _ProcessEvent(const SPUCoreEvent &theEvent)
+	{
+		switch (theEvent.type)
+		{
+			case SPUCoreEventType_Write8: SPU_core->WriteByte(theEvent.addr, (u8)theEvent.val); break;
+			case SPUCoreEventType_Write16: SPU_core->WriteWord(theEvent.addr, (u16)theEvent.val); break;
+			case SPUCoreEventType_Write32: SPU_core->WriteLong(theEvent.addr, theEvent.val); break;
+
+			case SPUCoreEventType_Emulate:
+			{
+				SPU_MixAudio(theEvent.actuallyMix != 0, SPU_core, (int)theEvent.val);
+
+				if (theEvent.actuallyMix != 0)
+				{
+					u32 writeIndex = this->_outputWriteIndex.load(std::memory_order_relaxed);
+					assert((writeIndex - this->_outputReadIndex.load(std::memory_order_acquire) + theEvent.val) <= SPU_CORE_OUTPUT_QUEUE_SIZE);
+
+					for (u32 i = 0; i < theEvent.val; i++, writeIndex++)
+					{
+						const u32 outIndex = (writeIndex & (SPU_CORE_OUTPUT_QUEUE_SIZE - 1)) * 2;
+						this->_output[outIndex + 0] = SPU_core->outbuf[(i * 2) + 0];
+						this->_output[outIndex + 1] = SPU_core->outbuf[(i * 2) + 1];
+					}
+
+					this->_outputWriteIndex.store(writeIndex, std::memory_order_release);
+				}
+
+				this->_linesDone.fetch_add(1, std::memory_order_release);
+				break;
+			}
+
+			default:
+				break;
+		}
+	}
+
+public:
+	SPUCoreThread()
+		: _eventReadIndex(0)
+		, _eventWriteIndex(0)
+		, _outputReadIndex(0)
+		, _outputWriteIndex(0)
+		, _linesDone(0)
+		, _linesPushed(0)
+		, _linesSinceWake(0)
+		, _exitRequested(false)
+	{
+		_mutex = slock_new();
+		_condWake = scond_new();
+		_condDrained = scond_new();
+		_thread = sthread_create(&SPU_RunCoreThread, this);
+	}
+
+	~SPUCoreThread()
+	{
+		slock_lock(this->_mutex);
+		this->_exitRequested = true;
+		scond_signal(this->_condWake);
+		slock_unlock(this->_mutex);
+
+		sthread_join(this->_thread);
+
+		scond_free(this->_condDrained);
+		scond_free(this->_condWake);
+		slock_free(this->_mutex);
+	}
+
+	//audio thread
+	void RunLoop()
+	{
+		slock_lock(this->_mutex);
+
+		for (;;)
+		{
+			if (this->_eventReadIndex.load(std::memory_order_relaxed) == this->_eventWriteIndex.load(std::memory_order_acquire))
+			{
+				scond_broadcast(this->_condDrained);
+
+				if (this->_exitRequested)
+					break;
+
+				scond_wait(this->_condWake, this->_mutex);
+				continue;
+			}
+
+			slock_unlock(this->_mutex);
+
+			u32 readIndex = this->_eventReadIndex.load(std::memory_order_relaxed);
+			const u32 writeIndex = this->_eventWriteIndex.load(std::memory_order_acquire);
+
+			//only advance the read index once the event is done, so that a drained queue
+			//always means that SPU_core is completely up to date
+			for (; readIndex != writeIndex; readIndex++)
+			{
+				this->_ProcessEvent(this->_event[readIndex & (SPU_CORE_EVENT_QUEUE_SIZE - 1)]);
+				this->_eventReadIndex.store(readIndex + 1, std::memory_order_release);
+			}
+
+			slock_lock(this->_mutex);
+		}
+
+		slock_unlock(this->_mutex);
+	}
+
+	//emulation thread
+	void Wake()
+	{
+		this->_linesSinceWake = 0;
+
+		slock_lock(this->_mutex);
+		scond_signal(this->_condWake);
+		slock_unlock(this->_mutex);
+	}
+
+	bool IsDrained() const
+	{
+		return (this->_eventReadIndex.load(std::memory_order_acquire) == this->_eventWriteIndex.load(std::memory_order_relaxed));
+	}
+
+	void Drain()
+	{
+		if (!this->IsDrained())
+		{
+			this->Wake();
+
+			slock_lock(this->_mutex);
+			while (!this->IsDrained())
+			{
+				scond_wait(this->_condDrained, this->_mutex);
+			}
+			slock_unlock(this->_mutex);
+		}
+
+		SPU_OnCoreThreadDrained();
+	}
+
+	void PushWrite(const SPUCoreEventType type, const u32 addr, const u32 val)
+	{
+		SPUCoreEvent theEvent;
+		theEvent.type = (u8)type;
+		theEvent.actuallyMix = 0;
+		theEvent.addr = (u16)addr;
+		theEvent.val = val;
+
+		this->_PushEvent(theEvent);
+	}
+
+	void PushEmulate(const bool actuallyMix, const int sampleCount)
+	{
+		SPUCoreEvent theEvent;
+		theEvent.type = SPUCoreEventType_Emulate;
+		theEvent.actuallyMix = (actuallyMix) ? 1 : 0;
+		theEvent.addr = 0;
+		theEvent.val = (u32)sampleCount;
+
+		this->_PushEvent(theEvent);
+		this->_linesPushed++;
+
+		if ((this->_linesPushed - this->_linesDone.load(std::memory_order_acquire)) >= SPU_CORE_MAX_PENDING_LINES)
+		{
+			this->Drain();
+		}
+		else if (++this->_linesSinceWake >= SPU_CORE_WAKE_LINES)
+		{
+			this->Wake();
+		}
+	}
+
+	//returns the number of stereo samples copied into outBuffer
+	size_t PopOutput(s16 *outBuffer, const size_t maxSampleCount)
+	{
+		u32 readIndex = this->_outputReadIndex.load(std::memory_order_relaxed);
+		const u32 writeIndex = this->_outputWriteIndex.load(std::memory_order_acquire);
+		size_t sampleCount = 0;
+
+		for (; (readIndex != writeIndex) && (sampleCount < maxSampleCount); readIndex++, sampleCount++)
+		{
+			const u32 outIndex = (readIndex & (SPU_CORE_OUTPUT_QUEUE_SIZE - 1)) * 2;
+			outBuffer[(sampleCount * 2) + 0] = this->_output[outIndex + 0];
+			outBuffer[(sampleCount * 2) + 1] = this->_output[outIndex + 1];
+		}
+
+		this->_outputReadIndex.store(readIndex, std::memory_order_release);
+		return sampleCount;
+	}
+};
+
+static void SPU_RunCoreThread(void *arg)
+{
+	SPUCoreThread *coreThread = (SPUCoreThread *)arg;
+	coreThread->RunLoop();
+}
+
+static SPUCoreThread *_spuCoreThread = NULL;
+static s16 _spuCoreThreadOutput[SPU_CORE_OUTPUT_QUEUE_SIZE * 2];
+
+//the main memory that each channel may read from for the queued work, empty when start == end.
+//SPU_coreGuardStart/SPU_coreGuardEnd span all of them, so that most writes can skip the per-channel checks.
+static u32 _spuCoreGuardChanStart[16];
+static u32 _spuCoreGuardChanEnd[16];
+u32 SPU_coreGuardStart = 0;
+u32 SPU_coreGuardEnd = 0;
+bool SPU_coreGuardOther = false;
+
+static void SPU_CloneCoreShadow()
+{
+	if (_spuCoreShadow == NULL)
+		return;
+
+	memcpy(_spuCoreShadow->channels, SPU_core->channels, sizeof(SPU_core->channels));
+	_spuCoreShadow->regs = SPU_core->regs;
+}
+
+static void SPU_ClearCoreGuard()
+{
+	memset(_spuCoreGuardChanStart, 0, sizeof(_spuCoreGuardChanStart));
+	memset(_spuCoreGuardChanEnd, 0, sizeof(_spuCoreGuardChanEnd));
+	SPU_coreGuardStart = SPU_coreGuardEnd = 0;
+	SPU_coreGuardOther = false;
+}
+
+//nothing is queued anymore, so SPU_core is up to date and nothing needs to read from emulated memory
+static void SPU_OnCoreThreadDrained()
+{
+	SPU_CloneCoreShadow();
+	SPU_ClearCoreGuard();
+}
+
+//adds the sample data of the channels that are playing according to the shadow to the guarded memory.
+//the ranges only ever grow until the queue is drained, since the queued work may still need the old ones.
+static void SPU_ExtendCoreGuard()
+{
+	const u32 mainMemSize = _MMU_MAIN_MEM_MASK + 1;
+
+	for (int i = 0; i < 16; i++)
+	{
+		const channel_struct &thischan = _spuCoreShadow->channels[i];
+		if (thischan.status != CHANSTAT_PLAY || thischan.format == 3)
+			continue;
+
+		//totlength is latched at key on, but loopstart and length can be changed while the channel plays.
+		//leave some room for the samples that the interpolation looks ahead at, too.
+		const u32 length = std::max<u32>(thischan.totlength, thischan.loopstart + thischan.length);
+		const u32 size = (length << 2) + 16;
+
+		if ((thischan.addr & 0x0F000000) != 0x02000000)
+		{
+			SPU_coreGuardOther = true;
+			continue;
+		}
+
+		u32 start = thischan.addr & _MMU_MAIN_MEM_MASK;
+		u32 end = start + size;
+		if (end > mainMemSize)
+		{
+			//wraps around in the mirrored main memory, or runs past it
+			start = 0;
+			end = mainMemSize;
+			if ((thischan.addr + size) > 0x03000000)
+				SPU_coreGuardOther = true;
+		}
+
+		if (_spuCoreGuardChanStart[i] == _spuCoreGuardChanEnd[i])
+		{
+			_spuCoreGuardChanStart[i] = start;
+			_spuCoreGuardChanEnd[i] = end;
+		}
+		else
+		{
+			_spuCoreGuardChanStart[i] = std::min<u32>(_spuCoreGuardChanStart[i], start);
+			_spuCoreGuardChanEnd[i] = std::max<u32>(_spuCoreGuardChanEnd[i], end);
+		}
+
+		if (SPU_coreGuardStart == SPU_coreGuardEnd)
+		{
+			SPU_coreGuardStart = start;
+			SPU_coreGuardEnd = end;
+		}
+		else
+		{
+			SPU_coreGuardStart = std::min<u32>(SPU_coreGuardStart, start);
+			SPU_coreGuardEnd = std::max<u32>(SPU_coreGuardEnd, end);
+		}
+	}
+}
+
+void SPU_GuardCoreWrite(u32 offset, u32 size)
+{
+	for (int i = 0; i < 16; i++)
+	{
+		if ( (offset < _spuCoreGuardChanEnd[i]) && ((offset + size) > _spuCoreGuardChanStart[i]) )
+		{
+			SPU_SyncCore();
+			return;
+		}
+	}
+}
+
+static void SPU_FetchCoreSamples(s16 *sampleBuffer, size_t sampleCount)
+{
+	SoundInterface_struct *soundProcessor = SPU_SoundCore();
+	
+	if (soundProcessor == NULL)
+	{
+		return;
+	}
+	
+	if (soundProcessor->FetchSamples != NULL)
+	{
+		soundProcessor->FetchSamples(sampleBuffer, sampleCount, _currentSynchMode, _currentSynchronizer);
+	}
+	else
+	{
+		SPU_DefaultFetchSamples(sampleBuffer, sampleCount, _currentSynchMode, _currentSynchronizer);
+	}
+}
+
+static void SPU_FetchThreadedCoreSamples()
+{
+	const size_t sampleCount = _spuCoreThread->PopOutput(_spuCoreThreadOutput, SPU_CORE_OUTPUT_QUEUE_SIZE);
+	if (sampleCount > 0)
+	{
+		SPU_FetchCoreSamples(_spuCoreThreadOutput, sampleCount);
+	}
+}
+
+static void SPU_StartCoreThread()
+{
+	if (_spuCoreThread != NULL)
+		return;
+
+	_spuCoreShadow = new SPU_struct(1);
+	SPU_CloneCoreShadow();
+	SPU_ClearCoreGuard();
+	_spuCoreThread = new SPUCoreThread;
+}
+
+static void SPU_StopCoreThread()
+{
+	if (_spuCoreThread == NULL)
+		return;
+
+	_spuCoreThread->Drain();
+	SPU_FetchThreadedCoreSamples();
+
+	delete _spuCoreThread;
+	_spuCoreThread = NULL;
+
+	delete _spuCoreShadow;
+	_spuCoreShadow = NULL;
+}
+
+void SPU_SyncCore()
+{
+	if (_spuCoreThread != NULL)
+		_spuCoreThread->Drain();
+}
+
+void SPU_WriteByte(u32 addr, u8 val)
+{
+	addr &= 0xFFF;
+
+	if (_spuCoreThread != NULL)
+	{
+		//queue it before the shadow sees it, since queueing it may drain the queue and refresh the shadow
+		_spuCoreThread->PushWrite(SPUCoreEventType_Write8, addr, val);
+		_spuCoreShadow->WriteByte(addr, val);
+		SPU_ExtendCoreGuard();
+	}
+	else
+	{
+		SPU_core->WriteByte(addr,val);
+	}
+
+	if(SPU_user)
+		SPU_user->WriteByte(addr,val);
+}
+
+void SPU_WriteWord(u32 addr, u16 val)
+{
+	addr &= 0xFFF;
+
+	if (_spuCoreThread != NULL)
+	{
+		_spuCoreThread->PushWrite(SPUCoreEventType_Write16, addr, val);
+		_spuCoreShadow->WriteWord(addr, val);
+		SPU_ExtendCoreGuard();
+	}
+	else
+	{
+		SPU_core->WriteWord(addr,val);
+	}
+
+	if(SPU_user)
+		SPU_user->WriteWord(addr,val);
+}
+
+void SPU_WriteLong(u32 addr, u32 val)
+{
+	addr &= 0xFFF;
+
+	if (_spuCoreThread != NULL)
+	{
+		_spuCoreThread->PushWrite(SPUCoreEventType_Write32, addr, val);
+		_spuCoreShadow->WriteLong(addr, val);
+		SPU_ExtendCoreGuard();
+	}
+	else
+	{
+		SPU_core->WriteLong(addr,val);
+	}
+
+	if(SPU_user) 
+		SPU_user->WriteLong(addr,val);
+}
+
+//whether a register read can be answered from the shadow while the audio thread is running.
+//statusOffset is where the read would see a channel's busy bit, which is the only thing that
+//the queued work can change, and a channel that's stopped according to the shadow stays stopped.
+static bool SPU_CanReadCoreShadow(u32 addr, u32 statusOffset)
+{
+	if (_spuCoreThread == NULL)
+		return false;
+
+	if ( ((addr & 0x0F00) == 0x0400) && ((addr & 0xF) == statusOffset) )
+		return (_spuCoreShadow->channels[(addr >> 4) & 0xF].status != CHANSTAT_PLAY);
+
+	return true;
+}
+
+u8 SPU_ReadByte(u32 addr)
+{
+	addr &= 0x0FFF;
+
+	if (SPU_CanReadCoreShadow(addr, 0x3))
+		return _spuCoreShadow->ReadByte(addr);
+
+	SPU_SyncCore();
+	return SPU_core->ReadByte(addr);
+}
+
+u16 SPU_ReadWord(u32 addr)
+{
+	addr &= 0x0FFF;
+
+	if (SPU_CanReadCoreShadow(addr, 0x2))
+		return _spuCoreShadow->ReadWord(addr);
+
+	SPU_SyncCore();
+	return SPU_core->ReadWord(addr);
+}
+
+u32 SPU_ReadLong(u32 addr)
+{
+	addr &= 0x0FFF;
+
+	if (SPU_CanReadCoreShadow(addr, 0x0))
+		return _spuCoreShadow->ReadLong(addr);
+
+	SPU_SyncCore();
+	return SPU_core->ReadLong(addr);
+}
+
 //////////////////////////////////////////////////////////////////////////////
 
 
@@ -1624,9 +2529,8 @@ static void SPU_MixAudio(bool actuallyMix, SPU_struct *SPU, int length)
 //in sync with the emulator framerate
 void SPU_Emulate_core()
 {
+	NDSPerfTimer perfTimer(NDS_PERF_SPU_MIX_NS);
 	bool needToMix = true;
-	SoundInterface_struct *soundProcessor = SPU_SoundCore();
-	
 	_samples += samples_per_hline;
 	spu_core_samples = (int)(_samples);
 	_samples -= spu_core_samples;
@@ -1635,26 +2539,46 @@ void SPU_Emulate_core()
 	// later in SPU_Emulate_user(). Disable mixing here to speed up processing.
 	// However, recording still needs to mix the audio, so make sure we're also
 	// not recording before we disable mixing.
-	if ( _currentSynchMode == ESynchMode_DualSynchAsynch &&
-		!(driver->AVI_IsRecording() || driver->WAV_IsRecording()) )
+	// Silent mode doesn't produce any audio either, unless we're recording.
+	const bool isRecording = (driver->AVI_IsRecording() || driver->WAV_IsRecording());
+	const bool isSilent = CommonSettings.spu_silent && !isRecording;
+	if ( (_currentSynchMode == ESynchMode_DualSynchAsynch || isSilent) && !isRecording )
 	{
 		needToMix = false;
 	}
 	
-	SPU_MixAudio(needToMix, SPU_core, spu_core_samples);
-	
-	if (soundProcessor == NULL)
+	if (CommonSettings.spu_threaded)
 	{
-		return;
+		SPU_StartCoreThread();
+	}
+	else
+	{
+		SPU_StopCoreThread();
 	}
 	
-	if (soundProcessor->FetchSamples != NULL)
+	if (_spuCoreThread != NULL)
 	{
-		soundProcessor->FetchSamples(SPU_core->outbuf, spu_core_samples, _currentSynchMode, _currentSynchronizer);
+		if (!isRecording && !_spuCoreShadow->regs.cap[0].runtime.running && !_spuCoreShadow->regs.cap[1].runtime.running)
+		{
+			SPU_ExtendCoreGuard();
+			_spuCoreThread->PushEmulate(needToMix, spu_core_samples);
+			SPU_FetchThreadedCoreSamples();
+			
+			//nothing for the recorders to pick up from SPU_core->outbuf
+			spu_core_samples = 0;
+			return;
+		}
+		
+		_spuCoreThread->Drain();
+		SPU_FetchThreadedCoreSamples();
 	}
-	else
+	
+	SPU_MixAudio(needToMix, SPU_core, spu_core_samples);
+	SPU_CloneCoreShadow();
+	
+	if (!isSilent)
 	{
-		SPU_DefaultFetchSamples(SPU_core->outbuf, spu_core_samples, _currentSynchMode, _currentSynchronizer);
+		SPU_FetchCoreSamples(SPU_core->outbuf, spu_core_samples);
 	}
 }
 
@@ -1666,7 +2590,7 @@ void SPU_Emulate_user(bool mix)
 	size_t processedSampleCount = 0;
 	SoundInterface_struct *soundProcessor = SPU_SoundCore();
 	
-	if (soundProcessor == NULL)
+	if ( (soundProcessor == NULL) || CommonSettings.spu_silent )
 	{
 		return;
 	}
@@ -1918,6 +2842,8 @@ void spu_savestate(EMUFILE &os)
 	//version
 	os.write_32LE(7);
 
+	SPU_SyncCore();
+
 	SPU_struct *spu = SPU_core;
 
 	for (int j = 0; j < 16; j++)
@@ -1984,6 +2910,8 @@ bool spu_loadstate(EMUFILE &is, int size)
 	//this would get played back forever without being replaced by captured data.
 	//it's been solved by capturing zeroes though even when advanced spu logic is disabled.
 	
+	SPU_SyncCore();
+
 	//read version
 	u32 version;
 	if (is.read_32LE(version) != 1) return false;
@@ -2119,6 +3047,7 @@ bool spu_loadstate(EMUFILE &is, int size)
 
 	//copy the core spu (the more accurate) to the user spu
 	SPU_CloneUser();
+	SPU_CloneCoreShadow();
 
 	return true;
 }
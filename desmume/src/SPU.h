@@ -237,33 +237,23 @@ void SPU_ClearOutputBuffer(void);
 void SPU_Reset(void);
 void SPU_DeInit(void);
 void SPU_KeyOn(int channel);
-static FORCEINLINE void SPU_WriteByte(u32 addr, u8 val)
-{
-	addr &= 0xFFF;
-
-	SPU_core->WriteByte(addr,val);
-	if(SPU_user)
-		SPU_user->WriteByte(addr,val);
-}
-static FORCEINLINE void SPU_WriteWord(u32 addr, u16 val)
-{
-	addr &= 0xFFF;
-
-	SPU_core->WriteWord(addr,val);
-	if(SPU_user)
-		SPU_user->WriteWord(addr,val);
-}
-static FORCEINLINE void SPU_WriteLong(u32 addr, u32 val)
-{
-	addr &= 0xFFF;
-
-	SPU_core->WriteLong(addr,val);
-	if(SPU_user) 
-		SPU_user->WriteLong(addr,val);
-}
-static FORCEINLINE u8 SPU_ReadByte(u32 addr) { return SPU_core->ReadByte(addr & 0x0FFF); }
-static FORCEINLINE u16 SPU_ReadWord(u32 addr) { return SPU_core->ReadWord(addr & 0x0FFF); }
-static FORCEINLINE u32 SPU_ReadLong(u32 addr) { return SPU_core->ReadLong(addr & 0x0FFF); }
+void SPU_WriteByte(u32 addr, u8 val);
+void SPU_WriteWord(u32 addr, u16 val);
+void SPU_WriteLong(u32 addr, u32 val);
+u8 SPU_ReadByte(u32 addr);
+u16 SPU_ReadWord(u32 addr);
+u32 SPU_ReadLong(u32 addr);
+//waits for the audio thread to catch up, if SPU_core is being run on one (see CommonSettings.spu_threaded).
+//SPU_core may only be looked at from outside of the SPU after calling this.
+void SPU_SyncCore(void);
+//the part of main memory, as offsets into MMU.MAIN_MEM, that the audio thread may still read sample data
+//from for the work that's been queued up so far. it's empty when the audio thread isn't running.
+//SPU_coreGuardOther is set if it may also read from somewhere outside of main memory.
+extern u32 SPU_coreGuardStart, SPU_coreGuardEnd;
+extern bool SPU_coreGuardOther;
+//waits for the audio thread to catch up if [offset, offset+size) of main memory holds sample data that
+//it may still have to read. see MMU_GuardSPUCoreWrite().
+void SPU_GuardCoreWrite(u32 offset, u32 size);
 void SPU_Emulate_core(void);
 void SPU_Emulate_user(bool mix = true);
 void SPU_DefaultFetchSamples(s16 *sampleBuffer, size_t sampleCount, ESynchMode synchMode, ISynchronizingAudioBuffer *theSynchronizer);
@@ -21,10 +21,21 @@
 #include "../emufile.h"
 
 
+//marks _block as not holding any ROM data, since block addresses are always 0x200 aligned
+#define SLOT1COMP_ROM_NO_BLOCK 0xFFFFFFFF
+
+Slot1Comp_Rom::Slot1Comp_Rom()
+	: _address(0)
+	, _operation(eSlot1Operation_Unknown)
+	, _blockAddress(SLOT1COMP_ROM_NO_BLOCK)
+{
+}
+
 void Slot1Comp_Rom::start(eSlot1Operation operation, u32 addr)
 {
 	this->_operation = operation;
 	this->_address = addr;
+	this->_blockAddress = SLOT1COMP_ROM_NO_BLOCK;
 }
 
 u32 Slot1Comp_Rom::read()
@@ -78,8 +89,25 @@ u32 Slot1Comp_Rom::read()
 				DEBUG_Notify.ReadBeyondEndOfCart(this->_address,gameInfo.romsize);
 			}
 
-			//actually read from the ROM provider
-			u32 ret = gameInfo.readROM(this->_address);
+			//actually read from the ROM provider.
+			//games stream whole 0x200 byte blocks, so read the block in one go rather than a word at a time
+			u32 ret;
+			const u32 blockOffset = this->_address & 0x1FF;
+			if (blockOffset <= (0x200 - 4))
+			{
+				const u32 blockAddress = this->_address - blockOffset;
+				if (this->_blockAddress != blockAddress)
+				{
+					gameInfo.readROMBlock(blockAddress, this->_block, sizeof(this->_block));
+					this->_blockAddress = blockAddress;
+				}
+				memcpy(&ret, this->_block + blockOffset, sizeof(ret)); //blockOffset needn't be aligned
+				ret = LE_TO_LOCAL_32(ret);
+			}
+			else
+			{
+				ret = gameInfo.readROM(this->_address);
+			}
 
 			//"However, the datastream wraps to the begin of the current 4K block when address+length crosses a 4K boundary (1000h bytes)"
 			this->_address = (this->_address&~0xFFF) + ((this->_address+4)&0xFFF);
@@ -120,4 +148,5 @@ void Slot1Comp_Rom::loadstate(EMUFILE &is)
 	s32 version = is.read_s32LE();
 	this->_operation = (eSlot1Operation)is.read_s32LE();
 	this->_address = is.read_u32LE();
+	this->_blockAddress = SLOT1COMP_ROM_NO_BLOCK;
 }
@@ -29,6 +29,8 @@ class EMUFILE;
 class Slot1Comp_Rom
 {
 public:
+	Slot1Comp_Rom();
+
 	void start(eSlot1Operation operation, u32 addr);
 	u32 read();
 	u32 getAddress();
@@ -40,6 +42,10 @@ public:
 private:
 	u32 _address;
 	eSlot1Operation _operation;
+
+	//the card block being streamed by B7 reads, fetched from the ROM in one go
+	u8 _block[0x200];
+	u32 _blockAddress;
 };
 
 #endif
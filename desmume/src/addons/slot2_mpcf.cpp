@@ -26,6 +26,7 @@
 #include "../slot2.h"
 #include "../debug.h"
 #include "../emufile.h"
+#include "../NDSSystem.h"
 #include "../path.h"
 #include "../utils/vfat.h"
 
@@ -104,8 +105,9 @@ static BOOL cflash_init()
 
 		fileStartLBA = fileEndLBA = 0xFFFFFFFF;
 		VFAT vfat;
-		bool ret = vfat.build(sFlashPath.c_str(),16); //allocate 16MB extra for writing. this is probably enough for anyone, but maybe it should be configurable.
+		//allocate 16MB extra for writing. this is probably enough for anyone, but maybe it should be configurable.
 		//we could always suggest to users to add a big file to their directory to overwrite (that would cause the image to get padded)
+		bool ret = CommonSettings.lazyFatImage ? vfat.buildLazy(sFlashPath.c_str(),16,path.getpath(path.BATTERY).c_str()) : vfat.build(sFlashPath.c_str(),16);
 
 		if(!ret)
 		{
@@ -204,7 +206,9 @@ static void cflash_write(unsigned int address,unsigned int data)
 						size_t written = 0;
 
 						if(file) 
-							if(currLBA + 512 < file->size()) 
+							//lazily built images may be up to 4GB, and EMUFILE::size() returns their size as an int,
+							//so it is read back as unsigned. fseek() below wraps the same way, which the lazy image expects.
+							if((u64)currLBA + 512 < (u32)file->size()) 
 							{
 								file->fseek(currLBA,SEEK_SET);
 				      
@@ -2222,6 +2222,8 @@ static u32 FASTCALL OP_LDM_STM(u32 adr, u64 regs, int n)
 	}
 	else if((adr & 0x0F000000) == 0x02000000)
 	{
+		if(store)
+			MMU_GuardSPUCoreWrite((dir>0) ? adr : (adr - (n-1)*4), n*4);
 		ptr = MMU.MAIN_MEM + (adr & _MMU_MAIN_MEM_MASK32);
 		cycles = n * ((PROCNUM==ARMCPU_ARM9) ? 4 : 2);
 	}
@@ -4257,6 +4259,7 @@ template<int PROCNUM> u32 arm_jit_compile()
 	}
 	recompile_counts[mask_adr >> 1] += 1 << 4*(mask_adr & 1);
 
+	NDSPerfTimer perfTimer(NDS_PERF_JIT_COMPILE_NS);
 	return compile_basicblock<PROCNUM>();
 }
 
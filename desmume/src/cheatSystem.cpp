@@ -24,6 +24,14 @@
 #include "debug.h"
 #include "emufile.h"
 
+#ifdef HAVE_JIT
+#include "arm_jit.h"
+#endif
+
+#include <algorithm>
+#include <chrono>
+#include <sys/stat.h>
+
 #ifndef _MSC_VER 
 #include <stdint.h>
 #endif
@@ -35,6 +43,9 @@ CHEATSEARCH *cheatSearch = NULL;
 
 static bool cheatsResetJit = false;
 
+// Main RAM ranges that the running cheats changed, for invalidating just those JIT blocks afterwards.
+static std::vector< std::pair<u32, u32> > cheatsWrittenRanges;
+
 void CHEATS::clear()
 {
 	this->_list.resize(0);
@@ -170,7 +181,10 @@ bool CHEATS::DirectWrite(const size_t newValueLength, const int targetProc, cons
 	return false;
 }
 
-bool CHEATS::ARparser(const CHEATS_LIST &theList)
+// Runs an Action Replay code that was decoded by CHEATS_COMPILED::compile(). All memory writes go
+// through the sink, so the same interpreter both runs cheats and records their writes at compile time.
+template <typename WRITESINK>
+static bool CHEATS_RunAR(const CHEATS_COMPILED &theCode, WRITESINK &sink)
 {
 	//primary organizational source (seems to be referenced by cheaters the most) - http://doc.kodewerx.org/hacking_nds.html
 	//secondary clarification and details (for programmers) - http://problemkaputt.de/gbatek.htm#dscartcheatactionreplayds
@@ -217,19 +231,18 @@ bool CHEATS::ARparser(const CHEATS_LIST &theList)
 
 	CHEATLOG("-----------------------------------\n");
 
-	for (u32 i = 0; i < theList.num; i++)
+	const u32 num = (u32)theCode.op.size();
+	for (u32 i = 0; i < num; i++)
 	{
 		bool shouldResetJit = false;
-		const u32 hi = theList.code[i][0];
-		const u32 lo = theList.code[i][1];
+		const CHEATS_COMPILED_OP &op = theCode.op[i];
+		const u32 hi = op.hi;
+		const u32 lo = op.lo;
 
 		CHEATLOG("executing [%02d] %08X %08X (ofs=%08X)\n",i, hi,lo, st.offset);
 
-		//parse codes into types by kodewerx standards
-		u32 type = theList.code[i][0] >> 28;
-		//these two are broken down into subtypes
-		if(type == 0x0C || type == 0x0D)
-			type = theList.code[i][0] >> 24;
+		//codes were parsed into types by kodewerx standards when compiled
+		const u32 type = op.type;
 
 		//process current execution status:
 		u32 statusSkip = st.status & 1;
@@ -275,7 +288,7 @@ bool CHEATS::ARparser(const CHEATS_LIST &theList)
 			x = hi & 0x0FFFFFFF;
 			y = lo;
 			addr = x + st.offset;
-			shouldResetJit = CHEATS::DirectWrite<4>(st.proc, addr, y);
+			shouldResetJit |= sink.write(st.proc, addr, y, 4);
 			break;
 		
 		case 0x01:
@@ -285,7 +298,7 @@ bool CHEATS::ARparser(const CHEATS_LIST &theList)
 			x = hi & 0x0FFFFFFF;
 			y = lo & 0xFFFF;
 			addr = x + st.offset;
-			shouldResetJit = CHEATS::DirectWrite<2>(st.proc, addr, y);
+			shouldResetJit |= sink.write(st.proc, addr, y, 2);
 			break;
 
 		case 0x02:
@@ -295,7 +308,7 @@ bool CHEATS::ARparser(const CHEATS_LIST &theList)
 			x = hi & 0x0FFFFFFF;
 			y = lo & 0xFF;
 			addr = x + st.offset;
-			shouldResetJit = CHEATS::DirectWrite<1>(st.proc, addr, y);
+			shouldResetJit |= sink.write(st.proc, addr, y, 1);
 			break;
 
 		case 0x03:
@@ -445,7 +458,7 @@ bool CHEATS::ARparser(const CHEATS_LIST &theList)
 			//<gbatek> C6000000 XXXXXXXX   [XXXXXXXX]=offset  
 			if(!v154) break;
 			x = lo;
-			shouldResetJit = CHEATS::DirectWrite<4>(st.proc, x, st.offset);
+			shouldResetJit |= sink.write(st.proc, x, st.offset, 4);
 			break;
 
 		case 0xD0:
@@ -526,7 +539,7 @@ bool CHEATS::ARparser(const CHEATS_LIST &theList)
 			//<gbatek> word[XXXXXXXX+offset]=datareg, offset=offset+4
 			x = lo;
 			addr = x + st.offset;
-			shouldResetJit = CHEATS::DirectWrite<4>(st.proc, addr, st.data);
+			shouldResetJit |= sink.write(st.proc, addr, st.data, 4);
 			st.offset += 4;
 			break;
 
@@ -537,7 +550,7 @@ bool CHEATS::ARparser(const CHEATS_LIST &theList)
 			//<gbatek> half[XXXXXXXX+offset]=datareg, offset=offset+2
 			x = lo;
 			addr = x + st.offset;
-			shouldResetJit = CHEATS::DirectWrite<2>(st.proc, addr, st.data);
+			shouldResetJit |= sink.write(st.proc, addr, st.data, 2);
 			st.offset += 2;
 			break;
 
@@ -548,7 +561,7 @@ bool CHEATS::ARparser(const CHEATS_LIST &theList)
 			//<gbatek> byte[XXXXXXXX+offset]=datareg, offset=offset+1
 			x = lo;
 			addr = x + st.offset;
-			shouldResetJit = CHEATS::DirectWrite<1>(st.proc, addr, st.data);
+			shouldResetJit |= sink.write(st.proc, addr, st.data, 1);
 			st.offset += 1;
 			break;
 
@@ -614,35 +627,15 @@ bool CHEATS::ARparser(const CHEATS_LIST &theList)
 			y = lo;
 			addr = x + st.offset;
 
+			//the parameter bytes were already gathered up by CHEATS_COMPILED::compile()
+			for (u32 p = 0; p < op.patchCount; p++)
 			{
-				u32 t = 0;
-				u32 b = 0;
-				
-				if(y>0) i++; //skip over the current code
-				while(y>=4)
-				{
-					if (i == theList.num) break; //if we erroneously went off the end, bail
-					u32 tmp = theList.code[i][t];
-					if (t == 1) i++;
-					t ^= 1;
-					shouldResetJit = CHEATS::DirectWrite<4>(st.proc, addr, tmp);
-					addr += 4;
-					y -= 4;
-				}
-				while(y>0)
-				{
-					if (i == theList.num) break; //if we erroneously went off the end, bail
-					u32 tmp = theList.code[i][t]>>b;
-					shouldResetJit = CHEATS::DirectWrite<1>(st.proc, addr, tmp);
-					addr += 1;
-					y -= 1;
-					b += 4;
-				}
-
-				//the main loop will increment to the next cheat, but the loop above may have gone one too far
-				if(t==0)
-					i--;
+				const CHEATS_COMPILED_WRITE &patch = theCode.write[op.patchFirst + p];
+				shouldResetJit |= sink.write(st.proc, addr + patch.address, patch.value, patch.length);
 			}
+
+			//the main loop will increment to the next cheat
+			i = op.patchNext;
 			break;
 
 		case 0x0F:
@@ -657,18 +650,18 @@ bool CHEATS::ARparser(const CHEATS_LIST &theList)
 			operand = x; //mis-use of this variable to store dst
 			while(y>=4)
 			{
-				if (i == theList.num) break; //if we erroneously went off the end, bail
+				if (i == num) break; //if we erroneously went off the end, bail
 				u32 tmp = _MMU_read32(st.proc,MMU_AT_DEBUG,addr);
-				shouldResetJit = CHEATS::DirectWrite<4>(st.proc, operand, tmp);
+				shouldResetJit |= sink.write(st.proc, operand, tmp, 4);
 				addr += 4;
 				operand += 4;
 				y -= 4;
 			}
 			while(y>0)
 			{
-				if (i == theList.num) break; //if we erroneously went off the end, bail
+				if (i == num) break; //if we erroneously went off the end, bail
 				u8 tmp = _MMU_read08(st.proc,MMU_AT_DEBUG,addr);
-				shouldResetJit = CHEATS::DirectWrite<1>(st.proc, operand, tmp);
+				shouldResetJit |= sink.write(st.proc, operand, tmp, 1);
 				addr += 1;
 				operand += 1;
 				y -= 1;
@@ -689,6 +682,234 @@ bool CHEATS::ARparser(const CHEATS_LIST &theList)
 	return needsJitReset;
 }
 
+// Performs cheat writes on the emulated memory.
+class CHEATS_DirectWriteSink
+{
+public:
+	bool write(const int proc, const u32 addr, const u32 value, const size_t length)
+	{
+		const bool didChangeMainMemory = CHEATS::DirectWrite(length, proc, addr, value);
+		if (didChangeMainMemory)
+		{
+			cheatsWrittenRanges.push_back( std::make_pair(addr, addr + (u32)length) );
+		}
+		
+		return didChangeMainMemory;
+	}
+};
+
+// Records cheat writes without performing them, for turning a cheat into a write list.
+class CHEATS_RecordWriteSink
+{
+public:
+	std::vector<CHEATS_COMPILED_WRITE> &list;
+	
+	CHEATS_RecordWriteSink(std::vector<CHEATS_COMPILED_WRITE> &theList) : list(theList) {}
+	
+	bool write(const int proc, const u32 addr, const u32 value, const size_t length)
+	{
+		CHEATS_COMPILED_WRITE w;
+		w.address = addr;
+		w.value = value;
+		w.length = (u8)length;
+		w.proc = (u8)proc;
+		this->list.push_back(w);
+		
+		return false;
+	}
+};
+
+// Any cheat made only of these code types writes the same values to the same addresses every time it
+// runs, since none of them read emulated memory. Such cheats are run once at compile time, and their
+// writes are then simply replayed.
+static bool CHEATS_IsConstantWriteType(const u8 type)
+{
+	switch (type)
+	{
+		case 0x00: case 0x01: case 0x02: case 0x0E:
+		case 0xC6:
+		case 0xD0: case 0xD2: case 0xD3: case 0xD4: case 0xD5:
+		case 0xD6: case 0xD7: case 0xD8: case 0xDC: case 0xDF:
+			return true;
+			
+		default:
+			break;
+	}
+	
+	return false;
+}
+
+#define CHEATS_COMPILED_MAX_WRITES 1024
+
+CHEATS_COMPILED::CHEATS_COMPILED()
+{
+	type = 0xFF;
+	size = 0;
+	num = 0;
+	isWriteList = false;
+	lastNanoseconds = 0;
+	totalNanoseconds = 0;
+	runCount = 0;
+}
+
+bool CHEATS_COMPILED::isCompiledFrom(const CHEATS_LIST &cheat) const
+{
+	if ( (cheat.type != this->type) || (cheat.size != this->size) || (cheat.num != this->num) )
+		return false;
+	
+	const size_t codeCount = (cheat.num > MAX_XX_CODE) ? MAX_XX_CODE : cheat.num;
+	if (this->source.size() != codeCount * 2)
+		return false;
+	
+	return (codeCount == 0) || (memcmp(&this->source[0], cheat.code, codeCount * 2 * sizeof(u32)) == 0);
+}
+
+void CHEATS_COMPILED::compile(const CHEATS_LIST &cheat)
+{
+	const u32 codeCount = (cheat.num > MAX_XX_CODE) ? MAX_XX_CODE : cheat.num;
+	
+	this->type = cheat.type;
+	this->size = cheat.size;
+	this->num = cheat.num;
+	this->source.assign(&cheat.code[0][0], &cheat.code[0][0] + codeCount * 2);
+	this->isWriteList = false;
+	this->op.clear();
+	this->write.clear();
+	this->lastNanoseconds = 0;
+	this->totalNanoseconds = 0;
+	this->runCount = 0;
+	
+	if (cheat.type == CHEAT_TYPE_INTERNAL)
+	{
+		CHEATS_COMPILED_WRITE w;
+		w.address = cheat.code[0][0];
+		w.value = cheat.code[0][1];
+		w.length = cheat.size + 1;
+		w.proc = ARMCPU_ARM9;
+		this->write.push_back(w);
+		this->isWriteList = true;
+		return;
+	}
+	
+	if (cheat.type != CHEAT_TYPE_AR)
+	{
+		return;
+	}
+	
+	bool isConstant = true;
+	
+	for (u32 i = 0; i < codeCount; i++)
+	{
+		CHEATS_COMPILED_OP newOp;
+		newOp.hi = cheat.code[i][0];
+		newOp.lo = cheat.code[i][1];
+		newOp.patchFirst = 0;
+		newOp.patchCount = 0;
+		newOp.patchNext = i;
+		
+		//parse codes into types by kodewerx standards
+		newOp.type = newOp.hi >> 28;
+		//these two are broken down into subtypes
+		if (newOp.type == 0x0C || newOp.type == 0x0D)
+			newOp.type = newOp.hi >> 24;
+		
+		isConstant = isConstant && CHEATS_IsConstantWriteType(newOp.type);
+		this->op.push_back(newOp);
+	}
+	
+	// Gather the parameter bytes of the E codes now, the same way that they are copied by the Action Replay.
+	for (u32 i = 0; i < codeCount; i++)
+	{
+		CHEATS_COMPILED_OP &patchOp = this->op[i];
+		if (patchOp.type != 0x0E)
+			continue;
+		
+		u32 line = i;
+		u32 y = patchOp.lo;
+		u32 addr = 0;
+		u32 t = 0;
+		u32 b = 0;
+		
+		patchOp.patchFirst = (u32)this->write.size();
+		
+		if (y == 0)
+		{
+			//nothing to copy, so just continue with the next code
+			continue;
+		}
+		
+		line++; //skip over the current code
+		while (y >= 4)
+		{
+			if (line == codeCount) break; //if we erroneously went off the end, bail
+			CHEATS_COMPILED_WRITE w = { addr, cheat.code[line][t], 4, 0 };
+			if (t == 1) line++;
+			t ^= 1;
+			this->write.push_back(w);
+			addr += 4;
+			y -= 4;
+		}
+		while (y > 0)
+		{
+			if (line == codeCount) break; //if we erroneously went off the end, bail
+			CHEATS_COMPILED_WRITE w = { addr, cheat.code[line][t] >> b, 1, 0 };
+			this->write.push_back(w);
+			addr += 1;
+			y -= 1;
+			b += 4;
+		}
+		
+		//the main loop will increment to the next cheat, but the loop above may have gone one too far
+		if (t == 0)
+			line--;
+		
+		patchOp.patchCount = (u32)this->write.size() - patchOp.patchFirst;
+		patchOp.patchNext = line;
+	}
+	
+	if (isConstant)
+	{
+		std::vector<CHEATS_COMPILED_WRITE> writeList;
+		CHEATS_RecordWriteSink recorder(writeList);
+		CHEATS_RunAR(*this, recorder);
+		
+		if (writeList.size() <= CHEATS_COMPILED_MAX_WRITES)
+		{
+			this->op.clear();
+			this->write = writeList;
+			this->isWriteList = true;
+		}
+	}
+}
+
+bool CHEATS_COMPILED::run() const
+{
+	CHEATS_DirectWriteSink sink;
+	
+	if (!this->isWriteList)
+	{
+		return (this->type == CHEAT_TYPE_AR) ? CHEATS_RunAR(*this, sink) : false;
+	}
+	
+	bool didChangeMainMemory = false;
+	const size_t writeCount = this->write.size();
+	for (size_t i = 0; i < writeCount; i++)
+	{
+		const CHEATS_COMPILED_WRITE &w = this->write[i];
+		didChangeMainMemory |= sink.write(w.proc, w.address, w.value, w.length);
+	}
+	
+	return didChangeMainMemory;
+}
+
+bool CHEATS::ARparser(const CHEATS_LIST &theList)
+{
+	CHEATS_COMPILED compiledCode;
+	compiledCode.compile(theList);
+	
+	return compiledCode.run();
+}
+
 size_t CHEATS::add_AR_Direct(const CHEATS_LIST &srcCheat)
 {
 	const size_t itemIndex = this->addItem(srcCheat);
@@ -1144,7 +1365,7 @@ bool CHEATS::load()
 	return didLoadAllItems;
 }
 
-bool CHEATS::process(int targetType) const
+bool CHEATS::process(int targetType)
 {
 	bool needsJitReset = false;
 	
@@ -1152,6 +1373,11 @@ bool CHEATS::process(int targetType) const
 		return needsJitReset;
 	
 	size_t num = this->_list.size();
+	if (this->_compiled.size() != num)
+	{
+		this->_compiled.resize(num);
+	}
+	
 	for (size_t i = 0; i < num; i++)
 	{
 		bool shouldResetJit = false;
@@ -1167,13 +1393,34 @@ bool CHEATS::process(int targetType) const
 		switch (type)
 		{
 			case CHEAT_TYPE_INTERNAL:
-				//INFO("list at 0x0|%07X value %i (size %i)\n",list[i].code[0], list[i].lo[0], list[i].size);
-				shouldResetJit = CHEATS::DirectWrite(this->_list[i].size + 1, ARMCPU_ARM9, this->_list[i].code[0][0], this->_list[i].code[0][1]);
-				break;
-				
 			case CHEAT_TYPE_AR:
-				shouldResetJit = CHEATS::ARparser(this->_list[i]);
+			{
+				// Cheats are only compiled again after they change, so the codes aren't parsed every frame.
+				CHEATS_COMPILED &compiledCode = this->_compiled[i];
+				if (!compiledCode.isCompiledFrom(this->_list[i]))
+				{
+					compiledCode.compile(this->_list[i]);
+				}
+				
+				// Each cheat is only timed while the performance counters are on, so the clock isn't read
+				// twice per cheat every frame otherwise.
+				if (nds_perfCountersEnabled)
+				{
+					const u64 startTime = NDS_GetPerfTime();
+					shouldResetJit = compiledCode.run();
+					const u64 elapsedNanoseconds = NDS_GetPerfTime() - startTime;
+					
+					compiledCode.lastNanoseconds = elapsedNanoseconds;
+					compiledCode.totalNanoseconds += elapsedNanoseconds;
+					compiledCode.runCount++;
+					NDS_PERF_ADD(NDS_PERF_CHEATS_NS, elapsedNanoseconds);
+				}
+				else
+				{
+					shouldResetJit = compiledCode.run();
+				}
 				break;
+			}
 				
 			case CHEAT_TYPE_CODEBREAKER:
 				break;
@@ -1190,12 +1437,70 @@ bool CHEATS::process(int targetType) const
 	
 	if (needsJitReset)
 	{
-		CHEATS::JitNeedsReset();
+		CHEATS::InvalidateJitForWrites();
 	}
+	cheatsWrittenRanges.clear();
 	
 	return needsJitReset;
 }
 
+bool CHEATS::getExecutionTime(const size_t pos, double &outLastMicroseconds, double &outAverageMicroseconds) const
+{
+	if ( (pos >= this->_compiled.size()) || (this->_compiled[pos].runCount == 0) )
+	{
+		return false;
+	}
+	
+	const CHEATS_COMPILED &compiledCode = this->_compiled[pos];
+	outLastMicroseconds = (double)compiledCode.lastNanoseconds / 1000.0;
+	outAverageMicroseconds = ((double)compiledCode.totalNanoseconds / (double)compiledCode.runCount) / 1000.0;
+	
+	return true;
+}
+
+void CHEATS::InvalidateJitForWrites()
+{
+#ifdef HAVE_JIT
+	if (!CommonSettings.use_jit || cheatsWrittenRanges.empty())
+	{
+		return;
+	}
+	
+	// A compiled block can start up to one maximum sized block before the written address, so each
+	// range is widened backwards by that much.
+	const u32 maxBlockSize = std::max<u32>(CommonSettings.jit_max_block_size, saveBlockSizeJIT);
+	const u32 lookBehind = maxBlockSize * 4;
+	
+	std::sort(cheatsWrittenRanges.begin(), cheatsWrittenRanges.end());
+	
+	u32 invalidatedEnd = 0x02000000;
+	for (size_t i = 0; i < cheatsWrittenRanges.size(); i++)
+	{
+		u32 start = cheatsWrittenRanges[i].first & ~1;
+		u32 end = std::min<u32>(cheatsWrittenRanges[i].second, 0x02000000 + _MMU_MAIN_MEM_MASK + 1);
+		
+		start = (start - 0x02000000 > lookBehind) ? start - lookBehind : 0x02000000;
+		if (start < invalidatedEnd)
+		{
+			start = invalidatedEnd;
+		}
+		
+		for (u32 adr = start; adr < end; adr += 2)
+		{
+			if (JIT_MAPPED(adr, ARMCPU_ARM9))
+				JIT_COMPILED_FUNC(adr, ARMCPU_ARM9) = 0;
+			if (JIT_MAPPED(adr, ARMCPU_ARM7))
+				JIT_COMPILED_FUNC(adr, ARMCPU_ARM7) = 0;
+		}
+		
+		if (end > invalidatedEnd)
+		{
+			invalidatedEnd = end;
+		}
+	}
+#endif
+}
+
 void CHEATS::JitNeedsReset()
 {
 	cheatsResetJit = true;
@@ -1317,253 +1622,489 @@ bool CHEATS::XXCodeFromString(const char *codeString, CHEATS_LIST &outCheatItem)
 }
 
 // ========================================== search
-bool CHEATSEARCH::start(u8 type, u8 size, u8 sign)
+// The search kernels compare 64 values at a time, which is one word of the candidate bitmap.
+#define CHEATSEARCH_BLOCK_VALUES 64
+
+static u32 CHEATSEARCH_CountBits(u64 bits)
 {
-	bool didStartSearch = false;
+	bits = bits - ((bits >> 1) & 0x5555555555555555ULL);
+	bits = (bits & 0x3333333333333333ULL) + ((bits >> 2) & 0x3333333333333333ULL);
+	bits = (bits + (bits >> 4)) & 0x0F0F0F0F0F0F0F0FULL;
+	return (u32)((bits * 0x0101010101010101ULL) >> 56);
+}
 
-	if ( (this->_statMem != NULL) || (this->_mem != NULL) )
+template <size_t ELEMENTSIZE, bool SIGNED>
+static FORCEINLINE s64 CHEATSEARCH_ReadValue(const u8 *mem)
+{
+	switch (ELEMENTSIZE)
 	{
-		// If these buffers exist, then that implies that a search is already
-		// in progress. However, the existing code design is such that a
-		// CHEATSEARCH object may only have one search in progress at a time.
-		return didStartSearch;
+		case 1: return (SIGNED) ? (s64)(s8)T1ReadByte((u8 *)mem, 0) : (s64)T1ReadByte((u8 *)mem, 0);
+		case 2: return (SIGNED) ? (s64)(s16)T1ReadWord((u8 *)mem, 0) : (s64)T1ReadWord((u8 *)mem, 0);
+		case 3:
+		{
+			const u32 value = (u32)T1ReadByte((u8 *)mem, 0) | ((u32)T1ReadByte((u8 *)mem, 1) << 8) | ((u32)T1ReadByte((u8 *)mem, 2) << 16);
+			return (SIGNED) ? (s64)((s32)(value << 8) >> 8) : (s64)value;
+		}
+		default: return (SIGNED) ? (s64)(s32)T1ReadLong((u8 *)mem, 0) : (s64)T1ReadLong((u8 *)mem, 0);
 	}
-
-	this->_statMem = new u8 [ ( 4 * 1024 * 1024 ) / 8 ];
-	memset(this->_statMem, 0xFF, ( 4 * 1024 * 1024 ) / 8);
-
-	// comparative search type (need 8Mb RAM !!! (4+4))
-	this->_mem = new u8 [ ( 4 * 1024 * 1024 ) ];
-	memcpy(this->_mem, MMU.MMU_MEM[0][0x20], ( 4 * 1024 * 1024 ) );
-
-	this->_type = type;
-	this->_size = size;
-	this->_sign = sign;
-	this->_amount = 0;
-	this->_lastRecord = 0;
-	
-	//INFO("Cheat search system is inited (type %s)\n", type?"comparative":"exact");
-	didStartSearch = true;
-	return didStartSearch;
 }
 
-void CHEATSEARCH::close()
+template <size_t ELEMENTSIZE, bool SIGNED>
+static FORCEINLINE s64 CHEATSEARCH_ConvertValue(const u32 val)
 {
-	if (this->_statMem != NULL)
+	switch (ELEMENTSIZE)
 	{
-		delete [] this->_statMem;
-		this->_statMem = NULL;
+		case 1: return (SIGNED) ? (s64)(s8)val : (s64)(u8)val;
+		case 2: return (SIGNED) ? (s64)(s16)val : (s64)(u16)val;
+		case 3: return (SIGNED) ? (s64)((s32)(val << 8) >> 8) : (s64)(val & 0x00FFFFFF);
+		default: return (SIGNED) ? (s64)(s32)val : (s64)val;
 	}
+}
 
-	if (this->_mem != NULL)
+template <int COMPARE>
+static FORCEINLINE bool CHEATSEARCH_ComparePasses(const s64 curValue, const s64 refValue)
+{
+	switch (COMPARE)
 	{
-		delete [] this->_mem;
-		this->_mem = NULL;
+		case CHEATSEARCH_COMPARE_GREATER:  return (curValue > refValue);
+		case CHEATSEARCH_COMPARE_LESS:     return (curValue < refValue);
+		case CHEATSEARCH_COMPARE_EQUAL:    return (curValue == refValue);
+		case CHEATSEARCH_COMPARE_NOTEQUAL: return (curValue != refValue);
+		default: return false;
 	}
-
-	this->_amount = 0;
-	this->_lastRecord = 0;
-	//INFO("Cheat search system is closed\n");
 }
 
-u32 CHEATSEARCH::search(u32 val)
+// Compares the values one at a time. refMem is NULL when comparing against val.
+template <size_t ELEMENTSIZE, bool SIGNED, int COMPARE>
+static FORCEINLINE u64 CHEATSEARCH_CompareValues(const u8 *curMem, const u8 *refMem, const s64 refValue, const size_t valueCount)
 {
-	this->_amount = 0;
-
-	switch (this->_size)
+	u64 passed = 0;
+	
+	for (size_t i = 0; i < valueCount; i++)
 	{
-		case 0:		// 1 byte
-			for (u32 i = 0; i < (4 * 1024 * 1024); i++)
-			{
-				u32	addr = (i >> 3);
-				u32	offs = (i % 8);
-				if (this->_statMem[addr] & (1<<offs))
-				{
-					if ( T1ReadByte(MMU.MMU_MEM[ARMCPU_ARM9][0x20], i) == val )
-					{
-						this->_statMem[addr] |= (1<<offs);
-						this->_amount++;
-						continue;
-					}
-					this->_statMem[addr] &= ~(1<<offs);
-				}
-			}
-		break;
-
-		case 1:		// 2 bytes
-			for (u32 i = 0; i < (4 * 1024 * 1024); i+=2)
-			{
-				u32	addr = (i >> 3);
-				u32	offs = (i % 8);
-				if (this->_statMem[addr] & (3<<offs))
-				{
-					if ( T1ReadWord(MMU.MMU_MEM[ARMCPU_ARM9][0x20], i) == val )
-					{
-						this->_statMem[addr] |= (3<<offs);
-						this->_amount++;
-						continue;
-					}
-					this->_statMem[addr] &= ~(3<<offs);
-				}
-			}
-		break;
+		const s64 curValue = CHEATSEARCH_ReadValue<ELEMENTSIZE, SIGNED>(curMem + (i * ELEMENTSIZE));
+		const s64 otherValue = (refMem != NULL) ? CHEATSEARCH_ReadValue<ELEMENTSIZE, SIGNED>(refMem + (i * ELEMENTSIZE)) : refValue;
+		
+		if (CHEATSEARCH_ComparePasses<COMPARE>(curValue, otherValue))
+		{
+			passed |= (1ULL << i);
+		}
+	}
+	
+	return passed;
+}
 
-		case 2:		// 3 bytes
-			for (u32 i = 0; i < (4 * 1024 * 1024); i+=3)
-			{
-				u32	addr = (i >> 3);
-				u32	offs = (i % 8);
-				if (this->_statMem[addr] & (0x7<<offs))
-				{
-					if ( (T1ReadLong(MMU.MMU_MEM[ARMCPU_ARM9][0x20], i) & 0x00FFFFFF) == val )
-					{
-						this->_statMem[addr] |= (0x7<<offs);
-						this->_amount++;
-						continue;
-					}
-					this->_statMem[addr] &= ~(0x7<<offs);
-				}
-			}
-		break;
+#ifdef ENABLE_SSE2
 
-		case 3:		// 4 bytes
-			for (u32 i = 0; i < (4 * 1024 * 1024); i+=4)
-			{
-				u32	addr = (i >> 3);
-				u32	offs = (i % 8);
-				if (this->_statMem[addr] & (0xF<<offs))
-				{
-					if ( T1ReadLong(MMU.MMU_MEM[ARMCPU_ARM9][0x20], i) == val )
-					{
-						this->_statMem[addr] |= (0xF<<offs);
-						this->_amount++;
-						continue;
-					}
-					this->_statMem[addr] &= ~(0xF<<offs);
-				}
-			}
-		break;
+template <size_t ELEMENTSIZE, bool SIGNED, int COMPARE>
+static FORCEINLINE __m128i CHEATSEARCH_Compare_SSE2(__m128i curVec, __m128i refVec)
+{
+	if ( (COMPARE == CHEATSEARCH_COMPARE_EQUAL) || (COMPARE == CHEATSEARCH_COMPARE_NOTEQUAL) )
+	{
+		// NOTEQUAL is done by inverting the result bits afterwards.
+		switch (ELEMENTSIZE)
+		{
+			case 1: return _mm_cmpeq_epi8(curVec, refVec);
+			case 2: return _mm_cmpeq_epi16(curVec, refVec);
+			default: return _mm_cmpeq_epi32(curVec, refVec);
+		}
+	}
+	
+	// SSE2 only has signed comparisons, so unsigned values are compared with their top bits flipped.
+	if (!SIGNED)
+	{
+		const __m128i signBit = (ELEMENTSIZE == 1) ? _mm_set1_epi8((char)0x80) : ((ELEMENTSIZE == 2) ? _mm_set1_epi16((short)0x8000) : _mm_set1_epi32((int)0x80000000));
+		curVec = _mm_xor_si128(curVec, signBit);
+		refVec = _mm_xor_si128(refVec, signBit);
+	}
+	
+	if (COMPARE == CHEATSEARCH_COMPARE_LESS)
+	{
+		const __m128i swapVec = curVec;
+		curVec = refVec;
+		refVec = swapVec;
+	}
+	
+	switch (ELEMENTSIZE)
+	{
+		case 1: return _mm_cmpgt_epi8(curVec, refVec);
+		case 2: return _mm_cmpgt_epi16(curVec, refVec);
+		default: return _mm_cmpgt_epi32(curVec, refVec);
 	}
-
-	return this->_amount;
 }
 
-u32 CHEATSEARCH::search(u8 comp)
+template <size_t ELEMENTSIZE, bool SIGNED, int COMPARE>
+static FORCEINLINE __m128i CHEATSEARCH_CompareAt_SSE2(const u8 *curMem, const u8 *refMem, const __m128i refValueVec, const size_t i)
 {
-	bool didComparePass = false;
+	const __m128i curVec = _mm_loadu_si128((const __m128i *)(curMem + (i * 16)));
+	const __m128i refVec = (refMem != NULL) ? _mm_loadu_si128((const __m128i *)(refMem + (i * 16))) : refValueVec;
+	
+	return CHEATSEARCH_Compare_SSE2<ELEMENTSIZE, SIGNED, COMPARE>(curVec, refVec);
+}
 
-	this->_amount = 0;
+// Compares 64 values. The comparison results are packed down to one byte per value, so that
+// _mm_movemask_epi8() gathers 16 of them at once.
+template <size_t ELEMENTSIZE, bool SIGNED, int COMPARE>
+static FORCEINLINE u64 CHEATSEARCH_CompareBlock(const u8 *curMem, const u8 *refMem, const u32 val)
+{
+	__m128i refValueVec;
+	switch (ELEMENTSIZE)
+	{
+		case 1: refValueVec = _mm_set1_epi8((char)val); break;
+		case 2: refValueVec = _mm_set1_epi16((short)val); break;
+		default: refValueVec = _mm_set1_epi32((int)val); break;
+	}
+	
+	u64 passed = 0;
 	
-	switch (this->_size)
+	for (size_t i = 0; i < 4; i++)
 	{
-		case 0:		// 1 byte
-			for (u32 i = 0; i < (4 * 1024 * 1024); i++)
-			{
-				u32	addr = (i >> 3);
-				u32	offs = (i % 8);
-				if (this->_statMem[addr] & (1<<offs))
-				{
-					switch (comp)
-					{
-						case 0: didComparePass = (T1ReadByte(MMU.MMU_MEM[ARMCPU_ARM9][0x20], i) > T1ReadByte(this->_mem, i)); break;
-						case 1: didComparePass = (T1ReadByte(MMU.MMU_MEM[ARMCPU_ARM9][0x20], i) < T1ReadByte(this->_mem, i)); break;
-						case 2: didComparePass = (T1ReadByte(MMU.MMU_MEM[ARMCPU_ARM9][0x20], i) == T1ReadByte(this->_mem, i)); break;
-						case 3: didComparePass = (T1ReadByte(MMU.MMU_MEM[ARMCPU_ARM9][0x20], i) != T1ReadByte(this->_mem, i)); break;
-						default: didComparePass = false; break;
-					}
-					if (didComparePass)
-					{
-						this->_statMem[addr] |= (1<<offs);
-						this->_amount++;
-						continue;
-					}
-					this->_statMem[addr] &= ~(1<<offs);
-				}
-			}
-		break;
-
-		case 1:		// 2 bytes
-			for (u32 i = 0; i < (4 * 1024 * 1024); i+=2)
-			{
-				u32	addr = (i >> 3);
-				u32	offs = (i % 8);
-				if (this->_statMem[addr] & (3<<offs))
-				{
-					switch (comp)
-					{
-						case 0: didComparePass = (T1ReadWord(MMU.MMU_MEM[ARMCPU_ARM9][0x20], i) > T1ReadWord(this->_mem, i)); break;
-						case 1: didComparePass = (T1ReadWord(MMU.MMU_MEM[ARMCPU_ARM9][0x20], i) < T1ReadWord(this->_mem, i)); break;
-						case 2: didComparePass = (T1ReadWord(MMU.MMU_MEM[ARMCPU_ARM9][0x20], i) == T1ReadWord(this->_mem, i)); break;
-						case 3: didComparePass = (T1ReadWord(MMU.MMU_MEM[ARMCPU_ARM9][0x20], i) != T1ReadWord(this->_mem, i)); break;
-						default: didComparePass = false; break;
-					}
-					if (didComparePass)
-					{
-						this->_statMem[addr] |= (3<<offs);
-						this->_amount++;
-						continue;
-					}
-					this->_statMem[addr] &= ~(3<<offs);
-				}
+		__m128i result;
+		
+		switch (ELEMENTSIZE)
+		{
+			case 1:
+				result = CHEATSEARCH_CompareAt_SSE2<ELEMENTSIZE, SIGNED, COMPARE>(curMem, refMem, refValueVec, i);
+				break;
+				
+			case 2:
+				result = _mm_packs_epi16( CHEATSEARCH_CompareAt_SSE2<ELEMENTSIZE, SIGNED, COMPARE>(curMem, refMem, refValueVec, (i * 2) + 0),
+				                          CHEATSEARCH_CompareAt_SSE2<ELEMENTSIZE, SIGNED, COMPARE>(curMem, refMem, refValueVec, (i * 2) + 1) );
+				break;
+				
+			default:
+				result = _mm_packs_epi16( _mm_packs_epi32(CHEATSEARCH_CompareAt_SSE2<ELEMENTSIZE, SIGNED, COMPARE>(curMem, refMem, refValueVec, (i * 4) + 0),
+				                                          CHEATSEARCH_CompareAt_SSE2<ELEMENTSIZE, SIGNED, COMPARE>(curMem, refMem, refValueVec, (i * 4) + 1)),
+				                          _mm_packs_epi32(CHEATSEARCH_CompareAt_SSE2<ELEMENTSIZE, SIGNED, COMPARE>(curMem, refMem, refValueVec, (i * 4) + 2),
+				                                          CHEATSEARCH_CompareAt_SSE2<ELEMENTSIZE, SIGNED, COMPARE>(curMem, refMem, refValueVec, (i * 4) + 3)) );
+				break;
+		}
+		
+		passed |= (u64)(u16)_mm_movemask_epi8(result) << (i * 16);
+	}
+	
+	return (COMPARE == CHEATSEARCH_COMPARE_NOTEQUAL) ? ~passed : passed;
+}
+
+#else
+
+template <size_t ELEMENTSIZE, bool SIGNED, int COMPARE>
+static FORCEINLINE u64 CHEATSEARCH_CompareBlock(const u8 *curMem, const u8 *refMem, const u32 val)
+{
+	return CHEATSEARCH_CompareValues<ELEMENTSIZE, SIGNED, COMPARE>(curMem, refMem, CHEATSEARCH_ConvertValue<ELEMENTSIZE, SIGNED>(val), CHEATSEARCH_BLOCK_VALUES);
+}
+
+#endif
+
+// Removes every candidate whose value doesn't pass the comparison, and returns how many remain.
+// Blocks without any candidates left are skipped entirely, so later searches get faster as the
+// candidates are narrowed down.
+template <size_t ELEMENTSIZE, bool SIGNED, int COMPARE>
+static u32 CHEATSEARCH_FilterCandidates(u64 *candidate, const size_t valueCount, const u8 *curMem, const u8 *refMem, const u32 val)
+{
+	const size_t fullBlockCount = valueCount / CHEATSEARCH_BLOCK_VALUES;
+	const size_t remainingValues = valueCount % CHEATSEARCH_BLOCK_VALUES;
+	const size_t blockBytes = ELEMENTSIZE * CHEATSEARCH_BLOCK_VALUES;
+	u32 amount = 0;
+	
+	for (size_t b = 0; b < fullBlockCount; b++)
+	{
+		if (candidate[b] == 0)
+			continue;
+		
+		// 3 byte values are never aligned to the vector lanes, so they are always compared one at a time.
+		if (ELEMENTSIZE == 3)
+		{
+			candidate[b] &= CHEATSEARCH_CompareValues<ELEMENTSIZE, SIGNED, COMPARE>(curMem + (b * blockBytes), (refMem != NULL) ? refMem + (b * blockBytes) : NULL, CHEATSEARCH_ConvertValue<ELEMENTSIZE, SIGNED>(val), CHEATSEARCH_BLOCK_VALUES);
+		}
+		else
+		{
+			candidate[b] &= CHEATSEARCH_CompareBlock<ELEMENTSIZE, SIGNED, COMPARE>(curMem + (b * blockBytes), (refMem != NULL) ? refMem + (b * blockBytes) : NULL, val);
+		}
+		
+		amount += CHEATSEARCH_CountBits(candidate[b]);
+	}
+	
+	if ( (remainingValues > 0) && (candidate[fullBlockCount] != 0) )
+	{
+		const size_t b = fullBlockCount;
+		candidate[b] &= CHEATSEARCH_CompareValues<ELEMENTSIZE, SIGNED, COMPARE>(curMem + (b * blockBytes), (refMem != NULL) ? refMem + (b * blockBytes) : NULL, CHEATSEARCH_ConvertValue<ELEMENTSIZE, SIGNED>(val), remainingValues);
+		amount += CHEATSEARCH_CountBits(candidate[b]);
+	}
+	
+	return amount;
+}
+
+template <size_t ELEMENTSIZE, bool SIGNED>
+static u32 CHEATSEARCH_FilterCandidates(u64 *candidate, const size_t valueCount, const u8 *curMem, const u8 *refMem, const u32 val, const u8 comp)
+{
+	switch (comp)
+	{
+		case CHEATSEARCH_COMPARE_GREATER:  return CHEATSEARCH_FilterCandidates<ELEMENTSIZE, SIGNED, CHEATSEARCH_COMPARE_GREATER>(candidate, valueCount, curMem, refMem, val);
+		case CHEATSEARCH_COMPARE_LESS:     return CHEATSEARCH_FilterCandidates<ELEMENTSIZE, SIGNED, CHEATSEARCH_COMPARE_LESS>(candidate, valueCount, curMem, refMem, val);
+		case CHEATSEARCH_COMPARE_EQUAL:    return CHEATSEARCH_FilterCandidates<ELEMENTSIZE, SIGNED, CHEATSEARCH_COMPARE_EQUAL>(candidate, valueCount, curMem, refMem, val);
+		case CHEATSEARCH_COMPARE_NOTEQUAL: return CHEATSEARCH_FilterCandidates<ELEMENTSIZE, SIGNED, CHEATSEARCH_COMPARE_NOTEQUAL>(candidate, valueCount, curMem, refMem, val);
+		default: break;
+	}
+	
+	// An unknown comparison never passes.
+	memset(candidate, 0, ((valueCount + CHEATSEARCH_BLOCK_VALUES - 1) / CHEATSEARCH_BLOCK_VALUES) * sizeof(u64));
+	return 0;
+}
+
+bool CHEATSEARCH::start(u8 type, u8 size, u8 sign)
+{
+	bool didStartSearch = false;
+
+	if (!this->_candidate.empty())
+	{
+		// If the candidates exist, then that implies that a search is already
+		// in progress. However, the existing code design is such that a
+		// CHEATSEARCH object may only have one search in progress at a time.
+		return didStartSearch;
+	}
+
+	if (size > 3)
+	{
+		return didStartSearch;
+	}
+
+	// Search all of the main RAM that the emulated console has, including the extra RAM of
+	// debug consoles and the DSi.
+	this->_regionSize = _MMU_MAIN_MEM_MASK + 1;
+	this->_type = type;
+	this->_size = size;
+	this->_sign = sign;
+	this->_amount = 0;
+	this->_lastRecord = 0;
+
+	const size_t valueCount = this->_regionSize / (this->_size + 1);
+	this->_candidate.assign((valueCount + CHEATSEARCH_BLOCK_VALUES - 1) / CHEATSEARCH_BLOCK_VALUES, ~0ULL);
+	if ((valueCount % CHEATSEARCH_BLOCK_VALUES) != 0)
+	{
+		this->_candidate.back() = (1ULL << (valueCount % CHEATSEARCH_BLOCK_VALUES)) - 1;
+	}
+
+	// comparative search type
+	this->_mem.assign(MMU.MAIN_MEM, MMU.MAIN_MEM + this->_regionSize);
+	
+	//INFO("Cheat search system is inited (type %s)\n", type?"comparative":"exact");
+	didStartSearch = true;
+	return didStartSearch;
+}
+
+void CHEATSEARCH::close()
+{
+	std::vector<u64>().swap(this->_candidate);
+	std::vector<u8>().swap(this->_mem);
+	this->_snapshot.clear();
+
+	this->_regionSize = 0;
+	this->_amount = 0;
+	this->_lastRecord = 0;
+	//INFO("Cheat search system is closed\n");
+}
+
+u32 CHEATSEARCH::_filter(const u8 *refMem, const u32 val, const u8 comp)
+{
+	if (this->_candidate.empty())
+	{
+		return 0;
+	}
+
+	const size_t valueCount = this->_regionSize / (this->_size + 1);
+	u64 *candidate = &this->_candidate[0];
+	const u8 *curMem = MMU.MAIN_MEM;
+
+	// A value that doesn't fit the element size lies above or below every element, so each comparison
+	// passes for all of the candidates or for none of them. (Truncating it would match the wrong values,
+	// e.g. a 1 byte search for 300 would find 44.)
+	if (refMem == NULL)
+	{
+		const u32 bits = (this->_size + 1) * 8;
+		const s64 minValue = (this->_sign != 0) ? -(1LL << (bits - 1)) : 0;
+		const s64 maxValue = (this->_sign != 0) ? ((1LL << (bits - 1)) - 1) : ((1LL << bits) - 1);
+		const s64 value = (this->_sign != 0) ? (s64)(s32)val : (s64)val;
+
+		if ( (value < minValue) || (value > maxValue) )
+		{
+			const bool passesAll = (comp == CHEATSEARCH_COMPARE_NOTEQUAL) ||
+			                       ((comp == CHEATSEARCH_COMPARE_GREATER) && (value < minValue)) ||
+			                       ((comp == CHEATSEARCH_COMPARE_LESS) && (value > maxValue));
+
+			this->_amount = 0;
+			for (size_t b = 0; b < this->_candidate.size(); b++)
+			{
+				if (!passesAll)
+					candidate[b] = 0;
+				this->_amount += CHEATSEARCH_CountBits(candidate[b]);
 			}
-		break;
 
-		case 2:		// 3 bytes
-			for (u32 i = 0; i < (4 * 1024 * 1024); i+=3)
+			return this->_amount;
+		}
+	}
+
+	switch ( (this->_size << 1) | ((this->_sign != 0) ? 1 : 0) )
+	{
+		case 0: this->_amount = CHEATSEARCH_FilterCandidates<1, false>(candidate, valueCount, curMem, refMem, val, comp); break;
+		case 1: this->_amount = CHEATSEARCH_FilterCandidates<1,  true>(candidate, valueCount, curMem, refMem, val, comp); break;
+		case 2: this->_amount = CHEATSEARCH_FilterCandidates<2, false>(candidate, valueCount, curMem, refMem, val, comp); break;
+		case 3: this->_amount = CHEATSEARCH_FilterCandidates<2,  true>(candidate, valueCount, curMem, refMem, val, comp); break;
+		case 4: this->_amount = CHEATSEARCH_FilterCandidates<3, false>(candidate, valueCount, curMem, refMem, val, comp); break;
+		case 5: this->_amount = CHEATSEARCH_FilterCandidates<3,  true>(candidate, valueCount, curMem, refMem, val, comp); break;
+		case 6: this->_amount = CHEATSEARCH_FilterCandidates<4, false>(candidate, valueCount, curMem, refMem, val, comp); break;
+		case 7: this->_amount = CHEATSEARCH_FilterCandidates<4,  true>(candidate, valueCount, curMem, refMem, val, comp); break;
+		default: break;
+	}
+
+	return this->_amount;
+}
+
+u32 CHEATSEARCH::search(u32 val)
+{
+	return this->_filter(NULL, val, CHEATSEARCH_COMPARE_EQUAL);
+}
+
+u32 CHEATSEARCH::search(u8 comp)
+{
+	if (this->_candidate.empty())
+	{
+		return 0;
+	}
+
+	this->_filter(&this->_mem[0], 0, comp);
+	memcpy(&this->_mem[0], MMU.MAIN_MEM, this->_regionSize);
+
+	return this->_amount;
+}
+
+u32 CHEATSEARCH::searchValue(u32 val, u8 comp)
+{
+	return this->_filter(NULL, val, comp);
+}
+
+u32 CHEATSEARCH::searchSnapshot(const char *name, u8 comp)
+{
+	std::map<std::string, std::vector<u8> >::const_iterator it = this->_snapshot.find( std::string(name) );
+	if ( (it == this->_snapshot.end()) || (it->second.size() != this->_regionSize) )
+	{
+		return 0;
+	}
+
+	return this->_filter(&it->second[0], 0, comp);
+}
+
+bool CHEATSEARCH::saveSnapshot(const char *name)
+{
+	if (this->_candidate.empty() || (name == NULL))
+	{
+		return false;
+	}
+
+	this->_snapshot[std::string(name)].assign(MMU.MAIN_MEM, MMU.MAIN_MEM + this->_regionSize);
+	return true;
+}
+
+bool CHEATSEARCH::removeSnapshot(const char *name)
+{
+	return (name != NULL) && (this->_snapshot.erase( std::string(name) ) > 0);
+}
+
+// Runs full passes of every search kind over a 16 MiB region of pseudo-random data, the size of DSi main RAM,
+// and prints how long each one takes. Each exact search is also counted with a plain loop to check the result.
+// This replaces the contents of main RAM, so it is only meant to run in place of emulation.
+bool CHEATSEARCH_Benchmark(const size_t loopCount)
+{
+	const u32 oldMask = _MMU_MAIN_MEM_MASK;
+	_MMU_MAIN_MEM_MASK = 0xFFFFFF;
+
+	u32 seed = 0x12345678;
+	for (size_t i = 0; i < sizeof(MMU.MAIN_MEM); i++)
+	{
+		seed ^= seed << 13;
+		seed ^= seed >> 17;
+		seed ^= seed << 5;
+		// Mostly small values, like the counters that are actually searched for.
+		MMU.MAIN_MEM[i] = ((seed & 0x300) == 0) ? (u8)seed : (u8)(seed & 0x07);
+	}
+
+	static const char *compareName[4] = { "greater", "less", "equal", "notequal" };
+	bool didMatchReference = true;
+
+	printf("Cheat search benchmark: 16 MiB region, loops: %u\n", (u32)loopCount);
+
+	for (u8 size = 0; size < 4; size++)
+	{
+		for (u8 sign = 0; sign < 2; sign++)
+		{
+			double exactMilliseconds = 0.0;
+			double compareMilliseconds[4] = { 0.0, 0.0, 0.0, 0.0 };
+			// Take the value from memory so that the exact search finds something, sign extending it for
+			// the signed searches so that it stays in range.
+			const u32 shift = 32 - ((size + 1) * 8);
+			const u32 valueMask = 0xFFFFFFFF >> shift;
+			u32 val = T1ReadLong(MMU.MAIN_MEM, 0x1000) & valueMask;
+			if (sign != 0)
+				val = (u32)((s32)(val << shift) >> shift);
+
+			for (size_t loop = 0; loop < loopCount; loop++)
 			{
-				u32	addr = (i >> 3);
-				u32	offs = (i % 8);
-				if (this->_statMem[addr] & (7<<offs))
+				CHEATSEARCH search;
+				search.start(0, size, sign);
+				std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+				const u32 amount = search.search(val);
+				exactMilliseconds += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+				if (loop == 0)
 				{
-					switch (comp)
+					u32 expected = 0;
+					const u32 step = size + 1;
+					for (u32 addr = 0; addr + step <= 0x1000000; addr += step)
 					{
-						case 0: didComparePass = ((T1ReadLong(MMU.MMU_MEM[ARMCPU_ARM9][0x20], i) & 0x00FFFFFF) > (T1ReadLong(this->_mem, i) & 0x00FFFFFF) ); break;
-						case 1: didComparePass = ((T1ReadLong(MMU.MMU_MEM[ARMCPU_ARM9][0x20], i) & 0x00FFFFFF) < (T1ReadLong(this->_mem, i) & 0x00FFFFFF) ); break;
-						case 2: didComparePass = ((T1ReadLong(MMU.MMU_MEM[ARMCPU_ARM9][0x20], i) & 0x00FFFFFF) == (T1ReadLong(this->_mem, i) & 0x00FFFFFF) ); break;
-						case 3: didComparePass = ((T1ReadLong(MMU.MMU_MEM[ARMCPU_ARM9][0x20], i) & 0x00FFFFFF) != (T1ReadLong(this->_mem, i) & 0x00FFFFFF) ); break;
-						default: didComparePass = false; break;
+						u32 value = 0;
+						for (u32 i = 0; i < step; i++)
+							value |= (u32)MMU.MAIN_MEM[addr + i] << (i * 8);
+						if (value == (val & valueMask))
+							expected++;
 					}
-					if (didComparePass)
+
+					if (amount != expected)
 					{
-						this->_statMem[addr] |= (7<<offs);
-						this->_amount++;
-						continue;
+						printf("  %u byte %s: exact search found %u values, expected %u\n", (u32)step, (sign != 0) ? "signed" : "unsigned", amount, expected);
+						didMatchReference = false;
 					}
-					this->_statMem[addr] &= ~(7<<offs);
 				}
-			}
-		break;
+				search.close();
 
-		case 3:		// 4 bytes
-			for (u32 i = 0; i < (4 * 1024 * 1024); i+=4)
-			{
-				u32	addr = (i >> 3);
-				u32	offs = (i % 8);
-				if (this->_statMem[addr] & (0xF<<offs))
+				for (u8 comp = 0; comp < 4; comp++)
 				{
-					switch (comp)
-					{
-						case 0: didComparePass = (T1ReadLong(MMU.MMU_MEM[ARMCPU_ARM9][0x20], i) > T1ReadLong(this->_mem, i)); break;
-						case 1: didComparePass = (T1ReadLong(MMU.MMU_MEM[ARMCPU_ARM9][0x20], i) < T1ReadLong(this->_mem, i)); break;
-						case 2: didComparePass = (T1ReadLong(MMU.MMU_MEM[ARMCPU_ARM9][0x20], i) == T1ReadLong(this->_mem, i)); break;
-						case 3: didComparePass = (T1ReadLong(MMU.MMU_MEM[ARMCPU_ARM9][0x20], i) != T1ReadLong(this->_mem, i)); break;
-						default: didComparePass = false; break;
-					}
-					if (didComparePass)
-					{
-						this->_statMem[addr] |= (0xF<<offs);
-						this->_amount++;
-						continue;
-					}
-					this->_statMem[addr] &= ~(0xF<<offs);
+					search.start(1, size, sign);
+					start = std::chrono::steady_clock::now();
+					search.searchValue(val, comp);
+					compareMilliseconds[comp] += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+					search.close();
 				}
 			}
-		break;
+
+			if (loopCount > 0)
+			{
+				printf("  %u byte %-8s exact %.2f ms", size + 1, (sign != 0) ? "signed" : "unsigned", exactMilliseconds / loopCount);
+				for (u8 comp = 0; comp < 4; comp++)
+					printf(", %s %.2f ms", compareName[comp], compareMilliseconds[comp] / loopCount);
+				printf("\n");
+			}
+		}
 	}
 
-	memcpy(this->_mem, MMU.MMU_MEM[0][0x20], ( 4 * 1024 * 1024 ) );
+	memset(MMU.MAIN_MEM, 0, sizeof(MMU.MAIN_MEM));
+	_MMU_MAIN_MEM_MASK = oldMask;
 
-	return this->_amount;
+	return didMatchReference;
+}
+
+u32 CHEATSEARCH::getRegionSize() const
+{
+	return this->_regionSize;
 }
 
 u32 CHEATSEARCH::getAmount()
@@ -1574,37 +2115,40 @@ u32 CHEATSEARCH::getAmount()
 bool CHEATSEARCH::getList(u32 *address, u32 *curVal)
 {
 	bool didGetValue = false;
-	u8 step = this->_size + 1;
-	u8 stepMem = 1;
+	const u32 step = this->_size + 1;
+	const size_t valueCount = (this->_regionSize == 0) ? 0 : this->_regionSize / step;
 
-	switch (this->_size)
+	for (size_t i = this->_lastRecord / step; i < valueCount; )
 	{
-		case 1: stepMem = 0x3; break;
-		case 2: stepMem = 0x7; break;
-		case 3: stepMem = 0xF; break;
-	}
+		const u64 bits = this->_candidate[i / CHEATSEARCH_BLOCK_VALUES] >> (i % CHEATSEARCH_BLOCK_VALUES);
+		if (bits == 0)
+		{
+			// Nothing left in this block, so go straight to the next one.
+			i = (i - (i % CHEATSEARCH_BLOCK_VALUES)) + CHEATSEARCH_BLOCK_VALUES;
+			continue;
+		}
 
-	for (u32 i = this->_lastRecord; i < (4 * 1024 * 1024); i+=step)
-	{
-		u32	addr = (i >> 3);
-		u32	offs = (i % 8);
-		if (this->_statMem[addr] & (stepMem<<offs))
+		if ((bits & 1) == 0)
 		{
-			*address = i;
-			this->_lastRecord = i+step;
-			
-			switch (this->_size)
-			{
-				case 0: *curVal = (u32)T1ReadByte(MMU.MMU_MEM[ARMCPU_ARM9][0x20], i); break;
-				case 1: *curVal = (u32)T1ReadWord(MMU.MMU_MEM[ARMCPU_ARM9][0x20], i); break;
-				case 2: *curVal = (u32)T1ReadLong(MMU.MMU_MEM[ARMCPU_ARM9][0x20], i) & 0x00FFFFFF; break;
-				case 3: *curVal = (u32)T1ReadLong(MMU.MMU_MEM[ARMCPU_ARM9][0x20], i); break;
-				default: break;
-			}
+			i++;
+			continue;
+		}
+
+		*address = (u32)(i * step);
+		this->_lastRecord = *address + step;
 
-			didGetValue = true;
-			return didGetValue;
+		// Read only the element itself, so that the last values in main RAM don't read past its end.
+		const u8 *mem = MMU.MAIN_MEM + *address;
+		switch (this->_size)
+		{
+			case 0: *curVal = (u32)CHEATSEARCH_ReadValue<1, false>(mem); break;
+			case 1: *curVal = (u32)CHEATSEARCH_ReadValue<2, false>(mem); break;
+			case 2: *curVal = (u32)CHEATSEARCH_ReadValue<3, false>(mem); break;
+			default: *curVal = (u32)CHEATSEARCH_ReadValue<4, false>(mem); break;
 		}
+
+		didGetValue = true;
+		return didGetValue;
 	}
 	this->_lastRecord = 0;
 	return didGetValue;
@@ -2129,6 +2673,7 @@ CheatDBFile::CheatDBFile()
 	_isEncrypted = false;
 	_size = 0;
 	_fp = NULL;
+	_mapping = NULL;
 }
 
 CheatDBFile::~CheatDBFile()
@@ -2161,7 +2706,7 @@ const char* CheatDBFile::GetFormatString() const
 	return this->_formatString.c_str();
 }
 
-CheatSystemError CheatDBFile::OpenFile(const char *filePath)
+CheatSystemError CheatDBFile::OpenFile(const char *filePath, const char *indexFilePath)
 {
 	CheatSystemError error = CheatSystemError_NoError;
 	
@@ -2229,6 +2774,21 @@ CheatSystemError CheatDBFile::OpenFile(const char *filePath)
 	this->_description = (const char *)(workingBuffer + CHEATDB_OFFSET_FILE_DESCRIPTION);
 	this->_path = filePath;
 	
+	// Looking up a single game goes through the game index. The FAT is only read through the
+	// mapping when the index needs to be built, so a valid index file means that the FAT
+	// doesn't need to be touched at all.
+	this->_mapping = new EMUFILE_MAPPING(filePath);
+	
+	if ( (indexFilePath == NULL) || !this->_LoadIndexFile(indexFilePath) )
+	{
+		this->_BuildIndex();
+		
+		if (indexFilePath != NULL)
+		{
+			this->_SaveIndexFile(indexFilePath);
+		}
+	}
+	
 	return error;
 }
 
@@ -2239,6 +2799,214 @@ void CheatDBFile::CloseFile()
 		fclose(this->_fp);
 		this->_fp = NULL;
 	}
+	
+	delete this->_mapping;
+	this->_mapping = NULL;
+	this->_index.clear();
+}
+
+static bool CheatDBIndexEntryLess(const CheatDBIndexEntry &a, const CheatDBIndexEntry &b)
+{
+	const int serialCompare = memcmp(a.serial, b.serial, sizeof(a.serial));
+	if (serialCompare != 0)
+	{
+		return (serialCompare < 0);
+	}
+	
+	return (a.CRC < b.CRC);
+}
+
+bool CheatDBFile::_ReadFATEntry(const u32 fileOffset, FAT_R4 &outFat, u8 (&sectorBuffer)[512], u64 &sectorInBuffer) const
+{
+	if ( (this->_mapping == NULL) || ((size_t)fileOffset + sizeof(FAT_R4) > this->_mapping->size()) )
+	{
+		memset(&outFat, 0, sizeof(outFat));
+		return false;
+	}
+	
+	const u8 *fileData = this->_mapping->data();
+	
+	if (!this->_isEncrypted)
+	{
+		memcpy(&outFat, fileData + fileOffset, sizeof(outFat));
+		return true;
+	}
+	
+	// FAT entries never straddle a sector, so decrypting the sector that holds
+	// the entry is all that's needed.
+	const u64 sector = fileOffset >> 9;
+	if (sector != sectorInBuffer)
+	{
+		const size_t sectorOffset = (size_t)(sector << 9);
+		const size_t sectorSize = std::min<size_t>(sizeof(sectorBuffer), this->_mapping->size() - sectorOffset);
+		
+		memset(sectorBuffer, 0, sizeof(sectorBuffer));
+		memcpy(sectorBuffer, fileData + sectorOffset, sectorSize);
+		CheatDBFile::R4Decrypt(sectorBuffer, sectorSize, sector);
+		sectorInBuffer = sector;
+	}
+	
+	memcpy(&outFat, &sectorBuffer[fileOffset % 512], sizeof(outFat));
+	return true;
+}
+
+void CheatDBFile::_BuildIndex()
+{
+	this->_index.clear();
+	
+	if ( (this->_mapping == NULL) || !this->_mapping->is_open() )
+	{
+		return;
+	}
+	
+	u8 sectorBuffer[512] = {0};
+	u64 sectorInBuffer = ~(u64)0;
+	u32 pos = CHEATDB_FILEOFFSET_FIRST_FAT_ENTRY;
+	FAT_R4 fatEntryCurrent = {0};
+	FAT_R4 fatEntryNext = {0};
+	
+	if (!this->_ReadFATEntry(pos, fatEntryNext, sectorBuffer, sectorInBuffer))
+	{
+		return;
+	}
+	
+	// This walks the FAT the same way that LoadGameList() does, so that the index lists the
+	// same games with the same data sizes.
+	do
+	{
+		fatEntryCurrent = fatEntryNext;
+		pos += sizeof(FAT_R4);
+		this->_ReadFATEntry(pos, fatEntryNext, sectorBuffer, sectorInBuffer);
+		
+		if (fatEntryCurrent.addr >= this->_size)
+		{
+			continue;
+		}
+		
+		u32 dataSize = 0;
+		
+		if (fatEntryNext.addr > 0)
+		{
+			dataSize = (u32)(fatEntryNext.addr - fatEntryCurrent.addr);
+		}
+		else
+		{
+			dataSize = (u32)(this->_size - fatEntryCurrent.addr);
+			if (dataSize > (1024 * 1024))
+			{
+				dataSize = 1024 * 1024;
+			}
+		}
+		
+		if (dataSize == 0)
+		{
+			continue;
+		}
+		
+		CheatDBIndexEntry newEntry;
+		memcpy(newEntry.serial, fatEntryCurrent.serial, sizeof(newEntry.serial));
+		newEntry.CRC = fatEntryCurrent.CRC;
+		newEntry.addr = (u32)fatEntryCurrent.addr;
+		newEntry.dataSize = dataSize;
+		
+		this->_index.push_back(newEntry);
+		
+	} while (fatEntryNext.addr > 0);
+	
+	// A stable sort keeps duplicate games in FAT order, so a search still finds the
+	// first one in the file, just like the linear search did.
+	std::stable_sort(this->_index.begin(), this->_index.end(), CheatDBIndexEntryLess);
+}
+
+#define CHEATDB_INDEX_FILE_MAGIC   "DeSmuME CheatDB index"
+#define CHEATDB_INDEX_FILE_VERSION 1
+
+bool CheatDBFile::_LoadIndexFile(const char *indexFilePath)
+{
+	struct stat dbFileStat;
+	if (stat(this->_path.c_str(), &dbFileStat) != 0)
+	{
+		return false;
+	}
+	
+	EMUFILE_FILE is(indexFilePath, "rb");
+	if (is.fail())
+	{
+		return false;
+	}
+	
+	char magic[sizeof(CHEATDB_INDEX_FILE_MAGIC)] = {0};
+	if ( (is.fread(magic, sizeof(magic)) != sizeof(magic)) || (memcmp(magic, CHEATDB_INDEX_FILE_MAGIC, sizeof(magic)) != 0) )
+	{
+		return false;
+	}
+	
+	// The index is only valid for the exact database file that it was built from.
+	const u32 version = is.read_u32LE();
+	const u64 dbFileSize = is.read_u64LE();
+	const s64 dbFileTime = is.read_s64LE();
+	const u32 entryCount = is.read_u32LE();
+	
+	if ( is.fail() ||
+	     (version != CHEATDB_INDEX_FILE_VERSION) ||
+	     (dbFileSize != (u64)this->_size) ||
+	     (dbFileTime != (s64)dbFileStat.st_mtime) ||
+	     ((u64)entryCount * sizeof(FAT_R4) > dbFileSize) )
+	{
+		return false;
+	}
+	
+	std::vector<CheatDBIndexEntry> newIndex(entryCount);
+	
+	for (size_t i = 0; i < newIndex.size(); i++)
+	{
+		CheatDBIndexEntry &entry = newIndex[i];
+		is.fread(entry.serial, sizeof(entry.serial));
+		is.read_32LE(entry.CRC);
+		is.read_32LE(entry.addr);
+		is.read_32LE(entry.dataSize);
+	}
+	
+	if (is.fail())
+	{
+		return false;
+	}
+	
+	this->_index.swap(newIndex);
+	return true;
+}
+
+bool CheatDBFile::_SaveIndexFile(const char *indexFilePath) const
+{
+	struct stat dbFileStat;
+	if (stat(this->_path.c_str(), &dbFileStat) != 0)
+	{
+		return false;
+	}
+	
+	EMUFILE_FILE os(indexFilePath, "wb");
+	if (os.fail())
+	{
+		printf("WARNING: Failed to save the cheat database index.\n");
+		return false;
+	}
+	
+	os.fwrite(CHEATDB_INDEX_FILE_MAGIC, sizeof(CHEATDB_INDEX_FILE_MAGIC));
+	os.write_32LE((u32)CHEATDB_INDEX_FILE_VERSION);
+	os.write_64LE((u64)this->_size);
+	os.write_64LE((s64)dbFileStat.st_mtime);
+	os.write_32LE((u32)this->_index.size());
+	
+	for (size_t i = 0; i < this->_index.size(); i++)
+	{
+		const CheatDBIndexEntry &entry = this->_index[i];
+		os.fwrite(entry.serial, sizeof(entry.serial));
+		os.write_32LE(entry.CRC);
+		os.write_32LE(entry.addr);
+		os.write_32LE(entry.dataSize);
+	}
+	
+	return !os.fail();
 }
 
 void CheatDBFile::R4Decrypt(u8 *buf, const size_t len, u64 n)
@@ -2337,6 +3105,37 @@ u32 CheatDBFile::LoadGameList(const char *gameCode, const u32 gameDatabaseCRC, C
 		outList.resize(0);
 	}
 	
+	// A single game is found with a binary search through the game index, which is only built
+	// when the file could be mapped. Otherwise, fall through to the linear search of the FAT.
+	if ( (gameCode != NULL) && (this->_mapping != NULL) && this->_mapping->is_open() )
+	{
+		CheatDBIndexEntry searchEntry;
+		memcpy(searchEntry.serial, gameCode, sizeof(searchEntry.serial));
+		searchEntry.CRC = gameDatabaseCRC;
+		
+		std::vector<CheatDBIndexEntry>::const_iterator it = std::lower_bound(this->_index.begin(), this->_index.end(), searchEntry, CheatDBIndexEntryLess);
+		if ( (it == this->_index.end()) || CheatDBIndexEntryLess(searchEntry, *it) )
+		{
+			return entryCount;
+		}
+		
+		if (GetCheatDBGameEntryFromList(outList, gameCode, gameDatabaseCRC) == NULL)
+		{
+			FAT_R4 fat;
+			memcpy(fat.serial, it->serial, sizeof(fat.serial));
+			fat.CRC = it->CRC;
+			fat.addr = it->addr;
+			
+			const u32 encryptOffset = (this->_isEncrypted) ? (it->addr % 512) : 0;
+			u8 gameEntryBuffer[1024] = {0};
+			
+			outList.push_back( this->_ReadGame(encryptOffset, fat, it->dataSize, gameEntryBuffer) );
+			entryCount = 1;
+		}
+		
+		return entryCount;
+	}
+	
 	u8 fatBuffer[512] = {0};
 	u8 gameEntryBuffer[1024] = {0};
 	u32 pos = CHEATDB_FILEOFFSET_FIRST_FAT_ENTRY;
@@ -2431,9 +3230,9 @@ u32 CheatDBFile::LoadGameList(const char *gameCode, const u32 gameDatabaseCRC, C
 				{
 					// Only add to the game list if the entry has not been added yet.
 					outList.push_back( this->_ReadGame(encryptOffset, fatEntryCurrent, dataSize, gameEntryBuffer) );
+					entryCount = 1;
 				}
 				
-				entryCount = 1;
 				return entryCount;
 			}
 		}
@@ -2460,11 +3259,11 @@ CHEATSEXPORT::~CHEATSEXPORT()
 	this->close();
 }
 
-bool CHEATSEXPORT::load(const char *path)
+bool CHEATSEXPORT::load(const char *path, const char *indexFilePath)
 {
 	bool didLoadSucceed = false;
 	
-	this->_lastError = this->_dbFile.OpenFile(path);
+	this->_lastError = this->_dbFile.OpenFile(path, indexFilePath);
 	if (this->_lastError != CheatSystemError_NoError)
 	{
 		return didLoadSucceed;
@@ -20,8 +20,11 @@
 #include <string.h>
 #include <string>
 #include <vector>
+#include <map>
 #include "types.h"
 
+class EMUFILE_MAPPING;
+
 #define CHEAT_VERSION_MAJOR			2
 #define CHEAT_VERSION_MINOR			0
 #define	MAX_XX_CODE					1024
@@ -32,6 +35,13 @@
 #define CHEAT_TYPE_AR 1
 #define CHEAT_TYPE_CODEBREAKER 2
 
+// Comparisons for CHEATSEARCH. When comparing against a snapshot, EQUAL means that a value
+// is unchanged and NOTEQUAL means that it has changed.
+#define CHEATSEARCH_COMPARE_GREATER  0
+#define CHEATSEARCH_COMPARE_LESS     1
+#define CHEATSEARCH_COMPARE_EQUAL    2
+#define CHEATSEARCH_COMPARE_NOTEQUAL 3
+
 enum CheatSystemError
 {
 	CheatSystemError_NoError           = 0,
@@ -73,10 +83,56 @@ struct CHEATS_LIST
 	u8		size;
 };
 
+// One line of an Action Replay code, decoded once when the cheat is compiled.
+struct CHEATS_COMPILED_OP
+{
+	u8  type;       // code type by kodewerx numbering: 0x00-0x0F, with the C and D codes broken down into 0xC0-0xDF
+	u32 hi;
+	u32 lo;
+	u32 patchFirst; // for E codes: the first of their writes in CHEATS_COMPILED::write,
+	u32 patchCount; // how many there are,
+	u32 patchNext;  // and the line that execution continues after
+};
+
+struct CHEATS_COMPILED_WRITE
+{
+	u32 address;    // relative to the target address for E code patches
+	u32 value;
+	u8  length;
+	u8  proc;
+};
+
+// A cheat compiled into the form that CHEATS::process() runs every frame. Cheats that only ever write the
+// same values to the same addresses (which is most of them) become a plain list of writes. Everything else
+// becomes a list of decoded lines for the Action Replay interpreter.
+class CHEATS_COMPILED
+{
+public:
+	u8 type;
+	u8 size;
+	u32 num;
+	std::vector<u32> source; // the code this was compiled from, to notice when the cheat changes
+
+	bool isWriteList;
+	std::vector<CHEATS_COMPILED_OP> op;
+	std::vector<CHEATS_COMPILED_WRITE> write;
+
+	u64 lastNanoseconds;
+	u64 totalNanoseconds;
+	u32 runCount; // runs timed while the performance counters were enabled
+
+	CHEATS_COMPILED();
+
+	bool isCompiledFrom(const CHEATS_LIST &cheat) const;
+	void compile(const CHEATS_LIST &cheat);
+	bool run() const; // returns true if code memory was modified
+};
+
 class CHEATS
 {
 private:
 	std::vector<CHEATS_LIST> _list;
+	std::vector<CHEATS_COMPILED> _compiled; // same order as _list, compiled when a cheat first runs
 	u8					_filename[MAX_PATH];
 	size_t				_currentGet;
 
@@ -130,10 +186,12 @@ public:
 	void	setDescription(const char *description, const size_t pos);
 	bool	save();
 	bool	load();
-	bool	process(int targetType) const;
+	bool	process(int targetType);
+	bool	getExecutionTime(const size_t pos, double &outLastMicroseconds, double &outAverageMicroseconds) const;
 	
 	static void JitNeedsReset();
 	static bool ResetJitIfNeeded();
+	static void InvalidateJitForWrites();
 	
 	template<size_t LENGTH> static bool DirectWrite(const int targetProc, const u32 targetAddress, u32 newValue);
 	static bool DirectWrite(const size_t newValueLength, const int targetProc, const u32 targetAddress, u32 newValue);
@@ -148,8 +206,10 @@ public:
 class CHEATSEARCH
 {
 private:
-	u8	*_statMem;
-	u8	*_mem;
+	std::vector<u64> _candidate; // one bit for each value that still matches, values being (_size + 1) bytes apart
+	std::vector<u8> _mem;        // main RAM as of the last comparative search
+	std::map<std::string, std::vector<u8> > _snapshot;
+	u32	_regionSize;
 	u32	_amount;
 	u32	_lastRecord;
 
@@ -157,15 +217,22 @@ private:
 	u32	_size;
 	u32	_sign;
 
+	u32 _filter(const u8 *refMem, const u32 val, const u8 comp);
+
 public:
 	CHEATSEARCH()
-			: _statMem(0), _mem(0), _amount(0), _lastRecord(0), _type(0), _size(0), _sign(0) 
+			: _regionSize(0), _amount(0), _lastRecord(0), _type(0), _size(0), _sign(0) 
 	{}
 	~CHEATSEARCH() { this->close(); }
 	bool start(u8 type, u8 size, u8 sign);
 	void close();
 	u32 search(u32 val);
 	u32 search(u8 comp);
+	u32 searchValue(u32 val, u8 comp);
+	u32 searchSnapshot(const char *name, u8 comp);
+	bool saveSnapshot(const char *name);
+	bool removeSnapshot(const char *name);
+	u32 getRegionSize() const;
 	u32 getAmount();
 	bool getList(u32 *address, u32 *curVal);
 	void getListReset();
@@ -192,6 +259,17 @@ typedef struct FAT_R4
 } FAT_R4;
 #pragma pack(pop)
 
+// One game of an R4 cheat database file, as listed in the game index that CheatDBFile builds
+// from the FAT. The index is sorted by serial and CRC so that a game can be found with a binary
+// search instead of a walk through the whole FAT.
+struct CheatDBIndexEntry
+{
+	u8  serial[4];
+	u32 CRC;
+	u32 addr;
+	u32 dataSize;
+};
+
 // Wrapper for a single entry in a memory block that contains data read from a cheat database file.
 // This struct also maintains the hierarchical relationships between entries.
 struct CheatDBEntry
@@ -273,8 +351,14 @@ protected:
 	size_t _size;
 	
 	FILE *_fp;
+	EMUFILE_MAPPING *_mapping;
+	std::vector<CheatDBIndexEntry> _index;
 	
 	CheatDBGame _ReadGame(const u32 encryptOffset, const FAT_R4 &fat, const u32 gameDataSize, u8 (&workingBuffer)[1024]);
+	bool _ReadFATEntry(const u32 fileOffset, FAT_R4 &outFat, u8 (&sectorBuffer)[512], u64 &sectorInBuffer) const;
+	void _BuildIndex();
+	bool _LoadIndexFile(const char *indexFilePath);
+	bool _SaveIndexFile(const char *indexFilePath) const;
 	
 public:
 	CheatDBFile();
@@ -289,7 +373,9 @@ public:
 	CheatDBFileFormat GetFormat() const;
 	const char* GetFormatString() const;
 	
-	CheatSystemError OpenFile(const char *filePath);
+	// If indexFilePath is given, the game index is read from that file when it is still valid for
+	// the database file, and is otherwise built and saved there for the next time.
+	CheatSystemError OpenFile(const char *filePath, const char *indexFilePath = NULL);
 	void CloseFile();
 	
 	u32 LoadGameList(const char *gameCode, const u32 gameDatabaseCRC, CheatDBGameList &outList);
@@ -308,7 +394,7 @@ public:
 	CHEATSEXPORT();
 	~CHEATSEXPORT();
 	
-	bool load(const char *path);
+	bool load(const char *path, const char *indexFilePath = NULL);
 	void close();
 	
 	CHEATS_LIST *getCheats() const;
@@ -322,5 +408,7 @@ CheatDBGame* GetCheatDBGameEntryFromList(const CheatDBGameList &gameList, const
 void CheatItemGenerateDescriptionHierarchical(const char *itemName, const char *itemNote, CHEATS_LIST &outCheatItem);
 void CheatItemGenerateDescriptionFlat(const char *folderName, const char *folderNote, const char *itemName, const char *itemNote, CHEATS_LIST &outCheatItem);
 
+bool CHEATSEARCH_Benchmark(const size_t loopCount);
+
 extern CHEATS *cheats;
 extern CHEATSEARCH *cheatSearch;
@@ -26,6 +26,7 @@
 #include "slot1.h"
 #include "slot2.h"
 #include "NDSSystem.h"
+#include "gfx3d.h"
 #include "utils/datetime.h"
 #include "utils/xstring.h"
 #include <compat/getopt.h>
@@ -39,6 +40,7 @@ int _commandline_linux_nojoy = 0;
 CommandLine::CommandLine()
 : is_cflash_configured(false)
 , _load_to_memory(-1)
+, _lazy_fat(0)
 , _play_movie_file(0)
 , _record_movie_file(0)
 , _cflash_image(0)
@@ -52,6 +54,8 @@ CommandLine::CommandLine()
 , _spu_sync_mode(-1)
 , _spu_sync_method(-1)
 , _spu_advanced(0)
+, _spu_thread(0)
+, _spu_silent(0)
 , _num_cores(-1)
 , _rigorous_timing(0)
 , _advanced_timing(-1)
@@ -69,6 +73,14 @@ CommandLine::CommandLine()
 , _console_type(NULL)
 , _advanscene_import(NULL)
 , load_slot(-1)
+, replay_3d_loops(1)
+, sync_interval(600)
+, sync_jobs(0)
+, sync_segment(-1)
+, perf_counters(0)
+, check_save_flush(0)
+, savestate_bench_loops(-1)
+, cheatsearch_bench_loops(-1)
 , arm9_gdb_port(0)
 , arm7_gdb_port(0)
 , start_paused(FALSE)
@@ -107,6 +119,9 @@ static const char* help_string = \
 " --num-cores N              Override numcores detection and use this many" ENDL
 " --spu-synch                Use SPU synch (crackles; helps streams; default ON)" ENDL
 " --spu-method N             Select SPU synch method: 0:N, 1:Z, 2:P; default 0" ENDL
+" --spu-thread               Run the SPU on a dedicated audio thread; default OFF" ENDL
+"                            (same output, but less of a gain with streamed audio)" ENDL
+" --spu-silent               Produce no audio, emulate only what the CPU can see" ENDL
 " --3d-render [SW|AUTOGL|GL|OLDGL]" ENDL
 "                            Select 3d renderer; default SW" ENDL
 " --3d-texture-deposterize-enable" ENDL
@@ -163,6 +178,8 @@ ENDL
 "                            Device type to be used SLOT-1; default RETAILAUTO" ENDL
 " --preload-rom              precache ROM to RAM instead of streaming from disk" ENDL
 " --slot1-fat-dir DIR        Directory to mount for SLOT-1 flash cards" ENDL
+" --lazy-fat                 Read files from SLOT-1/SLOT-2 FAT directories on demand" ENDL
+"                            instead of copying them into memory at startup" ENDL
 " --slot1_no8000prot         Disables retail card copy protection <8000 feature" ENDL
 ENDL
 "Arguments affecting contents of SLOT-2:" ENDL
@@ -175,6 +192,9 @@ ENDL
 " --load-slot N              loads savestate from slot N (0-9)" ENDL
 " --play-movie DSM_FILE      automatically plays movie" ENDL
 " --record-movie DSM_FILE    begin recording a movie" ENDL
+" --3d-capture FILE          Record every rendered 3D frame for --3d-replay" ENDL
+" --perf-counters N          Print the per-frame performance counters, averaged" ENDL
+"                            over every N frames (up to 256)" ENDL
 ENDL
 "Arguments affecting video filters:" ENDL
 " --scanline-filter-a N      Fadeout intensity (N/16) (topleft) (default 0)" ENDL
@@ -190,6 +210,17 @@ ENDL
 #endif
 "Utility commands which occur in place of emulation:" ENDL
 " --advanscene-import PATH   Import advanscene, dump .ddb, and exit" ENDL
+" --3d-replay FILE           Benchmark the 3D renderer with a --3d-capture file" ENDL
+" --3d-replay-loops N        Render the 3D capture N times over (default 1)" ENDL
+" --sync-record DIR          Play the --play-movie movie, saving checkpoints and frame hashes to DIR" ENDL
+" --sync-verify DIR          Check that the --play-movie movie still syncs against the recording in DIR" ENDL
+" --sync-interval N          Save a checkpoint every N frames with --sync-record (default 600)" ENDL
+" --sync-jobs N              Verify this many segments at once with --sync-verify (default: number of cores)" ENDL
+" --sync-segment N           Only verify segment N with --sync-verify (used by the parallel verification)" ENDL
+" --convert-movie FILE       Convert the --play-movie movie to FILE, from text to binary or back" ENDL
+" --check-save-flush         Rewrite one byte of the ROM's save file and check that the whole file survives the flush" ENDL
+" --savestate-bench N        Time writing and reading the ROM's state in memory N times over (after --load-slot, if given)" ENDL
+" --cheat-search-bench N     Time cheat searches over a 16 MiB region N times over" ENDL
 ENDL
 "These arguments may be reorganized/renamed in the future." ENDL ENDL
 ;
@@ -218,6 +249,8 @@ ENDL
 #define OPT_LOAD_SLOT 400
 #define OPT_PLAY_MOVIE 410
 #define OPT_RECORD_MOVIE 411
+#define OPT_3D_CAPTURE 420
+#define OPT_PERF_COUNTERS 430
 
 #define OPT_SLOT2_CFLASH_IMAGE 500
 #define OPT_SLOT2_CFLASH_DIR 501
@@ -235,6 +268,16 @@ ENDL
 #define OPT_RTC_HOUR 801
 
 #define OPT_ADVANSCENE 900
+#define OPT_3D_REPLAY 901
+#define OPT_3D_REPLAY_LOOPS 902
+#define OPT_SYNC_RECORD 910
+#define OPT_SYNC_VERIFY 911
+#define OPT_SYNC_INTERVAL 912
+#define OPT_SYNC_JOBS 913
+#define OPT_SYNC_SEGMENT 914
+#define OPT_CONVERT_MOVIE 920
+#define OPT_SAVESTATE_BENCH 930
+#define OPT_CHEATSEARCH_BENCH 940
 
 bool CommandLine::parse(int argc,char **argv)
 {
@@ -257,6 +300,8 @@ bool CommandLine::parse(int argc,char **argv)
 			{ "num-cores", required_argument, NULL, OPT_NUMCORES },
 			{ "spu-synch", no_argument, &_spu_sync_mode, 1 },
 			{ "spu-method", required_argument, NULL, OPT_SPU_METHOD },
+			{ "spu-thread", no_argument, &_spu_thread, 1 },
+			{ "spu-silent", no_argument, &_spu_silent, 1 },
 			{ "3d-render", required_argument, NULL, OPT_3D_RENDER },
 			{ "3d-texture-deposterize-enable", no_argument, &_texture_deposterize, 1 },
 			{ "3d-texture-upscale", required_argument, NULL, OPT_3D_TEXTURE_UPSCALE },
@@ -299,6 +344,7 @@ bool CommandLine::parse(int argc,char **argv)
 			{ "slot1", required_argument, NULL, OPT_SLOT1},
 			{ "preload-rom", no_argument, &_load_to_memory, 1},
 			{ "slot1-fat-dir", required_argument, NULL, OPT_SLOT1_FAT_DIR},
+			{ "lazy-fat", no_argument, &_lazy_fat, 1},
 			//and other slot-1 option
 			{ "slot1-no8000prot", no_argument, &_slot1_no8000prot, 1},
 
@@ -312,6 +358,8 @@ bool CommandLine::parse(int argc,char **argv)
 			{ "load-slot", required_argument, NULL, OPT_LOAD_SLOT},
 			{ "play-movie", required_argument, NULL, OPT_PLAY_MOVIE},
 			{ "record-movie", required_argument, NULL, OPT_RECORD_MOVIE},
+			{ "3d-capture", required_argument, NULL, OPT_3D_CAPTURE},
+			{ "perf-counters", required_argument, NULL, OPT_PERF_COUNTERS},
 
 			//video filters
 			{ "scanline-filter-a", required_argument, NULL, OPT_SCANLINES_A},
@@ -327,6 +375,17 @@ bool CommandLine::parse(int argc,char **argv)
 
 			//utilities
 			{ "advanscene-import", required_argument, NULL, OPT_ADVANSCENE},
+			{ "3d-replay", required_argument, NULL, OPT_3D_REPLAY},
+			{ "3d-replay-loops", required_argument, NULL, OPT_3D_REPLAY_LOOPS},
+			{ "sync-record", required_argument, NULL, OPT_SYNC_RECORD},
+			{ "sync-verify", required_argument, NULL, OPT_SYNC_VERIFY},
+			{ "sync-interval", required_argument, NULL, OPT_SYNC_INTERVAL},
+			{ "sync-jobs", required_argument, NULL, OPT_SYNC_JOBS},
+			{ "sync-segment", required_argument, NULL, OPT_SYNC_SEGMENT},
+			{ "convert-movie", required_argument, NULL, OPT_CONVERT_MOVIE},
+			{ "check-save-flush", no_argument, &check_save_flush, 1},
+			{ "savestate-bench", required_argument, NULL, OPT_SAVESTATE_BENCH},
+			{ "cheat-search-bench", required_argument, NULL, OPT_CHEATSEARCH_BENCH},
 				
 			{0,0,0,0}
 		};
@@ -378,6 +437,8 @@ bool CommandLine::parse(int argc,char **argv)
 		case OPT_LOAD_SLOT: load_slot = atoi(optarg);  break;
 		case OPT_PLAY_MOVIE: play_movie_file = optarg; break;
 		case OPT_RECORD_MOVIE: record_movie_file = optarg; break;
+		case OPT_3D_CAPTURE: capture_3d_file = optarg; break;
+		case OPT_PERF_COUNTERS: perf_counters = atoi(optarg); break;
 
 		//video filters
 		case OPT_SCANLINES_A: _scanline_filter_a = atoi(optarg); break;
@@ -391,6 +452,16 @@ bool CommandLine::parse(int argc,char **argv)
 
 		//utilities
 		case OPT_ADVANSCENE: CommonSettings.run_advanscene_import = optarg; break;
+		case OPT_3D_REPLAY: replay_3d_file = optarg; break;
+		case OPT_3D_REPLAY_LOOPS: replay_3d_loops = atoi(optarg); break;
+		case OPT_SYNC_RECORD: sync_record_dir = optarg; break;
+		case OPT_SYNC_VERIFY: sync_verify_dir = optarg; break;
+		case OPT_SYNC_INTERVAL: sync_interval = atoi(optarg); break;
+		case OPT_SYNC_JOBS: sync_jobs = atoi(optarg); break;
+		case OPT_SYNC_SEGMENT: sync_segment = atoi(optarg); break;
+		case OPT_CONVERT_MOVIE: convert_movie_file = optarg; break;
+		case OPT_SAVESTATE_BENCH: savestate_bench_loops = atoi(optarg); break;
+		case OPT_CHEATSEARCH_BENCH: cheatsearch_bench_loops = atoi(optarg); break;
 		case OPT_LANGUAGE: language = atoi(optarg); break;
 		}
 	} //arg parsing loop
@@ -402,6 +473,7 @@ bool CommandLine::parse(int argc,char **argv)
 	}
 
 	if(_load_to_memory != -1) CommonSettings.loadToMemory = (_load_to_memory == 1)?true:false;
+	if(_lazy_fat) CommonSettings.lazyFatImage = true;
 	if(_num_cores != -1) CommonSettings.num_cores = _num_cores;
 	if(_rigorous_timing) CommonSettings.rigorous_timing = true;
 	if(_advanced_timing != -1) CommonSettings.advanced_timing = _advanced_timing==1;
@@ -459,6 +531,8 @@ bool CommandLine::parse(int argc,char **argv)
 	if(_spu_sync_mode != -1) CommonSettings.SPU_sync_mode = _spu_sync_mode;
 	if(_spu_sync_method != -1) CommonSettings.SPU_sync_method = _spu_sync_method;
 	if(_spu_advanced) CommonSettings.spu_advanced = true;
+	if(_spu_thread) CommonSettings.spu_threaded = true;
+	if(_spu_silent) CommonSettings.spu_silent = true;
 
 	free(_bios_arm9);
 	free(_bios_arm7);
@@ -513,6 +587,51 @@ bool CommandLine::validate()
 		return false;
 	}
 
+	if(capture_3d_file != "" && replay_3d_file != "") {
+		printerror("Cannot both capture and replay 3D frames.\n");
+		return false;
+	}
+
+	if(replay_3d_loops < 1) {
+		printerror("Invalid 3D replay loop count, must be at least 1.\n");
+		return false;
+	}
+
+	if(sync_record_dir != "" && sync_verify_dir != "") {
+		printerror("Cannot both record and verify a movie sync check.\n");
+		return false;
+	}
+
+	if((sync_record_dir != "" || sync_verify_dir != "") && play_movie_file == "") {
+		printerror("A movie sync check needs the movie given with --play-movie.\n");
+		return false;
+	}
+
+	if(convert_movie_file != "" && play_movie_file == "") {
+		printerror("Converting a movie needs the movie given with --play-movie.\n");
+		return false;
+	}
+
+	if(savestate_bench_loops != -1 && savestate_bench_loops < 1) {
+		printerror("Invalid savestate benchmark loop count, must be at least 1.\n");
+		return false;
+	}
+
+	if(cheatsearch_bench_loops != -1 && cheatsearch_bench_loops < 1) {
+		printerror("Invalid cheat search benchmark loop count, must be at least 1.\n");
+		return false;
+	}
+
+	if(sync_interval < 1) {
+		printerror("Invalid sync check interval, must be at least 1.\n");
+		return false;
+	}
+
+	if(sync_jobs < 0) {
+		printerror("Invalid sync check job count.\n");
+		return false;
+	}
+
 	if(cflash_path != "" && cflash_image != "") {
 		printerror("Cannot specify both cflash-image and cflash-path.\n");
 		return false;
@@ -584,6 +703,11 @@ void CommandLine::process_movieCommands()
 	{
 		FCEUI_SaveMovie(record_movie_file.c_str(), L"", START_BLANK, NULL, FCEUI_MovieGetRTCDefault());
 	}
+
+	if(capture_3d_file != "")
+	{
+		GFX3D_CaptureBegin(capture_3d_file.c_str());
+	}
 }
 
 void CommandLine::process_addonCommands()
@@ -53,6 +53,19 @@ public:
 	std::string nds_file;
 	std::string play_movie_file;
 	std::string record_movie_file;
+	std::string capture_3d_file;
+	std::string replay_3d_file;
+	int replay_3d_loops;
+	std::string sync_record_dir;
+	std::string sync_verify_dir;
+	int sync_interval;
+	int sync_jobs;
+	int sync_segment;
+	std::string convert_movie_file;
+	int check_save_flush;
+	int savestate_bench_loops;
+	int cheatsearch_bench_loops;
+	int perf_counters;
 	int arm9_gdb_port, arm7_gdb_port;
 	int start_paused;
 	std::string cflash_image;
@@ -74,7 +87,7 @@ public:
 	//validate the common commandline options
 	bool validate();
 
-	//process movie play/record commands
+	//process movie play/record commands (and 3d capture, which also starts with the rom)
 	void process_movieCommands();
 	//etc.
 	void process_addonCommands();
@@ -98,8 +111,11 @@ private:
 	char* _fw_path;
 	int _fw_boot;
 	int _load_to_memory;
+	int _lazy_fat;
 	int _bios_swi;
 	int _spu_advanced;
+	int _spu_thread;
+	int _spu_silent;
 	int _num_cores;
 	int _rigorous_timing;
 	int _advanced_timing;
@@ -27,6 +27,14 @@ THE SOFTWARE.
 
 #include <vector>
 
+#ifdef HOST_WINDOWS
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
 inline u64 double_to_u64(double d)
 {
 	union
@@ -95,14 +103,14 @@ size_t EMUFILE_MEMORY::_fread(const void *ptr, size_t bytes){
 	}
 	if(todo<=4)
 	{
-		u8* src = buf()+pos;
+		u8* src = vec->data()+pos;
 		u8* dst = (u8*)ptr;
 		for(size_t i=0;i<todo;i++)
 			*dst++ = *src++;
 	}
 	else
 	{
-		memcpy((void*)ptr,buf()+pos,todo);
+		memcpy((void*)ptr,vec->data()+pos,todo);
 	}
 	pos += todo;
 	if(todo<bytes)
@@ -224,7 +232,10 @@ size_t EMUFILE::write_64LE(s64 s64valueIn)
 size_t EMUFILE::write_64LE(u64 u64valueIn)
 {
 	u64valueIn = LOCAL_TO_LE_64(u64valueIn);
-	fwrite(&u64valueIn,8);
+	if (this->_directMemory != NULL)
+		this->_directMemory->write_small<8>(&u64valueIn);
+	else
+		fwrite(&u64valueIn,8);
 	return 8;
 }
 
@@ -236,7 +247,8 @@ size_t EMUFILE::read_64LE(s64 &s64valueOut)
 size_t EMUFILE::read_64LE(u64 &u64valueOut)
 {
 	u64 temp = 0;
-	if (fread(&temp,8) != 8)
+	const size_t readBytes = (this->_directMemory != NULL) ? this->_directMemory->read_small<8>(&temp) : fread(&temp,8);
+	if (readBytes != 8)
 		return 0;
 	
 	u64valueOut = LE_TO_LOCAL_64(temp);
@@ -266,7 +278,10 @@ size_t EMUFILE::write_32LE(s32 s32valueIn)
 size_t EMUFILE::write_32LE(u32 u32valueIn)
 {
 	u32valueIn = LOCAL_TO_LE_32(u32valueIn);
-	fwrite(&u32valueIn,4);
+	if (this->_directMemory != NULL)
+		this->_directMemory->write_small<4>(&u32valueIn);
+	else
+		fwrite(&u32valueIn,4);
 	return 4;
 }
 
@@ -278,7 +293,8 @@ size_t EMUFILE::read_32LE(s32 &s32valueOut)
 size_t EMUFILE::read_32LE(u32 &u32valueOut)
 {
 	u32 temp = 0;
-	if (fread(&temp,4) != 4)
+	const size_t readBytes = (this->_directMemory != NULL) ? this->_directMemory->read_small<4>(&temp) : fread(&temp,4);
+	if (readBytes != 4)
 		return 0;
 	
 	u32valueOut = LE_TO_LOCAL_32(temp);
@@ -308,7 +324,10 @@ size_t EMUFILE::write_16LE(s16 s16valueIn)
 size_t EMUFILE::write_16LE(u16 u16valueIn)
 {
 	u16valueIn = LOCAL_TO_LE_16(u16valueIn);
-	fwrite(&u16valueIn,2);
+	if (this->_directMemory != NULL)
+		this->_directMemory->write_small<2>(&u16valueIn);
+	else
+		fwrite(&u16valueIn,2);
 	return 2;
 }
 
@@ -320,7 +339,8 @@ size_t EMUFILE::read_16LE(s16 &s16valueOut)
 size_t EMUFILE::read_16LE(u16 &u16valueOut)
 {
 	u32 temp = 0;
-	if (fread(&temp,2) != 2)
+	const size_t readBytes = (this->_directMemory != NULL) ? this->_directMemory->read_small<2>(&temp) : fread(&temp,2);
+	if (readBytes != 2)
 		return 0;
 	
 	u16valueOut = LE_TO_LOCAL_16(temp);
@@ -344,19 +364,24 @@ u16 EMUFILE::read_u16LE()
 
 size_t EMUFILE::write_u8(u8 u8valueIn)
 {
-	fwrite(&u8valueIn,1);
+	if (this->_directMemory != NULL)
+		this->_directMemory->write_small<1>(&u8valueIn);
+	else
+		fwrite(&u8valueIn,1);
 	return 1;
 }
 
 size_t EMUFILE::read_u8(u8 &u8valueOut)
 {
+	if (this->_directMemory != NULL)
+		return this->_directMemory->read_small<1>(&u8valueOut);
 	return fread(&u8valueOut,1);
 }
 
 u8 EMUFILE::read_u8()
 {
 	u8 value = 0;
-	fread(&value,1);
+	read_u8(value);
 	return value;
 }
 
@@ -531,3 +556,87 @@ void EMUFILE_FILE::__open(const char* fname, const char* mode)
 	this->_fname = fname;
 	strcpy(this->_mode, mode);
 }
+
+EMUFILE_MAPPING::EMUFILE_MAPPING(const char *fname)
+	: _data(NULL)
+	, _size(0)
+	, _mapped(false)
+#ifdef HOST_WINDOWS
+	, _mapHandle(NULL)
+#endif
+{
+#ifdef HOST_WINDOWS
+	HANDLE file = CreateFileW(mbstowcs((std::string)fname).c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (file == INVALID_HANDLE_VALUE)
+		return;
+
+	LARGE_INTEGER fileSize;
+	if (GetFileSizeEx(file, &fileSize) && fileSize.QuadPart > 0 && (u64)fileSize.QuadPart <= (u64)(size_t)-1)
+	{
+		this->_mapHandle = CreateFileMappingW(file, NULL, PAGE_READONLY, 0, 0, NULL);
+		if (this->_mapHandle != NULL)
+		{
+			this->_data = (u8 *)MapViewOfFile(this->_mapHandle, FILE_MAP_READ, 0, 0, 0);
+			if (this->_data == NULL)
+			{
+				CloseHandle(this->_mapHandle);
+				this->_mapHandle = NULL;
+			}
+		}
+		this->_size = (size_t)fileSize.QuadPart;
+		this->_mapped = (this->_data != NULL);
+	}
+	CloseHandle(file);
+#else
+	int fd = open(fname, O_RDONLY);
+	if (fd == -1)
+		return;
+
+	struct stat st;
+	if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0 && (u64)st.st_size <= (u64)(size_t)-1)
+	{
+		this->_size = (size_t)st.st_size;
+		void *map = mmap(NULL, this->_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (map != MAP_FAILED)
+		{
+			this->_data = (u8 *)map;
+			this->_mapped = true;
+		}
+	}
+	close(fd);
+#endif
+
+	if (this->_mapped || this->_size == 0)
+		return;
+
+	//couldn't map it, so read it instead
+	EMUFILE_FILE fp(fname, "rb");
+	if (fp.fail() || !fp.is_open())
+		return;
+
+	this->_data = (u8 *)malloc(this->_size);
+	if (this->_data != NULL && fp.fread(this->_data, this->_size) != this->_size)
+	{
+		free(this->_data);
+		this->_data = NULL;
+	}
+}
+
+EMUFILE_MAPPING::~EMUFILE_MAPPING()
+{
+	if (this->_data == NULL)
+		return;
+
+	if (!this->_mapped)
+	{
+		free(this->_data);
+		return;
+	}
+
+#ifdef HOST_WINDOWS
+	UnmapViewOfFile(this->_data);
+	CloseHandle(this->_mapHandle);
+#else
+	munmap(this->_data, this->_size);
+#endif
+}
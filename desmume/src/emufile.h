@@ -49,9 +49,15 @@ class EMUFILE {
 protected:
 	bool _failbit;
 
+	//set by EMUFILE_MEMORY so that the small fixed size helpers below (read_32LE() etc.) can work on its buffer
+	//directly instead of going through the virtual fread()/fwrite() for every value.
+	//a subclass of EMUFILE_MEMORY that overrides _fread() or fwrite() turns this off through its constructor.
+	EMUFILE_MEMORY *_directMemory;
+
 public:
 	EMUFILE()
 		: _failbit(false)
+		, _directMemory(NULL)
 	{}
 
 
@@ -153,23 +159,57 @@ protected:
 
 	void reserve(u32 amt) {
 		if(vec->size() < amt)
-			vec->resize(amt);
+		{
+			//a vector we own is only ever seen through len, so it can grow ahead of it. that way a stream
+			//written in small pieces isn't resized (and zero-filled) again for every piece
+			if(ownvec)
+				vec->resize(std::max<size_t>(amt, vec->size() * 2));
+			else
+				vec->resize(amt);
+		}
 	}
 
+	//for subclasses that override _fread() or fwrite(): those have to see every read and write, so the
+	//fixed size helpers mustn't go around them to the buffer
+	EMUFILE_MEMORY(std::vector<u8> *underlying, bool allowDirectAccess) : vec(underlying), ownvec(false), pos(0), len((s32)underlying->size()) { _directMemory = allowDirectAccess ? this : NULL; }
+
 public:
 
-	EMUFILE_MEMORY(std::vector<u8> *underlying) : vec(underlying), ownvec(false), pos(0), len((s32)underlying->size()) { }
+	EMUFILE_MEMORY(std::vector<u8> *underlying) : vec(underlying), ownvec(false), pos(0), len((s32)underlying->size()) { _directMemory = this; }
 	EMUFILE_MEMORY(u32 preallocate) : vec(new std::vector<u8>()), ownvec(true), pos(0), len(0) { 
+		_directMemory = this;
 		vec->resize(preallocate);
 		len = preallocate;
 	}
-	EMUFILE_MEMORY() : vec(new std::vector<u8>()), ownvec(true), pos(0), len(0) { vec->reserve(1024); }
+	EMUFILE_MEMORY() : vec(new std::vector<u8>()), ownvec(true), pos(0), len(0) { _directMemory = this; vec->reserve(1024); }
 	EMUFILE_MEMORY(void* buf, s32 size) : vec(new std::vector<u8>()), ownvec(true), pos(0), len(size) { 
+		_directMemory = this;
 		vec->resize(size);
 		if(size != 0)
 			memcpy(&vec->front(),buf,size);
 	}
 
+	//a copy gets its own vector if the original owned one, and always points _directMemory at itself
+	EMUFILE_MEMORY(const EMUFILE_MEMORY &other)
+		: EMUFILE(other), vec(other.ownvec ? new std::vector<u8>(*other.vec) : other.vec), ownvec(other.ownvec), pos(other.pos), len(other.len)
+	{
+		_directMemory = (other._directMemory != NULL) ? this : NULL;
+	}
+
+	EMUFILE_MEMORY& operator=(const EMUFILE_MEMORY &other)
+	{
+		if(this == &other) return *this;
+		std::vector<u8> *newvec = other.ownvec ? new std::vector<u8>(*other.vec) : other.vec;
+		if(ownvec) delete vec;
+		vec = newvec;
+		ownvec = other.ownvec;
+		pos = other.pos;
+		len = other.len;
+		_failbit = other._failbit;
+		_directMemory = (other._directMemory != NULL) ? this : NULL;
+		return *this;
+	}
+
 	~EMUFILE_MEMORY() {
 		if(ownvec) delete vec;
 	}
@@ -188,7 +228,38 @@ public:
 		return &(*vec)[0];
 	}
 
-	std::vector<u8>* get_vec() const { return vec; };
+	//the vector is trimmed to the stream's size first, since a vector the stream owns may have grown ahead of it
+	std::vector<u8>* get_vec() { trim(); return vec; };
+
+	//empties the stream but keeps its buffer, so that the next stream of about the same size can be written without reallocating
+	void reset()
+	{
+		pos = 0;
+		len = 0;
+		if(!ownvec)
+			vec->clear();
+	}
+
+	template<size_t N>
+	void write_small(const void *ptr)
+	{
+		if ((size_t)pos + N > vec->size())
+			reserve(pos + (s32)N);
+		memcpy(vec->data() + pos, ptr, N);
+		pos += (s32)N;
+		if (pos > len)
+			len = pos;
+	}
+
+	template<size_t N>
+	size_t read_small(void *ptr)
+	{
+		if ((pos < 0) || (len - pos < (s32)N))
+			return _fread(ptr, N);
+		memcpy(ptr, vec->data() + pos, N);
+		pos += (s32)N;
+		return N;
+	}
 
 	virtual FILE *get_fp() { return NULL; }
 
@@ -223,7 +294,7 @@ public:
 			this->_failbit = true;
 			return -1;
 		}
-		temp = buf()[pos];
+		temp = (*vec)[pos];
 		pos++;
 		return temp;
 	}
@@ -244,7 +315,8 @@ public:
 	virtual size_t _fread(const void *ptr, size_t bytes);
 	virtual size_t fwrite(const void *ptr, size_t bytes){
 		reserve(pos+(s32)bytes);
-		memcpy(buf()+pos,ptr,bytes);
+		//don't go through buf(), its size() check is a virtual call
+		memcpy(vec->data()+pos,ptr,bytes);
 		pos += (s32)bytes;
 		len = std::max(pos,len);
 		
@@ -369,4 +441,31 @@ public:
 
 };
 
+//a read-only view of a whole file.
+//the file is memory mapped where the platform allows it, so opening even a big file costs nothing until its pages are touched.
+//otherwise (or if mapping fails) it is read into memory.
+class EMUFILE_MAPPING {
+private:
+	u8 *_data;
+	size_t _size;
+	bool _mapped;
+#ifdef HOST_WINDOWS
+	void *_mapHandle;
+#endif
+
+	EMUFILE_MAPPING(const EMUFILE_MAPPING &);
+	EMUFILE_MAPPING& operator=(const EMUFILE_MAPPING &);
+
+public:
+	EMUFILE_MAPPING(const char *fname);
+	~EMUFILE_MAPPING();
+
+	//false if the file couldn't be opened or is empty
+	bool is_open() const { return this->_data != NULL; }
+	bool is_mapped() const { return this->_mapped; }
+
+	const u8* data() const { return this->_data; }
+	size_t size() const { return this->_size; }
+};
+
 #endif
@@ -316,6 +316,41 @@ EXPORTED void desmume_volume_set(int volume)
     SNDSDLSetAudioVolume(volume);
 }
 
+EXPORTED void desmume_perf_counters_set_enabled(BOOL enabled)
+{
+    NDS_SetPerfCountersEnabled(enabled != FALSE);
+}
+
+EXPORTED BOOL desmume_perf_counters_get_enabled()
+{
+    return nds_perfCountersEnabled;
+}
+
+EXPORTED int desmume_perf_counters_count()
+{
+    return NDS_PERF_COUNTER_COUNT;
+}
+
+EXPORTED const char *desmume_perf_counters_name(int counter)
+{
+    return NDS_GetPerfCounterName(counter);
+}
+
+EXPORTED int desmume_perf_counters_get_frames(u64 *counters, int *frame_numbers, int max_frames)
+{
+    if (max_frames <= 0)
+        return 0;
+
+    std::vector<NDSPerfFrame> frames(std::min(max_frames, NDS_PERF_HISTORY));
+    size_t count = NDS_GetPerfFrames(&frames[0], frames.size());
+    for (size_t i = 0; i < count; i++) {
+        memcpy(counters + i * NDS_PERF_COUNTER_COUNT, frames[i].counters, sizeof(frames[i].counters));
+        if (frame_numbers != NULL)
+            frame_numbers[i] = frames[i].frame;
+    }
+    return (int)count;
+}
+
 EXPORTED unsigned char desmume_memory_read_byte(int address)
 {
     return (unsigned char)(_MMU_read08<ARMCPU_ARM9>(address) & 0xFF);
@@ -606,7 +641,7 @@ EXPORTED BOOL desmume_movie_is_finished()
 
 EXPORTED int desmume_movie_get_length()
 {
-    return currMovieData.records.size();
+    return currMovieData.getNumRecords();
 }
 
 EXPORTED char *desmume_movie_get_name()
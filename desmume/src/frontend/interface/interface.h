@@ -114,6 +114,15 @@ EXPORTED void desmume_gpu_set_layer_sub_enable_state(int layer_index, BOOL the_s
 EXPORTED int desmume_volume_get();
 EXPORTED void desmume_volume_set(int volume);
 
+// Per-frame performance counters (see NDS_PERF_COUNTER in NDSSystem.h). Enabling them clears the frames collected before.
+EXPORTED void desmume_perf_counters_set_enabled(BOOL enabled);
+EXPORTED BOOL desmume_perf_counters_get_enabled();
+EXPORTED int desmume_perf_counters_count();
+EXPORTED const char *desmume_perf_counters_name(int counter);
+// Copies the counters of up to the last max_frames frames, oldest first: desmume_perf_counters_count() values per frame
+// into counters, and the frame numbers into frame_numbers if it isn't NULL. Returns the number of frames copied.
+EXPORTED int desmume_perf_counters_get_frames(u64 *counters, int *frame_numbers, int max_frames);
+
 EXPORTED unsigned char desmume_memory_read_byte(int address);
 EXPORTED signed char desmume_memory_read_byte_signed(int address);
 EXPORTED unsigned short desmume_memory_read_short(int address);
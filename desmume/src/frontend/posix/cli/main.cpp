@@ -24,6 +24,10 @@
 #include <stdlib.h>
 #include <string.h>
 #include <glib.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <map>
 
 #ifndef VERSION
 #define VERSION "Unknown version"
@@ -34,6 +38,7 @@
 #endif
 
 #include "../NDSSystem.h"
+#include "../MMU.h"
 #include "../driver.h"
 #include "../GPU.h"
 #include "../SPU.h"
@@ -42,6 +47,8 @@
 #include "../render3D.h"
 #include "../rasterize.h"
 #include "../saves.h"
+#include "../movie.h"
+#include "../cheatSystem.h"
 #include "../frontend/modules/osd/agg/agg_osd.h"
 #include "../shared/desmume_config.h"
 #include "../commandline.h"
@@ -218,7 +225,12 @@ fill_config( class configured_features *config,
     goto error;
   }
 
-  if (config->nds_file == "") {
+  if (config->perf_counters < 0 || config->perf_counters > NDS_PERF_HISTORY) {
+    g_printerr("Performance counters can be averaged over 1 to %d frames.\n", NDS_PERF_HISTORY);
+    goto error;
+  }
+
+  if (config->nds_file == "" && config->replay_3d_file == "" && config->convert_movie_file == "" && config->cheatsearch_bench_loops == -1) {
     g_printerr("Need to specify file to load.\n");
     goto error;
   }
@@ -268,6 +280,121 @@ static void
 resizeWindow_stub (u16 width, u16 height, void *screen_texture) {
 }
 
+/*
+ * Movie sync check. Verifying runs every segment between two checkpoints in
+ * its own desmume-cli process (this command line plus --sync-segment), a few
+ * at a time. Each one leaves its result in a file next to the checkpoints.
+ */
+static std::string
+sync_check_result_path(const char *dir, int segment) {
+  char name[32];
+  snprintf(name, sizeof(name), "/segment_%06d.result", segment);
+  return (std::string)dir + name;
+}
+
+static pid_t
+sync_check_spawn(int argc, char ** argv, int segment) {
+  pid_t pid = fork();
+  if (pid != 0)
+    return pid;
+
+  /* keep the emulator's own output from drowning out the report */
+  int devnull = open("/dev/null", O_WRONLY);
+  if (devnull >= 0)
+    dup2(devnull, STDOUT_FILENO);
+
+  char segment_arg[32];
+  snprintf(segment_arg, sizeof(segment_arg), "--sync-segment=%d", segment);
+
+  std::vector<char *> args(argv, argv + argc);
+  args.push_back(segment_arg);
+  args.push_back(NULL);
+
+  execvp(argv[0], &args[0]);
+  _exit(127);
+}
+
+static int
+sync_check_verify(class configured_features *config, int argc, char ** argv) {
+  const char *dir = config->sync_verify_dir.c_str();
+  const char *movie = config->play_movie_file.c_str();
+
+  if (config->sync_segment >= 0) {
+    int result = FCEUMOV_SyncCheckVerifySegment(movie, dir, config->sync_segment);
+    FILE *fp = fopen(sync_check_result_path(dir, config->sync_segment).c_str(), "w");
+    if (fp) {
+      fprintf(fp, "%d\n", result);
+      fclose(fp);
+    }
+    return (result == SYNCCHECK_INSYNC) ? 0 : 1;
+  }
+
+  int segments = FCEUMOV_SyncCheckSegmentCount(dir);
+  if (segments < 0) {
+    fprintf(stderr, "No sync check recording found in %s\n", dir);
+    return 1;
+  }
+
+  size_t jobs = (config->sync_jobs > 0) ? config->sync_jobs : CommonSettings.num_cores;
+  std::map<pid_t, int> running;
+  int next_segment = 0;
+  int failed_segment = segments;
+  int failed_result = SYNCCHECK_INSYNC;
+
+  /* segments after a failed one don't matter anymore, but earlier ones still do */
+  while (next_segment < failed_segment || !running.empty()) {
+    while (running.size() < jobs && next_segment < failed_segment) {
+      pid_t pid = sync_check_spawn(argc, argv, next_segment);
+      if (pid < 0) {
+        fprintf(stderr, "Could not start a sync check process\n");
+        failed_segment = next_segment;
+        failed_result = SYNCCHECK_ERROR;
+        break;
+      }
+      running[pid] = next_segment++;
+    }
+
+    if (running.empty())
+      break;
+
+    int status;
+    pid_t pid = waitpid(-1, &status, 0);
+    if (pid < 0)
+      break;
+    if (running.find(pid) == running.end())
+      continue;
+
+    int segment = running[pid];
+    running.erase(pid);
+
+    int result = SYNCCHECK_ERROR;
+    std::string result_path = sync_check_result_path(dir, segment);
+    FILE *fp = fopen(result_path.c_str(), "r");
+    if (fp) {
+      if (fscanf(fp, "%d", &result) != 1)
+        result = SYNCCHECK_ERROR;
+      fclose(fp);
+      remove(result_path.c_str());
+    }
+
+    if (result != SYNCCHECK_INSYNC && segment < failed_segment) {
+      failed_segment = segment;
+      failed_result = result;
+    }
+  }
+
+  if (failed_segment == segments) {
+    printf("Sync check: all %d segments are in sync\n", segments);
+    return 0;
+  }
+
+  if (failed_result == SYNCCHECK_ERROR)
+    printf("Sync check: segment %d could not be verified\n", failed_segment);
+  else
+    printf("Sync check: first desync at frame %d (segment %d)\n", failed_result, failed_segment);
+  return 1;
+}
+
 static void Draw(class configured_features *cfg) {
 	const float scale = cfg->scale;
 	const unsigned w = GPU_FRAMEBUFFER_NATIVE_WIDTH, h = GPU_FRAMEBUFFER_NATIVE_HEIGHT;
@@ -345,12 +472,30 @@ static gdbstub_handle_t setup_gdb_stub(u16 port, armcpu_t *cpu, const armcpu_mem
 }
 #endif
 
+static void print_perf_counters(int frames)
+{
+  NDSPerfFrame history[NDS_PERF_HISTORY];
+  size_t count = NDS_GetPerfFrames(history, frames);
+  if (count == 0)
+    return;
+
+  printf("Frames %d-%d:", history[0].frame, history[count - 1].frame);
+  for (int c = 0; c < NDS_PERF_COUNTER_COUNT; c++) {
+    u64 sum = 0;
+    for (size_t i = 0; i < count; i++)
+      sum += history[i].counters[c];
+    printf(" %s=%llu", NDS_GetPerfCounterName(c), (unsigned long long)(sum / count));
+  }
+  printf("\n");
+}
+
 int main(int argc, char ** argv) {
   class configured_features my_config;
   struct ctrls_event_config ctrls_cfg;
 
   int limiter_frame_counter = 0;
   int limiter_tick0 = 0;
+  int perf_frame_counter = 0;
   int error;
   unsigned i;
 
@@ -372,6 +517,14 @@ int main(int argc, char ** argv) {
     exit(1);
   }
 
+  if (my_config.convert_movie_file != "") {
+    bool convert_ok = FCEUMOV_ConvertMovie(my_config.play_movie_file.c_str(), my_config.convert_movie_file.c_str());
+    if (!convert_ok)
+      fprintf(stderr, "Could not convert %s\n", my_config.play_movie_file.c_str());
+    NDS_DeInit();
+    return (convert_ok) ? 0 : 1;
+  }
+
   /* use any language set on the command line */
   if ( my_config.firmware_language != -1) {
     CommonSettings.fwConfig.language = my_config.firmware_language;
@@ -468,7 +621,9 @@ int main(int argc, char ** argv) {
   }
 #endif
 
-  if ( !my_config.disable_sound) {
+  bool sync_check = (my_config.sync_record_dir != "" || my_config.sync_verify_dir != "");
+
+  if ( !my_config.disable_sound && !sync_check) {
     SPU_ChangeSoundCore(SNDCORE_SDL, 735 * 4);
   }
 
@@ -477,6 +632,19 @@ int main(int argc, char ** argv) {
     fprintf(stderr, "3D renderer initialization failed!\nFalling back to 3D core: %s\n", core3DList[RENDERID_SOFTRASTERIZER]->name);
   }
 
+  if (my_config.replay_3d_file != "") {
+    GFX3D_ReplayStats replay_stats;
+    bool replay_ok = GFX3D_ReplayCapture(my_config.replay_3d_file.c_str(), my_config.replay_3d_loops, replay_stats);
+    NDS_DeInit();
+    return (replay_ok) ? 0 : 1;
+  }
+
+  if (my_config.cheatsearch_bench_loops > 0) {
+    bool bench_ok = CHEATSEARCH_Benchmark(my_config.cheatsearch_bench_loops);
+    NDS_DeInit();
+    return (bench_ok) ? 0 : 1;
+  }
+
   backup_setManualBackupType(my_config.savetype);
 
   error = NDS_LoadROM( my_config.nds_file.c_str() );
@@ -485,8 +653,41 @@ int main(int argc, char ** argv) {
     exit(-1);
   }
 
+  if (my_config.savestate_bench_loops > 0) {
+    if (my_config.load_slot != -1) {
+      loadstate_slot(my_config.load_slot);
+    }
+    bool bench_ok = savestate_Benchmark(my_config.savestate_bench_loops);
+    NDS_DeInit();
+    return (bench_ok) ? 0 : 1;
+  }
+
+  if (my_config.check_save_flush) {
+    bool flush_ok = MMU_new.backupDevice.checkFlush();
+    NDS_DeInit();
+    return (flush_ok) ? 0 : 1;
+  }
+
+  if (my_config.capture_3d_file != "") {
+    GFX3D_CaptureBegin(my_config.capture_3d_file.c_str());
+  }
+
+  if (sync_check) {
+    int sync_ret;
+    if (my_config.sync_record_dir != "")
+      sync_ret = FCEUMOV_SyncCheckRecord(my_config.play_movie_file.c_str(), my_config.sync_record_dir.c_str(), my_config.sync_interval) ? 0 : 1;
+    else
+      sync_ret = sync_check_verify(&my_config, argc, argv);
+    NDS_DeInit();
+    return sync_ret;
+  }
+
   execute = true;
 
+  if (my_config.perf_counters > 0) {
+    NDS_SetPerfCountersEnabled(true);
+  }
+
   /* X11 multi-threading support */
   if(!XInitThreads())
     {
@@ -576,6 +777,14 @@ int main(int argc, char ** argv) {
         desmume_cycle(&ctrls_cfg);
     }
 
+    if (my_config.perf_counters > 0) {
+      perf_frame_counter += 1 + my_config.frameskip;
+      if (perf_frame_counter >= my_config.perf_counters) {
+        print_perf_counters(my_config.perf_counters);
+        perf_frame_counter = 0;
+      }
+    }
+
 #ifdef DISPLAY_FPS
     now = SDL_GetTicks();
 #endif
@@ -18,6 +18,7 @@
 
 #include <stdlib.h>
 #include <string.h>
+#include <atomic>
 
 #include <SDL.h>
 #include "types.h"
@@ -38,6 +39,8 @@ u32 SNDSDLGetAudioSpace();
 void SNDSDLMuteAudio();
 void SNDSDLUnMuteAudio();
 void SNDSDLSetVolume(int volume);
+void SNDSDLFetchSamples(s16 *sampleBuffer, size_t sampleCount, ESynchMode synchMode, ISynchronizingAudioBuffer *theSynchronizer);
+size_t SNDSDLPostProcessSamples(s16 *postProcessBuffer, size_t requestedSampleCount, ESynchMode synchMode, ISynchronizingAudioBuffer *theSynchronizer);
 
 SoundInterface_struct SNDSDL = {
 SNDCORE_SDL,
@@ -48,16 +51,103 @@ SNDSDLUpdateAudio,
 SNDSDLGetAudioSpace,
 SNDSDLMuteAudio,
 SNDSDLUnMuteAudio,
-SNDSDLSetVolume
+SNDSDLSetVolume,
+NULL,
+SNDSDLFetchSamples,
+SNDSDLPostProcessSamples
 };
 
-static u8 *stereodata;
+/* the samples go from the emulator to the SDL callback through a single producer/single consumer
+   ring, so neither side ever has to take the SDL audio lock. the producer is whatever thread runs
+   the SPU (SPU_Emulate_core() in synchronous mode, SPU_Emulate_user() in dual synch/asynch mode).
+
+   instead of dropping or duplicating samples when the emulator runs a little fast or slow, the
+   producer resamples by up to +/-0.5% to keep the ring filled at a constant level. the level is
+   one device buffer plus half a frame of audio: the emulator produces its samples in a burst once
+   a frame, so the ring swings about half a frame either side of the level, and the low point still
+   leaves a device buffer in hand. with the device buffer on top, that is 623 + 256 samples, just
+   under 20ms at 44100Hz. */
+#define SNDSDL_DEVICE_SAMPLES   256
+#define SNDSDL_RING_SIZE        8192 /* in stereo samples, must be a power of 2 */
+#define SNDSDL_TARGET_FILL      (SNDSDL_DEVICE_SAMPLES + (DESMUME_SAMPLE_RATE / 120))
+#define SNDSDL_MAX_RATE_ADJUST  0.005
+#define SNDSDL_FILL_SMOOTHING   (1.0 / 64.0)
+
+static s16 ringdata[SNDSDL_RING_SIZE * 2];
+static std::atomic<u32> ringread(0);
+static std::atomic<u32> ringwrite(0);
+
+/* producer side resampler state */
+static double fillaverage;
+static u32 resamplepos; /* 16.16 position, relative to lastframe */
+static s16 lastframe[2];
+
 static u8 *mixerdata;
-static u32 soundoff;
-static u32 soundbufsize;
 static SDL_AudioSpec audiofmt;
 int audio_volume;
 
+static u32 RingFill()
+{
+   return ringwrite.load(std::memory_order_relaxed) - ringread.load(std::memory_order_acquire);
+}
+
+static void RingReset()
+{
+   ringread.store(0);
+   ringwrite.store(0);
+   fillaverage = SNDSDL_TARGET_FILL;
+   resamplepos = 0;
+   lastframe[0] = lastframe[1] = 0;
+}
+
+static void RingPushSamples(const s16 *buffer, u32 num_samples)
+{
+   if (num_samples == 0)
+      return;
+
+   /* steer the playback rate towards the target fill level */
+   const u32 fill = RingFill();
+   fillaverage += ((double)fill - fillaverage) * SNDSDL_FILL_SMOOTHING;
+
+   double adjust = (fillaverage - SNDSDL_TARGET_FILL) / SNDSDL_TARGET_FILL * SNDSDL_MAX_RATE_ADJUST * 2.0;
+   if (adjust > SNDSDL_MAX_RATE_ADJUST) adjust = SNDSDL_MAX_RATE_ADJUST;
+   if (adjust < -SNDSDL_MAX_RATE_ADJUST) adjust = -SNDSDL_MAX_RATE_ADJUST;
+
+   /* how far to step through the input for each output sample, in 16.16 */
+   const u32 step = (u32)((1.0 + adjust) * 65536.0 + 0.5);
+   const u32 end = num_samples << 16;
+
+   u32 writeindex = ringwrite.load(std::memory_order_relaxed);
+   const u32 readindex = ringread.load(std::memory_order_acquire);
+
+   for (; resamplepos < end; resamplepos += step)
+   {
+      if ((writeindex - readindex) >= SNDSDL_RING_SIZE)
+         break; /* overflow, nobody is listening */
+
+      const u32 index = resamplepos >> 16;
+      const s32 frac = (s32)(resamplepos & 0xFFFF);
+      const s16 *a = (index == 0) ? lastframe : buffer + ((index - 1) * 2);
+      const s16 *b = buffer + (index * 2);
+      s16 *out = ringdata + ((writeindex & (SNDSDL_RING_SIZE - 1)) * 2);
+
+      /* the difference takes 17 bits and frac 16, so the product needs 64 */
+      out[0] = (s16)(a[0] + (s32)(((s64)(b[0] - a[0]) * frac) >> 16));
+      out[1] = (s16)(a[1] + (s32)(((s64)(b[1] - a[1]) * frac) >> 16));
+      writeindex++;
+   }
+
+   if (resamplepos >= end)
+      resamplepos -= end;
+   else
+      resamplepos = 0;
+
+   lastframe[0] = buffer[(num_samples - 1) * 2 + 0];
+   lastframe[1] = buffer[(num_samples - 1) * 2 + 1];
+
+   ringwrite.store(writeindex, std::memory_order_release);
+}
+
 //////////////////////////////////////////////////////////////////////////////
 #ifdef _XBOX
 static volatile bool doterminate;
@@ -79,23 +169,31 @@ DWORD WINAPI SNDXBOXThread( LPVOID )
 
 
 static void MixAudio(void *userdata, Uint8 *stream, int len) {
-   int i;
    /* if the volume is max, we don't need to call the mixer and do additional
       memory copying/cleaning, but can copy directly into the SDL buffer. */
-   u8 *dest = audio_volume == SDL_MIX_MAXVOLUME ? stream : mixerdata;
-   SDL_LockAudio();
-   if (len > soundoff) {
-        //dprintf(2, "bu: want %u, got %u\n", (unsigned)len, (unsigned)soundoff);
-        /* buffer underrun - rather than zeroing out SDL's audio buffer, we just
-           hand back the existing data, which reduces cracking */
-	len = soundoff;
+   s16 *dest = (s16 *)(audio_volume == SDL_MIX_MAXVOLUME ? stream : mixerdata);
+   const u32 wanted = (u32)len / 4;
+   u32 readindex = ringread.load(std::memory_order_relaxed);
+   const u32 available = ringwrite.load(std::memory_order_acquire) - readindex;
+   const u32 count = (wanted < available) ? wanted : available;
+
+   for (u32 i = 0; i < count; i++, readindex++)
+   {
+      const s16 *in = ringdata + ((readindex & (SNDSDL_RING_SIZE - 1)) * 2);
+      dest[i * 2 + 0] = in[0];
+      dest[i * 2 + 1] = in[1];
    }
-   memcpy(dest, stereodata, len);
-   soundoff -= len;
-   /* move rest of prebuffered data to the beginning of the buffer */
-   if (soundoff)
-      memmove(stereodata, stereodata+len, soundoff);
-   SDL_UnlockAudio();
+
+   /* buffer underrun - hold the last sample rather than cutting to zero,
+      which reduces cracking */
+   for (u32 i = count; i < wanted; i++)
+   {
+      dest[i * 2 + 0] = (i > 0) ? dest[i * 2 - 2] : 0;
+      dest[i * 2 + 1] = (i > 0) ? dest[i * 2 - 1] : 0;
+   }
+
+   ringread.store(readindex, std::memory_order_release);
+
    if(audio_volume != SDL_MIX_MAXVOLUME) {
       memset(stream, 0, len);
       SDL_MixAudio(stream, mixerdata, len, audio_volume);
@@ -112,17 +210,11 @@ int SNDSDLInit(int buffersize)
    audiofmt.freq = DESMUME_SAMPLE_RATE;
    audiofmt.format = AUDIO_S16SYS;
    audiofmt.channels = 2;
-   audiofmt.samples = (audiofmt.freq / 60) * 2;
+   //samples should be a power of 2 according to SDL-doc
+   audiofmt.samples = SNDSDL_DEVICE_SAMPLES;
    audiofmt.callback = MixAudio;
    audiofmt.userdata = NULL;
 
-   //samples should be a power of 2 according to SDL-doc
-   //so normalize it to the nearest power of 2 here
-   u32 normSamples = 512;
-   while (normSamples < audiofmt.samples) normSamples <<= 1;
-
-   audiofmt.samples = normSamples;
-
    SDL_AudioSpec obtained;
    if (SDL_OpenAudio(&audiofmt, &obtained) != 0)
    {
@@ -131,15 +223,9 @@ int SNDSDLInit(int buffersize)
 
    audiofmt = obtained;
 
-   /* allocate multiple of the size needed by SDL to be able to efficiently pre-buffer.
-      we effectively need the engine to pre-buffer a couple milliseconds because the
-      frontend might call SDL_Delay() to achieve the desired framerate, during which
-      the buffer isn't updated by the SPU. */
-   soundbufsize = audiofmt.size * 4;
-   soundoff = 0;
+   RingReset();
 
-   if ((stereodata = (u8*)calloc(soundbufsize, 1)) == NULL ||
-       (mixerdata  = (u8*)calloc(soundbufsize, 1)) == NULL)
+   if ((mixerdata = (u8*)calloc(audiofmt.size, 1)) == NULL)
       return -1;
 
 #ifdef _XBOX
@@ -165,9 +251,7 @@ void SNDSDLDeInit()
 #endif
    SDL_CloseAudio();
 
-   free(stereodata);
    free(mixerdata);
-   stereodata = NULL;
    mixerdata = NULL;
 }
 
@@ -176,23 +260,34 @@ void SNDSDLDeInit()
 void SNDSDLUpdateAudio(s16 *buffer, u32 num_samples)
 {
    // dprintf(2, "up: %u\n", num_samples);
-   u8 *incoming = (u8*) buffer;
-   u32 n = num_samples * 4;
-   SDL_LockAudio();
-   memcpy(stereodata+soundoff, incoming, n);
-   soundoff += n;
-   SDL_UnlockAudio();
+   RingPushSamples(buffer, num_samples);
 }
 
 //////////////////////////////////////////////////////////////////////////////
 
 u32 SNDSDLGetAudioSpace()
 {
-   u32 tmp;
-   SDL_LockAudio();
-   tmp = (soundbufsize - soundoff)/4;
-   SDL_UnlockAudio();
-   return tmp;
+   /* only ask for enough to reach the target level. the resampler takes care of the rest. */
+   const u32 fill = RingFill();
+   return (fill < SNDSDL_TARGET_FILL) ? (SNDSDL_TARGET_FILL - fill) : 0;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+
+/* in synchronous mode, the core's samples go straight into the ring instead of through
+   one of the metaspu synchronizers, which would drop or duplicate samples to keep up. */
+void SNDSDLFetchSamples(s16 *sampleBuffer, size_t sampleCount, ESynchMode synchMode, ISynchronizingAudioBuffer *theSynchronizer)
+{
+   if (synchMode == ESynchMode_Synchronous)
+      RingPushSamples(sampleBuffer, (u32)sampleCount);
+}
+
+size_t SNDSDLPostProcessSamples(s16 *postProcessBuffer, size_t requestedSampleCount, ESynchMode synchMode, ISynchronizingAudioBuffer *theSynchronizer)
+{
+   if (synchMode == ESynchMode_Synchronous)
+      return 0;
+
+   return SPU_DefaultPostProcessSamples(postProcessBuffer, requestedSampleCount, synchMode, theSynchronizer);
 }
 
 //////////////////////////////////////////////////////////////////////////////
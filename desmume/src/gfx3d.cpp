@@ -34,6 +34,10 @@
 #include <string.h>
 #include <algorithm>
 #include <queue>
+#include <vector>
+#include <zlib.h>
+
+#include <features/features_cpu.h>
 
 #include "armcpu.h"
 #include "debug.h"
@@ -50,6 +54,7 @@
 #include "readwrite.h"
 #include "FIFO.h"
 #include "utils/bits.h"
+#include "utils/task.h"
 #include "movie.h" //only for currframecounter which really ought to be moved into the core emu....
 
 //#define _SHOW_VTX_COUNTERS	// show polygon/vertex counters on screen
@@ -116,6 +121,46 @@ public:
 
 	void receive(u32 val) 
 	{
+		u8 cmd[4];
+		u32 param[4];
+		const size_t count = this->_decode(val, cmd, param);
+
+		for (size_t i = 0; i < count; i++)
+			GFX_FIFOsend(cmd[i], param[i]);
+	}
+
+	//decodes a whole run of packed command words (such as a gxfifo DMA block) in one pass,
+	//and then pushes the resulting commands into the fifo together so that the fifo
+	//events and the scheduling cost only get handled once for the entire run.
+	void receiveBatch(const u32 *val, size_t count)
+	{
+		static const size_t BATCH_SIZE = 512;
+		u8 cmd[BATCH_SIZE];
+		u32 param[BATCH_SIZE];
+		size_t cmdCount = 0;
+
+		for (size_t i = 0; i < count; i++)
+		{
+			//each word can produce at most 4 commands
+			if (cmdCount > (BATCH_SIZE - 4))
+			{
+				GFX_FIFOsendBatch(cmd, param, cmdCount);
+				cmdCount = 0;
+			}
+
+			cmdCount += this->_decode(val[i], cmd + cmdCount, param + cmdCount);
+		}
+
+		if (cmdCount > 0)
+			GFX_FIFOsendBatch(cmd, param, cmdCount);
+	}
+
+private:
+
+	size_t _decode(u32 val, u8 *outCmd, u32 *outParam)
+	{
+		size_t outCount = 0;
+
 		//so, it seems as if the dummy values and restrictions on the highest-order command in the packed command set 
 		//is solely about some unknown internal timing quirk, and not about the logical behaviour of the state machine.
 		//it's possible that writing some values too quickly can result in the gxfifo not being ready. 
@@ -155,11 +200,13 @@ public:
 		//finish receiving args
 		if(paramCounter>0)
 		{
-			GFX_FIFOsend(currCommand, val);
+			outCmd[outCount] = currCommand;
+			outParam[outCount] = val;
+			outCount++;
 			paramCounter--;
 			if(paramCounter <= 0)
 				shiftCommand >>= 8;
-			else return;
+			else return outCount;
 		}
 
 		//analyze current packed commands
@@ -172,7 +219,9 @@ public:
 				shiftCommand >>= 8;
 			else if(currCommandType == GFX_NOARG_COMMAND)
 			{
-				GFX_FIFOsend(currCommand, 0);
+				outCmd[outCount] = currCommand;
+				outParam[outCount] = 0;
+				outCount++;
 				shiftCommand >>= 8;
 			}
 			else if(currCommand == 0 && shiftCommand!=0)
@@ -194,9 +243,9 @@ public:
 				break;
 			}
 		}
-	}
 
-private:
+		return outCount;
+	}
 
 	u32 shiftCommand;
 	u32 paramCounter;
@@ -256,6 +305,11 @@ public:
 #define GFX_DELAY(x) NDS_RescheduleGXFIFO(1);
 #define GFX_DELAY_M2(x) NDS_RescheduleGXFIFO(1);
 
+//this is a SPEED HACK
+//fifo is currently emulated more accurately than it probably needs to be.
+//without this batch size the emuloop will escape way too often to run fast.
+static const size_t HACK_FIFO_BATCH_SIZE = 64;
+
 using std::max;
 using std::min;
 
@@ -265,6 +319,27 @@ static GFX3D_IOREG *_GFX3D_IORegisterMap = NULL;
 static NDSGeometryEngine _gEngine;
 static GFX3D gfx3d;
 
+// Polygon clipping is split into ranges of raw polygons that get clipped on worker threads.
+// Small lists aren't worth the synchronization cost, so they stay on the emulation thread.
+#define GFX3D_CLIPPER_MAX_THREADS 4
+#define GFX3D_CLIPPER_MIN_POLYS_PER_THREAD 256
+
+struct GFX3D_ClipperThreadParam
+{
+	ClipperMode clippingMode;
+	const GFX3D_GeometryList *gList;
+	CPoly *outCPolyUnsortedList;
+	size_t startIndex;
+	size_t endIndex;
+	s64 wScalar;
+	s64 hScalar;
+	size_t clipCount;
+};
+
+static Task *_clipperTask = NULL;
+static size_t _clipperThreadCount = 0;
+static GFX3D_ClipperThreadParam _clipperThreadParam[GFX3D_CLIPPER_MAX_THREADS];
+
 //tables that are provided to anyone
 CACHE_ALIGN u32 dsDepthExtend_15bit_to_24bit[32768];
 
@@ -409,10 +484,45 @@ void gfx3d_init()
 	
 	makeTables();
 	Render3D_Init();
+	
+	// The emulation thread always clips the first polygon range by itself, so we only
+	// need worker threads for the remaining ranges.
+	_clipperThreadCount = (CommonSettings.num_cores > 1) ? (size_t)CommonSettings.num_cores : 1;
+	if (_clipperThreadCount > GFX3D_CLIPPER_MAX_THREADS)
+	{
+		_clipperThreadCount = GFX3D_CLIPPER_MAX_THREADS;
+	}
+	
+	if (_clipperThreadCount > 1)
+	{
+		_clipperTask = new Task[_clipperThreadCount - 1];
+		
+		for (size_t i = 0; i < _clipperThreadCount - 1; i++)
+		{
+			char name[16];
+			snprintf(name, 16, "gfx3d clipper %d", (int)i);
+			_clipperTask[i].start(false, 0, name);
+		}
+	}
 }
 
 void gfx3d_deinit()
 {
+	if (_clipperTask != NULL)
+	{
+		for (size_t i = 0; i < _clipperThreadCount - 1; i++)
+		{
+			_clipperTask[i].finish();
+			_clipperTask[i].shutdown();
+		}
+		
+		delete[] _clipperTask;
+		_clipperTask = NULL;
+	}
+	
+	_clipperThreadCount = 0;
+	
+	GFX3D_CaptureEnd();
 	Render3D_DeInit();
 }
 
@@ -420,6 +530,7 @@ void gfx3d_reset()
 {
 	if (CurrentRenderer->GetRenderNeedsFinish())
 	{
+		NDSPerfTimer perfTimer(NDS_PERF_3D_RENDER_NS);
 		GPU->ForceRender3DFinishAndFlush(false);
 		CurrentRenderer->SetRenderNeedsFinish(false);
 		GPU->GetEventHandler()->DidRender3DEnd();
@@ -3153,45 +3264,41 @@ static void gfx3d_execute(u8 cmd, u32 param)
 
 void gfx3d_execute3D()
 {
-	u8	cmd = 0;
-	u32	param = 0;
+	u8	cmd[HACK_FIFO_BATCH_SIZE];
+	u32	param[HACK_FIFO_BATCH_SIZE];
 
 	//3d engine is locked up, or something.
 	//I dont think this should happen....
 	if (gfx3d.isSwapBuffersPending) return;
 
-	//this is a SPEED HACK
-	//fifo is currently emulated more accurately than it probably needs to be.
-	//without this batch size the emuloop will escape way too often to run fast.
-	static const size_t HACK_FIFO_BATCH_SIZE = 64;
-
-	for (size_t i = 0; i < HACK_FIFO_BATCH_SIZE; i++)
-	{
-		if (GFX_PIPErecv(&cmd, &param))
-		{
-			//if (gfx3d.isSwapBuffersPending) printf("Executing while swapbuffers is pending: %d:%08X\n",cmd,param);
-
-			//since we did anything at all, incur a pipeline motion cost.
-			//also, we can't let gxfifo sequencer stall until the fifo is empty.
-			//see...
-			GFX_DELAY(1); 
+	//pull the whole batch out of the fifo at once. since no cpu or dma can run while we're in here,
+	//the fifo events only need to be evaluated once for the batch (the fifo size only decreases).
+	const size_t count = GFX_PIPErecvBatch(cmd, param, HACK_FIFO_BATCH_SIZE);
+	if (count == 0) return;
 
-			//..these guys will ordinarily set a delay, but multi-param operations won't
-			//for the earlier params.
-			//printf("%05d:%03d:%12lld: executed 3d: %02X %08X\n",currFrameCounter, nds.VCount, nds_timer , cmd, param);
-			gfx3d_execute(cmd, param);
+	//since we did anything at all, incur a pipeline motion cost.
+	//also, we can't let gxfifo sequencer stall until the fifo is empty.
+	//see...
+	//..the commands will ordinarily set a delay, but multi-param operations won't
+	//for the earlier params.
+	NDS_RescheduleGXFIFO(count);
 
-			//this is a COMPATIBILITY HACK.
-			//this causes 3d to take virtually no time whatsoever to execute.
-			//this was done for marvel nemesis, but a similar family of 
-			//hacks for ridiculously fast 3d execution has proven necessary for a number of games.
-			//the true answer is probably dma bus blocking.. but lets go ahead and try this and
-			//check the compatibility, at the very least it will be nice to know if any games suffer from
-			//3d running too fast
-			MMU.gfx3dCycles = nds_timer+1;
-		} else break;
+	NDSPerfTimer perfTimer(NDS_PERF_3D_GEOMETRY_NS);
+	for (size_t i = 0; i < count; i++)
+	{
+		//if (gfx3d.isSwapBuffersPending) printf("Executing while swapbuffers is pending: %d:%08X\n",cmd[i],param[i]);
+		//printf("%05d:%03d:%12lld: executed 3d: %02X %08X\n",currFrameCounter, nds.VCount, nds_timer , cmd[i], param[i]);
+		gfx3d_execute(cmd[i], param[i]);
 	}
 
+	//this is a COMPATIBILITY HACK.
+	//this causes 3d to take virtually no time whatsoever to execute.
+	//this was done for marvel nemesis, but a similar family of 
+	//hacks for ridiculously fast 3d execution has proven necessary for a number of games.
+	//the true answer is probably dma bus blocking.. but lets go ahead and try this and
+	//check the compatibility, at the very least it will be nice to know if any games suffer from
+	//3d running too fast
+	MMU.gfx3dCycles = nds_timer+1;
 }
 
 void gfx3d_glFlush(const u32 param)
@@ -3210,33 +3317,105 @@ void gfx3d_glFlush(const u32 param)
 	GFX_DELAY(1);
 }
 
-static bool gfx3d_ysort_compare(const u16 idx1, const u16 idx2)
+// Maps a signed sort key to an unsigned key with the same ordering.
+static FORCEINLINE u64 gfx3d_ysort_key(const s64 y)
+{
+	return (u64)y ^ 0x8000000000000000ULL;
+}
+
+template <bool USEMAX>
+static void gfx3d_ysort_radix_pass(const u16 *__restrict inIndex, u16 *__restrict outIndex, const size_t count, const u32 shift)
 {
-	const CPoly &cp1 = gfx3d.clippedPolyUnsortedList[idx1];
-	const CPoly &cp2 = gfx3d.clippedPolyUnsortedList[idx2];
+	const s64 *__restrict sortY = (USEMAX) ? gfx3d.rawPolySortYMax : gfx3d.rawPolySortYMin;
+	size_t bucket[256];
+	memset(bucket, 0, sizeof(bucket));
 	
-	const s64 &y1Max = gfx3d.rawPolySortYMax[cp1.index];
-	const s64 &y2Max = gfx3d.rawPolySortYMax[cp2.index];
+	for (size_t i = 0; i < count; i++)
+	{
+		const u64 key = gfx3d_ysort_key(sortY[gfx3d.clippedPolyUnsortedList[inIndex[i]].index]);
+		bucket[(key >> shift) & 0xFF]++;
+	}
 	
-	const s64 &y1Min = gfx3d.rawPolySortYMin[cp1.index];
-	const s64 &y2Min = gfx3d.rawPolySortYMin[cp2.index];
+	for (size_t i = 0, offset = 0; i < 256; i++)
+	{
+		const size_t n = bucket[i];
+		bucket[i] = offset;
+		offset += n;
+	}
 	
-	//this may be verified by checking the game create menus in harvest moon island of happiness
-	//also the buttons in the knights in the nightmare frontend depend on this and the perspective division
-	if (y1Max != y2Max)
-		return (y1Max < y2Max);
-	if (y1Min != y2Min)
-		return (y1Min < y2Min);
+	for (size_t i = 0; i < count; i++)
+	{
+		const u64 key = gfx3d_ysort_key(sortY[gfx3d.clippedPolyUnsortedList[inIndex[i]].index]);
+		outIndex[bucket[(key >> shift) & 0xFF]++] = inIndex[i];
+	}
+}
+
+//sorts the index list by the max y-value, then by the min y-value.
+//this may be verified by checking the game create menus in harvest moon island of happiness
+//also the buttons in the knights in the nightmare frontend depend on this and the perspective division
+//
+//notably, the main shop interface in harvest moon will not have a correct RTN button
+//i think this is due to a math error rounding its position to one pixel too high and it popping behind
+//the bar that it sits on.
+//everything else in all the other menus that I could find looks right..
+//
+//make sure we respect the game's ordering in cases of complete ties
+//this must be a stable sort or else advance wars DOR will flicker in the main map mode
+//(the index list is always built in ascending order, and an LSD radix sort is stable, so this is satisfied.)
+static void gfx3d_ysort(u16 *__restrict indexList, const size_t count)
+{
+	if (count < 2)
+	{
+		return;
+	}
 	
-	//notably, the main shop interface in harvest moon will not have a correct RTN button
-	//i think this is due to a math error rounding its position to one pixel too high and it popping behind
-	//the bar that it sits on.
-	//everything else in all the other menus that I could find looks right..
+	// Most of the bytes in the keys will be the same for every polygon, so find out which
+	// byte positions actually differ so that we only need to do passes on those.
+	u64 minKeyAnd = ~0ULL;
+	u64 minKeyOr  =  0ULL;
+	u64 maxKeyAnd = ~0ULL;
+	u64 maxKeyOr  =  0ULL;
 	
-	//make sure we respect the game's ordering in cases of complete ties
-	//this makes it a stable sort.
-	//this must be a stable sort or else advance wars DOR will flicker in the main map mode
-	return (idx1 < idx2);
+	for (size_t i = 0; i < count; i++)
+	{
+		const u16 rawPolyIndex = gfx3d.clippedPolyUnsortedList[indexList[i]].index;
+		const u64 minKey = gfx3d_ysort_key(gfx3d.rawPolySortYMin[rawPolyIndex]);
+		const u64 maxKey = gfx3d_ysort_key(gfx3d.rawPolySortYMax[rawPolyIndex]);
+		minKeyAnd &= minKey;
+		minKeyOr  |= minKey;
+		maxKeyAnd &= maxKey;
+		maxKeyOr  |= maxKey;
+	}
+	
+	const u64 minKeyDiff = minKeyAnd ^ minKeyOr;
+	const u64 maxKeyDiff = maxKeyAnd ^ maxKeyOr;
+	
+	u16 *inIndex = indexList;
+	u16 *outIndex = gfx3d.indexOfClippedPolySortTemp;
+	
+	// The least significant key (y-min) gets sorted first.
+	for (u32 shift = 0; shift < 64; shift += 8)
+	{
+		if ( ((minKeyDiff >> shift) & 0xFF) == 0 )
+			continue;
+		
+		gfx3d_ysort_radix_pass<false>(inIndex, outIndex, count, shift);
+		std::swap(inIndex, outIndex);
+	}
+	
+	for (u32 shift = 0; shift < 64; shift += 8)
+	{
+		if ( ((maxKeyDiff >> shift) & 0xFF) == 0 )
+			continue;
+		
+		gfx3d_ysort_radix_pass<true>(inIndex, outIndex, count, shift);
+		std::swap(inIndex, outIndex);
+	}
+	
+	if (inIndex != indexList)
+	{
+		memcpy(indexList, inIndex, count * sizeof(u16));
+	}
 }
 
 static FORCEINLINE s32 iround(const float f)
@@ -3245,15 +3424,12 @@ static FORCEINLINE s32 iround(const float f)
 }
 
 template <ClipperMode CLIPPERMODE>
-size_t gfx3d_PerformClipping(const GFX3D_GeometryList &gList, CPoly *outCPolyUnsortedList)
+size_t gfx3d_PerformClipping(const GFX3D_GeometryList &gList, const size_t startIndex, const size_t endIndex, const s64 wScalar, const s64 hScalar, CPoly *outCPolyUnsortedList)
 {
 	size_t clipCount = 0;
 	PolygonType cpType = POLYGON_TYPE_UNDEFINED;
 	
-	const s64 wScalar = (s64)CurrentRenderer->GetFramebufferWidth()  / (s64)GPU_FRAMEBUFFER_NATIVE_WIDTH;
-	const s64 hScalar = (s64)CurrentRenderer->GetFramebufferHeight() / (s64)GPU_FRAMEBUFFER_NATIVE_HEIGHT;
-	
-	for (size_t polyIndex = 0; polyIndex < gList.rawPolyCount; polyIndex++)
+	for (size_t polyIndex = startIndex; polyIndex < endIndex; polyIndex++)
 	{
 		const POLY &rawPoly = gList.rawPolyList[polyIndex];
 		const GFX3D_Viewport theViewport = rawPoly.viewport;
@@ -3370,21 +3546,79 @@ size_t gfx3d_PerformClipping(const GFX3D_GeometryList &gList, CPoly *outCPolyUns
 	return clipCount;
 }
 
-void GFX3D_GenerateRenderLists(const ClipperMode clippingMode, const GFX3D_State &inState, GFX3D_GeometryList &outGList)
+static size_t gfx3d_PerformClippingRange(const GFX3D_ClipperThreadParam &param)
 {
-	switch (clippingMode)
+	switch (param.clippingMode)
 	{
 		case ClipperMode_Full:
-			outGList.clippedPolyCount = gfx3d_PerformClipping<ClipperMode_Full>(outGList, gfx3d.clippedPolyUnsortedList);
-			break;
+			return gfx3d_PerformClipping<ClipperMode_Full>(*param.gList, param.startIndex, param.endIndex, param.wScalar, param.hScalar, param.outCPolyUnsortedList);
 			
 		case ClipperMode_FullColorInterpolate:
-			outGList.clippedPolyCount = gfx3d_PerformClipping<ClipperMode_FullColorInterpolate>(outGList, gfx3d.clippedPolyUnsortedList);
-			break;
+			return gfx3d_PerformClipping<ClipperMode_FullColorInterpolate>(*param.gList, param.startIndex, param.endIndex, param.wScalar, param.hScalar, param.outCPolyUnsortedList);
 			
 		case ClipperMode_DetermineClipOnly:
-			outGList.clippedPolyCount = gfx3d_PerformClipping<ClipperMode_DetermineClipOnly>(outGList, gfx3d.clippedPolyUnsortedList);
-			break;
+			return gfx3d_PerformClipping<ClipperMode_DetermineClipOnly>(*param.gList, param.startIndex, param.endIndex, param.wScalar, param.hScalar, param.outCPolyUnsortedList);
+	}
+	
+	return 0;
+}
+
+static void* gfx3d_RunPerformClippingRange(void *arg)
+{
+	GFX3D_ClipperThreadParam *param = (GFX3D_ClipperThreadParam *)arg;
+	param->clipCount = gfx3d_PerformClippingRange(*param);
+	
+	return NULL;
+}
+
+void GFX3D_GenerateRenderLists(const ClipperMode clippingMode, const GFX3D_State &inState, GFX3D_GeometryList &outGList)
+{
+	NDSPerfTimer perfTimer(NDS_PERF_3D_CLIP_NS);
+	const s64 wScalar = (s64)CurrentRenderer->GetFramebufferWidth()  / (s64)GPU_FRAMEBUFFER_NATIVE_WIDTH;
+	const s64 hScalar = (s64)CurrentRenderer->GetFramebufferHeight() / (s64)GPU_FRAMEBUFFER_NATIVE_HEIGHT;
+	
+	// Each polygon range is clipped into its own region of the unsorted list, starting at the
+	// range's first raw polygon index. (A raw polygon never produces more than one clipped
+	// polygon, so the regions can never overlap.) This leaves gaps in the unsorted list, but
+	// since we build an index list for sorting anyways, we never need to compact it.
+	size_t rangeCount = outGList.rawPolyCount / GFX3D_CLIPPER_MIN_POLYS_PER_THREAD;
+	if (rangeCount > _clipperThreadCount)
+	{
+		rangeCount = _clipperThreadCount;
+	}
+	
+	if (rangeCount < 1)
+	{
+		rangeCount = 1;
+	}
+	
+	const size_t polysPerRange = outGList.rawPolyCount / rangeCount;
+	
+	for (size_t i = 0; i < rangeCount; i++)
+	{
+		GFX3D_ClipperThreadParam &param = _clipperThreadParam[i];
+		param.clippingMode = clippingMode;
+		param.gList = &outGList;
+		param.startIndex = i * polysPerRange;
+		param.endIndex = (i < rangeCount - 1) ? (i + 1) * polysPerRange : outGList.rawPolyCount;
+		param.wScalar = wScalar;
+		param.hScalar = hScalar;
+		param.outCPolyUnsortedList = gfx3d.clippedPolyUnsortedList + param.startIndex;
+		param.clipCount = 0;
+	}
+	
+	for (size_t i = 1; i < rangeCount; i++)
+	{
+		_clipperTask[i - 1].execute(&gfx3d_RunPerformClippingRange, &_clipperThreadParam[i]);
+	}
+	
+	_clipperThreadParam[0].clipCount = gfx3d_PerformClippingRange(_clipperThreadParam[0]);
+	outGList.clippedPolyCount = _clipperThreadParam[0].clipCount;
+	
+	for (size_t i = 1; i < rangeCount; i++)
+	{
+		_clipperTask[i - 1].finish();
+		outGList.clippedPolyCount += _clipperThreadParam[i].clipCount;
 	}
 
 #ifdef _SHOW_VTX_COUNTERS
@@ -3397,20 +3631,30 @@ void GFX3D_GenerateRenderLists(const ClipperMode clippingMode, const GFX3D_State
 	//we need to sort the poly list with alpha polys last
 	//first, look for opaque polys
 	size_t ctr = 0;
-	for (size_t i = 0; i < outGList.clippedPolyCount; i++)
+	for (size_t r = 0; r < rangeCount; r++)
 	{
-		const CPoly &clippedPoly = gfx3d.clippedPolyUnsortedList[i];
-		if ( !GFX3D_IsPolyTranslucent(outGList.rawPolyList[clippedPoly.index]) )
-			gfx3d.indexOfClippedPolyUnsortedList[ctr++] = i;
+		const GFX3D_ClipperThreadParam &param = _clipperThreadParam[r];
+		
+		for (size_t i = param.startIndex; i < param.startIndex + param.clipCount; i++)
+		{
+			const CPoly &clippedPoly = gfx3d.clippedPolyUnsortedList[i];
+			if ( !GFX3D_IsPolyTranslucent(outGList.rawPolyList[clippedPoly.index]) )
+				gfx3d.indexOfClippedPolyUnsortedList[ctr++] = i;
+		}
 	}
 	outGList.clippedPolyOpaqueCount = ctr;
 	
 	//then look for translucent polys
-	for (size_t i = 0; i < outGList.clippedPolyCount; i++)
+	for (size_t r = 0; r < rangeCount; r++)
 	{
-		const CPoly &clippedPoly = gfx3d.clippedPolyUnsortedList[i];
-		if ( GFX3D_IsPolyTranslucent(outGList.rawPolyList[clippedPoly.index]) )
-			gfx3d.indexOfClippedPolyUnsortedList[ctr++] = i;
+		const GFX3D_ClipperThreadParam &param = _clipperThreadParam[r];
+		
+		for (size_t i = param.startIndex; i < param.startIndex + param.clipCount; i++)
+		{
+			const CPoly &clippedPoly = gfx3d.clippedPolyUnsortedList[i];
+			if ( GFX3D_IsPolyTranslucent(outGList.rawPolyList[clippedPoly.index]) )
+				gfx3d.indexOfClippedPolyUnsortedList[ctr++] = i;
+		}
 	}
 	
 	//find the min and max y values for each poly.
@@ -3423,7 +3667,7 @@ void GFX3D_GenerateRenderLists(const ClipperMode clippingMode, const GFX3D_State
 	
 	for (size_t i = 0; i < outGList.clippedPolyCount; i++)
 	{
-		const u16 rawPolyIndex = gfx3d.clippedPolyUnsortedList[i].index;
+		const u16 rawPolyIndex = gfx3d.clippedPolyUnsortedList[gfx3d.indexOfClippedPolyUnsortedList[i]].index;
 		const POLY &poly = outGList.rawPolyList[rawPolyIndex];
 		
 		s64 y = (s64)appliedVertList[poly.vertIndexes[0]].position.y;
@@ -3463,13 +3707,13 @@ void GFX3D_GenerateRenderLists(const ClipperMode clippingMode, const GFX3D_State
 	//now we have to sort the opaque polys by y-value.
 	//(test case: harvest moon island of happiness character creator UI)
 	//should this be done after clipping??
-	std::sort(gfx3d.indexOfClippedPolyUnsortedList, gfx3d.indexOfClippedPolyUnsortedList + outGList.clippedPolyOpaqueCount, gfx3d_ysort_compare);
+	gfx3d_ysort(gfx3d.indexOfClippedPolyUnsortedList, outGList.clippedPolyOpaqueCount);
 	
 	if (inState.SWAP_BUFFERS.YSortMode == 0)
 	{
 		//if we are autosorting translucent polys, we need to do this also
 		//TODO - this is unverified behavior. need a test case
-		std::sort(gfx3d.indexOfClippedPolyUnsortedList + outGList.clippedPolyOpaqueCount, gfx3d.indexOfClippedPolyUnsortedList + outGList.clippedPolyCount, gfx3d_ysort_compare);
+		gfx3d_ysort(gfx3d.indexOfClippedPolyUnsortedList + outGList.clippedPolyOpaqueCount, outGList.clippedPolyCount - outGList.clippedPolyOpaqueCount);
 	}
 	
 	// Reorder the clipped polygon list to match our sorted index list.
@@ -3546,6 +3790,266 @@ void gfx3d_VBlankSignal()
 	}
 }
 
+// Geometry capture and replay
+//
+// A capture stores the applied GFX3D_State and geometry list of every rendered 3D frame, along
+// with the texture and palette VRAM that the frame can reference. Replaying a capture feeds the
+// frames straight into CurrentRenderer, which lets a Render3D backend be benchmarked without
+// emulating the CPU. Structs are written in their raw host layout, so a capture can only be
+// replayed by a build that has the same struct sizes as the build that recorded it.
+
+#define GFX3D_CAPTURE_MAGIC        0x50414333 // "3CAP"
+#define GFX3D_CAPTURE_VERSION      1
+#define GFX3D_CAPTURE_TEXSLOT_SIZE 0x20000
+#define GFX3D_CAPTURE_PALSLOT_SIZE 0x4000
+
+struct GFX3D_CaptureHeader
+{
+	u32 magic;
+	u32 version;
+	u32 stateSize;
+	u32 vertexSize;
+	u32 polySize;
+};
+typedef struct GFX3D_CaptureHeader GFX3D_CaptureHeader;
+
+static EMUFILE_FILE *_captureFile = NULL;
+
+static GFX3D_CaptureHeader gfx3d_GetCaptureHeader()
+{
+	GFX3D_CaptureHeader header;
+	header.magic = GFX3D_CAPTURE_MAGIC;
+	header.version = GFX3D_CAPTURE_VERSION;
+	header.stateSize = (u32)sizeof(GFX3D_State);
+	header.vertexSize = (u32)sizeof(NDSVertex);
+	header.polySize = (u32)sizeof(POLY);
+	
+	return header;
+}
+
+bool GFX3D_CaptureBegin(const char *fileName)
+{
+	GFX3D_CaptureEnd();
+	
+	_captureFile = new EMUFILE_FILE(fileName, "wb");
+	if (_captureFile->fail())
+	{
+		printf("3D capture: could not open %s for writing\n", fileName);
+		delete _captureFile;
+		_captureFile = NULL;
+		return false;
+	}
+	
+	const GFX3D_CaptureHeader header = gfx3d_GetCaptureHeader();
+	_captureFile->fwrite(&header, sizeof(header));
+	
+	return true;
+}
+
+void GFX3D_CaptureEnd()
+{
+	delete _captureFile;
+	_captureFile = NULL;
+}
+
+bool GFX3D_IsCapturing()
+{
+	return (_captureFile != NULL);
+}
+
+static void gfx3d_CaptureFrame(const GFX3D_State &inState, const GFX3D_GeometryList &inGList)
+{
+	EMUFILE &os = *_captureFile;
+	
+	os.write_32LE((u32)currFrameCounter);
+	os.fwrite(&inState, sizeof(GFX3D_State));
+	os.write_32LE((u32)inGList.rawVertCount);
+	os.write_32LE((u32)inGList.rawPolyCount);
+	os.fwrite(inGList.rawVtxList, inGList.rawVertCount * sizeof(NDSVertex));
+	os.fwrite(inGList.rawPolyList, inGList.rawPolyCount * sizeof(POLY));
+	
+	// Unmapped slots all point at blank memory, so only note them in the mask instead of storing them.
+	u32 slotMask = 0;
+	for (size_t i = 0; i < 4; i++)
+	{
+		if (MMU.texInfo.textureSlotAddr[i] != MMU.blank_memory)
+			slotMask |= (1 << i);
+	}
+	
+	for (size_t i = 0; i < 6; i++)
+	{
+		if (MMU.texInfo.texPalSlot[i] != MMU.blank_memory)
+			slotMask |= (1 << (4 + i));
+	}
+	
+	os.write_32LE(slotMask);
+	
+	for (size_t i = 0; i < 4; i++)
+	{
+		if (slotMask & (1 << i))
+			os.fwrite(MMU.texInfo.textureSlotAddr[i], GFX3D_CAPTURE_TEXSLOT_SIZE);
+	}
+	
+	for (size_t i = 0; i < 6; i++)
+	{
+		if (slotMask & (1 << (4 + i)))
+			os.fwrite(MMU.texInfo.texPalSlot[i], GFX3D_CAPTURE_PALSLOT_SIZE);
+	}
+}
+
+static bool gfx3d_ReadCaptureFrame(EMUFILE &is, u32 &outFrameNumber, GFX3D_State &outState, GFX3D_GeometryList &outGList, u8 *slotBuffer, MMU_struct::TextureInfo &outTexInfo)
+{
+	u32 vertCount = 0;
+	u32 polyCount = 0;
+	u32 slotMask = 0;
+	
+	is.read_32LE(outFrameNumber);
+	is.fread(&outState, sizeof(GFX3D_State));
+	is.read_32LE(vertCount);
+	is.read_32LE(polyCount);
+	
+	if (is.fail() || (vertCount > VERTLIST_SIZE) || (polyCount > POLYLIST_SIZE))
+	{
+		return false;
+	}
+	
+	outGList.rawVertCount = vertCount;
+	outGList.rawPolyCount = polyCount;
+	is.fread(outGList.rawVtxList, vertCount * sizeof(NDSVertex));
+	is.fread(outGList.rawPolyList, polyCount * sizeof(POLY));
+	is.read_32LE(slotMask);
+	
+	for (size_t i = 0; i < 4; i++)
+	{
+		if (slotMask & (1 << i))
+		{
+			outTexInfo.textureSlotAddr[i] = slotBuffer + (i * GFX3D_CAPTURE_TEXSLOT_SIZE);
+			is.fread(outTexInfo.textureSlotAddr[i], GFX3D_CAPTURE_TEXSLOT_SIZE);
+		}
+		else
+		{
+			outTexInfo.textureSlotAddr[i] = MMU.blank_memory;
+		}
+	}
+	
+	for (size_t i = 0; i < 6; i++)
+	{
+		if (slotMask & (1 << (4 + i)))
+		{
+			outTexInfo.texPalSlot[i] = slotBuffer + (4 * GFX3D_CAPTURE_TEXSLOT_SIZE) + (i * GFX3D_CAPTURE_PALSLOT_SIZE);
+			is.fread(outTexInfo.texPalSlot[i], GFX3D_CAPTURE_PALSLOT_SIZE);
+		}
+		else
+		{
+			outTexInfo.texPalSlot[i] = MMU.blank_memory;
+		}
+	}
+	
+	return !is.fail();
+}
+
+bool GFX3D_ReplayCapture(const char *fileName, const size_t loopCount, GFX3D_ReplayStats &outStats)
+{
+	memset(&outStats, 0, sizeof(GFX3D_ReplayStats));
+	
+	EMUFILE_FILE is(fileName, "rb");
+	if (is.fail())
+	{
+		printf("3D replay: could not open %s\n", fileName);
+		return false;
+	}
+	
+	const GFX3D_CaptureHeader expectedHeader = gfx3d_GetCaptureHeader();
+	GFX3D_CaptureHeader header;
+	if ( (is.fread(&header, sizeof(header)) != sizeof(header)) || (memcmp(&header, &expectedHeader, sizeof(header)) != 0) )
+	{
+		printf("3D replay: %s is not a capture from a compatible build\n", fileName);
+		return false;
+	}
+	
+	const int firstFramePos = is.ftell();
+	const int fileSize = is.size();
+	
+	GFX3D_State replayState;
+	GFX3D_GeometryList *replayGList = (GFX3D_GeometryList *)malloc_alignedPage(sizeof(GFX3D_GeometryList));
+	u8 *slotBuffer = (u8 *)malloc_alignedPage((4 * GFX3D_CAPTURE_TEXSLOT_SIZE) + (6 * GFX3D_CAPTURE_PALSLOT_SIZE));
+	const MMU_struct::TextureInfo oldTexInfo = MMU.texInfo;
+	std::vector<u32> frameHashList;
+	size_t mismatchCount = 0;
+	bool didReadAll = true;
+	
+	printf("3D replay: %s, renderer: %s, loops: %d\n", fileName, CurrentRenderer->GetName().c_str(), (int)loopCount);
+	
+	for (size_t loop = 0; (loop < loopCount) && didReadAll; loop++)
+	{
+		is.fseek(firstFramePos, SEEK_SET);
+		
+		// EMUFILE_FILE::eof() only becomes true after a read has failed, so stop at the end of the last frame instead.
+		for (size_t frameIndex = 0; is.ftell() < fileSize; frameIndex++)
+		{
+			u32 frameNumber = 0;
+			if (!gfx3d_ReadCaptureFrame(is, frameNumber, replayState, *replayGList, slotBuffer, MMU.texInfo))
+			{
+				printf("3D replay: %s is truncated at frame index %d\n", fileName, (int)frameIndex);
+				didReadAll = false;
+				break;
+			}
+			
+			// Every frame brings its own copy of VRAM without remapping any slots, so the texture
+			// cache has to be told to check every texture against it.
+			texCache.InvalidateAll();
+			
+			// Only the geometry processing and rendering are timed, not the file reading.
+			const retro_time_t startTime = cpu_features_get_time_usec();
+			
+			GFX3D_GenerateRenderLists(CurrentRenderer->GetPreferredPolygonClippingMode(), replayState, *replayGList);
+			CurrentRenderer->ApplyRenderingSettings(replayState);
+			CurrentRenderer->SetTextureProcessingProperties();
+			CurrentRenderer->SetRenderNeedsFinish(true);
+			CurrentRenderer->Render(replayState, *replayGList);
+			CurrentRenderer->RenderFinish();
+			CurrentRenderer->SetRenderNeedsFinish(false);
+			CurrentRenderer->RenderFlush(true, true);
+			
+			outStats.elapsedUsec += (u64)(cpu_features_get_time_usec() - startTime);
+			outStats.frameCount++;
+			outStats.polyCount += replayGList->clippedPolyCount;
+			
+			const Color4u8 *framebuffer = CurrentRenderer->GetFramebuffer();
+			const u32 frameHash = (framebuffer == NULL) ? 0 : (u32)crc32(0, (const Bytef *)framebuffer, (uInt)(CurrentRenderer->GetFramebufferWidth() * CurrentRenderer->GetFramebufferHeight() * sizeof(Color4u8)));
+			
+			if (loop == 0)
+			{
+				printf("3D replay: frame %d, polys %d, hash %08X\n", (int)frameNumber, (int)replayGList->clippedPolyCount, frameHash);
+				frameHashList.push_back(frameHash);
+			}
+			else if (frameHashList[frameIndex] != frameHash)
+			{
+				printf("3D replay: frame %d, hash %08X differs from first loop (%08X)\n", (int)frameNumber, frameHash, frameHashList[frameIndex]);
+				mismatchCount++;
+			}
+		}
+	}
+	
+	MMU.texInfo = oldTexInfo;
+	texCache.InvalidateAll();
+	
+	free_aligned(slotBuffer);
+	free_aligned(replayGList);
+	
+	if (outStats.frameCount > 0)
+	{
+		const double elapsedSec = (double)outStats.elapsedUsec / 1000000.0;
+		printf("3D replay: %d frames, %.3f ms/frame, %.0f polys/s, %d hash mismatches\n",
+		       (int)outStats.frameCount,
+		       (elapsedSec * 1000.0) / (double)outStats.frameCount,
+		       (elapsedSec > 0.0) ? (double)outStats.polyCount / elapsedSec : 0.0,
+		       (int)mismatchCount);
+	}
+	
+	return didReadAll && (mismatchCount == 0);
+}
+
 void gfx3d_VBlankEndSignal(bool skipFrame)
 {
 	if (CurrentRenderer->GetRenderNeedsFinish())
@@ -3609,6 +4113,12 @@ void gfx3d_VBlankEndSignal(bool skipFrame)
 	//the timing of powering on rendering may not be exactly right here.
 	if (GPU->GetEngineMain()->GetEnableStateApplied() && nds.power_render)
 	{
+		if (_captureFile != NULL)
+		{
+			gfx3d_CaptureFrame(gfx3d.appliedState, gfx3d.gList[gfx3d.appliedListIndex]);
+		}
+		
+		NDSPerfTimer perfTimer(NDS_PERF_3D_RENDER_NS);
 		CurrentRenderer->SetTextureProcessingProperties();
 		CurrentRenderer->Render(gfx3d.appliedState, gfx3d.gList[gfx3d.appliedListIndex]);
 	}
@@ -3627,6 +4137,11 @@ void gfx3d_sendCommandToFIFO(const u32 v)
 	gxf_hardware.receive(v);
 }
 
+void gfx3d_sendCommandToFIFOBatch(const u32 *v, const size_t count)
+{
+	gxf_hardware.receiveBatch(v, count);
+}
+
 void gfx3d_sendCommand(u32 cmd, u32 param)
 {
 	cmd = (cmd & 0x01FF) >> 2;
@@ -4318,8 +4833,14 @@ static FORCEINLINE void GFX3D_ClipPoint(const NDSVertex &insideVtx, const NDSVer
 }
 
 #define MAX_SCRATCH_CLIP_VERTS (4*6 + 40)
-static NDSVertex scratchClipVerts[MAX_SCRATCH_CLIP_VERTS];
-static size_t numScratchClipVerts = 0;
+
+// Holds the intermediate vertices generated while clipping a single polygon.
+// Each clipper owns one of these, so that polygons can be clipped on multiple threads at once.
+struct ClipperScratch
+{
+	NDSVertex vtx[MAX_SCRATCH_CLIP_VERTS];
+	size_t count;
+};
 
 template <ClipperMode CLIPPERMODE, int COORD, int WHICH, class NEXT>
 class ClipperPlane
@@ -4327,11 +4848,12 @@ class ClipperPlane
 public:
 	ClipperPlane(NEXT &next) : m_next(next) {}
 	
-	void init(NDSVertex *vtxList)
+	void init(NDSVertex *vtxList, ClipperScratch *scratch)
 	{
 		m_prevVert =  NULL;
 		m_firstVert = NULL;
-		m_next.init(vtxList);
+		m_scratch = scratch;
+		m_next.init(vtxList, scratch);
 	}
 	
 	void clipVert(const NDSVertex &vtx)
@@ -4362,6 +4884,7 @@ public:
 private:
 	NDSVertex *m_prevVert;
 	NDSVertex *m_firstVert;
+	ClipperScratch *m_scratch;
 	NEXT &m_next;
 	
 	FORCEINLINE void clipSegmentVsPlane(const NDSVertex &vtx0, const NDSVertex &vtx1)
@@ -4392,18 +4915,20 @@ private:
 		if (!out0 && out1)
 		{
 			CLIPLOG(" exiting\n");
-			assert((u32)numScratchClipVerts < MAX_SCRATCH_CLIP_VERTS);
-			GFX3D_ClipPoint<CLIPPERMODE, COORD, WHICH>(vtx0, vtx1, scratchClipVerts[numScratchClipVerts]);
-			m_next.clipVert(scratchClipVerts[numScratchClipVerts++]);
+			assert((u32)m_scratch->count < MAX_SCRATCH_CLIP_VERTS);
+			NDSVertex &clippedVtx = m_scratch->vtx[m_scratch->count++];
+			GFX3D_ClipPoint<CLIPPERMODE, COORD, WHICH>(vtx0, vtx1, clippedVtx);
+			m_next.clipVert(clippedVtx);
 		}
 		
 		//entering volume: insert clipped point and the next (interior) point
 		if (out0 && !out1)
 		{
 			CLIPLOG(" entering\n");
-			assert((u32)numScratchClipVerts < MAX_SCRATCH_CLIP_VERTS);
-			GFX3D_ClipPoint<CLIPPERMODE, COORD, WHICH>(vtx1, vtx0, scratchClipVerts[numScratchClipVerts]);
-			m_next.clipVert(scratchClipVerts[numScratchClipVerts++]);
+			assert((u32)m_scratch->count < MAX_SCRATCH_CLIP_VERTS);
+			NDSVertex &clippedVtx = m_scratch->vtx[m_scratch->count++];
+			GFX3D_ClipPoint<CLIPPERMODE, COORD, WHICH>(vtx1, vtx0, clippedVtx);
+			m_next.clipVert(clippedVtx);
 			m_next.clipVert(vtx1);
 		}
 	}
@@ -4412,7 +4937,7 @@ private:
 class ClipperOutput
 {
 public:
-	void init(NDSVertex *vtxList)
+	void init(NDSVertex *vtxList, ClipperScratch *scratch)
 	{
 		m_nextDestVert = vtxList;
 		m_numVerts = 0;
@@ -4437,74 +4962,49 @@ private:
 
 // see "Template juggling with Sutherland-Hodgman" http://www.codeguru.com/cpp/misc/misc/graphics/article.php/c8965__2/
 // for the idea behind setting things up like this.
-
-// Non-interpolated clippers
-static ClipperOutput clipperOut;
-typedef ClipperPlane<ClipperMode_Full, 2, 1,ClipperOutput> Stage6; static Stage6 clipper6 (clipperOut); // back plane //TODO - we need to parameterize back plane clipping
-typedef ClipperPlane<ClipperMode_Full, 2,-1,Stage6> Stage5;        static Stage5 clipper5 (clipper6); // front plane
-typedef ClipperPlane<ClipperMode_Full, 1, 1,Stage5> Stage4;        static Stage4 clipper4 (clipper5); // top plane
-typedef ClipperPlane<ClipperMode_Full, 1,-1,Stage4> Stage3;        static Stage3 clipper3 (clipper4); // bottom plane
-typedef ClipperPlane<ClipperMode_Full, 0, 1,Stage3> Stage2;        static Stage2 clipper2 (clipper3); // right plane
-typedef ClipperPlane<ClipperMode_Full, 0,-1,Stage2> Stage1;        static Stage1 clipper1 (clipper2); // left plane
-
-// Interpolated clippers
-static ClipperOutput clipperOuti;
-typedef ClipperPlane<ClipperMode_FullColorInterpolate, 2, 1,ClipperOutput> Stage6i; static Stage6i clipper6i (clipperOuti); // back plane //TODO - we need to parameterize back plane clipping
-typedef ClipperPlane<ClipperMode_FullColorInterpolate, 2,-1,Stage6i> Stage5i;       static Stage5i clipper5i (clipper6i); // front plane
-typedef ClipperPlane<ClipperMode_FullColorInterpolate, 1, 1,Stage5i> Stage4i;       static Stage4i clipper4i (clipper5i); // top plane
-typedef ClipperPlane<ClipperMode_FullColorInterpolate, 1,-1,Stage4i> Stage3i;       static Stage3i clipper3i (clipper4i); // bottom plane
-typedef ClipperPlane<ClipperMode_FullColorInterpolate, 0, 1,Stage3i> Stage2i;       static Stage2i clipper2i (clipper3i); // right plane
-typedef ClipperPlane<ClipperMode_FullColorInterpolate, 0,-1,Stage2i> Stage1i;       static Stage1i clipper1i (clipper2i); // left plane
-
-// Determine's clip status only
-static ClipperOutput clipperOutd;
-typedef ClipperPlane<ClipperMode_DetermineClipOnly, 2, 1,ClipperOutput> Stage6d; static Stage6d clipper6d (clipperOutd); // back plane //TODO - we need to parameterize back plane clipping
-typedef ClipperPlane<ClipperMode_DetermineClipOnly, 2,-1,Stage6d> Stage5d;       static Stage5d clipper5d (clipper6d); // front plane
-typedef ClipperPlane<ClipperMode_DetermineClipOnly, 1, 1,Stage5d> Stage4d;       static Stage4d clipper4d (clipper5d); // top plane
-typedef ClipperPlane<ClipperMode_DetermineClipOnly, 1,-1,Stage4d> Stage3d;       static Stage3d clipper3d (clipper4d); // bottom plane
-typedef ClipperPlane<ClipperMode_DetermineClipOnly, 0, 1,Stage3d> Stage2d;       static Stage2d clipper2d (clipper3d); // right plane
-typedef ClipperPlane<ClipperMode_DetermineClipOnly, 0,-1,Stage2d> Stage1d;       static Stage1d clipper1d (clipper2d); // left plane
-
 template <ClipperMode CLIPPERMODE>
-PolygonType GFX3D_GenerateClippedPoly(const u16 rawPolyIndex, const PolygonType rawPolyType, const NDSVertex *(&rawVtx)[4], CPoly &outCPoly)
+class PolygonClipper
 {
-	CLIPLOG("==Begin poly==\n");
+private:
+	typedef ClipperPlane<CLIPPERMODE, 2, 1,ClipperOutput> Stage6; // back plane //TODO - we need to parameterize back plane clipping
+	typedef ClipperPlane<CLIPPERMODE, 2,-1,Stage6> Stage5;        // front plane
+	typedef ClipperPlane<CLIPPERMODE, 1, 1,Stage5> Stage4;        // top plane
+	typedef ClipperPlane<CLIPPERMODE, 1,-1,Stage4> Stage3;        // bottom plane
+	typedef ClipperPlane<CLIPPERMODE, 0, 1,Stage3> Stage2;        // right plane
+	typedef ClipperPlane<CLIPPERMODE, 0,-1,Stage2> Stage1;        // left plane
+	
+	ClipperScratch _scratch;
+	ClipperOutput _output;
+	Stage6 _stage6;
+	Stage5 _stage5;
+	Stage4 _stage4;
+	Stage3 _stage3;
+	Stage2 _stage2;
+	Stage1 _stage1;
 	
-	PolygonType outClippedType;
-	numScratchClipVerts = 0;
+public:
+	PolygonClipper() : _output(), _stage6(_output), _stage5(_stage6), _stage4(_stage5), _stage3(_stage4), _stage2(_stage3), _stage1(_stage2) {}
 	
-	switch (CLIPPERMODE)
+	// Clips the polygon and returns the number of clipped output verts.
+	int Clip(const NDSVertex *(&rawVtx)[4], const size_t rawVtxCount, NDSVertex *outVtx)
 	{
-		case ClipperMode_Full:
-		{
-			clipper1.init(outCPoly.vtx);
-			for (size_t i = 0; i < (size_t)rawPolyType; i++)
-				clipper1.clipVert(*rawVtx[i]);
-			
-			outClippedType = (PolygonType)clipper1.finish();
-			break;
-		}
-			
-		case ClipperMode_FullColorInterpolate:
-		{
-			clipper1i.init(outCPoly.vtx);
-			for (size_t i = 0; i < (size_t)rawPolyType; i++)
-				clipper1i.clipVert(*rawVtx[i]);
-			
-			outClippedType = (PolygonType)clipper1i.finish();
-			break;
-		}
-			
-		case ClipperMode_DetermineClipOnly:
-		{
-			clipper1d.init(outCPoly.vtx);
-			for (size_t i = 0; i < (size_t)rawPolyType; i++)
-				clipper1d.clipVert(*rawVtx[i]);
-			
-			outClippedType = (PolygonType)clipper1d.finish();
-			break;
-		}
+		this->_scratch.count = 0;
+		this->_stage1.init(outVtx, &this->_scratch);
+		
+		for (size_t i = 0; i < rawVtxCount; i++)
+			this->_stage1.clipVert(*rawVtx[i]);
+		
+		return this->_stage1.finish();
 	}
+};
+
+template <ClipperMode CLIPPERMODE>
+PolygonType GFX3D_GenerateClippedPoly(const u16 rawPolyIndex, const PolygonType rawPolyType, const NDSVertex *(&rawVtx)[4], CPoly &outCPoly)
+{
+	CLIPLOG("==Begin poly==\n");
+	
+	PolygonClipper<CLIPPERMODE> clipper;
+	const PolygonType outClippedType = (PolygonType)clipper.Clip(rawVtx, (size_t)rawPolyType, outCPoly.vtx);
 	
 	assert((u32)outClippedType < MAX_CLIPPED_VERTS);
 	if (outClippedType < POLYGON_TYPE_TRIANGLE)
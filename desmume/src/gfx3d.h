@@ -759,6 +759,7 @@ struct GFX3D
 	// Working lists for rendering.
 	CACHE_ALIGN CPoly clippedPolyUnsortedList[CLIPPED_POLYLIST_SIZE]; // Records clipped polygon info on first pass
 	CACHE_ALIGN u16 indexOfClippedPolyUnsortedList[CLIPPED_POLYLIST_SIZE];
+	CACHE_ALIGN u16 indexOfClippedPolySortTemp[CLIPPED_POLYLIST_SIZE]; // Temp buffer used for processing polygon Y-sorting
 	CACHE_ALIGN s64 rawPolySortYMin[POLYLIST_SIZE]; // Temp buffer used for processing polygon Y-sorting
 	CACHE_ALIGN s64 rawPolySortYMax[POLYLIST_SIZE]; // Temp buffer used for processing polygon Y-sorting
 	
@@ -979,6 +980,7 @@ void gfx3d_VBlankSignal();
 void gfx3d_VBlankEndSignal(bool skipFrame);
 void gfx3d_execute3D();
 void gfx3d_sendCommandToFIFO(const u32 v);
+void gfx3d_sendCommandToFIFOBatch(const u32 *v, const size_t count);
 void gfx3d_sendCommand(u32 cmd, u32 param);
 
 //other misc stuff
@@ -1009,6 +1011,24 @@ void GFX3D_HandleGeometryPowerOff();
 u32 GFX3D_GetRender3DFrameCount();
 void GFX3D_ResetRender3DFrameCount();
 
+struct GFX3D_ReplayStats
+{
+	size_t frameCount;	// Frames rendered across all replay loops.
+	size_t polyCount;	// Clipped polygons rendered across all replay loops.
+	u64 elapsedUsec;	// Time spent generating render lists and rendering, excluding file reads.
+};
+typedef struct GFX3D_ReplayStats GFX3D_ReplayStats;
+
+// Records every rendered 3D frame to a file, for replaying with GFX3D_ReplayCapture().
+bool GFX3D_CaptureBegin(const char *fileName);
+void GFX3D_CaptureEnd();
+bool GFX3D_IsCapturing();
+
+// Renders every frame of a capture with CurrentRenderer, loopCount times over, and prints
+// timings and framebuffer hashes. Returns false if the file could not be read or if the
+// framebuffer hashes changed between loops.
+bool GFX3D_ReplayCapture(const char *fileName, const size_t loopCount, GFX3D_ReplayStats &outStats);
+
 template<ClipperMode CLIPPERMODE> PolygonType GFX3D_GenerateClippedPoly(const u16 rawPolyIndex, const PolygonType rawPolyType, const NDSVertex *(&rawVtx)[4], CPoly &outCPoly);
 
 #endif //_GFX3D_H_
@@ -2256,7 +2256,7 @@ DEFINE_LUA_FUNCTION(state_savescriptdata, "location")
 #include "gfx3d.h"
 class EMUFILE_MEMORY_VERIFIER : public EMUFILE_MEMORY { 
 public:
-	EMUFILE_MEMORY_VERIFIER(EMUFILE_MEMORY* underlying) : EMUFILE_MEMORY(underlying->get_vec()) { }
+	EMUFILE_MEMORY_VERIFIER(EMUFILE_MEMORY* underlying) : EMUFILE_MEMORY(underlying->get_vec(), false) { }
 
 	std::vector<std::string> differences;
 
@@ -3942,7 +3942,7 @@ DEFINE_LUA_FUNCTION(emu_atframeboundary, "")
 }
 DEFINE_LUA_FUNCTION(movie_getlength, "")
 {
-	lua_pushinteger(L, currMovieData.records.size());
+	lua_pushinteger(L, currMovieData.getNumRecords());
 	return 1;
 }
 DEFINE_LUA_FUNCTION(movie_isactive, "")
@@ -21,6 +21,11 @@
 
 #include <stdlib.h>
 #include <string.h>
+#include <algorithm>
+
+#ifdef HOST_WINDOWS
+#include <windows.h>
+#endif
 
 #include "common.h"
 #include "armcpu.h"
@@ -32,6 +37,7 @@
 #include "path.h"
 #include "utils/advanscene.h"
 #include "utils/xstring.h"
+#include "utils/task.h"
 #include "emufile.h"
 
 //#define _DONT_SAVE_BACKUP
@@ -63,6 +69,11 @@
 #define CARDFLASH_DEEP_POWDOWN		0xB9    /* Not used*/
 #define CARDFLASH_WAKEUP			0xAB    /* Not used*/
 
+//how many frames without a backup memory write before the save file is written out,
+//and how many frames a game that never stops writing may keep it dirty before it is written out anyway
+#define BACKUP_FLUSH_QUIET_FRAMES	60
+#define BACKUP_FLUSH_MAX_FRAMES		600
+
 #ifdef _MCLOG
 #define MCLOG(...) printf(__VA_ARGS__)
 #else
@@ -121,6 +132,8 @@ void backup_setManualBackupType(int type)
 
 bool BackupDevice::save_state(EMUFILE &os)
 {
+	queueFlush(true);
+
 	u32 savePos = this->_fpMC->ftell();
 	std::vector<u8> data(this->_fsize);
 	this->_fpMC->fseek(0, SEEK_SET);
@@ -216,6 +229,12 @@ BackupDevice::BackupDevice()
 	_fpMC = NULL;
 	_fsize = 0;
 	_addr_size = 0;
+	_isFileBacked = false;
+	_dirtyBegin = _dirtyEnd = 0;
+	_quietFrames = _dirtyFrames = 0;
+	_flushTask = NULL;
+	_isFlushPending = _isFlushAsync = false;
+	_flushResult = true;
 
 	//default for most games; will be altered where appropriate
 	//usually 0xFF, but occasionally others. If these exceptions could be related to a particular backup memory type, that would be helpful.
@@ -326,20 +345,36 @@ BackupDevice::BackupDevice()
 		}
 	}
 
-	_fpMC = new EMUFILE_FILE(_fileName, fexists?"rb+" : "wb+");
-	const bool fileCanReadWrite = (_fpMC->get_fp() != NULL);
-	if (!fileCanReadWrite)
+	//the game works on a copy in memory; changes are written back to the file in the background by flushBackup()/nextFrame()
+	_fpMC = new EMUFILE_MEMORY();
 	{
-		delete _fpMC;
-		_fpMC = new EMUFILE_MEMORY();
-		printf("BackupDevice: WARNING! Failed to get read/write access to the save file! Will operate in RAM instead.\n");
+		EMUFILE_FILE fpFile(_fileName, fexists?"rb+" : "wb+");
+		_isFileBacked = (fpFile.get_fp() != NULL);
+		if (_isFileBacked)
+		{
+			const u32 fileSize = fpFile.size();
+			std::vector<u8> fileData(fileSize);
+			if ( (fileSize > 0) && (fpFile.fread(&fileData[0], fileSize) == fileSize) )
+			{
+				_fpMC->fwrite(&fileData[0], fileSize);
+				//_flushImage holds what is on disk, so that a flush of only the dirty range keeps the rest of the file
+				_flushImage.swap(fileData);
+			}
+			_fpMC->fseek(0, SEEK_SET);
+		}
 	}
+	_dirtyBegin = _dirtyEnd = 0;
+	if (!_isFileBacked)
+		printf("BackupDevice: WARNING! Failed to get read/write access to the save file! Will operate in RAM instead.\n");
 	
 	if (!_fpMC->fail())
 	{
 		_fsize = _fpMC->size();
 		if (_fsize < saveSizes[0])
+		{
 			_fpMC->truncate(0);
+			markDirty(0, 0xFFFFFFFF);
+		}
 
 		if (readFooter() == 0)
 			_fsize -= BackupDevice::GetDSVFooterSize();
@@ -409,6 +444,16 @@ BackupDevice::BackupDevice()
 
 BackupDevice::~BackupDevice()
 {
+	queueFlush(false);
+	finishFlush();
+
+	if (this->_flushTask != NULL)
+	{
+		this->_flushTask->shutdown();
+		delete this->_flushTask;
+		this->_flushTask = NULL;
+	}
+
 	delete this->_fpMC;
 	this->_fpMC = NULL;
 }
@@ -523,35 +568,46 @@ bool  BackupDevice::write(u8 val)
 	return true;
 #endif
 
+	const u32 pos = this->_fpMC->ftell();
+	markDirty(pos, pos + 1);
 	return (this->_fpMC->fwrite(&val, 1) == 1);
 }
 
 void BackupDevice::writeByte(u32 addr, u8 val)
 {
+	markDirty(addr, addr + 1);
 	this->_fpMC->fseek(addr, SEEK_SET);
 	this->_fpMC->write_u8(val);
 }
 void BackupDevice::writeWord(u32 addr, u16 val)
 {
+	markDirty(addr, addr + 2);
 	this->_fpMC->fseek(addr, SEEK_SET);
 	this->_fpMC->write_16LE(val);
 }
 void BackupDevice::writeLong(u32 addr, u32 val)
 {
+	markDirty(addr, addr + 4);
 	this->_fpMC->fseek(addr, SEEK_SET);
 	this->_fpMC->write_32LE(val);
 }
 
 void BackupDevice::writeByte(u8 val)
 {
+	const u32 pos = this->_fpMC->ftell();
+	markDirty(pos, pos + 1);
 	this->_fpMC->write_u8(val);
 }
 void BackupDevice::writeWord(u16 val)
 {
+	const u32 pos = this->_fpMC->ftell();
+	markDirty(pos, pos + 2);
 	this->_fpMC->write_16LE(val);
 }
 void BackupDevice::writeLong(u32 val)
 {
+	const u32 pos = this->_fpMC->ftell();
+	markDirty(pos, pos + 4);
 	this->_fpMC->write_32LE(val);
 }
 
@@ -562,7 +618,172 @@ void BackupDevice::seek(u32 pos)
 
 void BackupDevice::flushBackup()
 {
-	this->_fpMC->fflush();
+	queueFlush(true);
+}
+
+//rewrites one byte of the save with the value it already has, flushes, and compares the whole file on disk with the save memory.
+//this exercises the partial write path without changing the save.
+bool BackupDevice::checkFlush()
+{
+	const u32 imageSize = (this->_fpMC != NULL) ? (u32)this->_fpMC->size() : 0;
+	if (!this->_isFileBacked || (imageSize == 0))
+	{
+		printf("BackupDevice: No save file to check.\n");
+		return false;
+	}
+
+	const u32 savePos = this->_fpMC->ftell();
+	const u32 addr = imageSize / 2;
+	writeByte(addr, readByte(addr, 0));
+	queueFlush(false);
+
+	std::vector<u8> expected(imageSize);
+	this->_fpMC->fseek(0, SEEK_SET);
+	this->_fpMC->fread(&expected[0], imageSize);
+	this->_fpMC->fseek(savePos, SEEK_SET);
+
+	EMUFILE_FILE file(this->_fileName, "rb");
+	std::vector<u8> actual;
+	if (!file.fail() && (file.size() > 0))
+	{
+		actual.resize(file.size());
+		actual.resize(file.fread(&actual[0], actual.size()));
+	}
+
+	if (actual != expected)
+	{
+		size_t i = 0;
+		while ( (i < actual.size()) && (i < expected.size()) && (actual[i] == expected[i]) )
+			i++;
+		printf("BackupDevice: %s differs from the save memory at 0x%X (%u bytes on disk, %u expected)\n", this->_fileName.c_str(), (u32)i, (u32)actual.size(), imageSize);
+		return false;
+	}
+
+	printf("BackupDevice: %s matches the save memory after a one byte flush (%u bytes)\n", this->_fileName.c_str(), imageSize);
+	return true;
+}
+
+void BackupDevice::nextFrame()
+{
+	if (this->_dirtyBegin >= this->_dirtyEnd)
+		return;
+
+	this->_quietFrames++;
+	this->_dirtyFrames++;
+	if ( (this->_quietFrames >= BACKUP_FLUSH_QUIET_FRAMES) || (this->_dirtyFrames >= BACKUP_FLUSH_MAX_FRAMES) )
+		queueFlush(true);
+}
+
+//extends the range of the save file that changed since the last write. the end is clamped to the file size when it is written.
+void BackupDevice::markDirty(u32 begin, u32 end)
+{
+	if (this->_dirtyBegin >= this->_dirtyEnd)
+	{
+		this->_dirtyBegin = begin;
+		this->_dirtyEnd = end;
+		this->_dirtyFrames = 0;
+	}
+	else
+	{
+		this->_dirtyBegin = std::min(this->_dirtyBegin, begin);
+		this->_dirtyEnd = std::max(this->_dirtyEnd, end);
+	}
+	this->_quietFrames = 0;
+}
+
+//moves the finished temporary file over the real one, so that a crash mid-write never leaves a truncated save file behind
+static bool BackupDevice_ReplaceFile(const std::string &tempName, const std::string &fileName)
+{
+#ifdef HOST_WINDOWS
+	return MoveFileExW(mbstowcs(tempName).c_str(), mbstowcs(fileName).c_str(), MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+	return rename(tempName.c_str(), fileName.c_str()) == 0;
+#endif
+}
+
+void* BackupDevice::flushJobProc(void *arg)
+{
+	BackupDevice &device = *(BackupDevice *)arg;
+	const std::string tempName = device._fileName + ".tmp";
+
+	{
+		EMUFILE_FILE file(tempName, "wb");
+		device._flushResult = !file.fail();
+		if (device._flushResult)
+		{
+			if (!device._flushImage.empty())
+				file.fwrite(&device._flushImage[0], device._flushImage.size());
+			file.fflush();
+			device._flushResult = !file.fail();
+		}
+	}
+
+	device._flushResult = device._flushResult && BackupDevice_ReplaceFile(tempName, device._fileName);
+	if (!device._flushResult)
+		remove(tempName.c_str());
+
+	return NULL;
+}
+
+//brings _flushImage up to date with the dirty range and writes it out, on the flush thread if isAsync and there is more than one core
+void BackupDevice::queueFlush(bool isAsync)
+{
+	if (!this->_isFileBacked || (this->_dirtyBegin >= this->_dirtyEnd))
+		return;
+
+	//_flushImage belongs to the flush thread until it is done with it
+	finishFlush();
+
+	//_flushImage keeps the previous contents, so only the bytes that changed need to be copied out of the save memory
+	const u32 imageSize = (u32)this->_fpMC->size();
+	const u32 begin = std::min(this->_dirtyBegin, imageSize);
+	const u32 end = std::min(this->_dirtyEnd, imageSize);
+	this->_flushImage.resize(imageSize);
+	if (end > begin)
+	{
+		const u32 savePos = this->_fpMC->ftell();
+		this->_fpMC->fseek(begin, SEEK_SET);
+		this->_fpMC->fread(&this->_flushImage[begin], end - begin);
+		this->_fpMC->fseek(savePos, SEEK_SET);
+	}
+	this->_dirtyBegin = this->_dirtyEnd = 0;
+
+	this->_isFlushAsync = isAsync && (CommonSettings.num_cores > 1);
+	this->_isFlushPending = true;
+
+	if (!this->_isFlushAsync)
+	{
+		flushJobProc(this);
+		finishFlush();
+		return;
+	}
+
+	if (this->_flushTask == NULL)
+	{
+		this->_flushTask = new Task;
+		this->_flushTask->start(false, 0, "save file writer");
+	}
+
+	this->_flushTask->execute(&BackupDevice::flushJobProc, this);
+}
+
+//collects the pending background write, if there is one
+void BackupDevice::finishFlush()
+{
+	if (!this->_isFlushPending)
+		return;
+
+	if (this->_isFlushAsync)
+		this->_flushTask->finish();
+
+	this->_isFlushPending = false;
+
+	if (!this->_flushResult)
+	{
+		printf("BackupDevice: Failed to write the save file: %s\n", this->_fileName.c_str());
+		//try again after the next quiet period
+		markDirty(0, 0xFFFFFFFF);
+	}
 }
 
 bool BackupDevice::saveBuffer(u8 *data, u32 size, bool willRewind, bool willTruncate)
@@ -630,7 +851,9 @@ void BackupDevice::reset()
 
 void BackupDevice::close_rom()
 {
-	this->_fpMC->fflush();
+	queueFlush(false);
+	finishFlush();
+	this->_isFileBacked = false;
 	delete this->_fpMC;
 	this->_fpMC = NULL;
 }
@@ -710,9 +933,6 @@ void BackupDevice::checkReset()
 	{
 		//printf("MC  : reset command\n");
 
-		if ( (this->_com == BM_CMD_WRITELOW) || (this->_com == BM_CMD_WRITEHIGH) )
-			this->_fpMC->fflush();
-		
 		this->_com = 0;
 		this->_reset_command_state = false;
 	}
@@ -973,6 +1193,9 @@ void BackupDevice::ensure(u32 addr, u8 val, EMUFILE *fpOut)
 
 	fp->fflush();
 
+	if (fp == this->_fpMC)
+		markDirty(0, 0xFFFFFFFF);
+
 	//this is a HORRIBLE IDEA.
 	//leave the FP positioned to write the final byte
 	//this is a HACK to make the basic read/write byte operation work when it calls ensure().
@@ -1659,6 +1882,10 @@ bool BackupDevice::import_dsv(const char *filename)
 
 bool BackupDevice::load_movie(EMUFILE *is)
 {
+	//the movie brings its own save memory; the user's save file is left alone until the next reset
+	queueFlush(false);
+	finishFlush();
+	this->_isFileBacked = false;
 	delete this->_fpMC;
 	this->_fpMC = is;
 	
@@ -1682,6 +1909,9 @@ bool BackupDevice::load_movie(EMUFILE *is)
 
 void BackupDevice::load_movie_blank()
 {
+	queueFlush(false);
+	finishFlush();
+	this->_isFileBacked = false;
 	delete this->_fpMC;
 	this->_fpMC = new EMUFILE_MEMORY();
 
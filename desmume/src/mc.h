@@ -26,6 +26,8 @@
 
 #include "types.h"
 
+class Task;
+
 #define MAX_SAVE_TYPES 13
 #define MC_TYPE_AUTODETECT      0x0
 #define MC_TYPE_EEPROM1         0x1
@@ -104,7 +106,12 @@ public:
 
 	void seek(u32 pos);
 
+	//queues a write of the save file if anything changed since the last one
 	void flushBackup();
+	//writes one byte, flushes, and checks that the whole save file on disk matches. used by --check-save-flush
+	bool checkFlush();
+	//called once per emulated frame. writes the save file out once the game stops writing to it for a while
+	void nextFrame();
 	
 	u8 searchFileSaveType(u32 size);
 
@@ -166,6 +173,19 @@ private:
 	EMUFILE *_fpMC;
 	std::string _fileName;
 	u32	_fsize;
+
+	//the whole .dsv lives in memory in _fpMC; these track what still has to go out to _fileName
+	bool _isFileBacked;
+	u32 _dirtyBegin, _dirtyEnd;
+	u32 _quietFrames, _dirtyFrames;
+	Task *_flushTask;
+	bool _isFlushPending, _isFlushAsync, _flushResult;
+	std::vector<u8> _flushImage;
+	static void* flushJobProc(void *arg);
+	void markDirty(u32 begin, u32 end);
+	void queueFlush(bool isAsync);
+	void finishFlush();
+
 	BackupDeviceFileInfo _info;
 	int readFooter();
 	bool write(u8 val);
@@ -40,6 +40,8 @@
 #include "path.h"
 #include "emufile.h"
 #include "saves.h"
+#include "GPU.h"
+#include "armcpu.h"
 
 using namespace std;
 bool freshMovie = false;	  //True when a movie loads, false when movie is altered.  Used to determine if a movie has been altered since opening
@@ -61,6 +63,18 @@ EMOVIEMODE movieMode = MOVIEMODE_INACTIVE;
 
 //this should not be set unless we are in MOVIEMODE_RECORD!
 EMUFILE *osRecordingMovie = NULL;
+//was the current movie loaded from a binary movie file? then that's what gets recorded to it as well
+static bool curMovieBinary = false;
+//the binary movie file the current movie's records are decoded from
+static EMUFILE_MAPPING *curMovieMapping = NULL;
+
+typedef std::vector<std::pair<std::string,std::string> > MovieHeaderValues;
+static bool IsBinaryMovie(const char *fname);
+static bool LoadBinaryMovie(MovieData &movieData, const u8 *data, size_t size, MovieHeaderValues *headerValues);
+static void dumpRecordingMovie();
+static void dumpRecordingMovieRecord(MovieRecord &mr);
+static void finishRecordingMovie();
+static void releaseMovieMapping();
 
 int currFrameCounter;
 u32 cur_input_display = 0;
@@ -80,12 +94,14 @@ bool movie_reset_command = false;
 
 void MovieData::clearRecordRange(int start, int len)
 {
+	decodeRecords();
 	for(int i=0;i<len;i++)
 		records[i+start].clear();
 }
 
 void MovieData::insertEmpty(int at, int frames)
 {
+	decodeRecords();
 	if(at == -1) 
 	{
 		int currcount = records.size();
@@ -206,6 +222,9 @@ MovieData::MovieData(bool fromCurrentSettings)
 	, emuVersion(EMU_DESMUME_VERSION_NUMERIC())
 	, romChecksum(0)
 	, rerecordCount(0)
+	, binaryRecordData(NULL)
+	, binaryRecordSize(0)
+	, binaryRecordCount(0)
 	, binaryFlag(false)
 	, rtcStart(FCEUI_MovieGetRTCDefault())
 {
@@ -225,42 +244,6 @@ MovieData::MovieData(bool fromCurrentSettings)
 	
 	advancedTiming = -1;
 	jitBlockSize = -1;
-	
-	installValueMap["version"] = &MovieData::installVersion;
-	installValueMap["emuVersion"] = &MovieData::installEmuVersion;
-	installValueMap["rerecordCount"] = &MovieData::installRerecordCount;
-	installValueMap["romFilename"] = &MovieData::installRomFilename;
-	installValueMap["romChecksum"] = &MovieData::installRomChecksum;
-	installValueMap["romSerial"] = &MovieData::installRomSerial;
-	installValueMap["guid"] = &MovieData::installGuid;
-	installValueMap["rtcStart"] = &MovieData::installRtcStart;
-	installValueMap["rtcStartNew"] = &MovieData::installRtcStartNew;
-	
-	installValueMap["comment"] = &MovieData::installComment;
-	installValueMap["binary"] = &MovieData::installBinary;
-	installValueMap["useExtBios"] = &MovieData::installUseExtBios;
-	installValueMap["swiFromBios"] = &MovieData::installSwiFromBios;
-	installValueMap["useExtFirmware"] = &MovieData::installUseExtFirmware;
-	installValueMap["bootFromFirmware"] = &MovieData::installBootFromFirmware;
-	
-	installValueMap["firmNickname"] = &MovieData::installFirmNickname;
-	installValueMap["firmMessage"] = &MovieData::installFirmMessage;
-	installValueMap["firmFavColour"] = &MovieData::installFirmFavColour;
-	installValueMap["firmBirthMonth"] = &MovieData::installFirmBirthMonth;
-	installValueMap["firmBirthDay"] = &MovieData::installFirmBirthDay;
-	installValueMap["firmLanguage"] = &MovieData::installFirmLanguage;
-	
-	installValueMap["advancedTiming"] = &MovieData::installAdvancedTiming;
-	installValueMap["jitBlockSize"] = &MovieData::installJitBlockSize;
-	installValueMap["savestate"] = &MovieData::installSavestate;
-	installValueMap["sram"] = &MovieData::installSram;
-
-	for(int i=0;i<256;i++)
-	{
-		char tmp[256];
-		sprintf(tmp,"micsample%d",i);
-		installValueMap[tmp] = &MovieData::installMicSample;
-	}
 
 	if (fromCurrentSettings)
 	{
@@ -289,9 +272,60 @@ MovieData::MovieData(bool fromCurrentSettings)
 	}
 }
 
+//every movie shares one map. building it (with its 256 mic sample keys) for each MovieData was a big part of
+//loading a savestate during movie playback
+std::map<std::string, MovieData::ivm>& MovieData::installValueMap()
+{
+	static std::map<std::string, ivm> valueMap;
+	if (valueMap.empty())
+	{
+		valueMap["version"] = &MovieData::installVersion;
+		valueMap["emuVersion"] = &MovieData::installEmuVersion;
+		valueMap["rerecordCount"] = &MovieData::installRerecordCount;
+		valueMap["romFilename"] = &MovieData::installRomFilename;
+		valueMap["romChecksum"] = &MovieData::installRomChecksum;
+		valueMap["romSerial"] = &MovieData::installRomSerial;
+		valueMap["guid"] = &MovieData::installGuid;
+		valueMap["rtcStart"] = &MovieData::installRtcStart;
+		valueMap["rtcStartNew"] = &MovieData::installRtcStartNew;
+		
+		valueMap["comment"] = &MovieData::installComment;
+		valueMap["binary"] = &MovieData::installBinary;
+		valueMap["useExtBios"] = &MovieData::installUseExtBios;
+		valueMap["swiFromBios"] = &MovieData::installSwiFromBios;
+		valueMap["useExtFirmware"] = &MovieData::installUseExtFirmware;
+		valueMap["bootFromFirmware"] = &MovieData::installBootFromFirmware;
+		
+		valueMap["firmNickname"] = &MovieData::installFirmNickname;
+		valueMap["firmMessage"] = &MovieData::installFirmMessage;
+		valueMap["firmFavColour"] = &MovieData::installFirmFavColour;
+		valueMap["firmBirthMonth"] = &MovieData::installFirmBirthMonth;
+		valueMap["firmBirthDay"] = &MovieData::installFirmBirthDay;
+		valueMap["firmLanguage"] = &MovieData::installFirmLanguage;
+		
+		valueMap["advancedTiming"] = &MovieData::installAdvancedTiming;
+		valueMap["jitBlockSize"] = &MovieData::installJitBlockSize;
+		valueMap["savestate"] = &MovieData::installSavestate;
+		valueMap["sram"] = &MovieData::installSram;
+
+		for(int i=0;i<256;i++)
+		{
+			char tmp[256];
+			sprintf(tmp,"micsample%d",i);
+			valueMap[tmp] = &MovieData::installMicSample;
+		}
+	}
+	return valueMap;
+}
+
 void MovieData::truncateAt(int frame)
 {
-	if((int)records.size() > frame)
+	if(binaryRecordData != NULL)
+	{
+		if(binaryRecordCount > frame)
+			binaryRecordCount = frame;
+	}
+	else if((int)records.size() > frame)
 		records.resize(frame);
 }
 
@@ -346,9 +380,10 @@ void MovieData::installMicSample(std::string& key, std::string& val)
 
 void MovieData::installValue(std::string& key, std::string& val)
 {
-	ivm method = installValueMap[key];
-	if (method != NULL)
-		(this->*method)(key,val);
+	std::map<std::string, ivm> &valueMap = installValueMap();
+	std::map<std::string, ivm>::iterator it = valueMap.find(key);
+	if (it != valueMap.end())
+		(this->*(it->second))(key,val);
 }
 
 
@@ -360,7 +395,7 @@ int MovieData::dump(EMUFILE &fp, bool binary)
 	fp.fprintf("rerecordCount %d\n", rerecordCount);
 
 	fp.fprintf("romFilename %s\n", romFilename.c_str());
-	fp.fprintf("romChecksum %s\n", u32ToHexString(gameInfo.crc).c_str());
+	fp.fprintf("romChecksum %s\n", u32ToHexString(gameInfo.getCRC()).c_str());
 	fp.fprintf("romSerial %s\n", romSerial.c_str());
 	fp.fprintf("guid %s\n", guid.toString().c_str());
 	fp.fprintf("useExtBios %d\n", CommonSettings.UseExtBIOS?1:0); // TODO: include bios file data, not just a flag saying something was used
@@ -420,12 +455,12 @@ int MovieData::dump(EMUFILE &fp, bool binary)
 	{
 		//put one | to start the binary dump
 		fp.fputc('|');
-		for (int i = 0; i < (int)records.size(); i++)
-			records[i].dumpBinary(fp);
+		for (int i = 0; i < getNumRecords(); i++)
+			getRecord(i).dumpBinary(fp);
 	}
 	else
-		for (int i = 0; i < (int)records.size(); i++)
-			records[i].dump(fp);
+		for (int i = 0; i < getNumRecords(); i++)
+			getRecord(i).dump(fp);
 
 	int end = fp.ftell();
 	return end-start;
@@ -489,8 +524,38 @@ void readUntilNotWhitespace(EMUFILE &fp)
 		}
 	}
 }
+//reads the rest of a "key value" header line.
+//a line with an empty value ends right after the key, so don't let the value run on into the next line
+static void readHeaderValue(EMUFILE &fp, std::string &key, std::string &value)
+{
+	key = "";
+	value = "";
+	while (true)
+	{
+		int c = fp.fgetc();
+		switch (c)
+		{
+		case -1:
+		case '\r':
+		case '\n':
+			return;
+		case ' ':
+		case '\t':
+			while ((c = fp.fgetc()) == ' ' || c == '\t') {}
+			if (c != -1)
+				fp.unget();
+			value = readUntilNewline(fp);
+			return;
+		default:
+			key += c;
+			break;
+		}
+	}
+}
+
 //yuck... another custom text parser.
-bool LoadFM2(MovieData &movieData, EMUFILE &fp, int size, bool stopAfterHeader)
+//the header values are also handed back in file order when headerValues isn't NULL, so that the movie can be converted without losing any of them
+static bool LoadFM2_internal(MovieData &movieData, EMUFILE &fp, int size, bool stopAfterHeader, MovieHeaderValues *headerValues)
 {
 	int endOfMovie;
 	if (size == INT_MAX)
@@ -535,10 +600,11 @@ bool LoadFM2(MovieData &movieData, EMUFILE &fp, int size, bool stopAfterHeader)
 		else // key value
 		{
 			fp.unget();
-			std::string key = readUntilWhitespace(fp);
-			readUntilNotWhitespace(fp);
-			std::string value = readUntilNewline(fp);
+			std::string key, value;
+			readHeaderValue(fp, key, value);
 			movieData.installValue(key, value);
+			if (headerValues != NULL)
+				headerValues->push_back(std::make_pair(key, value));
 		}
 	}
 
@@ -548,11 +614,17 @@ bool LoadFM2(MovieData &movieData, EMUFILE &fp, int size, bool stopAfterHeader)
 	return true;
 }
 
+bool LoadFM2(MovieData &movieData, EMUFILE &fp, int size, bool stopAfterHeader)
+{
+	return LoadFM2_internal(movieData, fp, size, stopAfterHeader, NULL);
+}
+
 
 static void closeRecordingMovie()
 {
 	if(osRecordingMovie)
 	{
+		finishRecordingMovie();
 		delete osRecordingMovie;
 		osRecordingMovie = 0;
 	}
@@ -676,13 +748,24 @@ const char* _CDECL_ FCEUI_LoadMovie(const char *fname, bool _read_only, bool tas
 	//--------------
 
 	currMovieData = MovieData();
+	releaseMovieMapping();
 	
 	strcpy(curMovieFilename, fname);
 	
 	bool loadedfm2 = false;
-	EMUFILE *fp = new EMUFILE_FILE(fname, "rb");
-	loadedfm2 = LoadFM2(currMovieData, *fp, INT_MAX, false);
-	delete fp;
+	curMovieBinary = IsBinaryMovie(fname);
+	if (curMovieBinary)
+	{
+		//the mapping stays open for as long as currMovieData decodes its records from it
+		curMovieMapping = new EMUFILE_MAPPING(fname);
+		loadedfm2 = curMovieMapping->is_open() && LoadBinaryMovie(currMovieData, curMovieMapping->data(), curMovieMapping->size(), NULL);
+	}
+	else
+	{
+		EMUFILE *fp = new EMUFILE_FILE(fname, "rb");
+		loadedfm2 = LoadFM2(currMovieData, *fp, INT_MAX, false);
+		delete fp;
+	}
 
 	if(!loadedfm2)
 		return "failed to load movie";
@@ -699,7 +782,8 @@ const char* _CDECL_ FCEUI_LoadMovie(const char *fname, bool _read_only, bool tas
 	{
 		// SS file name should be the same as the movie file name, except for extension
 		std::string ssName = fname;
-		ssName.erase(ssName.length() - 3, 3);
+		size_t extension = ssName.find_last_of('.');
+		ssName.erase((extension != std::string::npos) ? extension + 1 : ssName.length() - 3);
 		ssName.append("dst");
 		if (!savestate_load(ssName.c_str()))
 			return "Could not load movie's savestate. There should be a .dst file with the same name as the movie, in the same folder.";
@@ -747,6 +831,9 @@ const char* _CDECL_ FCEUI_LoadMovie(const char *fname, bool _read_only, bool tas
 
 static void openRecordingMovie(const char* fname)
 {
+	//the file is about to be rewritten, so it mustn't be mapped anymore
+	releaseMovieMapping();
+
 	//osRecordingMovie = FCEUD_UTF8_fstream(fname, "wb");
 	osRecordingMovie = new EMUFILE_FILE(fname, "wb");
 	/*if(!osRecordingMovie)
@@ -805,16 +892,17 @@ void FCEUI_SaveMovie(const char *fname, std::wstring author, START_FROM startFro
 
 	FCEUI_StopMovie();
 
+	currMovieData = MovieData();
+	curMovieBinary = false;
 	openRecordingMovie(fname);
 
 	currFrameCounter = 0;
 	//LagCounterReset();
 
-	currMovieData = MovieData();
 	currMovieData.guid.newGuid();
 
 	if(author != L"") currMovieData.comments.push_back(L"author " + author);
-	currMovieData.romChecksum = gameInfo.crc;
+	currMovieData.romChecksum = gameInfo.getCRC();
 	currMovieData.romSerial = gameInfo.ROMserial;
 	currMovieData.romFilename = path.GetRomName();
 	currMovieData.rtcStart = rtcstart;
@@ -885,18 +973,18 @@ void FCEUI_SaveMovie(const char *fname, std::wstring author, START_FROM startFro
 	 if(movieMode == MOVIEMODE_PLAY)
 	 {
 		 //stop when we run out of frames
-		 if(currFrameCounter == (int)currMovieData.records.size())
+		 if(currFrameCounter == currMovieData.getNumRecords())
 		 {
 			 FinishPlayback();
 		 }
 		 else
 		 {
 			 UserInput &input = NDS_getProcessingUserInput();
-			 ReplayRecToDesmumeInput(currMovieData.records[currFrameCounter], input);
+			 ReplayRecToDesmumeInput(currMovieData.getRecord(currFrameCounter), input);
 		 }
 
 		 //if we are on the last frame, then pause the emulator if the player requested it
-		 if(currFrameCounter == (int)currMovieData.records.size()-1)
+		 if(currFrameCounter == currMovieData.getNumRecords()-1)
 		 {
 			 /*if(FCEUD_PauseAfterPlayback())
 			 {
@@ -933,7 +1021,7 @@ void FCEUI_SaveMovie(const char *fname, std::wstring author, START_FROM startFro
 		 //assert(nds.touchX == input.touch.touchX && nds.touchY == input.touch.touchY);
 		 //assert((mr.touch.x << 4) == nds.touchX && (mr.touch.y << 4) == nds.touchY);
 
-		 mr.dump(*osRecordingMovie);
+		 dumpRecordingMovieRecord(mr);
 		 currMovieData.records.push_back(mr);
 
 		 // it's apparently un-threadsafe to do this here
@@ -999,7 +1087,9 @@ bool CheckTimelines(MovieData& stateMovie, MovieData& currMovie, int& errorFr)
 
 	for (int x = 0; x < length; x++)
 	{
-		if (!stateMovie.records[x].Compare(currMovie.records[x]))
+		MovieRecord stateRecord = stateMovie.getRecord(x);
+		MovieRecord currRecord = currMovie.getRecord(x);
+		if (!stateRecord.Compare(currRecord))
 		{
 			isInTimeline = false;
 			errorFr = x;
@@ -1134,7 +1224,7 @@ bool mov_loadstate(EMUFILE &fp, int size)
 			currMovieData.rerecordCount = currRerecordCount;
 		}
 
-		if(currFrameCounter > (int)currMovieData.records.size())
+		if(currFrameCounter > currMovieData.getNumRecords())
 		{
 			// if the frame counter is longer than our current movie,
 			// switch to "finished" mode.
@@ -1186,7 +1276,7 @@ bool mov_loadstate(EMUFILE &fp, int size)
 			}
 
 			//printf("DUMPING MOVIE: %d FRAMES\n",currMovieData.records.size());
-			currMovieData.dump(*osRecordingMovie, false);
+			dumpRecordingMovie();
 			movieMode = MOVIEMODE_RECORD;
 		}
 	}
@@ -1273,10 +1363,282 @@ void LoadFM2_binarychunk(MovieData &movieData, EMUFILE &fp, int size)
 	int numRecords = todo/recordsize;
 	//printf("LOADED MOVIE: %d records; currFrameCounter: %d\n",numRecords,currFrameCounter);
 	movieData.records.resize(numRecords);
-	for(int i=0;i<numRecords;i++)
+	if (numRecords == 0)
+		return;
+
+	//this runs for every savestate loaded during movie playback, so read the whole chunk at once
+	//instead of going through parseBinary() for every field of every record
+	std::vector<u8> chunk(numRecords*recordsize);
+	fp.fread(&chunk[0], chunk.size());
+	const u8 *src = &chunk[0];
+	for(int i=0;i<numRecords;i++, src+=recordsize)
+	{
+		MovieRecord &mr = movieData.records[i];
+		mr.commands = src[0];
+		mr.pad = (u16)(src[1] | (src[2] << 8));
+		mr.touch.x = src[3];
+		mr.touch.y = src[4];
+		mr.touch.touch = src[5];
+	}
+}
+
+//----binary movies
+//a binary movie holds the same header values as a text movie, in the order they were written, followed by records of a fixed size.
+//so the file can be memory mapped and the records are found without parsing anything, which makes loading long movies instant.
+//
+//header:  u32 'DSMB', u32 format version, u32 number of header values, u32 record size, u32 number of records, u32 offset of the first record
+//values:  u32 key length, key, u32 value length, value; then padding up to the (8 byte aligned) first record
+//records: u8 commands, u16 pad, u8 touch x, u8 touch y, u8 touch, u8 mic sample, u8 unused
+
+static const u32 kDSMB = 0x424D5344;
+#define BINARY_MOVIE_VERSION 1
+#define BINARY_MOVIE_HEADER_SIZE 24
+#define BINARY_MOVIE_RECORD_SIZE 8
+#define BINARY_MOVIE_RECORD_COUNT_OFFSET 16
+
+static void WriteBinaryMovieRecord(const MovieRecord &mr, u8 *dst)
+{
+	dst[0] = mr.commands;
+	dst[1] = (u8)(mr.pad & 0xFF);
+	dst[2] = (u8)(mr.pad >> 8);
+	dst[3] = mr.touch.x;
+	dst[4] = mr.touch.y;
+	dst[5] = mr.touch.touch;
+	dst[6] = mr.touch.micsample;
+	dst[7] = 0;
+}
+
+//the records are packed, so pad isn't aligned
+static void ReadBinaryMovieRecord(MovieRecord &mr, const u8 *src)
+{
+	mr.commands = src[0];
+	mr.pad = (u16)(src[1] | (src[2] << 8));
+	mr.touch.x = src[3];
+	mr.touch.y = src[4];
+	mr.touch.touch = src[5];
+	mr.touch.micsample = src[6];
+}
+
+MovieRecord MovieData::getRecord(int frame) const
+{
+	if (binaryRecordData == NULL)
+		return records[frame];
+
+	MovieRecord mr;
+	ReadBinaryMovieRecord(mr, binaryRecordData + (size_t)frame * binaryRecordSize);
+	return mr;
+}
+
+//decodes the records that are still in a binary movie's file, so that they can be changed
+void MovieData::decodeRecords()
+{
+	if (binaryRecordData == NULL)
+		return;
+
+	records.resize(binaryRecordCount);
+	for (int i = 0; i < binaryRecordCount; i++)
+		ReadBinaryMovieRecord(records[i], binaryRecordData + (size_t)i * binaryRecordSize);
+
+	binaryRecordData = NULL;
+	binaryRecordCount = 0;
+}
+
+static void releaseMovieMapping()
+{
+	if (curMovieMapping == NULL)
+		return;
+
+	currMovieData.decodeRecords();
+	delete curMovieMapping;
+	curMovieMapping = NULL;
+}
+
+static void WriteBinaryMovie(EMUFILE &fp, const MovieHeaderValues &headerValues, const std::vector<MovieRecord> &records)
+{
+	EMUFILE_MEMORY values;
+	u32 valueCount = 0;
+	for (size_t i = 0; i < headerValues.size(); i++)
 	{
-		movieData.records[i].parseBinary(fp);
+		//the records aren't stored in the text movie's binary chunk anymore
+		if (headerValues[i].first == "binary")
+			continue;
+
+		values.write_32LE((u32)headerValues[i].first.size());
+		values.fwrite(headerValues[i].first.data(), headerValues[i].first.size());
+		values.write_32LE((u32)headerValues[i].second.size());
+		values.fwrite(headerValues[i].second.data(), headerValues[i].second.size());
+		valueCount++;
 	}
+
+	u32 recordsOffset = (BINARY_MOVIE_HEADER_SIZE + values.size() + 7) & ~7;
+	while ((u32)values.size() < recordsOffset - BINARY_MOVIE_HEADER_SIZE)
+		values.write_u8(0);
+
+	fp.write_32LE(kDSMB);
+	fp.write_32LE(BINARY_MOVIE_VERSION);
+	fp.write_32LE(valueCount);
+	fp.write_32LE(BINARY_MOVIE_RECORD_SIZE);
+	fp.write_32LE((u32)records.size());
+	fp.write_32LE(recordsOffset);
+	if (values.size() > 0)
+		fp.fwrite(values.buf(), values.size());
+
+	if (records.empty())
+		return;
+
+	std::vector<u8> recordData(records.size() * BINARY_MOVIE_RECORD_SIZE);
+	for (size_t i = 0; i < records.size(); i++)
+		WriteBinaryMovieRecord(records[i], &recordData[i * BINARY_MOVIE_RECORD_SIZE]);
+	fp.fwrite(&recordData[0], recordData.size());
+}
+
+static bool LoadBinaryMovie(MovieData &movieData, const u8 *data, size_t size, MovieHeaderValues *headerValues)
+{
+	if (size < BINARY_MOVIE_HEADER_SIZE || savestate_ReadLE32(data) != kDSMB)
+		return false;
+
+	u32 version = savestate_ReadLE32(data + 4);
+	u32 valueCount = savestate_ReadLE32(data + 8);
+	u32 recordSize = savestate_ReadLE32(data + 12);
+	u32 recordCount = savestate_ReadLE32(data + 16);
+	u32 recordsOffset = savestate_ReadLE32(data + 20);
+
+	if (version != BINARY_MOVIE_VERSION || recordSize < 7 || recordsOffset < BINARY_MOVIE_HEADER_SIZE || recordsOffset > size)
+		return false;
+	if ((u64)recordCount * recordSize > size - recordsOffset)
+		return false;
+
+	size_t pos = BINARY_MOVIE_HEADER_SIZE;
+	for (u32 i = 0; i < valueCount; i++)
+	{
+		std::string kv[2];
+		for (int j = 0; j < 2; j++)
+		{
+			if (recordsOffset - pos < 4)
+				return false;
+			u32 len = savestate_ReadLE32(data + pos);
+			pos += 4;
+			if (recordsOffset - pos < len)
+				return false;
+			kv[j].assign((const char *)data + pos, len);
+			pos += len;
+		}
+
+		movieData.installValue(kv[0], kv[1]);
+		if (headerValues != NULL)
+			headerValues->push_back(std::make_pair(kv[0], kv[1]));
+	}
+
+	//the records are decoded as they are needed, so data has to stay around as long as movieData uses it
+	movieData.records.clear();
+	movieData.binaryRecordData = data + recordsOffset;
+	movieData.binaryRecordSize = recordSize;
+	movieData.binaryRecordCount = (int)recordCount;
+
+	return true;
+}
+
+static bool IsBinaryMovie(const char *fname)
+{
+	EMUFILE_FILE fp(fname, "rb");
+	u32 cookie;
+	return !fp.fail() && fp.is_open() && fp.read_32LE(cookie) == 1 && cookie == kDSMB;
+}
+
+//the header values a text dump of this movie would have
+static void GetMovieHeaderValues(MovieData &movieData, MovieHeaderValues &headerValues)
+{
+	std::vector<MovieRecord> records;
+	records.swap(movieData.records);
+	EMUFILE_MEMORY header;
+	movieData.dump(header, false);
+	records.swap(movieData.records);
+
+	MovieData scratch;
+	header.fseek(0, SEEK_SET);
+	LoadFM2_internal(scratch, header, header.size(), true, &headerValues);
+}
+
+//writes the whole movie to the file being recorded to, in the format it was loaded in
+static void dumpRecordingMovie()
+{
+	if (curMovieBinary)
+	{
+		MovieHeaderValues headerValues;
+		GetMovieHeaderValues(currMovieData, headerValues);
+		WriteBinaryMovie(*osRecordingMovie, headerValues, currMovieData.records);
+	}
+	else
+		currMovieData.dump(*osRecordingMovie, false);
+}
+
+//appends a record to the file being recorded to
+static void dumpRecordingMovieRecord(MovieRecord &mr)
+{
+	if (!curMovieBinary)
+	{
+		mr.dump(*osRecordingMovie);
+		return;
+	}
+
+	//the header's record count is only brought up to date once recording finishes
+	u8 recordData[BINARY_MOVIE_RECORD_SIZE];
+	WriteBinaryMovieRecord(mr, recordData);
+	osRecordingMovie->fwrite(recordData, BINARY_MOVIE_RECORD_SIZE);
+}
+
+//writes the number of records that were recorded into a binary movie's header
+static void finishRecordingMovie()
+{
+	if (!curMovieBinary)
+		return;
+
+	osRecordingMovie->fseek(BINARY_MOVIE_RECORD_COUNT_OFFSET, SEEK_SET);
+	osRecordingMovie->write_32LE((u32)currMovieData.getNumRecords());
+	osRecordingMovie->fseek(0, SEEK_END);
+}
+
+bool FCEUMOV_ConvertMovie(const char *inFile, const char *outFile)
+{
+	MovieData movieData;
+	MovieHeaderValues headerValues;
+	bool toBinary = !IsBinaryMovie(inFile);
+
+	if (toBinary)
+	{
+		EMUFILE_FILE fp(inFile, "rb");
+		if (fp.fail() || !fp.is_open() || !LoadFM2_internal(movieData, fp, INT_MAX, false, &headerValues))
+			return false;
+	}
+	else
+	{
+		EMUFILE_MAPPING mapping(inFile);
+		if (!mapping.is_open() || !LoadBinaryMovie(movieData, mapping.data(), mapping.size(), &headerValues))
+			return false;
+
+		//every record gets converted anyway, and the mapping goes away here
+		movieData.decodeRecords();
+	}
+
+	EMUFILE_FILE outf(outFile, "wb");
+	if (outf.fail() || !outf.is_open())
+		return false;
+
+	if (toBinary)
+	{
+		WriteBinaryMovie(outf, headerValues, movieData.records);
+		return !outf.fail();
+	}
+
+	for (size_t i = 0; i < headerValues.size(); i++)
+	{
+		if (headerValues[i].first != "binary")
+			outf.fprintf("%s %s\n", headerValues[i].first.c_str(), headerValues[i].second.c_str());
+	}
+	for (int i = 0; i < movieData.getNumRecords(); i++)
+		movieData.getRecord(i).dump(outf);
+
+	return !outf.fail();
 }
 
 #include <sstream>
@@ -1445,3 +1807,217 @@ void DesmumeInputToReplayRec(const UserInput &inInput, MovieRecord &outRecord)
 	if (inInput.mic.micButtonPressed != 0)
 		outRecord.commands = MOVIECMD_MIC;
 }
+
+//----movie sync checking
+//a reference run of a movie records a savestate checkpoint every few frames and a hash of every frame.
+//another build can then replay each segment between two checkpoints on its own and compare the hashes,
+//so that the segments can be verified in parallel and the first desync is found without replaying the whole movie.
+
+#define SYNCCHECK_VERSION 1
+
+static std::string SyncCheck_IndexPath(const char *dir)
+{
+	return (std::string)dir + DIRECTORY_DELIMITER_CHAR + "synccheck.txt";
+}
+
+static std::string SyncCheck_CheckpointPath(const char *dir, int segment)
+{
+	char name[32];
+	sprintf(name, "checkpoint_%06d.dst", segment);
+	return (std::string)dir + DIRECTORY_DELIMITER_CHAR + name;
+}
+
+static u64 SyncCheck_Hash(u64 hash, const void *data, size_t size)
+{
+	//FNV-1a, a word at a time
+	const u8 *bytes = (const u8 *)data;
+	size_t i = 0;
+	for (; i + 8 <= size; i += 8)
+	{
+		u64 word;
+		memcpy(&word, bytes + i, 8);
+		hash = (hash ^ word) * 0x100000001B3ULL;
+	}
+	for (; i < size; i++)
+		hash = (hash ^ bytes[i]) * 0x100000001B3ULL;
+	return hash;
+}
+
+//hashes what a desync shows up in first: the screens and the cpu registers. the last frame of a segment
+//also takes main memory into account, so that a segment only passes if it ends where the next one starts.
+static u64 SyncCheck_HashFrame(bool isSegmentEnd)
+{
+	const NDSDisplayInfo &dispInfo = GPU->GetDisplayInfo();
+	u64 hash = 0xCBF29CE484222325ULL;
+
+	hash = SyncCheck_Hash(hash, dispInfo.masterNativeBuffer16, GPU_FRAMEBUFFER_NATIVE_WIDTH * GPU_FRAMEBUFFER_NATIVE_HEIGHT * 2 * sizeof(u16));
+	hash = SyncCheck_Hash(hash, NDS_ARM9.R, sizeof(NDS_ARM9.R));
+	hash = SyncCheck_Hash(hash, &NDS_ARM9.CPSR.val, sizeof(NDS_ARM9.CPSR.val));
+	hash = SyncCheck_Hash(hash, NDS_ARM7.R, sizeof(NDS_ARM7.R));
+	hash = SyncCheck_Hash(hash, &NDS_ARM7.CPSR.val, sizeof(NDS_ARM7.CPSR.val));
+
+	if (isSegmentEnd)
+		hash = SyncCheck_Hash(hash, MMU.MAIN_MEM, sizeof(MMU.MAIN_MEM));
+
+	return hash;
+}
+
+static void SyncCheck_RunFrame()
+{
+	NDS_beginProcessingInput();
+	FCEUMOV_HandlePlayback();
+	NDS_endProcessingInput();
+	NDS_exec<false>();
+}
+
+//checkpoints are saved and loaded without the movie in them, which would make every checkpoint as big as the movie.
+//the movie is already playing from its own file when they are loaded, and the frame counter is part of the state.
+static bool SyncCheck_SaveCheckpoint(const char *dir, int segment)
+{
+	const EMOVIEMODE oldMode = movieMode;
+	movieMode = MOVIEMODE_INACTIVE;
+	const bool result = savestate_save(SyncCheck_CheckpointPath(dir, segment).c_str());
+	movieMode = oldMode;
+	return result;
+}
+
+static bool SyncCheck_LoadCheckpoint(const char *dir, int segment)
+{
+	const EMOVIEMODE oldMode = movieMode;
+	movieMode = MOVIEMODE_INACTIVE;
+	const bool result = savestate_load(SyncCheck_CheckpointPath(dir, segment).c_str());
+	movieMode = oldMode;
+	return result;
+}
+
+struct SyncCheckIndex
+{
+	int interval;
+	std::vector<u64> hashes;
+
+	int segmentCount() const { return (int)((hashes.size() + interval - 1) / interval); }
+};
+
+static bool SyncCheck_ReadIndex(const char *dir, SyncCheckIndex &index)
+{
+	FILE *fp = fopen(SyncCheck_IndexPath(dir).c_str(), "r");
+	if (fp == NULL)
+		return false;
+
+	int version = 0;
+	int frames = 0;
+	bool ok = (fscanf(fp, "version %d\n", &version) == 1) && (version == SYNCCHECK_VERSION) &&
+	          (fscanf(fp, "interval %d\n", &index.interval) == 1) && (index.interval > 0) &&
+	          (fscanf(fp, "frames %d\n", &frames) == 1) && (frames >= 0);
+
+	index.hashes.clear();
+	for (int i = 0; ok && (i < frames); i++)
+	{
+		unsigned long long hash;
+		ok = (fscanf(fp, "%llx\n", &hash) == 1);
+		index.hashes.push_back((u64)hash);
+	}
+
+	fclose(fp);
+	return ok;
+}
+
+bool FCEUMOV_SyncCheckRecord(const char *movieFile, const char *dir, int interval)
+{
+	if (interval <= 0)
+		return false;
+
+	const char *error = FCEUI_LoadMovie(movieFile, true, false, -1);
+	if (error != NULL)
+	{
+		printf("Sync check: %s\n", error);
+		return false;
+	}
+
+	const int frames = currMovieData.getNumRecords();
+	std::vector<u64> hashes;
+	hashes.reserve(frames);
+
+	for (int frame = 0; frame < frames; frame++)
+	{
+		if ((frame % interval) == 0)
+		{
+			//the reference run goes through the same save and load as the verification will
+			const int segment = frame / interval;
+			if (!SyncCheck_SaveCheckpoint(dir, segment) || !SyncCheck_LoadCheckpoint(dir, segment))
+			{
+				printf("Sync check: could not save checkpoint %s\n", SyncCheck_CheckpointPath(dir, segment).c_str());
+				FCEUI_StopMovie();
+				return false;
+			}
+		}
+
+		SyncCheck_RunFrame();
+		hashes.push_back(SyncCheck_HashFrame(((frame + 1) % interval == 0) || (frame + 1 == frames)));
+	}
+
+	FCEUI_StopMovie();
+
+	FILE *fp = fopen(SyncCheck_IndexPath(dir).c_str(), "w");
+	if (fp == NULL)
+		return false;
+
+	fprintf(fp, "version %d\n", SYNCCHECK_VERSION);
+	fprintf(fp, "interval %d\n", interval);
+	fprintf(fp, "frames %d\n", frames);
+	for (size_t i = 0; i < hashes.size(); i++)
+		fprintf(fp, "%016llx\n", (unsigned long long)hashes[i]);
+
+	const bool ok = (ferror(fp) == 0);
+	fclose(fp);
+
+	printf("Sync check: recorded %d frames in %d segments\n", frames, (frames + interval - 1) / interval);
+	return ok;
+}
+
+int FCEUMOV_SyncCheckSegmentCount(const char *dir)
+{
+	SyncCheckIndex index;
+	if (!SyncCheck_ReadIndex(dir, index))
+		return -1;
+
+	return index.segmentCount();
+}
+
+int FCEUMOV_SyncCheckVerifySegment(const char *movieFile, const char *dir, int segment)
+{
+	SyncCheckIndex index;
+	if (!SyncCheck_ReadIndex(dir, index) || (segment < 0) || (segment >= index.segmentCount()))
+		return SYNCCHECK_ERROR;
+
+	const char *error = FCEUI_LoadMovie(movieFile, true, false, -1);
+	if (error != NULL)
+	{
+		printf("Sync check: %s\n", error);
+		return SYNCCHECK_ERROR;
+	}
+
+	const int startFrame = segment * index.interval;
+	const int endFrame = std::min<int>(startFrame + index.interval, (int)index.hashes.size());
+	int result = SYNCCHECK_INSYNC;
+
+	if (currMovieData.getNumRecords() != (int)index.hashes.size() || !SyncCheck_LoadCheckpoint(dir, segment) || (currFrameCounter != startFrame))
+	{
+		result = SYNCCHECK_ERROR;
+	}
+	else
+	{
+		for (int frame = startFrame; frame < endFrame; frame++)
+		{
+			SyncCheck_RunFrame();
+			if (SyncCheck_HashFrame(frame + 1 == endFrame) != index.hashes[frame])
+			{
+				result = frame;
+				break;
+			}
+		}
+	}
+
+	FCEUI_StopMovie();
+	return result;
+}
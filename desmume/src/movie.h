@@ -153,6 +153,11 @@ public:
 	bool savestate;
 	std::vector<u8> sram;
 	std::vector<MovieRecord> records;
+	//a binary movie's records are decoded from its mapped file as they are played instead of all at once
+	//when it is loaded. while binaryRecordData is set, that's where the records are and records is empty.
+	const u8 *binaryRecordData;
+	u32 binaryRecordSize;
+	int binaryRecordCount;
 	std::vector<std::wstring> comments;
 	std::vector<std::vector<u8> > micSamples;
 	
@@ -179,7 +184,9 @@ public:
 	int advancedTiming;
 	int jitBlockSize;
 
-	int getNumRecords() { return (int)records.size(); }
+	int getNumRecords() const { return (binaryRecordData != NULL) ? binaryRecordCount : (int)records.size(); }
+	MovieRecord getRecord(int frame) const;
+	void decodeRecords();
 
 	class TDictionary : public std::map<std::string,std::string>
 	{
@@ -248,7 +255,7 @@ private:
 	void installMicSample(std::string& key, std::string& val);
 
 	typedef void(MovieData::* ivm)(std::string&,std::string&);
-	std::map<std::string, ivm> installValueMap;
+	static std::map<std::string, ivm>& installValueMap();
 };
 
 extern int currFrameCounter;
@@ -270,6 +277,7 @@ void mov_savestate(EMUFILE &fp);
 bool mov_loadstate(EMUFILE &fp, int size);
 void LoadFM2_binarychunk(MovieData& movieData, EMUFILE &fp, int size);
 bool LoadFM2(MovieData &movieData, EMUFILE &fp, int size, bool stopAfterHeader);
+bool FCEUMOV_ConvertMovie(const char *inFile, const char *outFile); // converts a text movie to a binary movie, or a binary movie back to text
 extern bool movie_readonly;
 extern bool ShowInputDisplay;
 void FCEUI_MakeBackupMovie(bool dispMessage);
@@ -278,4 +286,12 @@ void BinaryDataFromString(std::string &inStringData, std::vector<u8> *outBinaryD
 void ReplayRecToDesmumeInput(const MovieRecord &inRecord, UserInput &outInput);
 void DesmumeInputToReplayRec(const UserInput &inInput, MovieRecord &outRecord);
 
+//movie sync checking. a reference run saves a checkpoint every interval frames and a hash of every frame into dir,
+//and then each segment between two checkpoints can be verified on its own, e.g. by several processes at once.
+#define SYNCCHECK_INSYNC -1
+#define SYNCCHECK_ERROR -2
+bool FCEUMOV_SyncCheckRecord(const char *movieFile, const char *dir, int interval);
+int FCEUMOV_SyncCheckSegmentCount(const char *dir); // returns -1 if dir doesn't hold a sync check recording
+int FCEUMOV_SyncCheckVerifySegment(const char *movieFile, const char *dir, int segment); // returns the first desynced frame, SYNCCHECK_INSYNC or SYNCCHECK_ERROR
+
 #endif
@@ -38,6 +38,7 @@
 #include "rasterize.h"
 
 #include <algorithm>
+#include <map>
 #include <assert.h>
 #include <math.h>
 #include <string.h>
@@ -64,6 +65,7 @@
 #include "NDSSystem.h"
 #include "utils/bits.h"
 #include "utils/task.h"
+#include <rthreads/rthreads.h>
 #include "./utils/colorspacehandler/colorspacehandler.h"
 #include "filter/filter.h"
 #include "filter/xbrz.h"
@@ -535,9 +537,6 @@ Render3DError RasterizerUnit<RENDERER>::_SetupTexture(const POLY &thePoly, size_
 	
 	this->_textureWrapMode = thePoly.texParam.TextureWrapMode;
 	
-	theTexture->ResetCacheAge();
-	theTexture->IncreaseCacheUsageCount(1);
-	
 	return RENDER3DERROR_NOERR;
 }
 
@@ -1415,10 +1414,10 @@ void* SoftRasterizer_RunRasterizerUnit(void *arg)
 	return 0;
 }
 
-static void* SoftRasterizer_RunGetAndLoadAllTextures(void *arg)
+static void* SoftRasterizer_RunLoadQueuedTextures(void *arg)
 {
-	SoftRasterizerRenderer *softRender = (SoftRasterizerRenderer *)arg;
-	softRender->GetAndLoadAllTextures();
+	SoftRasterizerTextureLoadParam *param = (SoftRasterizerTextureLoadParam *)arg;
+	param->renderer->LoadQueuedTextures(param->startIndex, param->stride);
 	
 	return NULL;
 }
@@ -1491,6 +1490,151 @@ static void SoftRasterizerRendererDestroy()
 	}
 }
 
+// Textures with identical packed data and unpack settings always decode to identical render
+// data, so the decoded render data is kept by content hash and shared between texture items,
+// even when they come from different VRAM addresses or palette attributes. This saves
+// textures that get evicted and re-added on scene transitions, or that are duplicated in VRAM,
+// from being decoded and upscaled again.
+//
+// 4x4 textures are never kept here, since they read their palette straight from VRAM while
+// unpacking instead of from their packed data.
+class SoftRasterizerTextureDecodeCache
+{
+protected:
+	struct Entry
+	{
+		u32 descriptor;
+		size_t packSize;
+		size_t renderSize;
+		u8 *packData;
+		u32 *renderData;
+	};
+	
+	std::map<u64, Entry> _entryMap;
+	size_t _actualSize;
+	slock_t *_mutex;
+	
+	void _Clear()
+	{
+		for (std::map<u64, Entry>::iterator it = this->_entryMap.begin(); it != this->_entryMap.end(); ++it)
+		{
+			free_aligned(it->second.packData);
+			free_aligned(it->second.renderData);
+		}
+		
+		this->_entryMap.clear();
+		this->_actualSize = 0;
+	}
+	
+public:
+	SoftRasterizerTextureDecodeCache()
+	{
+		_actualSize = 0;
+		_mutex = slock_new();
+	}
+	
+	~SoftRasterizerTextureDecodeCache()
+	{
+		this->_Clear();
+		slock_free(this->_mutex);
+	}
+	
+	static u64 GenerateHash(const u32 descriptor, const u8 *packData, const size_t packSize)
+	{
+		u64 hash = 0x9E3779B97F4A7C15ULL ^ descriptor;
+		size_t i = 0;
+		
+		for (; i + sizeof(u64) <= packSize; i += sizeof(u64))
+		{
+			u64 word;
+			memcpy(&word, packData + i, sizeof(u64));
+			hash = (hash ^ word) * 0xFF51AFD7ED558CCDULL;
+			hash ^= hash >> 32;
+		}
+		
+		for (; i < packSize; i++)
+		{
+			hash = (hash ^ packData[i]) * 0xFF51AFD7ED558CCDULL;
+			hash ^= hash >> 32;
+		}
+		
+		return hash;
+	}
+	
+	// Copies the cached render data into outRenderData and returns true if the packed data
+	// has already been decoded with the same settings.
+	bool Find(const u64 hash, const u32 descriptor, const u8 *packData, const size_t packSize, u32 *outRenderData, const size_t renderSize)
+	{
+		bool didFind = false;
+		
+		slock_lock(this->_mutex);
+		
+		std::map<u64, Entry>::const_iterator it = this->_entryMap.find(hash);
+		if (it != this->_entryMap.end())
+		{
+			const Entry &entry = it->second;
+			
+			// The hash only narrows the search. Compare everything so that a collision can
+			// never hand back the wrong texture.
+			if ( (entry.descriptor == descriptor) && (entry.packSize == packSize) && (entry.renderSize == renderSize) && (memcmp(entry.packData, packData, packSize) == 0) )
+			{
+				memcpy(outRenderData, entry.renderData, renderSize);
+				didFind = true;
+			}
+		}
+		
+		slock_unlock(this->_mutex);
+		
+		return didFind;
+	}
+	
+	void Add(const u64 hash, const u32 descriptor, const u8 *packData, const size_t packSize, const u32 *renderData, const size_t renderSize)
+	{
+		Entry newEntry;
+		newEntry.descriptor = descriptor;
+		newEntry.packSize = packSize;
+		newEntry.renderSize = renderSize;
+		newEntry.packData = (u8 *)malloc_alignedCacheLine(packSize);
+		newEntry.renderData = (u32 *)malloc_alignedCacheLine(renderSize);
+		memcpy(newEntry.packData, packData, packSize);
+		memcpy(newEntry.renderData, renderData, renderSize);
+		
+		slock_lock(this->_mutex);
+		
+		// Rather than tracking the age of every entry, just start over once the cache gets too big.
+		if (this->_actualSize + packSize + renderSize > TEXCACHE_DEFAULT_THRESHOLD)
+		{
+			this->_Clear();
+		}
+		
+		std::map<u64, Entry>::iterator it = this->_entryMap.find(hash);
+		if (it != this->_entryMap.end())
+		{
+			this->_actualSize -= it->second.packSize + it->second.renderSize;
+			free_aligned(it->second.packData);
+			free_aligned(it->second.renderData);
+			it->second = newEntry;
+		}
+		else
+		{
+			this->_entryMap[hash] = newEntry;
+		}
+		
+		this->_actualSize += packSize + renderSize;
+		
+		slock_unlock(this->_mutex);
+	}
+	
+	void Reset()
+	{
+		slock_lock(this->_mutex);
+		this->_Clear();
+		slock_unlock(this->_mutex);
+	}
+};
+
+static SoftRasterizerTextureDecodeCache softRasterizerDecodeCache;
+
 SoftRasterizerTexture::SoftRasterizerTexture(TEXIMAGE_PARAM texAttributes, u32 palAttributes) : Render3DTexture(texAttributes, palAttributes)
 {
 	_cacheSize = GetUnpackSizeUsingFormat(TexFormat_15bpp);
@@ -1505,6 +1649,8 @@ SoftRasterizerTexture::SoftRasterizerTexture(TEXIMAGE_PARAM texAttributes, u32 p
 	_renderHeightMask = _renderHeight - 1;
 	_renderWidthShift = 0;
 	
+	_isLoadQueued = false;
+	
 	_deposterizeSrcSurface.Surface = (unsigned char *)_unpackData;
 	
 	u32 tempWidth = _renderWidth;
@@ -1569,8 +1715,33 @@ FORCEINLINE void SoftRasterizerTexture::_vflip(s32 &val) const
 	_flip(val, this->_renderHeight, this->_renderHeightMask);
 }
 
+u32 SoftRasterizerTexture::_GetDecodeDescriptor() const
+{
+	return (u32)this->_packFormat |
+	       ((u32)this->_textureAttributes.SizeShiftS << 3) |
+	       ((u32)this->_textureAttributes.SizeShiftT << 6) |
+	       ((this->_isPalZeroTransparent) ? (1 << 9) : 0) |
+	       ((this->_useDeposterize) ? (1 << 10) : 0) |
+	       ((u32)this->_scalingFactor << 11);
+}
+
 void SoftRasterizerTexture::Load()
 {
+	const bool isDecodeCacheable = (this->_packFormat != TEXMODE_4X4);
+	const size_t renderSize = this->_renderWidth * this->_renderHeight * sizeof(u32);
+	const u32 descriptor = this->_GetDecodeDescriptor();
+	u64 hash = 0;
+	
+	if (isDecodeCacheable)
+	{
+		hash = SoftRasterizerTextureDecodeCache::GenerateHash(descriptor, this->_packData, this->_packTotalSize);
+		if (softRasterizerDecodeCache.Find(hash, descriptor, this->_packData, this->_packTotalSize, this->_renderData, renderSize))
+		{
+			this->_isLoadNeeded = false;
+			return;
+		}
+	}
+	
 	if (this->_scalingFactor == 1 && !this->_useDeposterize)
 	{
 		this->Unpack<TexFormat_15bpp>((u32 *)this->_renderData);
@@ -1604,9 +1775,24 @@ void SoftRasterizerTexture::Load()
 		ColorspaceConvertBuffer8888To6665<false, false>(this->_renderData, this->_renderData, this->_renderWidth * this->_renderHeight);
 	}
 	
+	if (isDecodeCacheable)
+	{
+		softRasterizerDecodeCache.Add(hash, descriptor, this->_packData, this->_packTotalSize, this->_renderData, renderSize);
+	}
+	
 	this->_isLoadNeeded = false;
 }
 
+bool SoftRasterizerTexture::IsLoadQueued() const
+{
+	return this->_isLoadQueued;
+}
+
+void SoftRasterizerTexture::SetLoadQueued(bool isQueued)
+{
+	this->_isLoadQueued = isQueued;
+}
+
 u32* SoftRasterizerTexture::GetUnpackData()
 {
 	return this->_unpackData;
@@ -1775,6 +1961,7 @@ SoftRasterizerRenderer::SoftRasterizerRenderer()
 	
 	_renderGeometryNeedsFinish = false;
 	_framebufferAttributes = NULL;
+	_textureLoadCount = 0;
 	
 	_enableHighPrecisionColorInterpolation = CommonSettings.GFX3D_HighResolutionInterpolateColor;
 	_enableLineHack = CommonSettings.GFX3D_LineHack;
@@ -1912,9 +2099,10 @@ ClipperMode SoftRasterizerRenderer::GetPreferredPolygonClippingMode() const
 	return (this->_enableHighPrecisionColorInterpolation) ? ClipperMode_FullColorInterpolate : ClipperMode_Full;
 }
 
-void SoftRasterizerRenderer::GetAndLoadAllTextures()
+void SoftRasterizerRenderer::GetAllTextures()
 {
 	const POLY *rawPolyList = this->_rawPolyList;
+	this->_textureLoadCount = 0;
 	
 	for (size_t i = 0; i < this->_clippedPolyCount; i++)
 	{
@@ -1929,6 +2117,18 @@ void SoftRasterizerRenderer::GetAndLoadAllTextures()
 	}
 }
 
+void SoftRasterizerRenderer::LoadQueuedTextures(const size_t startIndex, const size_t stride)
+{
+	// Textures are interleaved between the threads so that large textures, which tend to be
+	// queued next to each other, get spread out.
+	for (size_t i = startIndex; i < this->_textureLoadCount; i += stride)
+	{
+		SoftRasterizerTexture *theTexture = this->_textureLoadList[i];
+		theTexture->Load();
+		theTexture->SetLoadQueued(false);
+	}
+}
+
 void SoftRasterizerRenderer::RasterizerPrecalculate()
 {
 	for (size_t i = 0, precalcIdx = 0; i < this->_clippedPolyCount; i++)
@@ -2018,16 +2218,29 @@ Render3DError SoftRasterizerRenderer::BeginRender(const GFX3D_State &renderState
 	memcpy(this->_clippedPolyList, renderGList.clippedPolyList, this->_clippedPolyCount * sizeof(CPoly));
 	this->_rawPolyList = (POLY *)renderGList.rawPolyList;
 	
+	// The texture cache isn't thread safe, so the textures are looked up here first. Only the
+	// unpacking and upscaling of the textures that need it is spread across the threads.
+	this->GetAllTextures();
+	
 	const bool doMultithreadedStateSetup = (this->_threadCount >= 2);
+	size_t textureLoadThreadCount = 0;
 	
 	if (doMultithreadedStateSetup)
 	{
-		this->_task[0].execute(&SoftRasterizer_RunGetAndLoadAllTextures, this);
-		this->_task[1].execute(&SoftRasterizer_RunRasterizerPrecalculate, this);
+		this->_task[0].execute(&SoftRasterizer_RunRasterizerPrecalculate, this);
+		
+		textureLoadThreadCount = std::min<size_t>(this->_threadCount - 1, this->_textureLoadCount);
+		for (size_t i = 0; i < textureLoadThreadCount; i++)
+		{
+			this->_threadTextureLoadParam[i].renderer = this;
+			this->_threadTextureLoadParam[i].startIndex = i;
+			this->_threadTextureLoadParam[i].stride = textureLoadThreadCount;
+			this->_task[i + 1].execute(&SoftRasterizer_RunLoadQueuedTextures, &this->_threadTextureLoadParam[i]);
+		}
 	}
 	else
 	{
-		this->GetAndLoadAllTextures();
+		this->LoadQueuedTextures(0, 1);
 		this->RasterizerPrecalculate();
 	}
 	
@@ -2046,7 +2259,11 @@ Render3DError SoftRasterizerRenderer::BeginRender(const GFX3D_State &renderState
 	
 	if (doMultithreadedStateSetup)
 	{
-		this->_task[1].finish();
+		for (size_t i = 0; i < textureLoadThreadCount; i++)
+		{
+			this->_task[i + 1].finish();
+		}
+		
 		this->_task[0].finish();
 	}
 	
@@ -2284,11 +2501,14 @@ SoftRasterizerTexture* SoftRasterizerRenderer::GetLoadedTextureFromPolygon(const
 	
 	theTexture->SetSamplingEnabled(isTextureEnabled);
 	
-	if (theTexture->IsLoadNeeded() && isTextureEnabled)
+	if (theTexture->IsLoadNeeded() && isTextureEnabled && !theTexture->IsLoadQueued())
 	{
+		// Only queue the texture here. LoadQueuedTextures() does the actual loading, possibly
+		// on multiple threads.
 		theTexture->SetUseDeposterize(this->_enableTextureDeposterize);
 		theTexture->SetScalingFactor(this->_textureScalingFactor);
-		theTexture->Load();
+		theTexture->SetLoadQueued(true);
+		this->_textureLoadList[this->_textureLoadCount++] = theTexture;
 	}
 	
 	return theTexture;
@@ -2375,6 +2595,8 @@ Render3DError SoftRasterizerRenderer::Reset()
 	this->_renderGeometryNeedsFinish = false;
 	
 	texCache.Reset();
+	softRasterizerDecodeCache.Reset();
+	this->_textureLoadCount = 0;
 	memset(this->_precalc, 0, CLIPPED_POLYLIST_SIZE * MAX_CLIPPED_VERTS * sizeof(SoftRasterizerPrecalculation));
 	
 	return RENDER3DERROR_NOERR;
@@ -55,6 +55,13 @@ struct SoftRasterizerClearParam
 	size_t endPixel;
 };
 
+struct SoftRasterizerTextureLoadParam
+{
+	SoftRasterizerRenderer *renderer;
+	size_t startIndex;
+	size_t stride;
+};
+
 struct SoftRasterizerPostProcessParams
 {
 	SoftRasterizerRenderer *renderer;
@@ -90,12 +97,19 @@ protected:
 	s32 _renderHeightMask;
 	u32 _renderWidthShift;
 	
+	bool _isLoadQueued;
+	
+	u32 _GetDecodeDescriptor() const;
+	
 public:
 	SoftRasterizerTexture(TEXIMAGE_PARAM texAttributes, u32 palAttributes);
 	virtual ~SoftRasterizerTexture();
 	
 	virtual void Load();
 	
+	bool IsLoadQueued() const;
+	void SetLoadQueued(bool isQueued);
+	
 	u32* GetUnpackData();
 	
 	u32* GetRenderData();
@@ -163,6 +177,10 @@ protected:
 	Task *_task;
 	SoftRasterizerClearParam _threadClearParam[SOFTRASTERIZER_MAX_THREADS];
 	SoftRasterizerPostProcessParams _threadPostprocessParam[SOFTRASTERIZER_MAX_THREADS];
+	SoftRasterizerTextureLoadParam _threadTextureLoadParam[SOFTRASTERIZER_MAX_THREADS];
+	
+	SoftRasterizerTexture *_textureLoadList[CLIPPED_POLYLIST_SIZE];
+	size_t _textureLoadCount;
 	
 	RasterizerUnit<true> _rasterizerUnit[SOFTRASTERIZER_MAX_THREADS];
 	RasterizerUnit<false> _HACK_viewer_rasterizerUnit;
@@ -209,7 +227,8 @@ public:
 	
 	virtual ClipperMode GetPreferredPolygonClippingMode() const;
 	
-	void GetAndLoadAllTextures();
+	void GetAllTextures();
+	void LoadQueuedTextures(const size_t startIndex, const size_t stride);
 	void RasterizerPrecalculate();
 	Render3DError RenderEdgeMarkingAndFog(const SoftRasterizerPostProcessParams &param);
 	
@@ -28,6 +28,7 @@
 #include <sys/stat.h>
 #include <time.h>
 #include <fstream>
+#include <chrono>
 
 #include "common.h"
 #include "armcpu.h"
@@ -54,6 +55,9 @@
 #include "wifi.h"
 
 #include "path.h"
+#include "file/file_path.h"
+#include "utils/task.h"
+#include "utils/xstring.h"
 
 #ifdef HOST_WINDOWS
 #include "frontend/windows/main.h"
@@ -76,10 +80,35 @@ savestates_t savestates[NB_STATES];
 
 #define SAVESTATE_VERSION       12
 static const char* magic = "DeSmuME SState\0";
+static const char* deltaMagic = "DeSmuME SDelta\0";
 
 //a savestate chunk loader can set this if it wants to permit a silent failure (for compatibility)
 static bool SAV_silent_fail_flag;
 
+//savestates queued with savestate_save_async() are compressed and written to disk on a background thread.
+//only one write is ever in flight; queueing another one (or touching a savestate file) waits for it first.
+struct SavestateWriteJob
+{
+	std::string fileName;
+	EMUFILE_MEMORY data; //the uncompressed chunks, as serialized on the emulation thread. reused for every save
+	EMUFILE_MEMORY compressed; //reused for every save as well
+	int compressionLevel;
+	int slot; //-1 if this wasn't a slot save
+	bool isAsync;
+	bool result;
+	SavestateTimingStats stats;
+};
+
+//a scratch stream for the other savestate writes, kept between them so that its buffer is already big enough
+static EMUFILE_MEMORY _savestateScratch;
+
+static Task *_savestateWriteTask = NULL;
+static SavestateWriteJob _savestateWriteJob;
+static bool _savestateWritePending = false;
+static SavestateTimingStats _savestateTimingStats = { 0, 0, 0.0, 0.0, 0.0 };
+
+static bool savestate_QueueWrite(const char *file_name, int compressionLevel, int slot);
+
 SFORMAT SF_NDS_INFO[]={
 	{ "GINF", 1, sizeof(gameInfo.header), &gameInfo.header},
 	{ "GRSZ", 1, 4, &gameInfo.romsize},
@@ -655,6 +684,8 @@ void clear_savestates()
 // Scan for existing savestates and update struct
 void scan_savestates()
 {
+	savestate_flush();
+
 	#ifdef _MSC_VER
 	struct _stat64i32 sbuf;
 	#else 
@@ -699,7 +730,9 @@ void savestate_slot(int num)
 	if (strlen(filename) + strlen(".dsx") + strlen("-2147483648") /* = biggest string for num */ > MAX_PATH) return;
 	sprintf(filename + strlen(filename), ".ds%d", num);
 
-	if (savestate_save(filename))
+	//slot saves are bound to hotkeys, so favor speed over size. the file itself is written in the background;
+	//if that fails, the error is reported when the write is collected.
+	if (savestate_QueueWrite(filename, Z_BEST_SPEED, num))
 	{
 		driver->SetLineColor(255, 255, 255);
 		driver->AddLine("Saved to %i slot", num);
@@ -713,10 +746,11 @@ void savestate_slot(int num)
 
 	if (num >= 0 && num < NB_STATES)
 	{
-		if (stat(filename, &sbuf) != -1)
+		//while the file is still being written in the background, go by the time it was saved at
+		if (_savestateWritePending || stat(filename, &sbuf) != -1)
 		{
 			savestates[num].exists = TRUE;
-			strncpy(savestates[num].date, format_time(sbuf.st_mtime), 40);
+			strncpy(savestates[num].date, format_time(_savestateWritePending ? time(NULL) : sbuf.st_mtime), 40);
 			savestates[num].date[40 - 1] = '\0';
 		}
 	}
@@ -908,8 +942,8 @@ static int SubWrite(EMUFILE *os, const SFORMAT *sf)
 
 #ifdef DEBUG
 	std::set<std::string> keyset;
-#endif
 
+	//this is quadratic in the number of entries and runs twice per chunk on every save, so only check it in debug builds
 	const SFORMAT* temp = sf;
 	while(temp->v) {
 		const SFORMAT* seek = sf;
@@ -921,6 +955,7 @@ static int SubWrite(EMUFILE *os, const SFORMAT *sf)
 		}
 		temp++;
 	}
+#endif
 
 	while (sf->v)
 	{
@@ -1041,6 +1076,7 @@ static void savestate_WriteChunk(EMUFILE &os, int type, void (*saveproc)(EMUFILE
 }
 
 static void writechunks(EMUFILE &os);
+static bool savestate_WriteCompressed(EMUFILE &outstream, u8 *data, u32 len, int compressionLevel);
 
 bool savestate_save(EMUFILE &outstream, int compressionLevel)
 {
@@ -1051,27 +1087,43 @@ bool savestate_save(EMUFILE &outstream, int compressionLevel)
 	compressionLevel = Z_NO_COMPRESSION;
 	#endif
 
-	EMUFILE_MEMORY ms;
-	EMUFILE &os = (compressionLevel != Z_NO_COMPRESSION) ? (EMUFILE &)ms : (EMUFILE &)outstream;
-	
 	if (compressionLevel == Z_NO_COMPRESSION)
 	{
-		os.fseek(32,SEEK_SET); //skip the header
+		outstream.fseek(32,SEEK_SET); //skip the header
+		writechunks(outstream);
+
+		//dump the header
+		u32 len = outstream.ftell();
+		outstream.fseek(0,SEEK_SET);
+		outstream.fwrite(magic,16);
+		outstream.write_32LE(SAVESTATE_VERSION);
+		outstream.write_32LE(EMU_DESMUME_VERSION_NUMERIC()); //desmume version
+		outstream.write_32LE(len); //uncompressed length
+		outstream.write_32LE(0xFFFFFFFF); //not compressed
+		return true;
 	}
-	
-	writechunks(os);
 
-	//save the length of the file
-	u32 len = os.ftell();
+	EMUFILE_MEMORY &ms = _savestateScratch;
+	ms.reset();
+	writechunks(ms);
+
+	return savestate_WriteCompressed(outstream, ms.buf(), ms.size(), compressionLevel);
+}
+
+//writes a savestate file from already serialized chunks, compressing them if asked to
+static bool savestate_WriteCompressed(EMUFILE &outstream, u8 *data, u32 len, int compressionLevel)
+{
+	#ifndef HAVE_LIBZ
+	compressionLevel = Z_NO_COMPRESSION;
+	#endif
 
 	u32 comprlen = 0xFFFFFFFF;
-	u8* cbuf;
+	u8* cbuf = NULL;
 
 	//compress the data
 	int error = Z_OK;
 	if (compressionLevel != Z_NO_COMPRESSION)
 	{
-		cbuf = ms.buf();
 		uLongf comprlen2;
 		//worst case compression.
 		//zlib says "0.1% larger than sourceLen plus 12 bytes"
@@ -1079,7 +1131,7 @@ bool savestate_save(EMUFILE &outstream, int compressionLevel)
 		cbuf = new u8[comprlen];
 		// Workaround to make it compile under linux 64bit
 		comprlen2 = comprlen;
-		error = compress2(cbuf,&comprlen2,ms.buf(),len,compressionLevel);
+		error = compress2(cbuf,&comprlen2,data,len,compressionLevel);
 		comprlen = (u32)comprlen2;
 	}
 
@@ -1088,20 +1140,26 @@ bool savestate_save(EMUFILE &outstream, int compressionLevel)
 	outstream.fwrite(magic,16);
 	outstream.write_32LE(SAVESTATE_VERSION);
 	outstream.write_32LE(EMU_DESMUME_VERSION_NUMERIC()); //desmume version
-	outstream.write_32LE(len); //uncompressed length
+	outstream.write_32LE((compressionLevel != Z_NO_COMPRESSION) ? len : len + 32); //uncompressed length
 	outstream.write_32LE(comprlen); //compressed length (-1 if it is not compressed)
 
 	if (compressionLevel != Z_NO_COMPRESSION)
 	{
-		outstream.fwrite(cbuf,comprlen==(u32)-1?len:comprlen);
+		outstream.fwrite(cbuf,comprlen);
 		delete[] cbuf;
 	}
+	else
+	{
+		outstream.fwrite(data,len);
+	}
 
 	return error == Z_OK;
 }
 
 bool savestate_save (const char *file_name)
 {
+	savestate_flush();
+
 	EMUFILE_MEMORY ms;
 	if (!savestate_save(ms))
 		return false;
@@ -1114,6 +1172,132 @@ bool savestate_save (const char *file_name)
 	return true;
 }
 
+static double savestate_MillisecondsSince(const std::chrono::steady_clock::time_point &start)
+{
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+//moves the finished temporary file over the real one, so that a crash mid-write never leaves a truncated savestate behind
+static bool savestate_ReplaceFile(const std::string &tempName, const std::string &fileName)
+{
+#ifdef HOST_WINDOWS
+	return MoveFileExW(mbstowcs(tempName).c_str(), mbstowcs(fileName).c_str(), MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+	return rename(tempName.c_str(), fileName.c_str()) == 0;
+#endif
+}
+
+static void* savestate_WriteJobProc(void *arg)
+{
+	SavestateWriteJob &job = *(SavestateWriteJob *)arg;
+
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	EMUFILE_MEMORY &ms = job.compressed;
+	ms.reset();
+	job.result = savestate_WriteCompressed(ms, job.data.buf(), (u32)job.data.size(), job.compressionLevel);
+	job.stats.compressedSize = (u32)ms.size();
+	job.stats.compressMilliseconds = savestate_MillisecondsSince(start);
+
+	start = std::chrono::steady_clock::now();
+	if (job.result)
+	{
+		const std::string tempName = job.fileName + ".tmp";
+		{
+			EMUFILE_FILE file(tempName, "wb");
+			job.result = !file.fail();
+			if (job.result)
+			{
+				file.fwrite(ms.buf(), ms.size());
+				file.fflush();
+				job.result = !file.fail();
+			}
+		}
+
+		job.result = job.result && savestate_ReplaceFile(tempName, job.fileName);
+		if (!job.result)
+			remove(tempName.c_str());
+	}
+	job.stats.writeMilliseconds = savestate_MillisecondsSince(start);
+
+	return NULL;
+}
+
+//collects the pending background write, if there is one. must be called from the emulation thread.
+bool savestate_flush()
+{
+	if (!_savestateWritePending)
+		return true;
+
+	SavestateWriteJob &job = _savestateWriteJob;
+	if (job.isAsync)
+		_savestateWriteTask->finish();
+
+	_savestateWritePending = false;
+	_savestateTimingStats = job.stats;
+
+	if (job.isAsync && !job.result)
+	{
+		printf("Failed to write savestate: %s\n", job.fileName.c_str());
+		if (job.slot >= 0)
+		{
+			driver->SetLineColor(255, 0, 0);
+			driver->AddLine("Error saving %i slot", job.slot);
+		}
+	}
+
+	return job.result;
+}
+
+static bool savestate_QueueWrite(const char *file_name, int compressionLevel, int slot)
+{
+	savestate_flush();
+
+	SavestateWriteJob &job = _savestateWriteJob;
+	job.fileName = file_name;
+	job.compressionLevel = compressionLevel;
+	job.slot = slot;
+	job.result = false;
+
+	//the only part that has to happen on the emulation thread: serialize the chunks into memory
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+#ifdef HAVE_JIT
+	arm_jit_sync();
+#endif
+	job.data.reset();
+	writechunks(job.data);
+	job.stats.uncompressedSize = (u32)job.data.size();
+	job.stats.snapshotMilliseconds = savestate_MillisecondsSince(start);
+
+	job.isAsync = (CommonSettings.num_cores > 1);
+	_savestateWritePending = true;
+
+	if (!job.isAsync)
+	{
+		savestate_WriteJobProc(&job);
+		return savestate_flush();
+	}
+
+	if (_savestateWriteTask == NULL)
+	{
+		_savestateWriteTask = new Task;
+		_savestateWriteTask->start(false, 0, "savestate writer");
+	}
+
+	_savestateWriteTask->execute(&savestate_WriteJobProc, &job);
+	return true;
+}
+
+bool savestate_save_async(const char *file_name, int compressionLevel)
+{
+	return savestate_QueueWrite(file_name, compressionLevel, -1);
+}
+
+SavestateTimingStats savestate_GetTimingStats()
+{
+	savestate_flush();
+	return _savestateTimingStats;
+}
+
 static void wifi_savestate(EMUFILE &os)
 {
 	wifiHandler->SaveState(os);
@@ -1314,12 +1498,21 @@ static void loadstate()
 	execute = !driver->EMU_IsEmulationPaused();
 }
 
-bool savestate_load(EMUFILE &is)
+static bool savestate_ReadDelta(EMUFILE &is, std::vector<u8> &buf, const char *file_name);
+
+//reads the header of a full savestate and decompresses its chunks into buf.
+//file_name is where the state was read from, if known, and is what a delta's base is found relative to
+static bool savestate_ReadStateData(EMUFILE &is, std::vector<u8> &buf, bool allowDelta, const char *file_name = NULL)
 {
-	SAV_silent_fail_flag = false;
 	char header[16];
 	is.fread(header,16);
-	if (is.fail() || memcmp(header,magic,16))
+	if (is.fail())
+		return false;
+
+	if (allowDelta && !memcmp(header,deltaMagic,16))
+		return savestate_ReadDelta(is, buf, file_name);
+
+	if (memcmp(header,magic,16))
 		return false;
 
 	u32 ssversion,len,comprlen;
@@ -1330,7 +1523,7 @@ bool savestate_load(EMUFILE &is)
 
 	if (ssversion != SAVESTATE_VERSION) return false;
 
-	std::vector<u8> buf(len);
+	buf.resize(len);
 
 	if (comprlen != 0xFFFFFFFF)
 	{
@@ -1351,9 +1544,23 @@ bool savestate_load(EMUFILE &is)
 	}
 	else
 	{
+		if (len <= 32) return false;
+		buf.resize(len-32);
 		is.fread(&buf[0],len-32);
+		if (is.fail()) return false;
 	}
 
+	return true;
+}
+
+static bool savestate_load(EMUFILE &is, const char *file_name)
+{
+	SAV_silent_fail_flag = false;
+
+	std::vector<u8> buf;
+	if (!savestate_ReadStateData(is, buf, true, file_name))
+		return false;
+
 	//GO!! READ THE SAVESTATE
 	//THERE IS NO GOING BACK NOW
 	//reset the emulator first to clean out the host's state
@@ -1376,7 +1583,7 @@ bool savestate_load(EMUFILE &is)
 	//SPU_Reset();
 
 	EMUFILE_MEMORY mstemp(&buf);
-	bool x = ReadStateChunks(mstemp,(s32)len);
+	bool x = ReadStateChunks(mstemp,(s32)buf.size());
 
 	if (!x && !SAV_silent_fail_flag)
 	{
@@ -1400,10 +1607,409 @@ bool savestate_load(EMUFILE &is)
 	return true;
 }
 
+bool savestate_load(EMUFILE &is)
+{
+	return savestate_load(is, NULL);
+}
+
 bool savestate_load(const char *file_name)
 {
+	savestate_flush();
+
 	EMUFILE_FILE f(file_name,"rb");
 	if (f.fail()) return false;
 
-	return savestate_load(f);
+	return savestate_load(f, file_name);
+}
+
+bool savestate_Benchmark(const size_t loopCount)
+{
+	savestate_flush();
+#ifdef HAVE_JIT
+	arm_jit_sync();
+#endif
+
+	//reading the chunks back goes into the running emulator, so the state is put back the normal way afterwards
+	EMUFILE_MEMORY savedState;
+	if (!savestate_save(savedState, Z_NO_COMPRESSION))
+		return false;
+
+	double freshMilliseconds = 0.0;
+	double reusedMilliseconds = 0.0;
+	double readMilliseconds = 0.0;
+	std::vector<u8> data;
+	bool didReadAll = true;
+
+	for (size_t loop = 0; loop < loopCount; loop++)
+	{
+		//a new stream, which has to grow as the chunks are written
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		{
+			EMUFILE_MEMORY ms;
+			writechunks(ms);
+		}
+		freshMilliseconds += savestate_MillisecondsSince(start);
+
+		//the stream savestate_save() keeps between saves
+		EMUFILE_MEMORY &ms = _savestateScratch;
+		start = std::chrono::steady_clock::now();
+		ms.reset();
+		writechunks(ms);
+		reusedMilliseconds += savestate_MillisecondsSince(start);
+
+		data.assign(ms.buf(), ms.buf() + ms.size());
+		EMUFILE_MEMORY is(&data);
+		start = std::chrono::steady_clock::now();
+		didReadAll = ReadStateChunks(is, (s32)data.size()) && didReadAll;
+		readMilliseconds += savestate_MillisecondsSince(start);
+	}
+
+	savedState.fseek(0, SEEK_SET);
+	if (!savestate_load(savedState))
+		didReadAll = false;
+
+	if (loopCount > 0)
+	{
+		printf("Savestate benchmark: %u bytes, loops: %u\n", (u32)data.size(), (u32)loopCount);
+		printf("  write (new stream):    %.3f ms\n", freshMilliseconds / loopCount);
+		printf("  write (reused stream): %.3f ms\n", reusedMilliseconds / loopCount);
+		printf("  read:                  %.3f ms\n", readMilliseconds / loopCount);
+	}
+
+	if (!didReadAll)
+		printf("Savestate benchmark: the state could not be read back\n");
+
+	return didReadAll;
+}
+
+//delta savestates store the chunks of a state as differences against a base savestate file, which is
+//useful when saving many states that only differ in a little bit of RAM. each chunk that also exists
+//in the base with the same size is stored as runs of unchanged bytes and runs of bytes XORed with the base.
+//the base is kept in memory between saves and loads, so that it is only read and decompressed once.
+//
+//format, after the 16 byte magic (all values are little endian u32):
+//  version, desmume version, base name length, base name, base chunk data length, base chunk data hash
+//  then for each chunk: type, size, encoding, payload length, payload
+//  terminated by a type of 0xFFFFFFFF
+#define SAVESTATE_DELTA_RAW 0
+#define SAVESTATE_DELTA_XORRLE 1
+
+struct SavestateChunkRef
+{
+	u32 type;
+	u32 offset; //of the chunk's data, past its type and size
+	u32 size;
+};
+
+struct SavestateDeltaBase
+{
+	std::string fileName;
+	s64 fileTime;
+	s64 fileSize;
+	u32 hash;
+	std::vector<u8> data;
+	std::vector<SavestateChunkRef> chunks;
+};
+
+static SavestateDeltaBase _savestateDeltaBase;
+
+static u32 savestate_HashData(const std::vector<u8> &data)
+{
+	//FNV-1a
+	u32 hash = 0x811C9DC5;
+	for (size_t i = 0; i < data.size(); i++)
+		hash = (hash ^ data[i]) * 0x01000193;
+	return hash;
+}
+
+//the chunks and lengths in a delta needn't be aligned, and T1ReadLong() would align them
+u32 savestate_ReadLE32(const u8 *p)
+{
+	u32 value;
+	memcpy(&value, p, sizeof(value));
+	return LE_TO_LOCAL_32(value);
+}
+
+static bool savestate_IndexChunks(u8 *data, u32 size, std::vector<SavestateChunkRef> &chunks)
+{
+	chunks.clear();
+
+	u32 pos = 0;
+	for (;;)
+	{
+		SavestateChunkRef chunk;
+		if (size - pos < 4) return false;
+		chunk.type = savestate_ReadLE32(data + pos);
+		if (chunk.type == 0xFFFFFFFF) return true;
+		if (size - pos < 8) return false;
+		chunk.size = savestate_ReadLE32(data + pos + 4);
+
+		chunk.offset = pos + 8;
+		if (chunk.size > size - chunk.offset) return false;
+
+		chunks.push_back(chunk);
+		pos = chunk.offset + chunk.size;
+	}
+}
+
+//returns the base state with the given name, reading it again only if the file changed since the last time
+static SavestateDeltaBase* savestate_GetDeltaBase(const char *file_name)
+{
+	SavestateDeltaBase &base = _savestateDeltaBase;
+
+	struct stat sbuf;
+	if (stat(file_name, &sbuf) == -1)
+		return NULL;
+
+	if (base.fileName == file_name && base.fileTime == (s64)sbuf.st_mtime && base.fileSize == (s64)sbuf.st_size && !base.data.empty())
+		return &base;
+
+	base.fileName.clear();
+
+	EMUFILE_FILE f(file_name, "rb");
+	if (f.fail() || !savestate_ReadStateData(f, base.data, false) || base.data.empty() || !savestate_IndexChunks(&base.data[0], (u32)base.data.size(), base.chunks))
+	{
+		base.data.clear();
+		return NULL;
+	}
+
+	base.fileName = file_name;
+	base.fileTime = (s64)sbuf.st_mtime;
+	base.fileSize = (s64)sbuf.st_size;
+	base.hash = savestate_HashData(base.data);
+	return &base;
+}
+
+//the name of the base as it is stored in a delta: relative to the delta's directory if the base is somewhere below it,
+//so that the two can be moved together, and absolute otherwise
+static std::string savestate_DeltaBaseName(const char *file_name, const char *base_file_name)
+{
+	char baseAbs[PATH_MAX_LENGTH];
+	char dirAbs[PATH_MAX_LENGTH];
+	snprintf(baseAbs, sizeof(baseAbs), "%s", base_file_name);
+	path_resolve_realpath(baseAbs, sizeof(baseAbs));
+	fill_pathname_basedir(dirAbs, file_name, sizeof(dirAbs));
+	path_resolve_realpath(dirAbs, sizeof(dirAbs));
+
+	const size_t dirLength = strlen(dirAbs);
+	if (dirLength > 0 && !strncmp(baseAbs, dirAbs, dirLength))
+	{
+		if (path_char_is_slash(dirAbs[dirLength - 1]))
+			return std::string(baseAbs + dirLength);
+		if (path_char_is_slash(baseAbs[dirLength]))
+			return std::string(baseAbs + dirLength + 1);
+	}
+
+	return std::string(baseAbs);
+}
+
+static const SavestateChunkRef* savestate_FindChunk(const SavestateDeltaBase &base, u32 type)
+{
+	for (size_t i = 0; i < base.chunks.size(); i++)
+	{
+		if (base.chunks[i].type == type)
+			return &base.chunks[i];
+	}
+	return NULL;
+}
+
+static void savestate_WriteXorRle(std::vector<u8> &payload, const u8 *cur, const u8 *ref, u32 size)
+{
+	//a run of changed bytes only ends after this many unchanged ones, so that a few scattered
+	//unchanged bytes don't cost a whole run header
+	static const u32 minSameRun = 8;
+
+	u32 pos = 0;
+	while (pos < size)
+	{
+		u32 start = pos;
+		while ((pos + 64 <= size) && !memcmp(cur + pos, ref + pos, 64)) pos += 64;
+		while ((pos < size) && (cur[pos] == ref[pos])) pos++;
+		const u32 same = pos - start;
+
+		start = pos;
+		u32 sameCount = 0;
+		while ((pos < size) && (sameCount < minSameRun))
+		{
+			sameCount = (cur[pos] == ref[pos]) ? sameCount + 1 : 0;
+			pos++;
+		}
+		if (sameCount >= minSameRun)
+			pos -= sameCount;
+		const u32 changed = pos - start;
+
+		const size_t outPos = payload.size();
+		payload.resize(outPos + 8 + changed);
+		u8 *out = &payload[outPos];
+		T1WriteLong(out, 0, same);
+		T1WriteLong(out, 4, changed);
+		for (u32 i = 0; i < changed; i++)
+			out[8 + i] = cur[start + i] ^ ref[start + i];
+	}
+}
+
+static bool savestate_ReadXorRle(u8 *payload, u32 payloadSize, u8 *out, const u8 *ref, u32 size)
+{
+	u32 pos = 0;
+	u32 in = 0;
+	while (pos < size)
+	{
+		if (payloadSize - in < 8) return false;
+		const u32 same = savestate_ReadLE32(payload + in);
+		const u32 changed = savestate_ReadLE32(payload + in + 4);
+		in += 8;
+
+		if ((same > size - pos) || (changed > size - pos - same) || (changed > payloadSize - in)) return false;
+
+		memcpy(out + pos, ref + pos, same);
+		pos += same;
+		for (u32 i = 0; i < changed; i++)
+			out[pos + i] = payload[in + i] ^ ref[pos + i];
+		pos += changed;
+		in += changed;
+	}
+
+	return (in == payloadSize);
+}
+
+bool savestate_save_delta(const char *file_name, const char *base_file_name)
+{
+	savestate_flush();
+
+	SavestateDeltaBase *base = savestate_GetDeltaBase(base_file_name);
+	if (base == NULL)
+		return false;
+
+#ifdef HAVE_JIT
+	arm_jit_sync();
+#endif
+	EMUFILE_MEMORY &ms = _savestateScratch;
+	ms.reset();
+	writechunks(ms);
+	u8 *data = ms.buf();
+
+	std::vector<SavestateChunkRef> chunks;
+	if (!savestate_IndexChunks(data, (u32)ms.size(), chunks))
+		return false;
+
+	const std::string baseName = savestate_DeltaBaseName(file_name, base_file_name);
+
+	EMUFILE_MEMORY os;
+	os.fwrite(deltaMagic,16);
+	os.write_32LE(SAVESTATE_VERSION);
+	os.write_32LE(EMU_DESMUME_VERSION_NUMERIC());
+	os.write_32LE((u32)baseName.size());
+	os.fwrite(baseName.c_str(), baseName.size());
+	os.write_32LE((u32)base->data.size());
+	os.write_32LE(base->hash);
+
+	std::vector<u8> payload;
+	for (size_t i = 0; i < chunks.size(); i++)
+	{
+		const SavestateChunkRef &chunk = chunks[i];
+		const SavestateChunkRef *ref = savestate_FindChunk(*base, chunk.type);
+
+		os.write_32LE(chunk.type);
+		os.write_32LE(chunk.size);
+
+		if ((ref != NULL) && (ref->size == chunk.size))
+		{
+			payload.clear();
+			savestate_WriteXorRle(payload, data + chunk.offset, &base->data[ref->offset], chunk.size);
+			os.write_32LE(SAVESTATE_DELTA_XORRLE);
+			os.write_32LE((u32)payload.size());
+			if (!payload.empty())
+				os.fwrite(&payload[0], payload.size());
+		}
+		else
+		{
+			os.write_32LE(SAVESTATE_DELTA_RAW);
+			os.write_32LE(chunk.size);
+			os.fwrite(data + chunk.offset, chunk.size);
+		}
+	}
+	os.write_32LE(0xFFFFFFFF);
+
+	EMUFILE_FILE file(file_name, "wb");
+	if (file.fail())
+		return false;
+
+	file.fwrite(os.buf(), os.size());
+	return !file.fail();
+}
+
+//rebuilds the full chunk data of a delta savestate, whose magic has already been read.
+//a relative base name is resolved against the directory of file_name, or the current directory if that isn't known
+static bool savestate_ReadDelta(EMUFILE &is, std::vector<u8> &buf, const char *file_name)
+{
+	u32 ssversion, version, nameLength, baseLength, baseHash;
+	if (!is.read_32LE(ssversion)) return false;
+	if (!is.read_32LE(version)) return false;
+	if (!is.read_32LE(nameLength)) return false;
+	if (ssversion != SAVESTATE_VERSION) return false;
+
+	std::string baseName(nameLength, '\0');
+	if (nameLength != 0)
+		is.fread(&baseName[0], nameLength);
+	if (!is.read_32LE(baseLength)) return false;
+	if (!is.read_32LE(baseHash)) return false;
+
+	if (file_name != NULL)
+	{
+		char basePath[PATH_MAX_LENGTH];
+		fill_pathname_resolve_relative(basePath, file_name, baseName.c_str(), sizeof(basePath));
+		baseName = basePath;
+	}
+
+	SavestateDeltaBase *base = savestate_GetDeltaBase(baseName.c_str());
+	if ((base == NULL) || (base->data.size() != baseLength) || (base->hash != baseHash))
+	{
+		printf("Delta savestate does not match its base savestate: %s\n", baseName.c_str());
+		return false;
+	}
+
+	_DESMUME_version = version;
+
+	buf.clear();
+	std::vector<u8> payload;
+	for (;;)
+	{
+		u32 type, size, encoding, payloadSize;
+		if (!is.read_32LE(type)) return false;
+		if (type == 0xFFFFFFFF) break;
+		if (!is.read_32LE(size)) return false;
+		if (!is.read_32LE(encoding)) return false;
+		if (!is.read_32LE(payloadSize)) return false;
+
+		const size_t outPos = buf.size();
+		buf.resize(outPos + 8 + size);
+		u8 *out = &buf[outPos];
+		T1WriteLong(out, 0, type);
+		T1WriteLong(out, 4, size);
+		out += 8;
+
+		if (encoding == SAVESTATE_DELTA_RAW)
+		{
+			if (payloadSize != size) return false;
+			if (size != 0 && is.fread(out, size) != size) return false;
+		}
+		else if (encoding == SAVESTATE_DELTA_XORRLE)
+		{
+			const SavestateChunkRef *ref = savestate_FindChunk(*base, type);
+			if ((ref == NULL) || (ref->size != size)) return false;
+
+			payload.resize(payloadSize);
+			if (payloadSize != 0 && is.fread(&payload[0], payloadSize) != payloadSize) return false;
+			if (!savestate_ReadXorRle(payload.empty() ? NULL : &payload[0], payloadSize, out, &base->data[ref->offset], size)) return false;
+		}
+		else
+		{
+			return false;
+		}
+	}
+
+	const size_t endPos = buf.size();
+	buf.resize(endPos + 4);
+	T1WriteLong(&buf[endPos], 0, 0xFFFFFFFF);
+	return true;
 }
@@ -67,4 +67,35 @@ void loadstate_slot(int num);
 bool savestate_load(class EMUFILE &is);
 bool savestate_save(class EMUFILE &outstream, int compressionLevel = Z_DEFAULT_COMPRESSION);
 
+struct SavestateTimingStats
+{
+	u32 uncompressedSize;
+	u32 compressedSize;
+	double snapshotMilliseconds; //serializing the state, on the emulation thread
+	double compressMilliseconds; //compressing it, on the writer thread
+	double writeMilliseconds; //writing and renaming the file, on the writer thread
+};
+
+//serializes the state right away, then compresses and writes the file on a background thread.
+//the file is written to a temporary name first and renamed over file_name once it is complete.
+bool savestate_save_async(const char *file_name, int compressionLevel = Z_BEST_SPEED);
+
+//waits for a pending savestate_save_async() to finish. returns false if that write failed.
+bool savestate_flush();
+
+//returns the timings of the most recent savestate_slot() or savestate_save_async(), waiting for it if needed
+SavestateTimingStats savestate_GetTimingStats();
+
+//saves only the differences from a full savestate file. the base's path is stored relative to the delta
+//(or absolute, if the base isn't in the delta's directory or below it), and savestate_load() picks it up
+//from there again when it sees a delta savestate.
+bool savestate_save_delta(const char *file_name, const char *base_file_name);
+
+//writes the current state to memory and reads it back loopCount times over, without compressing it or touching
+//any files, and prints the average times. the state is restored afterwards. returns false if it could not be read back.
+bool savestate_Benchmark(const size_t loopCount);
+
+//reads a little endian u32 that needn't be aligned
+u32 savestate_ReadLE32(const u8 *p);
+
 #endif
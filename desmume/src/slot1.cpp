@@ -54,7 +54,9 @@ static void scanDir()
 	}
 
 	VFAT vfat;
-	if(vfat.build(slot1_R4_path_type?path.RomDirectory.c_str():fatDir.c_str(), 16))
+	const char* dir = slot1_R4_path_type?path.RomDirectory.c_str():fatDir.c_str();
+	bool ok = CommonSettings.lazyFatImage ? vfat.buildLazy(dir, 16, path.getpath(path.BATTERY).c_str()) : vfat.build(dir, 16);
+	if(ok)
 	{
 		fatImage = vfat.detach();
 	}
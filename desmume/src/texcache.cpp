@@ -69,10 +69,20 @@ public:
 		u32 len;
 		u8* ptr;
 		u32 ofs; //offset within the memspan
+		u32 slot; //texture or texture palette slot that this item reads from
 	} items[MAXSIZE];
 
 	int size;
 
+	//returns a bitmask of the slots that this memspan reads from
+	u8 slotMask() const
+	{
+		u8 mask = 0;
+		for(int i=0;i<numItems;i++)
+			mask |= (1 << items[i].slot);
+		return mask;
+	}
+
 	//this MemSpan shall be considered the first argument to a standard memcmp
 	//the length shall be as specified in this MemSpan, unless you specify otherwise
 	int memcmp(void* buf2, int cmpSize=-1)
@@ -153,6 +163,7 @@ static MemSpan MemSpan_TexMem(u32 ofs, u32 len)
 		MemSpan::Item &curr = ret.items[ret.numItems++];
 		curr.start = ofs&0x1FFFF;
 		u32 slot = (ofs>>17)&3; //slots will wrap around
+		curr.slot = slot;
 		curr.len = min(len,0x20000-curr.start);
 		curr.ofs = currofs;
 		len -= curr.len;
@@ -182,6 +193,7 @@ static MemSpan MemSpan_TexPalette(u32 ofs, u32 len, bool silent)
 			PROGINFO("Texture palette overruns texture memory. Wrapping at palette slot 0.\n");
 			slot -= 5;
 		}
+		curr.slot = slot;
 		curr.len = min(len,0x4000-curr.start);
 		curr.ofs = currofs;
 		len -= curr.len;
@@ -199,28 +211,233 @@ static MemSpan MemSpan_TexPalette(u32 ofs, u32 len, bool silent)
 	return ret;
 }
 
-static bool TextureLRUCompare(TextureStore *tex1, TextureStore *tex2)
+TextureCacheMap::TextureCacheMap()
+{
+	_capacity = 1024;
+	_count = 0;
+	_keyList = (TextureCacheKey *)malloc(_capacity * sizeof(TextureCacheKey));
+	_valueList = (TextureStore **)calloc(_capacity, sizeof(TextureStore *));
+}
+
+TextureCacheMap::~TextureCacheMap()
+{
+	free(this->_keyList);
+	free(this->_valueList);
+}
+
+size_t TextureCacheMap::_GetHomeBucket(const TextureCacheKey key) const
+{
+	// Fibonacci hashing spreads the palette attributes in the upper 32 bits across the low bits.
+	return (size_t)((key * 0x9E3779B97F4A7C15ULL) >> 32) & (this->_capacity - 1);
+}
+
+void TextureCacheMap::_Resize(const size_t newCapacity)
+{
+	TextureCacheKey *oldKeyList = this->_keyList;
+	TextureStore **oldValueList = this->_valueList;
+	const size_t oldCapacity = this->_capacity;
+	
+	this->_capacity = newCapacity;
+	this->_count = 0;
+	this->_keyList = (TextureCacheKey *)malloc(newCapacity * sizeof(TextureCacheKey));
+	this->_valueList = (TextureStore **)calloc(newCapacity, sizeof(TextureStore *));
+	
+	for (size_t i = 0; i < oldCapacity; i++)
+	{
+		if (oldValueList[i] != NULL)
+		{
+			this->Insert(oldKeyList[i], oldValueList[i]);
+		}
+	}
+	
+	free(oldKeyList);
+	free(oldValueList);
+}
+
+size_t TextureCacheMap::GetCount() const
+{
+	return this->_count;
+}
+
+TextureStore* TextureCacheMap::Find(const TextureCacheKey key) const
 {
-	const size_t cacheAge1 = tex1->GetCacheAge();
-	const size_t cacheAge2 = tex2->GetCacheAge();
+	const size_t mask = this->_capacity - 1;
 	
-	if (cacheAge1 == cacheAge2)
+	for (size_t i = this->_GetHomeBucket(key); this->_valueList[i] != NULL; i = (i + 1) & mask)
 	{
-		return ( tex1->GetCacheUseCount() > tex2->GetCacheUseCount() );
+		if (this->_keyList[i] == key)
+		{
+			return this->_valueList[i];
+		}
 	}
 	
-	return (cacheAge1 < cacheAge2);
+	return NULL;
+}
+
+void TextureCacheMap::Insert(const TextureCacheKey key, TextureStore *value)
+{
+	// Keep the load factor at or below 1/2 so that probe sequences stay short.
+	if ( (this->_count + 1) * 2 > this->_capacity )
+	{
+		this->_Resize(this->_capacity * 2);
+	}
+	
+	const size_t mask = this->_capacity - 1;
+	size_t i = this->_GetHomeBucket(key);
+	
+	for (; this->_valueList[i] != NULL; i = (i + 1) & mask)
+	{
+		if (this->_keyList[i] == key)
+		{
+			this->_valueList[i] = value;
+			return;
+		}
+	}
+	
+	this->_keyList[i] = key;
+	this->_valueList[i] = value;
+	this->_count++;
+}
+
+void TextureCacheMap::Erase(const TextureCacheKey key)
+{
+	const size_t mask = this->_capacity - 1;
+	size_t i = this->_GetHomeBucket(key);
+	
+	for (; this->_valueList[i] != NULL; i = (i + 1) & mask)
+	{
+		if (this->_keyList[i] == key)
+		{
+			break;
+		}
+	}
+	
+	if (this->_valueList[i] == NULL)
+	{
+		return;
+	}
+	
+	// Shift back any following entries that would no longer be reachable from their home bucket.
+	for (size_t j = (i + 1) & mask; this->_valueList[j] != NULL; j = (j + 1) & mask)
+	{
+		const size_t home = this->_GetHomeBucket(this->_keyList[j]);
+		const bool isHomeBetween = (i <= j) ? ( (i < home) && (home <= j) ) : ( (i < home) || (home <= j) );
+		
+		if (!isHomeBetween)
+		{
+			this->_keyList[i] = this->_keyList[j];
+			this->_valueList[i] = this->_valueList[j];
+			i = j;
+		}
+	}
+	
+	this->_valueList[i] = NULL;
+	this->_count--;
+}
+
+void TextureCacheMap::Clear()
+{
+	memset(this->_valueList, 0, this->_capacity * sizeof(TextureStore *));
+	this->_count = 0;
 }
 
 TextureCache texCache;
 
 TextureCache::TextureCache()
 {
-	_texCacheMap.clear();
-	_texCacheList.reserve(4096);
+	_lruHead = NULL;
+	_lruTail = NULL;
 	_actualCacheSize = 0;
 	_cacheSizeThreshold = TEXCACHE_DEFAULT_THRESHOLD;
 	memset(_paletteDump, 0, sizeof(_paletteDump));
+	
+	memset(_texSlotAddr, 0, sizeof(_texSlotAddr));
+	memset(_palSlotAddr, 0, sizeof(_palSlotAddr));
+	memset(_texSlotGeneration, 0, sizeof(_texSlotGeneration));
+	memset(_palSlotGeneration, 0, sizeof(_palSlotGeneration));
+	_paletteDumpGeneration = 0;
+}
+
+TextureCache::~TextureCache()
+{
+	this->Reset();
+}
+
+void TextureCache::_LinkFront(TextureStore *texItem)
+{
+	texItem->_lruPrev = NULL;
+	texItem->_lruNext = this->_lruHead;
+	
+	if (this->_lruHead != NULL)
+	{
+		this->_lruHead->_lruPrev = texItem;
+	}
+	else
+	{
+		this->_lruTail = texItem;
+	}
+	
+	this->_lruHead = texItem;
+}
+
+void TextureCache::_Unlink(TextureStore *texItem)
+{
+	if (texItem->_lruPrev != NULL)
+	{
+		texItem->_lruPrev->_lruNext = texItem->_lruNext;
+	}
+	else
+	{
+		this->_lruHead = texItem->_lruNext;
+	}
+	
+	if (texItem->_lruNext != NULL)
+	{
+		texItem->_lruNext->_lruPrev = texItem->_lruPrev;
+	}
+	else
+	{
+		this->_lruTail = texItem->_lruPrev;
+	}
+	
+	texItem->_lruPrev = NULL;
+	texItem->_lruNext = NULL;
+}
+
+u32 TextureCache::_GetTextureGeneration(const TextureStore *texItem) const
+{
+	// Generations only ever increase, so their sum changes whenever any one of them does.
+	u32 generation = 0;
+	
+	for (size_t i = 0; i < 4; i++)
+	{
+		if (texItem->_texSlotMask & (1 << i))
+		{
+			generation += this->_texSlotGeneration[i];
+		}
+	}
+	
+	return generation;
+}
+
+u32 TextureCache::_GetPaletteGeneration(const TextureStore *texItem) const
+{
+	if (texItem->_packFormat == TEXMODE_4X4)
+	{
+		return this->_paletteDumpGeneration;
+	}
+	
+	u32 generation = 0;
+	
+	for (size_t i = 0; i < 6; i++)
+	{
+		if (texItem->_palSlotMask & (1 << i))
+		{
+			generation += this->_palSlotGeneration[i];
+		}
+	}
+	
+	return generation;
 }
 
 size_t TextureCache::GetActualCacheSize() const
@@ -240,28 +457,64 @@ void TextureCache::SetCacheSizeThreshold(size_t newThreshold)
 
 void TextureCache::Invalidate()
 {
+	for (size_t i = 0; i < 4; i++)
+	{
+		if (this->_texSlotAddr[i] != MMU.texInfo.textureSlotAddr[i])
+		{
+			this->_texSlotAddr[i] = MMU.texInfo.textureSlotAddr[i];
+			this->_texSlotGeneration[i]++;
+		}
+	}
+	
+	bool didPaletteMappingChange = false;
+	
+	for (size_t i = 0; i < 6; i++)
+	{
+		if (this->_palSlotAddr[i] != MMU.texInfo.texPalSlot[i])
+		{
+			this->_palSlotAddr[i] = MMU.texInfo.texPalSlot[i];
+			this->_palSlotGeneration[i]++;
+			didPaletteMappingChange = true;
+		}
+	}
+	
+	if (!didPaletteMappingChange)
+	{
+		return;
+	}
+	
 	//check whether the palette memory changed
-	//TODO - we should handle this instead by setting dirty flags in the vram memory mapping and noting whether palette memory was dirty.
-	//but this will work for now
+	//when the palette changes, we assume all 4x4 textures are dirty.
+	//this is because each 4x4 item doesnt carry along with it a copy of the entire palette, for verification
+	//instead, we just use the one paletteDump for verifying of all 4x4 textures; and if paletteDirty is set, verification has failed
 	MemSpan mspal = MemSpan_TexPalette(0, PALETTE_DUMP_SIZE, true);
 	const bool paletteDirty = mspal.memcmp(this->_paletteDump);
 	if (paletteDirty)
 	{
 		mspal.dump(this->_paletteDump);
+		this->_paletteDumpGeneration++;
+	}
+}
+
+void TextureCache::InvalidateAll()
+{
+	// Used when VRAM contents change without any remapping, so every texture item must be
+	// checked against VRAM again.
+	for (size_t i = 0; i < 4; i++)
+	{
+		this->_texSlotAddr[i] = MMU.texInfo.textureSlotAddr[i];
+		this->_texSlotGeneration[i]++;
 	}
 	
-	for (TextureCacheMap::iterator it(this->_texCacheMap.begin()); it != this->_texCacheMap.end(); ++it)
+	for (size_t i = 0; i < 6; i++)
 	{
-		it->second->SetSuspectedInvalid();
-		
-		//when the palette changes, we assume all 4x4 textures are dirty.
-		//this is because each 4x4 item doesnt carry along with it a copy of the entire palette, for verification
-		//instead, we just use the one paletteDump for verifying of all 4x4 textures; and if paletteDirty is set, verification has failed
-		if( (it->second->GetPackFormat() == TEXMODE_4X4) && paletteDirty )
-		{
-			it->second->SetAssumedInvalid();
-		}
+		this->_palSlotAddr[i] = MMU.texInfo.texPalSlot[i];
+		this->_palSlotGeneration[i]++;
 	}
+	
+	MemSpan mspal = MemSpan_TexPalette(0, PALETTE_DUMP_SIZE, true);
+	mspal.dump(this->_paletteDump);
+	this->_paletteDumpGeneration++;
 }
 
 void TextureCache::Evict()
@@ -272,83 +525,81 @@ void TextureCache::Evict()
 	//dont do anything unless we're over the target
 	if (this->_actualCacheSize <= this->_cacheSizeThreshold)
 	{
-		for (size_t i = 0; i < this->_texCacheList.size(); i++)
-		{
-			this->_texCacheList[i]->IncreaseCacheAge(1);
-		}
-		
 		return;
 	}
 	
 	//aim at cutting the cache to half of the max size
 	size_t targetCacheSize = this->_cacheSizeThreshold / 2;
 	
-	// Sort the textures in cache by age and usage count. Textures that we want to keep in
-	// cache are placed in the front of the list, while textures we want to evict are sorted
-	// to the back of the list.
-	std::sort(this->_texCacheList.begin(), this->_texCacheList.end(), &TextureLRUCompare);
-	
+	// Textures are moved to the front of the LRU list whenever they are used, so the least
+	// recently used textures are evicted from the back of the list.
 	while (this->_actualCacheSize > targetCacheSize)
 	{
-		if (this->_texCacheMap.size() == 0) break; //just in case.. doesnt seem possible, cache_size wouldve been 0
+		if (this->_lruTail == NULL) break; //just in case.. doesnt seem possible, cache_size wouldve been 0
 		
-		TextureStore *item = this->_texCacheList.back();
+		TextureStore *item = this->_lruTail;
 		this->Remove(item);
-		this->_texCacheList.pop_back();
 		
 		//printf("evicting! totalsize:%d\n",cache_size);
 		delete item;
 	}
-	
-	for (size_t i = 0; i < this->_texCacheList.size(); i++)
-	{
-		this->_texCacheList[i]->IncreaseCacheAge(1);
-	}
 }
 
 void TextureCache::Reset()
 {
-	for (size_t i = 0; i < this->_texCacheList.size(); i++)
+	while (this->_lruHead != NULL)
 	{
-		delete this->_texCacheList[i];
+		TextureStore *item = this->_lruHead;
+		this->_lruHead = item->_lruNext;
+		delete item;
 	}
 	
-	this->_texCacheMap.clear();
-	this->_texCacheList.clear();
+	this->_texCacheMap.Clear();
+	this->_lruHead = NULL;
+	this->_lruTail = NULL;
 	this->_actualCacheSize = 0;
 	memset(this->_paletteDump, 0, sizeof(this->_paletteDump));
+	memset(this->_texSlotAddr, 0, sizeof(this->_texSlotAddr));
+	memset(this->_palSlotAddr, 0, sizeof(this->_palSlotAddr));
 }
 
 void TextureCache::ForceReloadAllTextures()
 {
-	for (TextureCacheMap::iterator it(this->_texCacheMap.begin()); it != this->_texCacheMap.end(); ++it)
+	for (TextureStore *item = this->_lruHead; item != NULL; item = item->_lruNext)
 	{
-		it->second->SetLoadNeeded();
+		item->SetLoadNeeded();
 	}
 }
 
 TextureStore* TextureCache::GetTexture(TEXIMAGE_PARAM texAttributes, u32 palAttributes)
 {
-	TextureStore *theTexture = NULL;
 	const TextureCacheKey key = TextureCache::GenerateKey(texAttributes, palAttributes);
-	const TextureCacheMap::iterator cachedTexture = this->_texCacheMap.find(key);
+	TextureStore *theTexture = this->_texCacheMap.Find(key);
 	
-	if (cachedTexture == this->_texCacheMap.end())
+	if (theTexture == NULL)
 	{
 		return theTexture;
 	}
-	else
+	
+	const u32 texGeneration = this->_GetTextureGeneration(theTexture);
+	const u32 palGeneration = this->_GetPaletteGeneration(theTexture);
+	
+	if ( (theTexture->_packFormat == TEXMODE_4X4) && (palGeneration != theTexture->_palGeneration) )
 	{
-		theTexture = cachedTexture->second;
-		
-		if (theTexture->IsAssumedInvalid())
-		{
-			theTexture->Update();
-		}
-		else if (theTexture->IsSuspectedInvalid())
-		{
-			theTexture->VRAMCompareAndUpdate();
-		}
+		theTexture->Update();
+	}
+	else if ( (texGeneration != theTexture->_texGeneration) || (palGeneration != theTexture->_palGeneration) )
+	{
+		theTexture->VRAMCompareAndUpdate();
+	}
+	
+	theTexture->_texGeneration = texGeneration;
+	theTexture->_palGeneration = palGeneration;
+	
+	if (theTexture != this->_lruHead)
+	{
+		this->_Unlink(theTexture);
+		this->_LinkFront(theTexture);
 	}
 	
 	return theTexture;
@@ -357,16 +608,25 @@ TextureStore* TextureCache::GetTexture(TEXIMAGE_PARAM texAttributes, u32 palAttr
 void TextureCache::Add(TextureStore *texItem)
 {
 	const TextureCacheKey key = texItem->GetCacheKey();
-	this->_texCacheMap[key] = texItem;
-	this->_texCacheList.push_back(texItem);
+	this->_texCacheMap.Insert(key, texItem);
+	this->_LinkFront(texItem);
 	this->_actualCacheSize += texItem->GetCacheSize();
+	
+	// The texture item was just read from VRAM, so it is current with every slot.
+	texItem->_texGeneration = this->_GetTextureGeneration(texItem);
+	texItem->_palGeneration = this->_GetPaletteGeneration(texItem);
 	//printf("allocating: up to %d with %d items\n", this->cache_size, this->cacheTable.size());
 }
 
 void TextureCache::Remove(TextureStore *texItem)
 {
 	const TextureCacheKey key = texItem->GetCacheKey();
-	this->_texCacheMap.erase(key);
+	if (this->_texCacheMap.Find(key) == texItem)
+	{
+		this->_texCacheMap.Erase(key);
+	}
+	
+	this->_Unlink(texItem);
 	this->_actualCacheSize -= texItem->GetCacheSize();
 }
 
@@ -403,13 +663,16 @@ TextureStore::TextureStore()
 	
 	_packTotalSize = 0;
 	
-	_suspectedInvalid = false;
-	_assumedInvalid = false;
 	_isLoadNeeded = false;
 	
+	_texSlotMask = 0;
+	_palSlotMask = 0;
+	_texGeneration = 0;
+	_palGeneration = 0;
+	
 	_cacheSize = 0;
-	_cacheAge = 0;
-	_cacheUsageCount = 0;
+	_lruPrev = NULL;
+	_lruNext = NULL;
 }
 
 TextureStore::TextureStore(const TEXIMAGE_PARAM texAttributes, const u32 palAttributes)
@@ -458,12 +721,14 @@ TextureStore::TextureStore(const TEXIMAGE_PARAM texAttributes, const u32 palAttr
 		
 		MemSpan currentPackedTexIndexMS = MemSpan_TexMem(_packIndexAddress, _packIndexSize);
 		currentPackedTexIndexMS.dump(_packIndexData, _packIndexSize);
+		_texSlotMask = currentPackedTexIndexMS.slotMask();
 	}
 	else
 	{
 		_packIndexAddress = 0;
 		_packIndexSize = 0;
 		_packIndexData = NULL;
+		_texSlotMask = 0;
 		
 		_packTotalSize = _packSize + _paletteSize;
 		
@@ -473,10 +738,12 @@ TextureStore::TextureStore(const TEXIMAGE_PARAM texAttributes, const u32 palAttr
 	}
 	
 	_workingData = (u8 *)malloc_alignedCacheLine(_packTotalSize);
+	_palSlotMask = 0;
 	
 	if (_paletteSize > 0)
 	{
 		MemSpan currentPaletteMS = MemSpan_TexPalette(_paletteAddress, _paletteSize, false);
+		_palSlotMask = currentPaletteMS.slotMask();
 		
 #ifdef MSB_FIRST
 		currentPaletteMS.dump16(_paletteColorTable);
@@ -492,14 +759,16 @@ TextureStore::TextureStore(const TEXIMAGE_PARAM texAttributes, const u32 palAttr
 	MemSpan currentPackedTexDataMS = MemSpan_TexMem(_packAddress, _packSize);
 	currentPackedTexDataMS.dump(_packData);
 	_packSizeFirstSlot = currentPackedTexDataMS.items[0].len;
+	_texSlotMask |= currentPackedTexDataMS.slotMask();
 	
-	_suspectedInvalid = false;
-	_assumedInvalid = false;
 	_isLoadNeeded = true;
 	
+	_texGeneration = 0;
+	_palGeneration = 0;
+	
 	_cacheSize = _packTotalSize;
-	_cacheAge = 0;
-	_cacheUsageCount = 0;
+	_lruPrev = NULL;
+	_lruNext = NULL;
 }
 
 TextureStore::~TextureStore()
@@ -680,26 +949,6 @@ void TextureStore::Load(void *targetBuffer)
 	this->_isLoadNeeded = false;
 }
 
-bool TextureStore::IsSuspectedInvalid() const
-{
-	return this->_suspectedInvalid;
-}
-
-void TextureStore::SetSuspectedInvalid()
-{
-	this->_suspectedInvalid = true;
-}
-
-bool TextureStore::IsAssumedInvalid() const
-{
-	return this->_assumedInvalid;
-}
-
-void TextureStore::SetAssumedInvalid()
-{
-	this->_assumedInvalid = true;
-}
-
 void TextureStore::SetLoadNeeded()
 {
 	this->_isLoadNeeded = true;
@@ -725,36 +974,6 @@ void TextureStore::SetCacheSize(size_t cacheSize)
 	this->_cacheSize = cacheSize;
 }
 
-size_t TextureStore::GetCacheAge() const
-{
-	return this->_cacheAge;
-}
-
-void TextureStore::IncreaseCacheAge(const size_t ageAmount)
-{
-	this->_cacheAge += ageAmount;
-}
-
-void TextureStore::ResetCacheAge()
-{
-	this->_cacheAge = 0;
-}
-
-size_t TextureStore::GetCacheUseCount() const
-{
-	return this->_cacheUsageCount;
-}
-
-void TextureStore::IncreaseCacheUsageCount(const size_t usageCount)
-{
-	this->_cacheUsageCount += usageCount;
-}
-
-void TextureStore::ResetCacheUsageCount()
-{
-	this->_cacheUsageCount = 0;
-}
-
 void TextureStore::Update()
 {
 	MemSpan currentPaletteMS = MemSpan_TexPalette(this->_paletteAddress, this->_paletteSize, false);
@@ -769,8 +988,6 @@ void TextureStore::Update()
 	this->SetTextureData(currentPackedTexDataMS, currentPackedTexIndexMS);
 	this->SetTexturePalette(currentPaletteMS);
 	
-	this->_assumedInvalid = false;
-	this->_suspectedInvalid = false;
 	this->_isLoadNeeded = true;
 }
 
@@ -822,9 +1039,6 @@ void TextureStore::VRAMCompareAndUpdate()
 		this->_workingData = tempDataPtr;
 		this->_isLoadNeeded = true;
 	}
-	
-	this->_assumedInvalid = false;
-	this->_suspectedInvalid = false;
 }
 
 #ifdef DO_DEBUG_DUMP_TEXTURE
@@ -51,27 +51,66 @@ class MemSpan;
 class TextureStore;
 
 typedef u64 TextureCacheKey;
-typedef std::map<TextureCacheKey, TextureStore *> TextureCacheMap; // Key = A TextureCacheKey that includes a combination of the texture's NDS texture attributes and palette attributes; Value = Pointer to the texture item
-typedef std::vector<TextureStore *> TextureCacheList;
-//typedef u32 TextureFingerprint;
+
+// Open addressing hash map from a TextureCacheKey to its texture item, using linear probing.
+// Erasing uses backward shift deletion, so lookups never have to step over tombstones.
+class TextureCacheMap
+{
+protected:
+	TextureCacheKey *_keyList;
+	TextureStore **_valueList;	// A NULL value marks an empty bucket.
+	size_t _capacity;			// Always a power of two.
+	size_t _count;
+	
+	size_t _GetHomeBucket(const TextureCacheKey key) const;
+	void _Resize(const size_t newCapacity);
+	
+public:
+	TextureCacheMap();
+	~TextureCacheMap();
+	
+	size_t GetCount() const;
+	TextureStore* Find(const TextureCacheKey key) const;
+	void Insert(const TextureCacheKey key, TextureStore *value);
+	void Erase(const TextureCacheKey key);
+	void Clear();
+};
 
 class TextureCache
 {
 protected:
 	TextureCacheMap _texCacheMap;		// Used to quickly find a texture item by using a key of type TextureCacheKey
-	TextureCacheList _texCacheList;		// Used to sort existing texture items for various operations
+	TextureStore *_lruHead;				// Most recently used texture item
+	TextureStore *_lruTail;				// Least recently used texture item, which is the first to be evicted
 	size_t _actualCacheSize;
 	size_t _cacheSizeThreshold;
 	u8 _paletteDump[PALETTE_DUMP_SIZE];
 	
+	// Texture VRAM can only change while its bank is mapped to something other than texture
+	// or texture palette memory, so a slot's generation is bumped whenever its mapping changes.
+	// Texture items only need to be checked against VRAM when the generations of the slots
+	// that they read from have moved on.
+	u8 *_texSlotAddr[4];
+	u8 *_palSlotAddr[6];
+	u32 _texSlotGeneration[4];
+	u32 _palSlotGeneration[6];
+	u32 _paletteDumpGeneration;		// Used by 4x4 textures, which can read from the entire palette memory
+	
+	void _LinkFront(TextureStore *texItem);
+	void _Unlink(TextureStore *texItem);
+	u32 _GetTextureGeneration(const TextureStore *texItem) const;
+	u32 _GetPaletteGeneration(const TextureStore *texItem) const;
+	
 public:
 	TextureCache();
+	~TextureCache();
 	
 	size_t GetActualCacheSize() const;
 	size_t GetCacheSizeThreshold() const;
 	void SetCacheSizeThreshold(size_t newThreshold);
 	
 	void Invalidate();
+	void InvalidateAll();
 	void Evict();
 	void Reset();
 	void ForceReloadAllTextures();
@@ -86,6 +125,8 @@ public:
 
 class TextureStore
 {
+	friend class TextureCache;
+	
 protected:
 	TEXIMAGE_PARAM _textureAttributes;
 	u32 _paletteAttributes;
@@ -111,15 +152,18 @@ protected:
 	
 	size_t _packTotalSize;
 	
-	bool _suspectedInvalid;
-	bool _assumedInvalid;
 	bool _isLoadNeeded;
 	u8 *_workingData;
 	
+	u8 _texSlotMask;	// Texture slots that the packed data and 4x4 index data read from
+	u8 _palSlotMask;	// Texture palette slots that the palette reads from
+	u32 _texGeneration;
+	u32 _palGeneration;
+	
 	TextureCacheKey _cacheKey;
 	size_t _cacheSize;
-	size_t _cacheAge; // A value of 0 means the texture was just used. The higher this value, the older the texture.
-	size_t _cacheUsageCount;
+	TextureStore *_lruPrev;
+	TextureStore *_lruNext;
 	
 public:
 	TextureStore();
@@ -155,12 +199,6 @@ public:
 	
 	virtual void Load(void *targetBuffer);
 	
-	bool IsSuspectedInvalid() const;
-	void SetSuspectedInvalid();
-	
-	bool IsAssumedInvalid() const;
-	void SetAssumedInvalid();
-	
 	void SetLoadNeeded();
 	bool IsLoadNeeded() const;
 	
@@ -169,14 +207,6 @@ public:
 	size_t GetCacheSize() const;
 	void SetCacheSize(size_t cacheSize);
 	
-	size_t GetCacheAge() const;
-	void IncreaseCacheAge(const size_t ageAmount);
-	void ResetCacheAge();
-	
-	size_t GetCacheUseCount() const;
-	void IncreaseCacheUsageCount(const size_t usageCount);
-	void ResetCacheUsageCount();
-	
 	void Update();
 	void VRAMCompareAndUpdate();
 	void DebugDump();
@@ -2188,6 +2188,8 @@ static u32 FASTCALL OP_LDM_STM(u32 adr, u32 regslo, u32 regshi, int n)
 	}
 	else if((adr & 0x0F000000) == 0x02000000)
 	{
+		if(store)
+			MMU_GuardSPUCoreWrite((dir>0) ? adr : (adr - (n-1)*4), n*4);
 		ptr = MMU.MAIN_MEM + (adr & _MMU_MAIN_MEM_MASK32);
 		cycles = n * ((PROCNUM==ARMCPU_ARM9) ? 4 : 2);
 	}
@@ -18,11 +18,30 @@
 #include <stdio.h>
 #include <string>
 #include <cstring>
+#include <vector>
+#include <algorithm>
 
 #include "types.h"
 #include "fsnitro.h"
 #include "file/file_path.h"
 #include "NDSSystem.h"
+#include "utils/task.h"
+
+//extractAll() doesn't gain anything from more threads than this, the disk is the limit
+#define FS_NITRO_EXTRACT_MAX_THREADS 8
+//files handed to the extraction threads at once, per thread
+#define FS_NITRO_EXTRACT_BATCH 32
+
+//file ID and where to extract it to
+typedef std::vector< std::pair<u16, std::string> > FS_NITRO_EXTRACT_LIST;
+
+struct FS_NITRO_EXTRACT_JOB
+{
+	FS_NITRO *fs;
+	const FS_NITRO_EXTRACT_LIST *files;
+	size_t first;
+	size_t last;
+};
 
 FS_NITRO::FS_NITRO()
 {
@@ -120,6 +139,7 @@ void FS_NITRO::destroy()
 	if (fnt) { delete [] fnt; fnt = NULL; }
 	if (ovr9) { delete [] ovr9; ovr9 = NULL; }
 	if (ovr7) { delete [] ovr7; ovr7 = NULL; }
+	pathIndex.clear();
 	numDirs = numFiles = numOverlay7 = numOverlay9 = currentID = 0;
 	inited = false;
 }
@@ -477,6 +497,67 @@ u32 FS_NITRO::getEndAddrById(u16 id)
 	return (fat[id].end);
 }
 
+static std::string FS_NITRO_NormalizePath(std::string path)
+{
+	std::replace(path.begin(), path.end(), '\\', '/');
+	if (path.empty() || path[0] != '/')
+		path = "/" + path;
+	return path;
+}
+
+void FS_NITRO::buildPathIndex()
+{
+	pathIndex.clear();
+	if (!inited) return;
+
+	pathIndex.reserve(numFiles);
+	for (u32 i = 0; i < numFiles; i++)
+	{
+		//if two files have the same path, the first one is found, like in the FNT
+		pathIndex.insert(std::make_pair(FS_NITRO_NormalizePath(getFullPathByFileID(i)), (u16)i));
+	}
+}
+
+//path is a full path like getFullPathByFileID() makes, such as "/data/sound/sound_data.sdat" or "/overlay/overlay_0000.bin".
+//either slash works, and the leading one may be left out.
+bool FS_NITRO::getFileIdByPath(std::string path, u16 &id)
+{
+	id = 0xFFFF;
+	if (!inited) return false;
+
+	if (pathIndex.empty())
+		buildPathIndex();
+
+	std::unordered_map<std::string, u16>::const_iterator it = pathIndex.find(FS_NITRO_NormalizePath(path));
+	if (it == pathIndex.end()) return false;
+
+	id = it->second;
+	return true;
+}
+
+bool FS_NITRO::getFileData(u16 id, const u8 *&data, u32 &size)
+{
+	data = NULL; size = 0;
+	if (!inited) return false;
+	if (id >= numFiles) return false;
+	if (gameInfo.romdataView == NULL) return false;
+	if ((fat[id].start > fat[id].end) || (fat[id].end > gameInfo.romdataViewSize)) return false;
+
+	data = gameInfo.romdataView + fat[id].start;
+	size = fat[id].size;
+	return true;
+}
+
+bool FS_NITRO::getFileDataByPath(const std::string &path, const u8 *&data, u32 &size)
+{
+	data = NULL; size = 0;
+
+	u16 id;
+	if (!getFileIdByPath(path, id)) return false;
+
+	return getFileData(id, data, size);
+}
+
 bool FS_NITRO::extract(u16 id, std::string to)
 {
 	printf("Extract to %s\n", to.c_str());
@@ -484,6 +565,17 @@ bool FS_NITRO::extract(u16 id, std::string to)
 	FILE *fp = fopen(to.c_str(), "wb");
 	if (fp)
 	{
+		//when the whole ROM is in memory, the file is written straight from there at once
+		const u8 *data;
+		u32 size;
+		if (getFileData(id, data, size))
+		{
+			if (size > 0)
+				fwrite(data, 1, size, fp);
+			fclose(fp);
+			return true;
+		}
+
 		u32 remain = fat[id].size;
 		u32 dstofs = 0;
 		gameInfo.reader->Seek(gameInfo.fROM, fat[id].start, SEEK_SET);
@@ -537,21 +629,112 @@ bool FS_NITRO::extractAll(std::string to, void (*callback)(u32 current, u32 num)
 		path_mkdir((dataDir + path_default_slash() + tmp).c_str());
 	}
 
+	//data files first, then the overlays
+	FS_NITRO_EXTRACT_LIST files;
+	files.reserve(numFiles);
+
 	for (u32 i = 0; i < numFiles; i++)
 	{
 		if (fat[i].isOverlay) continue;
-		std::string fname = getFullPathByFileID(i, false);
-		extract(i, (dataDir + path_default_slash() + fname));
-		if (callback)
-			callback(i, numFiles);
+		files.push_back(std::make_pair((u16)i, dataDir + path_default_slash() + getFullPathByFileID(i, false)));
 	}
 
 	for (u32 i = 0; i < numFiles; i++)
 	{
 		if (!fat[i].isOverlay) continue;
-		extract(i, (overlayDir + path_default_slash() + fat[i].filename));
+		files.push_back(std::make_pair((u16)i, overlayDir + path_default_slash() + fat[i].filename));
+	}
+
+	//files can be written by several threads at once only when they are written from the ROM in memory,
+	//since the ROM reader can't be shared between threads
+	size_t threadCount = (CommonSettings.num_cores > 1) ? (size_t)CommonSettings.num_cores : 1;
+	if (threadCount > FS_NITRO_EXTRACT_MAX_THREADS)
+		threadCount = FS_NITRO_EXTRACT_MAX_THREADS;
+
+	FS_NITRO_EXTRACT_LIST remaining;
+	size_t first = 0;
+
+	if ((threadCount > 1) && (gameInfo.romdataView != NULL))
+	{
+		FS_NITRO_EXTRACT_LIST inMemory;
+		inMemory.reserve(files.size());
+
+		for (size_t i = 0; i < files.size(); i++)
+		{
+			const u8 *data;
+			u32 size;
+			if (getFileData(files[i].first, data, size))
+				inMemory.push_back(files[i]);
+			else
+				remaining.push_back(files[i]);
+		}
+		files.swap(inMemory);
+
+		Task *task = new Task[threadCount - 1];
+		for (size_t i = 0; i < threadCount - 1; i++)
+		{
+			char name[24];
+			snprintf(name, sizeof(name), "fsnitro extract %d", (int)i);
+			task[i].start(false, 0, name);
+		}
+
+		std::vector<FS_NITRO_EXTRACT_JOB> jobs(threadCount);
+
+		//the files go out in batches, so that the progress callback can be called from this thread in between
+		while (first < files.size())
+		{
+			const size_t batchSize = std::min<size_t>(files.size() - first, threadCount * FS_NITRO_EXTRACT_BATCH);
+			const size_t perThread = (batchSize + threadCount - 1) / threadCount;
+
+			for (size_t i = 0; i < threadCount; i++)
+			{
+				jobs[i].fs = this;
+				jobs[i].files = &files;
+				jobs[i].first = std::min<size_t>(first + i * perThread, first + batchSize);
+				jobs[i].last = std::min<size_t>(jobs[i].first + perThread, first + batchSize);
+			}
+
+			for (size_t i = 1; i < threadCount; i++)
+				task[i - 1].execute(&FS_NITRO::extractJobProc, &jobs[i]);
+			extractJobProc(&jobs[0]);
+			for (size_t i = 1; i < threadCount; i++)
+				task[i - 1].finish();
+
+			if (callback)
+			{
+				for (size_t i = first; i < first + batchSize; i++)
+					if (!fat[files[i].first].isOverlay)
+						callback(files[i].first, numFiles);
+			}
+
+			first += batchSize;
+		}
+
+		for (size_t i = 0; i < threadCount - 1; i++)
+			task[i].shutdown();
+		delete [] task;
+
+		files.swap(remaining);
+		first = 0;
+	}
+
+	for (size_t i = first; i < files.size(); i++)
+	{
+		extract(files[i].first, files[i].second);
+		if (callback && !fat[files[i].first].isOverlay)
+			callback(files[i].first, numFiles);
 	}
 
 	return true;
 }
 
+void* FS_NITRO::extractJobProc(void *param)
+{
+	FS_NITRO_EXTRACT_JOB *job = (FS_NITRO_EXTRACT_JOB *)param;
+
+	for (size_t i = job->first; i < job->last; i++)
+		job->fs->extract((*job->files)[i].first, (*job->files)[i].second);
+
+	return NULL;
+}
+
@@ -19,6 +19,7 @@
 #define _FS_NITRO_H_
 
 #include <string>
+#include <unordered_map>
 #include "types.h"
 
 enum FNT_TYPES
@@ -123,10 +124,16 @@ private:
 	OVR_NITRO	*ovr9;
 	OVR_NITRO	*ovr7;
 
+	//full path of every file (as made by getFullPathByFileID(), with '/' separators) to its ID.
+	//built by the first lookup by path.
+	std::unordered_map<std::string, u16> pathIndex;
+
 	FNT_TYPES getFNTType(u8 type);
 	bool loadFileTables();
+	void buildPathIndex();
 
 	bool extract(u16 id, std::string to);
+	static void* extractJobProc(void *param);
 	void destroy();
 
 public:
@@ -146,6 +153,14 @@ public:
 	u32 getFileSizeById(u16 id);
 	u32 getStartAddrById(u16 id);
 	u32 getEndAddrById(u16 id);
+
+	bool getFileIdByPath(std::string path, u16 &id);
+
+	//points data at the file's contents in the ROM, without copying them.
+	//only possible when the whole ROM is in memory (mapped or loaded), see GameInfo::romdataView.
+	//the pointer stays valid until the ROM is closed.
+	bool getFileData(u16 id, const u8 *&data, u32 &size);
+	bool getFileDataByPath(const std::string &path, const u8 *&data, u32 &size);
 	bool isOverlay(u16 id) { if (id > numFiles) return false; return fat[id].isOverlay; }
 	
 	bool isARM9(u32 addr) { return ((addr >= ARM9exeStart) && (addr < ARM9exeEnd)); }
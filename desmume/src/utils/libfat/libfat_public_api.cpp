@@ -6,12 +6,15 @@
 #include "common.h"
 #include "disc_io.h"
 #include "fatfile.h"
+#include "file_allocation_table.h"
+#include "../../emufile.h"
 
 
 struct Instance
 {
 	void* buffer;
 	int size_bytes;
+	EMUFILE* file;
 	devoptab_t* devops;
 };
 
@@ -28,6 +31,18 @@ bool MEDIUM_ISINSERTED(void)
 }
 bool MEDIUM_io(bool write, sec_t sector, sec_t numSectors, void* buffer)
 {
+	if(gInstance->file)
+	{
+		//offsets are passed through as unsigned, so that images up to 4GB can be addressed
+		EMUFILE* file = gInstance->file;
+		size_t todo = (size_t)numSectors*512;
+		file->fseek((int)(sector*512),SEEK_SET);
+		if(write)
+			return file->fwrite(buffer,todo) == todo;
+		else
+			return file->fread(buffer,todo) == todo;
+	}
+
 	int todo = (int)numSectors*512;
 	int loc = (int)sector*512;
 	int have = gInstance->size_bytes - loc;
@@ -80,6 +95,7 @@ namespace LIBFAT
 		gInstance = &sInstance;
 		gInstance->buffer = buffer;
 		gInstance->size_bytes = size_bytes;
+		gInstance->file = NULL;
 		fatMountSimple("fat",&discio);
 		gInstance->devops = GetDeviceOpTab(NULL);
 		
@@ -87,6 +103,16 @@ namespace LIBFAT
 		int zzz=9;
 	}
 
+	void Init(EMUFILE* file)
+	{
+		gInstance = &sInstance;
+		gInstance->buffer = NULL;
+		gInstance->size_bytes = 0;
+		gInstance->file = file;
+		fatMountSimple("fat",&discio);
+		gInstance->devops = GetDeviceOpTab(NULL);
+	}
+
 	bool MkDir(const char *path)
 	{
 		_reent r;
@@ -108,6 +134,32 @@ namespace LIBFAT
 		return false;
 	}
 
+	bool AllocateFile(const char *path, u32 len, std::vector<u32>& clusterSectors, u32& sectorsPerCluster)
+	{
+		_reent r;
+		FILE_STRUCT file;
+		intptr_t fd = gInstance->devops->open_r(&r,&file,path,O_CREAT | O_RDWR,0);
+		if(fd == -1)
+			return false;
+
+		//extending the file only writes zeroes into its clusters
+		PARTITION* partition = file.partition;
+		bool ok = gInstance->devops->ftruncate_r(&r, fd, (off_t)len) == 0;
+		if(ok)
+		{
+			sectorsPerCluster = partition->sectorsPerCluster;
+			clusterSectors.clear();
+			for(u32 cluster = file.startCluster; _FAT_fat_isValidCluster(partition,cluster); cluster = _FAT_fat_nextCluster(partition,cluster))
+				clusterSectors.push_back(_FAT_fat_clusterToSector(partition,cluster));
+		}
+		gInstance->devops->close_r(&r, fd);
+
+		//the cache pages still hold those zeroes. drop them, or they would be written over the file
+		//whenever something else in the same page is written.
+		_FAT_cache_invalidate(partition->cache);
+		return ok;
+	}
+
 	void Shutdown()
 	{
 		fatUnmountDirect(gInstance->devops);
@@ -1,12 +1,21 @@
 #ifndef _LIBFAT_PUBLIC_API_H_
 #define _LIBFAT_PUBLIC_API_H_
 
+#include <vector>
+#include "../../types.h"
+
+class EMUFILE;
+
 namespace LIBFAT
 {
 	void Init(void* buffer, int size_bytes);
+	//works on a disk image through an EMUFILE instead of a buffer in memory
+	void Init(EMUFILE* file);
 	void Shutdown();
 	bool MkDir(const char *path);
 	bool WriteFile(const char *path, const void* data, int len);
+	//creates a file of len bytes without writing its contents, and returns the first sector of each of its clusters
+	bool AllocateFile(const char *path, u32 len, std::vector<u32>& clusterSectors, u32& sectorsPerCluster);
 };
 
 #endif //_LIBFAT_PUBLIC_API_H_
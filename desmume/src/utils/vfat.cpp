@@ -23,6 +23,10 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <stack>
+#include <vector>
+#include <map>
+#include <algorithm>
+#include <sys/stat.h>
 
 #include "../types.h"
 #include "../debug.h"
@@ -80,6 +84,474 @@ static void list_files(const char *filepath, ListCallback list_callback)
 	retro_closedir(rdir);
 }
 
+#ifdef _MSC_VER
+#define VFAT_fseek64(fp, offset) _fseeki64(fp, (__int64)(offset), SEEK_SET)
+#else
+#define VFAT_fseek64(fp, offset) fseeko(fp, (off_t)(offset), SEEK_SET)
+#endif
+
+//returns false if the host file or directory doesn't exist
+static bool VFAT_Stat(const std::string &path, s64 &mtime, u64 &size)
+{
+	struct stat st;
+	if(stat(path.c_str(),&st) != 0) return false;
+	mtime = (s64)st.st_mtime;
+	size = (u64)st.st_size;
+	return true;
+}
+
+static bool VFAT_IsZero(const u8 *data, u32 len)
+{
+	u32 i = 0;
+	for(; i + 8 <= len; i += 8)
+	{
+		u64 value;
+		memcpy(&value, data + i, 8);
+		if(value != 0) return false;
+	}
+	for(; i < len; i++)
+		if(data[i] != 0) return false;
+	return true;
+}
+
+//the disk image made by VFAT::buildLazy().
+//only the sectors written by libfat or by the emulated program are kept in memory. sectors holding the contents of host files
+//are read from those files when they are needed, and all other sectors read as zero.
+//offsets are treated as unsigned, so that images up to 4GB can be addressed through the int based EMUFILE interface.
+class EMUFILE_VFAT : public EMUFILE
+{
+public:
+	struct HostFile
+	{
+		std::string path;
+		u32 size;
+		s64 mtime;
+	};
+
+	struct HostDir
+	{
+		std::string path;
+		s64 mtime;
+	};
+
+	EMUFILE_VFAT(u32 size)
+		: _size(size)
+		, _pos(0)
+		, _hostFile(NULL)
+		, _hostFileIndex(0xFFFFFFFF)
+		, _cachedSector(0xFFFFFFFF)
+	{}
+
+	~EMUFILE_VFAT()
+	{
+		if(_hostFile) fclose(_hostFile);
+	}
+
+	void addDir(const HostDir &hostDir) { _dirs.push_back(hostDir); }
+	void addFile(const HostFile &hostFile, const std::vector<u32> &clusterSectors, u32 sectorsPerCluster);
+
+	//true if none of the host directories and files changed since the image was built
+	bool isUpToDate() const;
+	void save(EMUFILE &os) const;
+	bool load(EMUFILE &is);
+
+	virtual EMUFILE* memwrap() { return this; }
+	virtual FILE *get_fp() { return NULL; }
+
+	virtual int fprintf(const char *format, ...) { return 0; }
+	virtual int fgetc() { u8 temp; return (_fread(&temp,1) == 1) ? temp : EOF; }
+	virtual int fputc(int c) { u8 temp = (u8)c; fwrite(&temp,1); return 0; }
+	virtual char* fgets(char* str, int num) { return NULL; }
+
+	virtual size_t _fread(const void *ptr, size_t bytes);
+	virtual size_t fwrite(const void *ptr, size_t bytes);
+
+	virtual int fseek(int offset, int origin);
+	virtual int ftell() { return (int)_pos; }
+	virtual int size() { return (int)_size; }
+	virtual void fflush() {}
+	virtual void truncate(s32 length);
+
+private:
+	struct Sector
+	{
+		u8 data[512];
+	};
+
+	//a run of image sectors that holds a run of sectors of one host file
+	struct Extent
+	{
+		u32 sector;
+		u32 count;
+		u32 file;
+		u32 fileSector;
+	};
+
+	struct ExtentSectorLess
+	{
+		bool operator()(u32 sector, const Extent &extent) const { return sector < extent.sector; }
+	};
+
+	u32 _size, _pos;
+	std::vector<HostDir> _dirs;
+	std::vector<HostFile> _files;
+	std::vector<Extent> _extents; //sorted by sector
+	std::map<u32,Sector> _sectors;
+
+	FILE *_hostFile;
+	u32 _hostFileIndex;
+	Sector _cache;
+	u32 _cachedSector;
+
+	void addExtent(u32 sector, u32 count, u32 file, u32 fileSector);
+	const Extent* findExtent(u32 sector) const;
+	void readSector(u32 sector, u8 *dst);
+};
+
+void EMUFILE_VFAT::addFile(const HostFile &hostFile, const std::vector<u32> &clusterSectors, u32 sectorsPerCluster)
+{
+	const u32 file = (u32)_files.size();
+	_files.push_back(hostFile);
+
+	u32 remain = (u32)(((u64)hostFile.size + 511) / 512);
+	u32 fileSector = 0;
+	for(size_t i = 0; (i < clusterSectors.size()) && (remain > 0); i++)
+	{
+		const u32 count = std::min(remain, sectorsPerCluster);
+		addExtent(clusterSectors[i], count, file, fileSector);
+		fileSector += count;
+		remain -= count;
+	}
+}
+
+void EMUFILE_VFAT::addExtent(u32 sector, u32 count, u32 file, u32 fileSector)
+{
+	std::vector<Extent>::iterator it = std::upper_bound(_extents.begin(), _extents.end(), sector, ExtentSectorLess());
+	if(it != _extents.begin())
+	{
+		//clusters are usually handed out in order, so most files end up as a single extent
+		Extent &prev = *(it-1);
+		if(prev.file == file && prev.sector + prev.count == sector && prev.fileSector + prev.count == fileSector)
+		{
+			prev.count += count;
+			return;
+		}
+	}
+
+	Extent extent = { sector, count, file, fileSector };
+	_extents.insert(it, extent);
+}
+
+const EMUFILE_VFAT::Extent* EMUFILE_VFAT::findExtent(u32 sector) const
+{
+	std::vector<Extent>::const_iterator it = std::upper_bound(_extents.begin(), _extents.end(), sector, ExtentSectorLess());
+	if(it == _extents.begin()) return NULL;
+	--it;
+	return (sector - it->sector < it->count) ? &*it : NULL;
+}
+
+void EMUFILE_VFAT::readSector(u32 sector, u8 *dst)
+{
+	std::map<u32,Sector>::const_iterator written = _sectors.find(sector);
+	if(written != _sectors.end())
+	{
+		memcpy(dst, written->second.data, 512);
+		return;
+	}
+
+	memset(dst, 0, 512);
+
+	const Extent *extent = findExtent(sector);
+	if(!extent) return;
+
+	if(extent->file != _hostFileIndex)
+	{
+		if(_hostFile) fclose(_hostFile);
+		_hostFile = fopen(_files[extent->file].path.c_str(),"rb");
+		_hostFileIndex = extent->file;
+		if(!_hostFile)
+			printf("ERROR opening file for fat: %s\n",_files[extent->file].path.c_str());
+	}
+	if(!_hostFile) return;
+
+	//the end of the last sector past the end of the file stays zero
+	const u64 offset = (u64)(extent->fileSector + (sector - extent->sector)) * 512;
+	if(VFAT_fseek64(_hostFile, offset) == 0)
+		::fread(dst, 1, 512, _hostFile);
+}
+
+size_t EMUFILE_VFAT::_fread(const void *ptr, size_t bytes)
+{
+	u8 *dst = (u8*)ptr;
+	size_t done = 0;
+	while(done < bytes)
+	{
+		if(_pos >= _size)
+		{
+			_failbit = true;
+			break;
+		}
+
+		const u32 sector = _pos >> 9;
+		const u32 offset = _pos & 511;
+		const u32 todo = (u32)std::min<u64>(std::min<u64>(512 - offset, bytes - done), _size - _pos);
+
+		//the r4 and mpcf read a sector a few bytes at a time
+		if(sector != _cachedSector)
+		{
+			readSector(sector, _cache.data);
+			_cachedSector = sector;
+		}
+		memcpy(dst + done, _cache.data + offset, todo);
+
+		done += todo;
+		_pos += todo;
+	}
+	return done;
+}
+
+size_t EMUFILE_VFAT::fwrite(const void *ptr, size_t bytes)
+{
+	const u8 *src = (const u8*)ptr;
+	size_t done = 0;
+	while(done < bytes)
+	{
+		if(_pos >= _size)
+		{
+			_failbit = true;
+			break;
+		}
+
+		const u32 sector = _pos >> 9;
+		const u32 offset = _pos & 511;
+		const u32 todo = (u32)std::min<u64>(std::min<u64>(512 - offset, bytes - done), _size - _pos);
+
+		std::map<u32,Sector>::iterator written = _sectors.find(sector);
+		if(written == _sectors.end())
+		{
+			//writing zeroes into a sector that already reads as zero doesn't need to be kept.
+			//this is also how libfat allocating the clusters of a lazily added file stays free.
+			if(findExtent(sector) != NULL || !VFAT_IsZero(src + done, todo))
+			{
+				Sector contents;
+				readSector(sector, contents.data);
+				written = _sectors.insert(std::make_pair(sector, contents)).first;
+			}
+		}
+
+		if(written != _sectors.end())
+		{
+			memcpy(written->second.data + offset, src + done, todo);
+			if(sector == _cachedSector)
+				memcpy(_cache.data + offset, src + done, todo);
+		}
+
+		done += todo;
+		_pos += todo;
+	}
+	return done;
+}
+
+int EMUFILE_VFAT::fseek(int offset, int origin)
+{
+	switch(origin)
+	{
+		case SEEK_SET: _pos = (u32)offset; break;
+		case SEEK_CUR: _pos += (u32)offset; break;
+		case SEEK_END: _pos = _size + (u32)offset; break;
+		default: return -1;
+	}
+	return 0;
+}
+
+void EMUFILE_VFAT::truncate(s32 length)
+{
+	_size = (u32)length;
+	_sectors.erase(_sectors.lower_bound((_size + 511) >> 9), _sectors.end());
+	_cachedSector = 0xFFFFFFFF;
+	if(_pos > _size) _pos = _size;
+}
+
+bool EMUFILE_VFAT::isUpToDate() const
+{
+	s64 mtime;
+	u64 size;
+
+	//adding, removing or renaming anything in a directory changes its mtime, so the listing doesn't need to be redone
+	for(size_t i = 0; i < _dirs.size(); i++)
+	{
+		if(!VFAT_Stat(_dirs[i].path, mtime, size) || mtime != _dirs[i].mtime)
+			return false;
+	}
+
+	for(size_t i = 0; i < _files.size(); i++)
+	{
+		if(!VFAT_Stat(_files[i].path, mtime, size) || mtime != _files[i].mtime || size != _files[i].size)
+			return false;
+	}
+
+	return true;
+}
+
+static void VFAT_WriteString(EMUFILE &os, const std::string &str)
+{
+	os.write_32LE((u32)str.size());
+	os.fwrite(str.c_str(), str.size());
+}
+
+static bool VFAT_ReadString(EMUFILE &is, std::string &str)
+{
+	u32 len = is.read_u32LE();
+	if(is.fail() || len > (u32)is.size()) return false;
+	str.resize(len);
+	if(len > 0) is.fread(&str[0], len);
+	return !is.fail();
+}
+
+void EMUFILE_VFAT::save(EMUFILE &os) const
+{
+	os.write_32LE(_size);
+
+	os.write_32LE((u32)_dirs.size());
+	for(size_t i = 0; i < _dirs.size(); i++)
+	{
+		VFAT_WriteString(os, _dirs[i].path);
+		os.write_64LE(_dirs[i].mtime);
+	}
+
+	os.write_32LE((u32)_files.size());
+	for(size_t i = 0; i < _files.size(); i++)
+	{
+		VFAT_WriteString(os, _files[i].path);
+		os.write_32LE(_files[i].size);
+		os.write_64LE(_files[i].mtime);
+	}
+
+	os.write_32LE((u32)_extents.size());
+	for(size_t i = 0; i < _extents.size(); i++)
+	{
+		os.write_32LE(_extents[i].sector);
+		os.write_32LE(_extents[i].count);
+		os.write_32LE(_extents[i].file);
+		os.write_32LE(_extents[i].fileSector);
+	}
+
+	os.write_32LE((u32)_sectors.size());
+	for(std::map<u32,Sector>::const_iterator it = _sectors.begin(); it != _sectors.end(); ++it)
+	{
+		os.write_32LE(it->first);
+		os.fwrite(it->second.data, 512);
+	}
+}
+
+bool EMUFILE_VFAT::load(EMUFILE &is)
+{
+	//every count is checked against the file size, so that a damaged cache can't make us allocate huge amounts of memory
+	const u32 fileSize = (u32)is.size();
+	u32 count;
+
+	_size = is.read_u32LE();
+
+	count = is.read_u32LE();
+	if(is.fail() || count > fileSize) return false;
+	_dirs.resize(count);
+	for(u32 i = 0; i < count; i++)
+	{
+		if(!VFAT_ReadString(is, _dirs[i].path)) return false;
+		_dirs[i].mtime = is.read_s64LE();
+	}
+
+	count = is.read_u32LE();
+	if(is.fail() || count > fileSize) return false;
+	_files.resize(count);
+	for(u32 i = 0; i < count; i++)
+	{
+		if(!VFAT_ReadString(is, _files[i].path)) return false;
+		_files[i].size = is.read_u32LE();
+		_files[i].mtime = is.read_s64LE();
+	}
+
+	count = is.read_u32LE();
+	if(is.fail() || count > fileSize) return false;
+	_extents.resize(count);
+	for(u32 i = 0; i < count; i++)
+	{
+		_extents[i].sector = is.read_u32LE();
+		_extents[i].count = is.read_u32LE();
+		_extents[i].file = is.read_u32LE();
+		_extents[i].fileSector = is.read_u32LE();
+		if(_extents[i].file >= _files.size()) return false;
+	}
+
+	count = is.read_u32LE();
+	if(is.fail() || count > fileSize) return false;
+	for(u32 i = 0; i < count; i++)
+	{
+		const u32 sector = is.read_u32LE();
+		is.fread(_sectors[sector].data, 512);
+	}
+
+	return !is.fail();
+}
+
+static const char VFAT_CACHE_MAGIC[] = "DeSmuME VFAT cache";
+static const u32 VFAT_CACHE_VERSION = 1;
+
+static std::string VFAT_CacheFileName(const char* cacheDir, const char* path)
+{
+	//FNV-1a of the host path, so that every directory gets its own cache
+	u32 hash = 0x811C9DC5;
+	for(const char* c = path; *c; c++)
+		hash = (hash ^ (u8)*c) * 0x01000193;
+
+	char name[32];
+	sprintf(name, "vfat_%08X.cache", hash);
+
+	std::string fileName = cacheDir;
+	if(!fileName.empty() && fileName[fileName.size()-1] != '/' && fileName[fileName.size()-1] != '\\')
+		fileName += path_default_slash();
+	return fileName + name;
+}
+
+static EMUFILE_VFAT* VFAT_LoadCache(const std::string &cacheFileName, const char* path, int extra_MB)
+{
+	EMUFILE_FILE is(cacheFileName, "rb");
+	if(is.fail()) return NULL;
+
+	char magic[sizeof(VFAT_CACHE_MAGIC)];
+	std::string cachedPath;
+	is.fread(magic, sizeof(magic));
+	const u32 version = is.read_u32LE();
+	const bool ok = VFAT_ReadString(is, cachedPath);
+	const s32 cachedExtra_MB = is.read_s32LE();
+	if(!ok || is.fail() || memcmp(magic, VFAT_CACHE_MAGIC, sizeof(magic)) || version != VFAT_CACHE_VERSION || cachedPath != path || cachedExtra_MB != extra_MB)
+		return NULL;
+
+	EMUFILE_VFAT* image = new EMUFILE_VFAT(0);
+	if(!image->load(is) || !image->isUpToDate())
+	{
+		delete image;
+		return NULL;
+	}
+	return image;
+}
+
+static void VFAT_SaveCache(const std::string &cacheFileName, const char* path, int extra_MB, const EMUFILE_VFAT &image)
+{
+	EMUFILE_FILE os(cacheFileName, "wb");
+	if(os.fail())
+	{
+		printf("VFAT: Could not write the cache file %s\n", cacheFileName.c_str());
+		return;
+	}
+
+	os.fwrite(VFAT_CACHE_MAGIC, sizeof(VFAT_CACHE_MAGIC));
+	os.write_32LE(VFAT_CACHE_VERSION);
+	VFAT_WriteString(os, path);
+	os.write_32LE((s32)extra_MB);
+	image.save(os);
+}
+
 enum eCallbackType
 {
 	eCallbackType_Count, eCallbackType_Build
@@ -97,6 +569,9 @@ static std::stack<std::string> pathStack;
 static std::stack<std::string> virtPathStack;
 static std::string currVirtPath;
 
+//for eCallbackType_Build with VFAT::buildLazy():
+static EMUFILE_VFAT* lazyImage = NULL;
+
 static void DirectoryListCallback(RDIR* rdir, EListCallbackArg arg)
 {
 	const char* fname = retro_dirent_get_name(rdir);
@@ -120,26 +595,57 @@ static void DirectoryListCallback(RDIR* rdir, EListCallbackArg arg)
 
 		currVirtPath = currVirtPath + "/" + fname;
 
+		currPath = currPath + path_default_slash() + fname;
+
 		if(callbackType == eCallbackType_Build)
 		{
 			bool ok = LIBFAT::MkDir(currVirtPath.c_str());
 
 			if(!ok)
 				printf("ERROR adding dir %s via libfat\n",currVirtPath.c_str());
+
+			if(lazyImage)
+			{
+				EMUFILE_VFAT::HostDir hostDir;
+				u64 size;
+				hostDir.path = currPath;
+				if(!VFAT_Stat(hostDir.path, hostDir.mtime, size))
+					hostDir.mtime = -1;
+				lazyImage->addDir(hostDir);
+			}
 		}
 		else
 		{
 			dataSectors++; //directories take one sector
 		}
 
-		currPath = currPath + path_default_slash() + fname;
 		return;
 	}
 	else
 	{
 		std::string path = currPath + path_default_slash() + fname;
 
-		if(callbackType == eCallbackType_Build)
+		if(callbackType == eCallbackType_Build && lazyImage)
+		{
+			//only allocate the clusters; the contents are read from the host file when they are needed
+			EMUFILE_VFAT::HostFile hostFile;
+			u64 size = 0;
+			hostFile.path = path;
+			if(VFAT_Stat(path, hostFile.mtime, size) && size <= 0xFFFFFFFF)
+			{
+				std::vector<u32> clusterSectors;
+				u32 sectorsPerCluster = 0;
+				hostFile.size = (u32)size;
+
+				std::string virtPath = currVirtPath + "/" + fname;
+				printf("FAT ~ (%10.2f KB) %s \n",size/1024.f,virtPath.c_str());
+				if(LIBFAT::AllocateFile(virtPath.c_str(),hostFile.size,clusterSectors,sectorsPerCluster))
+					lazyImage->addFile(hostFile,clusterSectors,sectorsPerCluster);
+				else
+					printf("ERROR adding file to fat\n");
+			} else printf("ERROR opening file for fat\n");
+		}
+		else if(callbackType == eCallbackType_Build)
 		{
 			FILE* inf = fopen(path.c_str(),"rb");
 			if(inf)
@@ -170,7 +676,8 @@ static void DirectoryListCallback(RDIR* rdir, EListCallbackArg arg)
 		
 }
 
-bool VFAT::build(const char* path, int extra_MB)
+//returns the number of sectors needed for an image holding the contents of path, or 0 on failure
+static u64 VFAT_CountSectors(const char* path, int extra_MB)
 {
 	dataSectors = 0;
 	currVirtPath = "";
@@ -183,7 +690,7 @@ bool VFAT::build(const char* path, int extra_MB)
 	if(count_failed)
 	{
 		printf("FAILED enumerating files for fat\n");
-		return false;
+		return 0;
 	}
 
 	dataSectors += 8; //a few for reserved sectors, etc.
@@ -197,6 +704,15 @@ bool VFAT::build(const char* path, int extra_MB)
 	if(dataSectors<36*1024*1024/512)
 		dataSectors = 36*1024*1024/512;
 
+	return dataSectors;
+}
+
+bool VFAT::build(const char* path, int extra_MB)
+{
+	dataSectors = VFAT_CountSectors(path, extra_MB);
+	if(dataSectors == 0)
+		return false;
+
 	if(dataSectors>=(0x80000000>>9))
 	{
 		printf("error allocating memory for fat (%llu KBytes)\n",(dataSectors*512)/1024);
@@ -240,6 +756,69 @@ bool VFAT::build(const char* path, int extra_MB)
 	return true;
 }
 
+bool VFAT::buildLazy(const char* path, int extra_MB, const char* cacheDir)
+{
+	std::string cacheFileName;
+	if(cacheDir != NULL && cacheDir[0] != 0)
+	{
+		cacheFileName = VFAT_CacheFileName(cacheDir, path);
+		EMUFILE_VFAT* cached = VFAT_LoadCache(cacheFileName, path, extra_MB);
+		if(cached)
+		{
+			printf("VFAT: using the cached FAT image structure for %s\n", path);
+			delete file;
+			file = cached;
+			return true;
+		}
+	}
+
+	dataSectors = VFAT_CountSectors(path, extra_MB);
+	if(dataSectors == 0)
+		return false;
+
+	//the image isn't held in memory, so it is only limited by the 32 bit offsets used for addressing it
+	if(dataSectors>=(0x100000000ULL>>9))
+	{
+		printf("error building fat (%llu KBytes)\n",(dataSectors*512)/1024);
+		printf("total fat sizes >= 4GB are never going to work\n");
+		return false;
+	}
+
+	EMUFILE_VFAT* image = new EMUFILE_VFAT((u32)(dataSectors*512));
+
+	//format the disk
+	{
+		EmuFat fat(image);
+		EmuFatVolume vol;
+		vol.init(&fat);
+		vol.formatNew((u32)dataSectors);
+	}
+
+	EMUFILE_VFAT::HostDir root;
+	u64 size;
+	root.path = path;
+	if(!VFAT_Stat(root.path, root.mtime, size))
+		root.mtime = -1;
+	image->addDir(root);
+
+	//setup libfat and add the directories and files through it
+	LIBFAT::Init(image);
+	lazyImage = image;
+	currVirtPath = "";
+	currPath = path;
+	callbackType = eCallbackType_Build;
+	list_files(path, DirectoryListCallback);
+	lazyImage = NULL;
+	LIBFAT::Shutdown();
+
+	if(!cacheFileName.empty())
+		VFAT_SaveCache(cacheFileName, path, extra_MB, *image);
+
+	delete file;
+	file = image;
+	return true;
+}
+
 VFAT::VFAT()
 	: file(NULL)
 {
@@ -17,6 +17,8 @@
 
 #ifndef _VFAT_H
 
+#include <stddef.h>
+
 class EMUFILE;
 
 //THIS CLASS IS NOT THREAD SAFE!! SORRY SO SLOPPY
@@ -27,6 +29,10 @@ public:
 	~VFAT();
 	bool build(const char* path, int extra_MB=0);
 
+	//builds the directory structure only. file contents are read from the host files when the emulated program reads them.
+	//if cacheDir is given, the structure is kept there and reused for as long as the host directories and files are unchanged.
+	bool buildLazy(const char* path, int extra_MB=0, const char* cacheDir=NULL);
+
 	EMUFILE* detach();
 
 private: